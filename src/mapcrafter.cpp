@@ -75,7 +75,10 @@ int main(int argc, char **argv) {
         "render-force,f", po::value<std::vector<std::string>>(&opts.render_force)->multitoken(),
         "renders the specified map(s) completely")("render-force-all,F", "force renders all maps")(
         "jobs,j", po::value<int>(&opts.jobs)->default_value(1),
-        "the count of jobs to use when rendering the map");
+        "the count of jobs to use when rendering the map")(
+        "watch,w", "keeps running and renders the changes whenever region files are written")(
+        "watch-delay", po::value<int>(&opts.watch_delay)->default_value(10),
+        "seconds without writes to the region files to wait before rendering the changes");
 
     po::options_description all("Allowed options");
     all.add(general).add(logging).add(renderer);
@@ -173,6 +176,7 @@ int main(int argc, char **argv) {
     opts.skip_all = vm.count("render-reset");
     opts.force_all = vm.count("render-force-all");
     opts.batch = vm.count("batch");
+    opts.watch = vm.count("watch");
     if (!vm.count("logging-config"))
         opts.logging_config = util::findLoggingConfigFile();
 
@@ -209,7 +213,10 @@ int main(int argc, char **argv) {
 
     renderer::RenderManager manager(config);
     manager.setRenderBehaviors(renderer::RenderBehaviors::fromRenderOpts(config, opts));
-    if (!manager.run(opts.jobs, opts.batch))
+    if (opts.watch) {
+        if (!manager.watch(opts.jobs, opts.batch, opts.watch_delay))
+            return 1;
+    } else if (!manager.run(opts.jobs, opts.batch))
         return 1;
     return 0;
 }
@@ -19,142 +19,26 @@
 
 #include "accumulator.h"
 #include "mapcraftercore/config/mapcrafterconfig.h"
-#include "mapcraftercore/mc/world.h"
-#include "mapcraftercore/mc/worldentities.h"
+#include "mapcraftercore/renderer/markers.h"
 #include "mapcraftercore/util.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <fstream>
-#include <map>
-#include <sstream>
 #include <string>
-#include <vector>
 
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
 namespace util = mapcrafter::util;
 namespace config = mapcrafter::config;
-namespace mc = mapcrafter::mc;
-
-struct Marker {
-    mc::BlockPos pos;
-    std::string title, text;
-
-    std::string toJSON() const {
-        std::string json = "{";
-        json += "\"pos\": [" + util::str(pos.x) + "," + util::str(pos.z) + "," + util::str(pos.y) +
-                "], ";
-        json += "\"title\": \"" + util::escapeJSON(title) + "\", ";
-        json += "\"text\": \"" + util::escapeJSON(text) + "\", ";
-        return json + "}";
-    }
-};
-
-typedef std::map<std::string, std::vector<Marker>> MarkerGroup;
-// map (marker group name -> map ( world name -> array of markers) )
-typedef std::map<std::string, MarkerGroup> Markers;
-
-Markers findMarkers(const config::MapcrafterConfig &config) {
-    Markers markers;
-    auto groups = config.getMarkers();
-    for (auto group_it = groups.begin(); group_it != groups.end(); ++group_it)
-        markers[group_it->getShortName()];
-
-    auto config_worlds = config.getWorlds();
-    auto config_markers = config.getMarkers();
-    for (auto world_it = config_worlds.begin(); world_it != config_worlds.end(); ++world_it) {
-        mc::WorldCrop world_crop = world_it->second.getWorldCrop();
-        mc::World world(world_it->second.getInputDir().string(), world_it->second.getDimension());
-        world.setWorldCrop(world_crop);
-        if (!world.load()) {
-            LOG(ERROR) << "Unable to load world " << world_it->first << "!";
-            continue;
-        }
-
-        LOGN(INFO, "progress") << "Loading entities of world '" << world_it->first << "' ...";
-        mc::WorldEntitiesCache entities(world);
-        util::LogOutputProgressHandler progress;
-        entities.update(&progress);
-
-        // use name of the world section as world name, not the world_name
-        std::string world_name = world_it->second.getShortName();
-        std::vector<mc::SignEntity> signs = entities.getSigns(world.getWorldCrop());
-        for (auto sign_it = signs.begin(); sign_it != signs.end(); ++sign_it) {
-            // don't use signs not contained in the world boundaries
-            if (!world_crop.isBlockContainedXZ(sign_it->getPos()) &&
-                !world_crop.isBlockContainedY(sign_it->getPos()))
-                continue;
-            for (auto marker_it = config_markers.begin(); marker_it != config_markers.end();
-                 ++marker_it) {
-                if (!marker_it->matchesSign(*sign_it))
-                    continue;
-                Marker marker;
-                marker.pos = sign_it->getPos();
-                marker.title = marker_it->formatTitle(*sign_it);
-                marker.text = marker_it->formatText(*sign_it);
-                markers[marker_it->getShortName()][world_name].push_back(marker);
-                LOG(DEBUG) << "Found marker (prefix '" << marker_it->getPrefix() << "'): '"
-                           << marker.title << "' at '" << world_it->first << "':" << marker.pos;
-                break;
-            }
-        }
-    }
-    return markers;
-}
-
-std::string createMarkersJSON(const config::MapcrafterConfig &config,
-                              const Markers &markers_found) {
-    auto markers = config.getMarkers();
-    std::stringstream ss;
-
-    ss << "// This file is automatically generated. Do not edit this file." << std::endl;
-    ss << "// Use the markers.js for your own markers instead." << std::endl << std::endl;
-    ss << "MAPCRAFTER_MARKERS_GENERATED = [" << std::endl;
-    for (auto marker_config_it = markers.begin(); marker_config_it != markers.end();
-         ++marker_config_it) {
-        config::MarkerSection marker_config = *marker_config_it;
-        std::string group = marker_config.getShortName();
-        ss << "  {" << std::endl;
-        ss << "    \"id\" : \"" << group << "\"," << std::endl;
-        ss << "    \"name\" : \"" << marker_config.getLongName() << "\"," << std::endl;
-        if (!marker_config.getIcon().empty()) {
-            ss << "    \"icon\" : \"" << marker_config.getIcon() << "\"," << std::endl;
-            if (!marker_config.getIconSize().empty())
-                ss << "    \"iconSize\" : " << marker_config.getIconSize() << "," << std::endl;
-        }
-        ss << "    \"showDefault\" : ";
-        ss << (marker_config.isShownByDefault() ? "true" : "false") << "," << std::endl;
-        ss << "    \"markers\" : {" << std::endl;
-
-        if (!markers_found.count(group)) {
-            ss << "    }," << std::endl;
-            ss << "  }," << std::endl;
-            continue;
-        }
-
-        for (auto world_it = markers_found.at(group).begin();
-             world_it != markers_found.at(group).end(); ++world_it) {
-            ss << "      \"" << world_it->first << "\" : [" << std::endl;
-            for (auto marker_it = world_it->second.begin(); marker_it != world_it->second.end();
-                 ++marker_it) {
-                ss << "        " << marker_it->toJSON() << "," << std::endl;
-            }
-            ss << "      ]," << std::endl;
-        }
-        ss << "    }," << std::endl;
-        ss << "  }," << std::endl;
-    }
-    ss << "];" << std::endl;
-
-    return ss.str();
-}
+namespace renderer = mapcrafter::renderer;
 
 int main(int argc, char **argv) {
     std::string config_file;
     std::string output_file;
     int verbosity = 0;
+    int jobs = 1;
 
     po::options_description all("Allowed options");
     all.add_options()("help,h", "shows this help message")(
@@ -164,7 +48,9 @@ int main(int argc, char **argv) {
          "the path to the configuration file (required)")(
             "output-file,o", po::value<std::string>(&output_file),
             "file to write the generated markers to, "
-            "defaults to markers-generated.js in the output directory.");
+            "defaults to markers-generated.js in the output directory.")(
+            "jobs,j", po::value<int>(&jobs)->default_value(1),
+            "the count of threads to use when reading the signs of the worlds");
 
     po::variables_map vm;
     try {
@@ -210,40 +96,17 @@ int main(int argc, char **argv) {
         LOG(WARNING) << "Please read the documentation about the new configuration file format.";
     }
 
-    Markers markers = findMarkers(config);
+    renderer::Markers markers = renderer::findMarkers(config, jobs);
 
-    // count how many markers / markers of which group were found
-    int markers_count = 0;
-    std::map<std::string, int> groups_count;
-
-    auto worlds = config.getWorlds();
-    auto groups = config.getMarkers();
-    for (auto group_it = groups.begin(); group_it != groups.end(); ++group_it) {
-        std::string group = group_it->getShortName();
-        groups_count[group] = 0;
-        for (auto world_it = worlds.begin(); world_it != worlds.end(); ++world_it)
-            groups_count[group] += markers[group][world_it->first].size();
-        markers_count += groups_count[group];
-    }
-
-    // and log some stats about that
-    LOG(INFO) << "Found " << markers_count << " markers in " << markers.size() << " categories:";
-    for (auto group_it = groups.begin(); group_it != groups.end(); ++group_it) {
-        std::string group = group_it->getShortName();
-        LOG(INFO) << "  Markers with prefix '" << config.getMarker(group).getPrefix()
-                  << "': " << groups_count[group];
-        for (auto world_it = worlds.begin(); world_it != worlds.end(); ++world_it)
-            LOG(INFO) << "    in world '" << world_it->first
-                      << "': " << markers[group][world_it->first].size();
-    }
+    renderer::logMarkerStats(config, markers);
 
     if (output_file == "-")
-        std::cout << createMarkersJSON(config, markers);
+        std::cout << renderer::createMarkersJSON(config, markers);
     else {
         if (output_file == "")
             output_file = config.getOutputPath("markers-generated.js").string();
         std::ofstream out(output_file);
-        out << createMarkersJSON(config, markers);
+        out << renderer::createMarkersJSON(config, markers);
         out.close();
         if (!out) {
             LOG(ERROR) << "Unable to write to file '" << output_file << "'!";
@@ -147,6 +147,7 @@ void MapSection::dump(std::ostream &out) const {
     out << "  lighting_water_intensity = " << lighting_water_intensity << std::endl;
     out << "  render_biomes = " << render_biomes << std::endl;
     out << "  use_image_timestamps = " << use_image_mtimes << std::endl;
+    out << "  use_chunk_hashes = " << use_chunk_hashes << std::endl;
 }
 
 void MapSection::setConfigDir(const fs::path &config_dir) { this->config_dir = config_dir; }
@@ -191,6 +192,8 @@ bool MapSection::renderBiomes() const { return render_biomes.getValue(); }
 
 bool MapSection::useImageModificationTimes() const { return use_image_mtimes.getValue(); }
 
+bool MapSection::useChunkHashes() const { return use_chunk_hashes.getValue(); }
+
 TileSetGroupID MapSection::getTileSetGroup() const {
     return TileSetGroupID(getWorld(), getRenderView(), getTileWidth());
 }
@@ -227,6 +230,7 @@ void MapSection::preParse(const INIConfigSection &section, ValidationList &valid
     lighting_water_intensity.setDefault(0.85);
     render_biomes.setDefault(true);
     use_image_mtimes.setDefault(true);
+    use_chunk_hashes.setDefault(false);
 }
 
 bool MapSection::parseField(const std::string key, const std::string value,
@@ -285,6 +289,8 @@ bool MapSection::parseField(const std::string key, const std::string value,
         render_biomes.load(key, value, validation);
     } else if (key == "use_image_mtimes") {
         use_image_mtimes.load(key, value, validation);
+    } else if (key == "use_chunk_hashes") {
+        use_chunk_hashes.load(key, value, validation);
     } else
         return false;
     return true;
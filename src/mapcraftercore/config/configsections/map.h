@@ -113,6 +113,7 @@ class MapSection : public ConfigSection {
     double getLightingWaterIntensity() const;
     bool renderBiomes() const;
     bool useImageModificationTimes() const;
+    bool useChunkHashes() const;
 
     TileSetGroupID getTileSetGroup() const;
     TileSetID getTileSet(int rotation) const;
@@ -146,7 +147,7 @@ class MapSection : public ConfigSection {
 
     Field<double> lighting_intensity, lighting_water_intensity;
     Field<bool> cave_high_contrast;
-    Field<bool> render_biomes, use_image_mtimes;
+    Field<bool> render_biomes, use_image_mtimes, use_chunk_hashes;
 
     std::set<TileSetID> tile_sets;
 };
@@ -68,6 +68,9 @@ void MapcrafterConfigRootSection::dump(std::ostream &out) const {
     out << "  output_dir = " << output_dir << std::endl;
     out << "  template_dir = " << template_dir << std::endl;
     out << "  color = " << background_color << std::endl;
+    out << "  chunk_cache_size = " << chunk_cache_size << std::endl;
+    out << "  chunk_cache_dir = " << chunk_cache_dir << std::endl;
+    out << "  generate_markers = " << generate_markers << std::endl;
 }
 
 void MapcrafterConfigRootSection::setConfigDir(const fs::path &config_dir) {
@@ -82,12 +85,23 @@ Color MapcrafterConfigRootSection::getBackgroundColor() const {
     return background_color.getValue();
 }
 
+int MapcrafterConfigRootSection::getChunkCacheSize() const { return chunk_cache_size.getValue(); }
+
+fs::path MapcrafterConfigRootSection::getChunkCacheDir() const {
+    return chunk_cache_dir.getValue();
+}
+
+bool MapcrafterConfigRootSection::generateMarkers() const { return generate_markers.getValue(); }
+
 void MapcrafterConfigRootSection::preParse(const INIConfigSection &section,
                                            ValidationList &validation) {
     fs::path default_template_dir = util::findTemplateDir();
     if (!default_template_dir.empty())
         template_dir.setDefault(default_template_dir);
     background_color.setDefault({"#DDDDDD", 0xDD, 0xDD, 0xDD});
+    chunk_cache_size.setDefault(0);
+    chunk_cache_dir.setDefault("");
+    generate_markers.setDefault(false);
 }
 
 bool MapcrafterConfigRootSection::parseField(const std::string key, const std::string value,
@@ -104,6 +118,14 @@ bool MapcrafterConfigRootSection::parseField(const std::string key, const std::s
         }
     } else if (key == "background_color") {
         background_color.load(key, value, validation);
+    } else if (key == "chunk_cache_size") {
+        if (chunk_cache_size.load(key, value, validation) && chunk_cache_size.getValue() < 0)
+            validation.error("'chunk_cache_size' must not be negative!");
+    } else if (key == "chunk_cache_dir") {
+        if (chunk_cache_dir.load(key, value, validation))
+            chunk_cache_dir.setValue(BOOST_FS_ABSOLUTE(chunk_cache_dir.getValue(), config_dir));
+    } else if (key == "generate_markers") {
+        generate_markers.load(key, value, validation);
     } else
         return false;
     return true;
@@ -186,6 +208,12 @@ fs::path MapcrafterConfig::getTemplatePath(const std::string &path) const {
 
 Color MapcrafterConfig::getBackgroundColor() const { return root_section.getBackgroundColor(); }
 
+int MapcrafterConfig::getChunkCacheSize() const { return root_section.getChunkCacheSize(); }
+
+fs::path MapcrafterConfig::getChunkCacheDir() const { return root_section.getChunkCacheDir(); }
+
+bool MapcrafterConfig::generateMarkers() const { return root_section.generateMarkers(); }
+
 bool MapcrafterConfig::hasWorld(const std::string &world) const { return worlds.count(world); }
 
 const std::map<std::string, WorldSection> &MapcrafterConfig::getWorlds() const { return worlds; }
@@ -60,6 +60,9 @@ class MapcrafterConfigRootSection : public ConfigSection {
     fs::path getOutputDir() const;
     fs::path getTemplateDir() const;
     Color getBackgroundColor() const;
+    int getChunkCacheSize() const;
+    fs::path getChunkCacheDir() const;
+    bool generateMarkers() const;
 
   protected:
     virtual void preParse(const INIConfigSection &section, ValidationList &validation);
@@ -72,6 +75,9 @@ class MapcrafterConfigRootSection : public ConfigSection {
 
     Field<fs::path> output_dir, template_dir;
     Field<Color> background_color;
+    Field<int> chunk_cache_size;
+    Field<fs::path> chunk_cache_dir;
+    Field<bool> generate_markers;
 };
 
 class MapcrafterConfig {
@@ -91,6 +97,9 @@ class MapcrafterConfig {
     fs::path getTemplatePath(const std::string &path) const;
 
     Color getBackgroundColor() const;
+    int getChunkCacheSize() const;
+    fs::path getChunkCacheDir() const;
+    bool generateMarkers() const;
 
     bool hasWorld(const std::string &world) const;
     const std::map<std::string, WorldSection> &getWorlds() const;
@@ -22,13 +22,14 @@
 #include "../util.h"
 
 #include <cassert>
+#include <cstring>
 
 namespace mapcrafter {
 namespace mc {
 
 BlockState::BlockState(std::string name) : name(name) { updateVariantDescription(); }
 
-std::string BlockState::getName() const { return name; }
+const std::string &BlockState::getName() const { return name; }
 
 const std::map<std::string, std::string> &BlockState::getProperties() const { return properties; }
 
@@ -46,7 +47,9 @@ void BlockState::setProperty(std::string key, std::string value) {
     updateVariantDescription();
 }
 
-const std::string BlockState::getVariantDescription() const { return variant_description; }
+const std::string &BlockState::getVariantDescription() const { return variant_description; }
+
+size_t BlockState::getHash() const { return hash; }
 
 bool BlockState::operator<(const BlockState &other) const {
     return variant_description < other.variant_description;
@@ -64,45 +67,95 @@ void BlockState::updateVariantDescription() {
     for (auto it = properties.begin(); it != properties.end(); ++it) {
         variant_description += it->first + "=" + it->second + ",";
     }
+    std::hash<std::string> hasher;
+    hash = hasher(name) * 31 + hasher(variant_description);
+}
+
+namespace {
+
+// source of the generations of block state registries, 0 is never used
+std::atomic<uint64_t> registry_generations(0);
+
+} // namespace
+
+BlockStateRegistry::Table::Table(size_t size)
+    : mask(size - 1), slots(new std::atomic<uint32_t>[size]) {
+    for (size_t i = 0; i < size; i++)
+        slots[i].store(0, std::memory_order_relaxed);
 }
 
-BlockStateRegistry::BlockStateRegistry() : unknown_block("mapcrafter:unknown") {}
+BlockStateRegistry::BlockStateRegistry()
+    : generation(++registry_generations), count(0), known_properties_hash_valid(false),
+      known_properties_hash(0), unknown_block("mapcrafter:unknown") {
+    tables.emplace_back(new Table(1024));
+    table = tables.back().get();
+    for (size_t i = 0; i < 65536 / BLOCK_SIZE; i++)
+        blocks[i] = nullptr;
+}
+
+BlockStateRegistry::~BlockStateRegistry() {
+    for (size_t i = 0; i < 65536 / BLOCK_SIZE; i++)
+        delete[] blocks[i].load();
+}
 
 uint16_t BlockStateRegistry::getBlockID(const BlockState &block) {
+    // lock-free path: the block state is already known
+    uint32_t slot = find(*table.load(std::memory_order_acquire), block)
+                        .load(std::memory_order_acquire);
+    if (slot != 0)
+        return slot - 1;
+
     std::lock_guard<std::mutex> guard(mutex);
+    Table *current = table.load(std::memory_order_relaxed);
+    // another thread might have added it in the meantime
+    slot = find(*current, block).load(std::memory_order_relaxed);
+    if (slot != 0)
+        return slot - 1;
 
-    // first check if that block name is known
-    auto it = block_lookup.find(block.getName());
-    if (it == block_lookup.end()) {
-        // block name unknown -> insert block
-        uint16_t id = block_states.size();
-        block_lookup[block.getName()][block.getVariantDescription()] = id;
-        block_states.push_back(block);
-        return id;
+    size_t id = count.load(std::memory_order_relaxed);
+    if (id >= 65536) {
+        LOG(ERROR) << "Too many block states, unable to add " << block.getName() << " "
+                   << block.getVariantDescription();
+        return 0;
     }
 
-    // block name is known -> just search for the variant now
-    auto it2 = it->second.find(block.getVariantDescription());
-    if (it2 == it->second.end()) {
-        // variant not found -> insert block
-        uint16_t id = block_states.size();
-        it->second[block.getVariantDescription()] = id;
-        block_states.push_back(block);
-        return id;
+    // keep the table at most half full, the new table is published after it is filled
+    if ((id + 1) * 2 > current->mask + 1) {
+        tables.emplace_back(new Table((current->mask + 1) * 2));
+        current = tables.back().get();
+        for (size_t i = 0; i < id; i++)
+            find(*current, getBlockState(i)).store(i + 1, std::memory_order_relaxed);
     }
-    return it2->second;
+
+    BlockState *states = blocks[id / BLOCK_SIZE].load(std::memory_order_relaxed);
+    if (states == nullptr) {
+        states = new BlockState[BLOCK_SIZE];
+        blocks[id / BLOCK_SIZE].store(states, std::memory_order_release);
+    }
+    states[id % BLOCK_SIZE] = block;
+    count.store(id + 1, std::memory_order_release);
+
+    find(*current, block).store(id + 1, std::memory_order_release);
+    table.store(current, std::memory_order_release);
+    return id;
 }
 
 const BlockState &BlockStateRegistry::getBlockState(uint16_t id) const {
-    if (id >= block_states.size()) {
+    if (id >= count.load(std::memory_order_acquire)) {
         assert(false);
         return unknown_block;
     }
-    return block_states.at(id);
+    return blocks[id / BLOCK_SIZE].load(std::memory_order_acquire)[id % BLOCK_SIZE];
 }
 
+size_t BlockStateRegistry::size() const { return count.load(std::memory_order_acquire); }
+
 void BlockStateRegistry::addKnownProperty(std::string block, std::string property) {
-    known_properties[block].insert(property);
+    // block images of every map add the same properties again, which changes nothing
+    if (known_properties[block].insert(property).second) {
+        generation = ++registry_generations;
+        known_properties_hash_valid = false;
+    }
 }
 
 bool BlockStateRegistry::isKnownProperty(std::string block, std::string property) const {
@@ -113,5 +166,98 @@ bool BlockStateRegistry::isKnownProperty(std::string block, std::string property
     return it->second.count(property);
 }
 
+uint64_t BlockStateRegistry::getGeneration() const { return generation; }
+
+uint64_t BlockStateRegistry::getKnownPropertiesHash() const {
+    // known properties are not added while rendering, so threads which compute the hash
+    // at the same time compute the same one
+    if (!known_properties_hash_valid.load(std::memory_order_acquire)) {
+        std::string properties;
+        for (auto it = known_properties.begin(); it != known_properties.end(); ++it)
+            for (auto it2 = it->second.begin(); it2 != it->second.end(); ++it2)
+                properties += it->first + ":" + *it2 + ",";
+        known_properties_hash.store(
+            util::hashBytes(reinterpret_cast<const uint8_t *>(properties.data()),
+                            properties.size()),
+            std::memory_order_relaxed);
+        known_properties_hash_valid.store(true, std::memory_order_release);
+    }
+    return known_properties_hash.load(std::memory_order_relaxed);
+}
+
+std::atomic<uint32_t> &BlockStateRegistry::find(const Table &table,
+                                                const BlockState &block) const {
+    for (size_t i = block.getHash() & table.mask;; i = (i + 1) & table.mask) {
+        std::atomic<uint32_t> &slot = table.slots[i];
+        uint32_t id = slot.load(std::memory_order_acquire);
+        if (id == 0)
+            return slot;
+        const BlockState &other = getBlockState(id - 1);
+        if (other.getHash() == block.getHash() && other.getName() == block.getName() &&
+            other.getVariantDescription() == block.getVariantDescription())
+            return slot;
+    }
+}
+
+BlockPaletteMemo::BlockPaletteMemo() : entries(256), count(0), generation(0) {}
+
+bool BlockPaletteMemo::lookup(const BlockStateRegistry &registry, const uint8_t *data,
+                              size_t len, uint16_t &id) {
+    checkGeneration(registry);
+    const Entry &entry = entries[find(util::hashBytes(data, len), data, len)];
+    if (entry.data.empty())
+        return false;
+    id = entry.id;
+    return true;
+}
+
+void BlockPaletteMemo::insert(const BlockStateRegistry &registry, const uint8_t *data,
+                              size_t len, uint16_t id) {
+    checkGeneration(registry);
+    if (len == 0)
+        return;
+
+    // keep the table at most half full
+    if ((count + 1) * 2 > entries.size()) {
+        std::vector<Entry> old(entries.size() * 2);
+        old.swap(entries);
+        for (auto it = old.begin(); it != old.end(); ++it)
+            if (!it->data.empty())
+                entries[find(it->hash, nullptr, 0)] = std::move(*it);
+    }
+
+    uint64_t hash = util::hashBytes(data, len);
+    Entry &entry = entries[find(hash, data, len)];
+    if (entry.data.empty()) {
+        entry.hash = hash;
+        entry.data.assign(reinterpret_cast<const char *>(data), len);
+        count++;
+    }
+    entry.id = id;
+}
+
+size_t BlockPaletteMemo::size() const { return count; }
+
+size_t BlockPaletteMemo::find(uint64_t hash, const uint8_t *data, size_t len) const {
+    size_t mask = entries.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Entry &entry = entries[i];
+        if (entry.data.empty())
+            return i;
+        if (entry.hash == hash && entry.data.size() == len &&
+            std::memcmp(entry.data.data(), data, len) == 0)
+            return i;
+    }
+}
+
+void BlockPaletteMemo::checkGeneration(const BlockStateRegistry &registry) {
+    uint64_t current = registry.getGeneration();
+    if (current == generation)
+        return;
+    generation = current;
+    entries.assign(256, Entry());
+    count = 0;
+}
+
 } // namespace mc
 } // namespace mapcrafter
@@ -20,7 +20,10 @@
 #ifndef BLOCKSTATE_H_
 #define BLOCKSTATE_H_
 
+#include <atomic>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <string>
@@ -33,14 +36,19 @@ class BlockState {
   public:
     BlockState(std::string name = "");
 
-    std::string getName() const;
+    const std::string &getName() const;
 
     const std::map<std::string, std::string> &getProperties() const;
     bool hasProperty(std::string key) const;
     std::string getProperty(std::string key, std::string default_value = "") const;
     void setProperty(std::string key, std::string value);
 
-    const std::string getVariantDescription() const;
+    const std::string &getVariantDescription() const;
+
+    /**
+     * Returns a hash of the name and the properties.
+     */
+    size_t getHash() const;
 
     bool operator<(const BlockState &other) const;
 
@@ -54,29 +62,133 @@ class BlockState {
     std::map<std::string, std::string> properties;
     // representation of properties that's like: "foo=bar,key1=value,key2=test,"
     std::string variant_description;
+    size_t hash;
 };
 
+/**
+ * Assigns the block states IDs. Looking up block states which are already known
+ * (getBlockID and getBlockState) doesn't lock, only adding new block states does.
+ *
+ * The IDs are stored in an open-addressing hash table whose slots are published
+ * atomically. When the table grows, a bigger copy replaces it and the old one is kept
+ * until the registry is destroyed, since other threads may still read from it. The
+ * block states are stored in blocks which never move, so the references returned by
+ * getBlockState stay valid.
+ */
 class BlockStateRegistry {
   public:
     BlockStateRegistry();
+    ~BlockStateRegistry();
 
     uint16_t getBlockID(const BlockState &block);
     const BlockState &getBlockState(uint16_t id) const;
 
+    /**
+     * Returns the count of registered block states.
+     */
+    size_t size() const;
+
     void addKnownProperty(std::string block, std::string property);
     bool isKnownProperty(std::string block, std::string property) const;
 
+    /**
+     * Returns a number which identifies the registry and its known properties. It is
+     * unique among all registries and changes when a known property is added, so
+     * everything that caches block IDs of a registry can check whether they are still
+     * valid.
+     */
+    uint64_t getGeneration() const;
+
+    /**
+     * Returns a hash of the known properties. Registries with the same known properties
+     * parse block states the same way, even across runs. The hash is computed only once
+     * after known properties were added.
+     */
+    uint64_t getKnownPropertiesHash() const;
+
   private:
+    // slots have the block ID + 1, or 0 if they are empty
+    struct Table {
+        Table(size_t size);
+
+        size_t mask;
+        std::unique_ptr<std::atomic<uint32_t>[]> slots;
+    };
+
+    static const size_t BLOCK_SIZE = 256;
+
+    /**
+     * Searches a table for a block state. Returns the slot with its ID, or the empty slot
+     * where it belongs to.
+     */
+    std::atomic<uint32_t> &find(const Table &table, const BlockState &block) const;
+
     std::mutex mutex;
+    std::atomic<uint64_t> generation;
+
+    std::atomic<Table *> table;
+    std::vector<std::unique_ptr<Table>> tables;
 
-    std::map<std::string, std::map<std::string, uint16_t>> block_lookup;
-    std::vector<BlockState> block_states;
+    // the block states in blocks of BLOCK_SIZE, a block ID is block index * BLOCK_SIZE + index
+    std::atomic<BlockState *> blocks[65536 / BLOCK_SIZE];
+    std::atomic<size_t> count;
 
     std::map<std::string, std::set<std::string>> known_properties;
+    // hash of the known properties, computed when it is requested the first time after
+    // the known properties changed
+    mutable std::atomic<bool> known_properties_hash_valid;
+    mutable std::atomic<uint64_t> known_properties_hash;
 
     BlockState unknown_block;
 };
 
+/**
+ * Remembers the block IDs of block palette entries by their raw NBT data (the bytes of
+ * an entry compound). Chunk sections use the same few hundred palette entries over and
+ * over again, with the memo they don't need to build block states and lock the registry
+ * for that each time.
+ *
+ * The memo isn't thread-safe, every thread should have its own one.
+ */
+class BlockPaletteMemo {
+  public:
+    BlockPaletteMemo();
+
+    /**
+     * Looks up the block ID of a palette entry. Returns false if the entry is unknown.
+     * The memo forgets all entries if the registry isn't the same as before.
+     */
+    bool lookup(const BlockStateRegistry &registry, const uint8_t *data, size_t len,
+                uint16_t &id);
+
+    /**
+     * Remembers the block ID of a palette entry.
+     */
+    void insert(const BlockStateRegistry &registry, const uint8_t *data, size_t len,
+                uint16_t id);
+
+    size_t size() const;
+
+  private:
+    struct Entry {
+        uint64_t hash;
+        std::string data;
+        uint16_t id;
+    };
+
+    /**
+     * Returns the slot of an entry: either the slot with the entry or the empty slot where
+     * it belongs to.
+     */
+    size_t find(uint64_t hash, const uint8_t *data, size_t len) const;
+    void checkGeneration(const BlockStateRegistry &registry);
+
+    // open addressing with linear probing, slots with empty data are free
+    std::vector<Entry> entries;
+    size_t count;
+    uint64_t generation;
+};
+
 } // namespace mc
 } // namespace mapcrafter
 
@@ -20,8 +20,13 @@
 #include "chunk.h"
 
 #include "blockstate.h"
+#include "compression.h"
+#include "packedarray.h"
+#include "worldentities.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 
 namespace mapcrafter {
@@ -92,117 +97,181 @@ static const std::unordered_map<std::string, uint32_t> biome_resource_ids = {
     {"minecraft:mangrove_swamp", 183},
 };
 
+ChunkSection::ChunkSection(int8_t y) : y(y), bits(0), mask(0), uniform_id(0) {
+    uniform_light[0] = uniform_light[1] = 0;
+}
+
 namespace {
 
-void readPackedShorts(const std::vector<int64_t> &data, std::array<uint16_t, 4096> &palette) {
-    // this is basically taken from Minecraft Overviewer
-    // https://github.com/gmcnew/Minecraft-Overviewer/blob/minecraft113/overviewer_core/world.py#L809
-    // maybe we can keep this, or maybe we could do something with unions for speed-up?
-    const uint8_t *b = reinterpret_cast<const uint8_t *>(&data.front());
-    int bits_per_entry = data.size() * 64 / (16 * 16 * 16);
-
-    unsigned int i = 0, j = 0;
-    while (i < data.size() * sizeof(int64_t)) {
-        if (bits_per_entry == 4) {
-            for (int k = 0; k < 4; k++) {
-                palette[j++] = b[i + k] & 0x0f;
-                palette[j++] = (b[i + k] & 0xf0) >> 4;
-            }
-            i += 4;
-        }
-        if (bits_per_entry == 5) {
-            palette[j++] = b[i] & 0x1f;
-            palette[j++] = ((b[i + 1] & 0x03) << 3) | ((b[i] & 0xe0) >> 5);
-            palette[j++] = (b[i + 1] & 0x7c) >> 2;
-            palette[j++] = ((b[i + 2] & 0x0f) << 1) | ((b[i + 1] & 0x80) >> 7);
-            palette[j++] = ((b[i + 3] & 0x01) << 4) | ((b[i + 2] & 0xf0) >> 4);
-            palette[j++] = (b[i + 3] & 0x3e) >> 1;
-            palette[j++] = ((b[i + 4] & 0x07) << 2) | ((b[i + 3] & 0xc0) >> 6);
-            palette[j++] = (b[i + 4] & 0xf8) >> 3;
-            i += 5;
-        }
-        if (bits_per_entry == 6) {
-            palette[j++] = b[i] & 0x3f;
-            palette[j++] = ((b[i + 1] & 0x0f) << 2) | ((b[i] & 0xc0) >> 6);
-            palette[j++] = ((b[i + 2] & 0x03) << 4) | ((b[i + 1] & 0xf0) >> 4);
-            palette[j++] = (b[i + 2] & 0xfc) >> 2;
-            i += 3;
-        }
-        if (bits_per_entry == 7) {
-            palette[j++] = b[i] & 0x7f;
-            palette[j++] = ((b[i + 1] & 0x3f) << 1) | ((b[i] & 0x80) >> 7);
-            palette[j++] = ((b[i + 2] & 0x1f) << 2) | ((b[i + 1] & 0xc0) >> 6);
-            palette[j++] = ((b[i + 3] & 0x0f) << 3) | ((b[i + 2] & 0xe0) >> 5);
-            palette[j++] = ((b[i + 4] & 0x07) << 4) | ((b[i + 3] & 0xf0) >> 4);
-            palette[j++] = ((b[i + 5] & 0x03) << 5) | ((b[i + 4] & 0xf8) >> 3);
-            palette[j++] = ((b[i + 6] & 0x01) << 6) | ((b[i + 5] & 0xfc) >> 2);
-            palette[j++] = (b[i + 6] & 0xfe) >> 1;
-            i += 7;
-        }
-        if (bits_per_entry == 8) {
-            palette[j++] = b[i];
-            i += 1;
-        }
-        if (bits_per_entry == 9) {
-            palette[j++] = ((b[i + 1] & 0x01) << 8) | b[0];
-            palette[j++] = ((b[i + 2] & 0x03) << 7) | ((b[i + 1] & 0xfe) >> 1);
-            palette[j++] = ((b[i + 3] & 0x07) << 6) | ((b[i + 2] & 0xfc) >> 2);
-            palette[j++] = ((b[i + 4] & 0x0f) << 5) | ((b[i + 3] & 0xf8) >> 3);
-            palette[j++] = ((b[i + 5] & 0x1f) << 4) | ((b[i + 4] & 0xf0) >> 4);
-            palette[j++] = ((b[i + 6] & 0x3f) << 3) | ((b[i + 5] & 0xe0) >> 5);
-            palette[j++] = ((b[i + 7] & 0x7f) << 2) | ((b[i + 6] & 0xc0) >> 6);
-            palette[j++] = (b[i + 8] << 1) | ((b[i + 7] & 0x80) >> 7);
-            i += 9;
-        }
-        if (bits_per_entry == 10) {
-            palette[j++] = ((b[i + 1] & 0x03) << 8) | b[0];
-            palette[j++] = ((b[i + 2] & 0x0f) << 6) | ((b[i + 1] & 0xfc) >> 2);
-            palette[j++] = ((b[i + 3] & 0x3f) << 4) | ((b[i + 2] & 0xf0) >> 4);
-            palette[j++] = (b[i + 4] << 2) | ((b[i + 3] & 0xc0) >> 6);
-            i += 5;
-        }
-        if (bits_per_entry == 11) {
-            palette[j++] = ((b[i + 1] & 0x07) << 8) | b[0];
-            palette[j++] = ((b[i + 2] & 0x3f) << 5) | ((b[i + 1] & 0xf8) >> 3);
-            palette[j++] = ((b[i + 4] & 0x01) << 10) | (b[i + 3] << 2) | ((b[i + 2] & 0xc0) >> 6);
-            palette[j++] = ((b[i + 5] & 0x0f) << 7) | ((b[i + 4] & 0xfe) >> 1);
-            palette[j++] = ((b[i + 6] & 0x7f) << 4) | ((b[i + 5] & 0xf0) >> 4);
-            palette[j++] = ((b[i + 8] & 0x03) << 9) | (b[i + 7] << 1) | ((b[i + 6] & 0x80) >> 7);
-            palette[j++] = ((b[i + 9] & 0x1f) << 2) | ((b[i + 8] & 0xfc) >> 2);
-            palette[j++] = (b[i + 10] << 3) | ((b[i + 9] & 0xe0) >> 5);
-            i += 11;
-        }
-        if (bits_per_entry == 12) {
-            palette[j++] = ((b[i + 1] & 0x0f) << 8) | b[0];
-            palette[j++] = (b[i + 2] << 4) | ((b[i + 1] & 0xf0) >> 4);
-            i += 3;
-        }
+// the position of every block ID in a palette + 1, or 0 if it isn't in the palette,
+// reset to 0 after use
+thread_local std::vector<uint16_t> palette_positions(65536, 0);
+
+/**
+ * Packs the values of a section with a specific bit width, the palette indices are
+ * translated to the values with a lookup table.
+ */
+template <int BITS>
+void packValues(const uint16_t *indices, const uint16_t *lookup, uint64_t *packed) {
+    const int per_long = 64 / BITS;
+    for (int i = 0; i < 4096 / per_long; i++) {
+        uint64_t value = 0;
+        for (int j = 0; j < per_long; j++)
+            value |= uint64_t(lookup[indices[j]]) << (j * BITS);
+        packed[i] = value;
+        indices += per_long;
     }
-    assert(j == 16 * 16 * 16);
 }
 
-template <std::size_t PALETTE_SIZE = 4096>
-void readPackedShorts_v116(const std::vector<int64_t> &data,
-                           std::array<uint16_t, PALETTE_SIZE> &palette) {
-    uint32_t shorts_per_long = (PALETTE_SIZE + data.size() - 1) / data.size();
-    uint32_t bits_per_value = 64 / shorts_per_long;
-    palette.fill(0);
-    uint16_t mask = (1 << bits_per_value) - 1;
+} // namespace
+
+void ChunkSection::setBlockIDs(const uint16_t *block_ids) {
+    thread_local std::vector<uint16_t> used_palette, indices;
+
+    used_palette.clear();
+    indices.resize(4096);
+    for (int i = 0; i < 4096; i++) {
+        uint16_t &position = palette_positions[block_ids[i]];
+        if (position == 0) {
+            used_palette.push_back(block_ids[i]);
+            position = used_palette.size();
+        }
+        indices[i] = position - 1;
+    }
+    for (size_t i = 0; i < used_palette.size(); i++)
+        palette_positions[used_palette[i]] = 0;
 
-    for (uint32_t i = 0; i < shorts_per_long; i++) {
-        uint32_t j = 0;
-        for (uint32_t k = i; k < PALETTE_SIZE; k += shorts_per_long) {
-            assert(j < data.size());
-            palette[k] = (uint16_t)(data[j] >> (bits_per_value * i)) & mask;
-            j++;
+    setBlockIDs(indices.data(), used_palette.data(), used_palette.size());
+}
+
+void ChunkSection::setBlockIDs(const uint16_t *indices, const uint16_t *block_palette,
+                               size_t palette_size) {
+    // palettes can have the same block ID multiple times (for example when they differ only
+    // in properties we don't know), so they are mapped to a palette without duplicates
+    thread_local std::vector<uint16_t> new_palette, remap;
+    new_palette.clear();
+    remap.resize(palette_size);
+    for (size_t i = 0; i < palette_size; i++) {
+        uint16_t &position = palette_positions[block_palette[i]];
+        if (position == 0) {
+            new_palette.push_back(block_palette[i]);
+            position = new_palette.size();
         }
-        assert(j <= data.size());
+        remap[i] = position - 1;
     }
+    for (size_t i = 0; i < new_palette.size(); i++)
+        palette_positions[new_palette[i]] = 0;
+
+    if (new_palette.size() <= 1) {
+        setBlockIDs(new_palette.empty() ? uint16_t(0) : new_palette[0]);
+        return;
+    }
+
+    // only widths which divide 64, so every value is in one long
+    if (new_palette.size() <= 2)
+        bits = 1;
+    else if (new_palette.size() <= 4)
+        bits = 2;
+    else if (new_palette.size() <= 16)
+        bits = 4;
+    else if (new_palette.size() <= 256)
+        bits = 8;
+    else
+        bits = 16;
+    mask = (1 << bits) - 1;
+
+    std::vector<uint64_t>(4096 * bits / 64).swap(this->indices);
+    uint64_t *packed = this->indices.data();
+    if (bits == 1)
+        packValues<1>(indices, remap.data(), packed);
+    else if (bits == 2)
+        packValues<2>(indices, remap.data(), packed);
+    else if (bits == 4)
+        packValues<4>(indices, remap.data(), packed);
+    else if (bits == 8)
+        packValues<8>(indices, remap.data(), packed);
+    else
+        packValues<16>(indices, block_palette, packed);
+
+    if (bits == 16)
+        std::vector<uint16_t>().swap(palette);
+    else
+        palette.assign(new_palette.begin(), new_palette.end());
 }
 
-} // namespace
+void ChunkSection::setBlockIDs(uint16_t block_id) {
+    bits = 0;
+    mask = 0;
+    uniform_id = block_id;
+    std::vector<uint16_t>().swap(palette);
+    std::vector<uint64_t>().swap(indices);
+}
+
+void ChunkSection::setLight(int array, const uint8_t *light) {
+    // all bytes are the same if every byte is the same as the next one
+    uint8_t first = light[0];
+    if ((first & 0x0f) == (first >> 4) && std::memcmp(light, light + 1, 2047) == 0)
+        setLight(array, first & 0x0f);
+    else
+        this->light[array].assign(light, light + 2048);
+}
+
+void ChunkSection::setLight(int array, uint8_t value) {
+    uniform_light[array] = value;
+    std::vector<uint8_t>().swap(light[array]);
+}
 
-Chunk::Chunk() : chunkpos(42, 42), rotation(0), air_id(0) { clear(); }
+bool ChunkSection::isEmpty(uint16_t air_id) const {
+    return bits == 0 && uniform_id == air_id && light[0].empty() && uniform_light[0] == 0 &&
+           light[1].empty() && uniform_light[1] == 15;
+}
+
+bool ChunkSection::hasBlocks(uint16_t air_id) const {
+    // the palette has different block IDs, one of them isn't air
+    return bits != 0 || uniform_id != air_id;
+}
+
+int ChunkSection::getHighestBlock(int x, int z, uint16_t air_id) const {
+    if (bits == 0)
+        return uniform_id == air_id ? -1 : 15;
+    for (int y = 15; y >= 0; y--)
+        if (getBlockID((y * 16 + z) * 16 + x) != air_id)
+            return y;
+    return -1;
+}
+
+size_t ChunkSection::getMemoryUsage() const {
+    return sizeof(ChunkSection) + palette.capacity() * sizeof(uint16_t) +
+           indices.capacity() * sizeof(uint64_t) + light[0].capacity() + light[1].capacity();
+}
+
+ChunkData::ChunkData()
+    : air_id(0), occupied_sections(0), highest_block(CHUNK_LOW * 16 - 1) {
+    std::fill(section_offsets, section_offsets + CHUNK_TOP - CHUNK_LOW, -1);
+    std::fill(heights, heights + 16 * 16, CHUNK_LOW * 16 - 1);
+    std::fill(biomes, biomes + BIOMES_ARRAY_SIZE, 21 /* DEFAULT_BIOME */);
+}
+
+void ChunkData::addSection(ChunkSection &&section) {
+    // sections with only air are the same as not existing ones
+    if (section.isEmpty(air_id))
+        return;
+    section_offsets[section.y - CHUNK_LOW] = sections.size();
+    if (section.hasBlocks(air_id))
+        occupied_sections |= 1u << (section.y - CHUNK_LOW);
+    sections.push_back(std::move(section));
+}
+
+size_t ChunkData::getMemoryUsage() const {
+    size_t usage = sizeof(ChunkData) +
+                   (sections.capacity() - sections.size()) * sizeof(ChunkSection) +
+                   status.capacity();
+    for (auto it = sections.begin(); it != sections.end(); ++it)
+        usage += it->getMemoryUsage();
+    return usage;
+}
+
+Chunk::Chunk() : chunkpos(42, 42), rotation(0), chunk_completely_contained(false) { clear(); }
 
 Chunk::~Chunk() {}
 
@@ -212,381 +281,723 @@ void Chunk::setWorldCrop(const WorldCrop &world_crop) { this->world_crop = world
 
 int Chunk::positionToKey(int x, int z, int y) const { return y + 256 * (x + 16 * z); }
 
-bool Chunk::readNBT117(mc::BlockStateRegistry &block_registry, const nbt::NBTFile &nbt) {
-    int data_version = nbt.findTag<nbt::TagInt>("DataVersion").payload;
+/**
+ * The tags of a chunk compound (the root compound, or the "Level" compound of chunks
+ * before 1.18) which are required to load a chunk. Everything else is skipped.
+ */
+struct Chunk::NBTTags {
+    bool has_data_version = false;
+    int32_t data_version = 0;
+
+    bool has_x = false, has_y = false, has_z = false;
+    int32_t x = 0, y = 0, z = 0;
+
+    bool has_status = false;
+    std::string_view status;
+
+    bool has_level = false;
+    size_t level = 0;
+
+    bool has_sections = false;
+    nbt::ListView sections;
+    // offset after the sections list
+    size_t sections_end = 0;
+
+    bool has_heightmaps = false;
+    size_t heightmaps = 0;
+
+    // block entities, called "TileEntities" before 1.18
+    bool has_block_entities = false;
+    nbt::ListView block_entities;
+
+    // biomes of chunks before 1.18, one of the array views is set depending on the type
+    int8_t biomes_type = nbt::TagEnd::TAG_TYPE;
+    nbt::ArrayView<int8_t> biomes_bytes;
+    nbt::ArrayView<int32_t> biomes_ints;
+    nbt::ArrayView<int64_t> biomes_longs;
+
+    /**
+     * Reads the tags of the compound the reader is positioned at. The name of the
+     * sections list changed with 1.18, that's why it needs to be specified.
+     */
+    void read(nbt::NBTReader &reader, std::string_view sections_name) {
+        int8_t type;
+        std::string_view name;
+        while (reader.readTagHeader(type, name)) {
+            if (name == "DataVersion") {
+                has_data_version = type == nbt::TagInt::TAG_TYPE;
+                if (has_data_version) {
+                    data_version = reader.readInt();
+                    continue;
+                }
+            } else if (name == "xPos") {
+                has_x = type == nbt::TagInt::TAG_TYPE;
+                if (has_x) {
+                    x = reader.readInt();
+                    continue;
+                }
+            } else if (name == "yPos") {
+                has_y = type == nbt::TagInt::TAG_TYPE;
+                if (has_y) {
+                    y = reader.readInt();
+                    continue;
+                }
+            } else if (name == "zPos") {
+                has_z = type == nbt::TagInt::TAG_TYPE;
+                if (has_z) {
+                    z = reader.readInt();
+                    continue;
+                }
+            } else if (name == "Status") {
+                has_status = type == nbt::TagString::TAG_TYPE;
+                if (has_status) {
+                    status = reader.readString();
+                    continue;
+                }
+            } else if (name == "Level") {
+                has_level = type == nbt::TagCompound::TAG_TYPE;
+                if (has_level) {
+                    level = reader.readCompound();
+                    continue;
+                }
+            } else if (name == "Heightmaps") {
+                has_heightmaps = type == nbt::TagCompound::TAG_TYPE;
+                if (has_heightmaps) {
+                    heightmaps = reader.readCompound();
+                    continue;
+                }
+            } else if (name == sections_name) {
+                has_sections = type == nbt::TagList::TAG_TYPE;
+                if (has_sections) {
+                    sections = reader.readList();
+                    sections_end = reader.tell();
+                    continue;
+                }
+            } else if (name == "block_entities" || name == "TileEntities") {
+                has_block_entities = type == nbt::TagList::TAG_TYPE;
+                if (has_block_entities) {
+                    block_entities = reader.readList();
+                    continue;
+                }
+            } else if (name == "Biomes") {
+                biomes_type = type;
+                if (type == nbt::TagByteArray::TAG_TYPE) {
+                    biomes_bytes = reader.readByteArray();
+                    continue;
+                } else if (type == nbt::TagIntArray::TAG_TYPE) {
+                    biomes_ints = reader.readIntArray();
+                    continue;
+                } else if (type == nbt::TagLongArray::TAG_TYPE) {
+                    biomes_longs = reader.readLongArray();
+                    continue;
+                }
+            }
+            reader.skip(type);
+        }
+    }
+
+    bool hasBiomes(int8_t type, int32_t size) const {
+        if (biomes_type != type)
+            return false;
+        if (type == nbt::TagByteArray::TAG_TYPE)
+            return biomes_bytes.size == size;
+        if (type == nbt::TagIntArray::TAG_TYPE)
+            return biomes_ints.size == size;
+        return biomes_longs.size == size;
+    }
+};
+
+namespace {
+
+/**
+ * A paletted container of a section: The "block_states" and "biomes" compounds of 1.18+
+ * chunks, and the "Palette" list / "BlockStates" array pair of older chunks.
+ */
+struct PalettedContainer {
+    bool has_palette = false;
+    nbt::ListView palette;
+
+    bool has_data = false;
+    nbt::ArrayView<int64_t> data;
+
+    void readPalette(nbt::NBTReader &reader, int8_t type) {
+        has_palette = type == nbt::TagList::TAG_TYPE;
+        if (has_palette)
+            palette = reader.readList();
+        else
+            reader.skip(type);
+    }
+
+    void readData(nbt::NBTReader &reader, int8_t type) {
+        has_data = type == nbt::TagLongArray::TAG_TYPE;
+        if (has_data)
+            data = reader.readLongArray();
+        else
+            reader.skip(type);
+    }
+
+    void read(nbt::NBTReader &reader) {
+        int8_t type;
+        std::string_view name;
+        while (reader.readTagHeader(type, name)) {
+            if (name == "palette")
+                readPalette(reader, type);
+            else if (name == "data")
+                readData(reader, type);
+            else
+                reader.skip(type);
+        }
+    }
+};
+
+/**
+ * The tags of a chunk section which are required to load it.
+ */
+struct SectionTags {
+    bool has_y = false;
+    int8_t y = 0;
+
+    bool has_block_states = false, has_biomes = false;
+    PalettedContainer block_states, biomes;
+
+    bool has_block_light = false, has_sky_light = false;
+    nbt::ArrayView<int8_t> block_light, sky_light;
+
+    void read(nbt::NBTReader &reader) {
+        int8_t type;
+        std::string_view name;
+        while (reader.readTagHeader(type, name)) {
+            if (name == "Y") {
+                has_y = type == nbt::TagByte::TAG_TYPE;
+                if (has_y) {
+                    y = reader.readByte();
+                    continue;
+                }
+            } else if (name == "block_states") {
+                has_block_states = type == nbt::TagCompound::TAG_TYPE;
+                if (has_block_states) {
+                    block_states = PalettedContainer();
+                    block_states.read(reader);
+                    continue;
+                }
+            } else if (name == "biomes") {
+                has_biomes = type == nbt::TagCompound::TAG_TYPE;
+                if (has_biomes) {
+                    biomes = PalettedContainer();
+                    biomes.read(reader);
+                    continue;
+                }
+            } else if (name == "Palette") {
+                // chunks before 1.18
+                block_states.readPalette(reader, type);
+                continue;
+            } else if (name == "BlockStates") {
+                block_states.readData(reader, type);
+                continue;
+            } else if (name == "BlockLight") {
+                has_block_light = type == nbt::TagByteArray::TAG_TYPE;
+                if (has_block_light) {
+                    block_light = reader.readByteArray();
+                    continue;
+                }
+            } else if (name == "SkyLight") {
+                has_sky_light = type == nbt::TagByteArray::TAG_TYPE;
+                if (has_sky_light) {
+                    sky_light = reader.readByteArray();
+                    continue;
+                }
+            }
+            reader.skip(type);
+        }
+    }
+};
+
+/**
+ * Returns the bit width of packed palette indices. Minecraft uses as few bits as the
+ * palette needs (but at least min_bits). If the count of longs doesn't match that, the
+ * bit width is guessed from the count of longs. Returns 0 if there is no such bit width.
+ */
+int getPackedBits(PackedFormat format, size_t palette_size, int min_bits, size_t longs,
+                  size_t count) {
+    int bits = min_bits;
+    while ((size_t(1) << bits) < palette_size)
+        bits++;
+    if (getPackedLongs(format, bits, count) == longs)
+        return bits;
+    for (bits = 1; bits <= 16; bits++)
+        if (getPackedLongs(format, bits, count) == longs)
+            return bits;
+    return 0;
+}
+
+/**
+ * Reads the block states of a section into the section. Returns false if the block
+ * states are corrupt.
+ */
+bool readBlockStates(PackedFormat format, const nbt::ArrayView<int64_t> &data,
+                     const std::vector<uint16_t> &palette_lookup, ChunkSection &section) {
+    int bits = getPackedBits(format, palette_lookup.size(), 4, data.size, 4096);
+    UnpackFunction unpack = getUnpackFunction(format, bits, 4096);
+    if (unpack == nullptr) {
+        LOG(ERROR) << "Invalid block states with " << data.size << " longs for "
+                   << palette_lookup.size() << " palette entries";
+        return false;
+    }
+
+    // the section stores palette indices itself, so they aren't translated to block IDs
+    thread_local std::array<uint16_t, 4096> indices;
+    if (unpack(data.data, getIdentityLookup(), indices.data()) < palette_lookup.size()) {
+        section.setBlockIDs(indices.data(), palette_lookup.data(), palette_lookup.size());
+        return true;
+    }
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (indices[i] >= palette_lookup.size()) {
+            LOG(ERROR) << "Incorrectly parsed palette ID " << indices[i] << " at index " << i
+                       << " (max is " << palette_lookup.size() - 1 << " with " << bits
+                       << " bits per entry)";
+            break;
+        }
+    }
+    return false;
+}
+
+void readLight(bool has_light, const nbt::ArrayView<int8_t> &light, ChunkSection &section,
+               int array) {
+    if (has_light && light.size == 2048)
+        section.setLight(array, light.data);
+    else
+        section.setLight(array, (uint8_t)0);
+}
+
+/**
+ * Reads a block palette (list of compounds with "Name" and optional "Properties") and
+ * looks up the block ID of each palette entry.
+ */
+void readBlockPalette(BlockStateRegistry &block_registry, nbt::NBTReader &reader,
+                      const nbt::ListView &palette, std::vector<uint16_t> &palette_lookup) {
+    palette_lookup.resize(palette.size);
+    if (palette.size > 0 && palette.tag_type != nbt::TagCompound::TAG_TYPE)
+        throw nbt::InvalidTagCast("Invalid tag cast");
+
+    // the same palette entries appear in nearly every chunk, so the block IDs of their
+    // raw data are remembered and a block state needs to be built only once per thread
+    thread_local BlockPaletteMemo memo;
+
+    std::vector<std::pair<std::string_view, std::string_view>> properties;
+    reader.seek(palette.offset);
+    for (int32_t i = 0; i < palette.size; i++) {
+        size_t start = reader.tell();
+        reader.skip(nbt::TagCompound::TAG_TYPE);
+        const uint8_t *entry = reader.getData() + start;
+        size_t entry_len = reader.tell() - start;
+        if (memo.lookup(block_registry, entry, entry_len, palette_lookup[i]))
+            continue;
+        reader.seek(start);
+
+        bool has_name = false;
+        std::string_view name;
+        properties.clear();
+
+        int8_t type;
+        std::string_view key;
+        while (reader.readTagHeader(type, key)) {
+            if (key == "Name") {
+                if (type != nbt::TagString::TAG_TYPE)
+                    throw nbt::InvalidTagCast("Invalid tag cast");
+                name = reader.readString();
+                has_name = true;
+            } else if (key == "Properties" && type == nbt::TagCompound::TAG_TYPE) {
+                properties.clear();
+                int8_t property_type;
+                std::string_view property;
+                while (reader.readTagHeader(property_type, property)) {
+                    if (property_type != nbt::TagString::TAG_TYPE)
+                        throw nbt::InvalidTagCast("Invalid tag cast");
+                    properties.emplace_back(property, reader.readString());
+                }
+            } else {
+                if (key == "Properties")
+                    properties.clear();
+                reader.skip(type);
+            }
+        }
+        if (!has_name)
+            throw nbt::TagNotFound("Tag 'Name' not found!");
+
+        mc::BlockState block{std::string(name)};
+        for (auto it = properties.begin(); it != properties.end(); ++it) {
+            std::string key(it->first);
+            if (block_registry.isKnownProperty(block.getName(), key)) {
+                block.setProperty(key, std::string(it->second));
+            }
+        }
+        palette_lookup[i] = block_registry.getBlockID(block);
+        memo.insert(block_registry, entry, entry_len, palette_lookup[i]);
+    }
+}
+
+/**
+ * Reads a biome palette (list of biome names) and looks up the biome ID of each
+ * palette entry.
+ */
+void readBiomePalette(nbt::NBTReader &reader, const nbt::ListView &palette,
+                      std::vector<uint32_t> &palette_lookup) {
+    palette_lookup.resize(palette.size);
+    if (palette.size > 0 && palette.tag_type != nbt::TagString::TAG_TYPE)
+        throw nbt::InvalidTagCast("Invalid tag cast");
+
+    reader.seek(palette.offset);
+    for (int32_t i = 0; i < palette.size; i++) {
+        auto it = biome_resource_ids.find(std::string(reader.readString()));
+        uint32_t biome_id = 1; // minecraft:plains
+        if (it != biome_resource_ids.end())
+            biome_id = it->second;
+        palette_lookup[i] = biome_id;
+    }
+}
+
+} // namespace
+
+bool Chunk::readNBT117(mc::BlockStateRegistry &block_registry, nbt::NBTReader &reader,
+                       const NBTTags &root, ChunkData &data, std::vector<RawSign> *signs) {
+    int data_version = root.data_version;
 
     // find "level" tag
-    if (!nbt.hasTag<nbt::TagCompound>("Level")) {
+    if (!root.has_level) {
         LOG(ERROR) << "Corrupt chunk: No level tag found!";
         return false;
     }
-    const nbt::TagCompound &level = nbt.findTag<nbt::TagCompound>("Level");
+    NBTTags level;
+    reader.seek(root.level);
+    level.read(reader, "Sections");
 
     // then find x/z pos of the chunk
-    if (!level.hasTag<nbt::TagInt>("xPos") || !level.hasTag<nbt::TagInt>("zPos")) {
+    if (!level.has_x || !level.has_z) {
         LOG(ERROR) << "Corrupt chunk: No x/z position found!";
         return false;
     }
-    chunkpos_original = ChunkPos(level.findTag<nbt::TagInt>("xPos").payload,
-                                 level.findTag<nbt::TagInt>("zPos").payload);
-    chunkpos = chunkpos_original;
-    if (rotation)
-        chunkpos.rotate(rotation);
+    data.pos = ChunkPos(level.x, level.z);
 
-    // now we have the original chunk position:
-    // check whether this chunk is completely contained within the cropped world
-    chunk_completely_contained = world_crop.isChunkCompletelyContained(chunkpos_original);
+    // the signs are collected for the markers while the chunk is read anyways
+    if (signs != nullptr && level.has_block_entities)
+        readSigns(reader, level.block_entities, *signs);
 
-    if (level.hasTag<nbt::TagString>("Status")) {
-        const nbt::TagString &tag = level.findTag<nbt::TagString>("Status");
+    if (level.has_status) {
         // completely generated chunks in fresh 1.13 worlds usually have status 'fullchunk' or
         // 'postprocessed' however, chunks of converted <1.13 worlds don't use these, but the state
         // 'mobs_spawned'
-        if (!(tag.payload == "fullchunk" || tag.payload == "full" ||
-              tag.payload == "postprocessed" || tag.payload == "mobs_spawned")) {
+        if (!(level.status == "fullchunk" || level.status == "full" ||
+              level.status == "postprocessed" || level.status == "mobs_spawned")) {
             return true;
         }
     }
 
-    if (level.hasArray<nbt::TagByteArray>("Biomes", BIOMES_ARRAY_SIZE)) {
-        const nbt::TagByteArray &biomes_tag = level.findTag<nbt::TagByteArray>("Biomes");
-        std::copy(biomes_tag.payload.begin(), biomes_tag.payload.end(), biomes);
-    } else if (level.hasArray<nbt::TagIntArray>("Biomes", BIOMES_ARRAY_SIZE)) {
-        const nbt::TagIntArray &biomes_tag = level.findTag<nbt::TagIntArray>("Biomes");
-        std::copy(biomes_tag.payload.begin(), biomes_tag.payload.end(), biomes);
-    } else if (level.hasArray<nbt::TagIntArray>("Biomes", 1024)) {
-        const nbt::TagIntArray &biomes_tag = level.findTag<nbt::TagIntArray>("Biomes");
-        std::copy(biomes_tag.payload.begin(), biomes_tag.payload.end(), biomes);
-    } else if (level.hasArray<nbt::TagByteArray>("Biomes", 0) ||
-               level.hasArray<nbt::TagLongArray>("Biomes", 0)) {
-        std::fill(biomes, biomes + BIOMES_ARRAY_SIZE, 0);
-    } else if (level.hasArray<nbt::TagByteArray>("Biomes", 256) ||
-               level.hasArray<nbt::TagIntArray>("Biomes", 256)) {
-        LOG(WARNING) << "Out dated chunk " << chunkpos << ": Old biome data found!";
+    const int8_t byte_array = nbt::TagByteArray::TAG_TYPE;
+    const int8_t int_array = nbt::TagIntArray::TAG_TYPE;
+    const int8_t long_array = nbt::TagLongArray::TAG_TYPE;
+    if (level.hasBiomes(byte_array, BIOMES_ARRAY_SIZE)) {
+        for (int32_t i = 0; i < BIOMES_ARRAY_SIZE; i++)
+            data.biomes[i] = level.biomes_bytes[i];
+    } else if (level.hasBiomes(int_array, BIOMES_ARRAY_SIZE) || level.hasBiomes(int_array, 1024)) {
+        for (int32_t i = 0; i < level.biomes_ints.size; i++)
+            data.biomes[i] = level.biomes_ints[i];
+    } else if (level.hasBiomes(byte_array, 0) || level.hasBiomes(long_array, 0)) {
+        std::fill(data.biomes, data.biomes + BIOMES_ARRAY_SIZE, 0);
+    } else if (level.hasBiomes(byte_array, 256) || level.hasBiomes(int_array, 256)) {
+        LOG(WARNING) << "Out dated chunk " << data.pos << ": Old biome data found!";
     } else {
-        LOG(WARNING) << "Corrupt chunk " << chunkpos << ": No biome data found!";
-        // level.dump(std::cout);
+        LOG(WARNING) << "Corrupt chunk " << data.pos << ": No biome data found!";
     }
 
     // find sections list
     // ignore it if section list does not exist, can happen sometimes with the empty
     // chunks of the end
-    if (!level.hasList<nbt::TagCompound>("Sections"))
+    if (!level.has_sections || level.sections.tag_type != nbt::TagCompound::TAG_TYPE)
         return true;
 
-    const nbt::TagList &sections_tag = level.findTag<nbt::TagList>("Sections");
-    if (sections_tag.tag_type != nbt::TagCompound::TAG_TYPE)
-        return true;
+    std::vector<uint16_t> palette_lookup;
 
     // go through all sections
-    for (auto it = sections_tag.payload.begin(); it != sections_tag.payload.end(); ++it) {
-        const nbt::TagCompound &section_tag = (*it)->cast<nbt::TagCompound>();
+    size_t section_offset = level.sections.offset;
+    for (int32_t s = 0; s < level.sections.size; s++) {
+        SectionTags section_tag;
+        reader.seek(section_offset);
+        section_tag.read(reader);
+        section_offset = reader.tell();
 
         // make sure section is valid
-        if (!section_tag.hasTag<nbt::TagByte>("Y")
-            //		|| !section_tag.hasArray<nbt::TagByteArray>("Blocks", 4096)
-            //		|| !section_tag.hasArray<nbt::TagByteArray>("Data", 2048)
-            || !section_tag.hasArray<nbt::TagLongArray>("BlockStates") ||
-            !section_tag.hasTag<nbt::TagList>("Palette"))
+        if (!section_tag.has_y || !section_tag.block_states.has_data ||
+            !section_tag.block_states.has_palette)
             continue;
 
-        const nbt::TagByte &y = section_tag.findTag<nbt::TagByte>("Y");
-        if (y.payload < CHUNK_LOW || y.payload >= CHUNK_TOP)
+        if (section_tag.y < CHUNK_LOW || section_tag.y >= CHUNK_TOP)
+            continue;
+        // there is nothing to unpack without block states
+        if (section_tag.block_states.data.empty())
             continue;
-        // const nbt::TagByteArray& blocks = section_tag.findTag<nbt::TagByteArray>("Blocks");
-        // const nbt::TagByteArray& data = section_tag.findTag<nbt::TagByteArray>("Data");
-
-        const nbt::TagLongArray &blockstates =
-            section_tag.findTag<nbt::TagLongArray>("BlockStates");
-
-        const nbt::TagList &palette = section_tag.findTag<nbt::TagList>("Palette");
-        std::vector<mc::BlockState> palette_blockstates(palette.payload.size());
-        std::vector<uint16_t> palette_lookup(palette.payload.size());
-
-        size_t i = 0;
-        for (auto it2 = palette.payload.begin(); it2 != palette.payload.end(); ++it2, ++i) {
-            const nbt::TagCompound &entry = (*it2)->cast<nbt::TagCompound>();
-            const nbt::TagString &name = entry.findTag<nbt::TagString>("Name");
-
-            mc::BlockState block(name.payload);
-            if (entry.hasTag<nbt::TagCompound>("Properties")) {
-                const nbt::TagCompound &properties = entry.findTag<nbt::TagCompound>("Properties");
-                for (auto it3 = properties.payload.begin(); it3 != properties.payload.end();
-                     ++it3) {
-                    std::string key = it3->first;
-                    std::string value = it3->second->cast<nbt::TagString>().payload;
-                    if (block_registry.isKnownProperty(block.getName(), key)) {
-                        block.setProperty(key, value);
-                    }
-                }
-            }
-            palette_blockstates[i] = block;
-            palette_lookup[i] = block_registry.getBlockID(block);
-        }
-
-        // create a ChunkSection-object
-        ChunkSection section;
-        section.y = y.payload;
 
-        if (data_version >= 2529) {
-            readPackedShorts_v116(blockstates.payload, section.block_ids);
-        } else {
-            readPackedShorts(blockstates.payload, section.block_ids);
-        }
+        readBlockPalette(block_registry, reader, section_tag.block_states.palette,
+                         palette_lookup);
 
-        int bits_per_entry = blockstates.payload.size() * 64 / (16 * 16 * 16);
-        bool ok = true;
-        for (size_t i = 0; i < 16 * 16 * 16; i++) {
-            if (section.block_ids[i] >= palette_blockstates.size()) {
-                LOG(ERROR) << "Incorrectly parsed palette ID " << section.block_ids[i]
-                           << " at index " << i << " (max is " << palette_blockstates.size() - 1
-                           << " with " << bits_per_entry << " bits per entry)";
-                ok = false;
-                break;
-            }
-            section.block_ids[i] = palette_lookup[section.block_ids[i]];
-        }
-        if (!ok) {
+        // create a ChunkSection-object
+        ChunkSection section(section_tag.y);
+        PackedFormat format = data_version >= 2529 ? PackedFormat::PADDED : PackedFormat::SPANNING;
+        if (!readBlockStates(format, section_tag.block_states.data, palette_lookup, section))
             continue;
-        }
 
-        if (section_tag.hasArray<nbt::TagByteArray>("BlockLight", 2048)) {
-            const nbt::TagByteArray &block_light =
-                section_tag.findTag<nbt::TagByteArray>("BlockLight");
-            std::copy(block_light.payload.begin(), block_light.payload.end(), section.block_light);
-        } else {
-            std::fill(&section.block_light[0], &section.block_light[2048], 0);
-        }
-        if (section_tag.hasArray<nbt::TagByteArray>("SkyLight", 2048)) {
-            const nbt::TagByteArray &sky_light = section_tag.findTag<nbt::TagByteArray>("SkyLight");
-            std::copy(sky_light.payload.begin(), sky_light.payload.end(), section.sky_light);
-        } else {
-            std::fill(&section.sky_light[0], &section.sky_light[2048], 0);
-        }
-
-        // add this section to the section list
-        section_offsets[section.y - CHUNK_LOW] = sections.size();
-        sections.push_back(section);
+        readLight(section_tag.has_block_light, section_tag.block_light, section, 0);
+        readLight(section_tag.has_sky_light, section_tag.sky_light, section, 1);
+        data.addSection(std::move(section));
     }
 
+    data.computeHeights();
     return true;
 }
 
-bool Chunk::simulateSunLight() const { return (this->chunk_status != "full"); }
+bool Chunk::simulateSunLight() const { return data->status != "full"; }
 
-bool Chunk::readNBT118(mc::BlockStateRegistry &block_registry, const nbt::NBTFile &nbt) {
-    int data_version = nbt.findTag<nbt::TagInt>("DataVersion").payload;
-    if (data_version < 2860) {
+bool Chunk::readNBT118(mc::BlockStateRegistry &block_registry, nbt::NBTReader &reader,
+                       const NBTTags &root, ChunkData &data, std::vector<RawSign> *signs) {
+    if (root.data_version < 2860) {
         throw new std::logic_error("readNBT118 needs data version >= 2860");
     }
 
     // then find x/z pos of the chunk
-    if (!nbt.hasTag<nbt::TagInt>("xPos") || !nbt.hasTag<nbt::TagInt>("zPos")) {
+    if (!root.has_x || !root.has_z) {
         LOG(ERROR) << "Corrupt chunk: No x/z position found!";
         return false;
     }
-    chunkpos_original = ChunkPos(nbt.findTag<nbt::TagInt>("xPos").payload,
-                                 nbt.findTag<nbt::TagInt>("zPos").payload);
-    chunkpos = chunkpos_original;
-    if (rotation)
-        chunkpos.rotate(rotation);
+    data.pos = ChunkPos(root.x, root.z);
 
-    // now we have the original chunk position:
-    // check whether this chunk is completely contained within the cropped world
-    chunk_completely_contained = world_crop.isChunkCompletelyContained(chunkpos_original);
+    // the signs are collected for the markers while the chunk is read anyways
+    if (signs != nullptr && root.has_block_entities)
+        readSigns(reader, root.block_entities, *signs);
 
-    if (!nbt.hasTag<nbt::TagString>("Status")) {
+    if (!root.has_status) {
         return true;
     }
 
-    chunk_status = nbt.findTag<nbt::TagString>("Status").payload;
+    data.status = std::string(root.status);
 
     // find sections list
     // ignore it if section list does not exist, can happen sometimes with the empty
     // chunks of the end
-    if (!nbt.hasList<nbt::TagCompound>("sections"))
+    if (!root.has_sections || root.sections.tag_type != nbt::TagCompound::TAG_TYPE)
         return true;
 
-    const nbt::TagList &sections_tag = nbt.findTag<nbt::TagList>("sections");
-    if (sections_tag.tag_type != nbt::TagCompound::TAG_TYPE)
-        return true;
+    std::vector<uint16_t> palette_lookup;
+    std::vector<uint32_t> biome_lookup;
 
-    for (auto it = sections_tag.payload.begin(); it != sections_tag.payload.end(); ++it) {
-        const nbt::TagCompound &section_tag = (*it)->cast<nbt::TagCompound>();
+    size_t section_offset = root.sections.offset;
+    for (int32_t s = 0; s < root.sections.size; s++) {
+        SectionTags section_tag;
+        reader.seek(section_offset);
+        section_tag.read(reader);
+        section_offset = reader.tell();
 
         // make sure section is valid
-        if (!section_tag.hasTag<nbt::TagByte>("Y"))
+        if (!section_tag.has_y)
             continue;
 
-        const nbt::TagByte &y = section_tag.findTag<nbt::TagByte>("Y");
-        if (y.payload < CHUNK_LOW || y.payload >= CHUNK_TOP)
+        if (section_tag.y < CHUNK_LOW || section_tag.y >= CHUNK_TOP)
             continue;
 
-        if (!section_tag.hasTag<nbt::TagCompound>("block_states"))
+        if (!section_tag.has_block_states)
             continue;
 
-        if (section_tag.hasTag<nbt::TagCompound>("biomes")) {
-            const auto &biomes_tag = section_tag.findTag<nbt::TagCompound>("biomes");
-            const nbt::TagList &palette = biomes_tag.findTag<nbt::TagList>("palette");
+        if (section_tag.has_biomes) {
+            const PalettedContainer &biomes_tag = section_tag.biomes;
+            if (!biomes_tag.has_palette)
+                throw nbt::TagNotFound("Tag 'palette' not found!");
+            readBiomePalette(reader, biomes_tag.palette, biome_lookup);
+
             const int biomes_per_section = 64; // 4 * 4 * 4
-            int biomes_base_index = (y.payload - CHUNK_LOW) * biomes_per_section;
-
-            if (biomes_tag.hasTag<nbt::TagLongArray>("data")) {
-                const auto &biomes_data = biomes_tag.findTag<nbt::TagLongArray>("data");
-                // std::cout << "biomes data for section x=" << chunkpos.x << " z=" << chunkpos.z
-                //           << " y=" << (int)y.payload << ":\n";
-                // for (const auto &value : biomes_data.payload) {
-                //     std::cout << "    " << value << "\n";
-                // }
+            int biomes_base_index = (section_tag.y - CHUNK_LOW) * biomes_per_section;
+
+            if (biomes_tag.has_data && !biomes_tag.data.empty()) {
+                const nbt::ArrayView<int64_t> &biome_data = biomes_tag.data;
+                int bits = getPackedBits(PackedFormat::PADDED, biome_lookup.size(), 1,
+                                         biome_data.size, biomes_per_section);
+                UnpackFunction unpack =
+                    getUnpackFunction(PackedFormat::PADDED, bits, biomes_per_section);
+                if (unpack == nullptr) {
+                    LOG(ERROR) << "Invalid biomes with " << biome_data.size << " longs for "
+                               << biome_lookup.size() << " palette entries";
+                    continue;
+                }
                 std::array<uint16_t, biomes_per_section> biome_palette;
-                readPackedShorts_v116(biomes_data.payload, biome_palette);
-                // for (auto v : section_biomes) {
-                //     std::cout << "  decoded value: " << v << "\n";
-                // }
+                unpack(biome_data.data, getIdentityLookup(), biome_palette.data());
                 for (int i = 0; i < biomes_per_section; i++) {
                     uint16_t palette_index = biome_palette.at(i);
-                    if (palette_index >= palette.payload.size()) {
+                    if (palette_index >= biome_lookup.size()) {
                         // still no clue how this happens, let's ignore for now
-                        // std::cout << "x=" << chunkpos.x << " z=" << chunkpos.z
-                        //           << " y=" << (int)y.payload << "\n";
                         continue;
                     }
-                    // std::cout << "palette_index: " << palette_index << " "
-                    //           << "palette_size: " << palette.payload.size() << "\n";
-
-                    std::string biome_name =
-                        palette.payload.at(palette_index)->cast<nbt::TagString>().payload;
-                    auto it = biome_resource_ids.find(biome_name);
-                    uint32_t biome_id = 1; // minecraft:plains
-                    if (it != biome_resource_ids.end())
-                        biome_id = it->second;
-                    biomes[biomes_base_index + i] = biome_id;
+                    data.biomes[biomes_base_index + i] = biome_lookup[palette_index];
                 }
             } else {
-                std::string biome_name = palette.payload.at(0)->cast<nbt::TagString>().payload;
-                uint32_t biome_id = 1; // minecraft:plains
-                auto it = biome_resource_ids.find(biome_name);
-                if (it != biome_resource_ids.end())
-                    biome_id = it->second;
-                std::fill(biomes + biomes_base_index,
-                          biomes + biomes_base_index + biomes_per_section, biome_id);
+                if (biome_lookup.empty())
+                    throw nbt::NBTError("Empty biome palette!");
+                std::fill(data.biomes + biomes_base_index,
+                          data.biomes + biomes_base_index + biomes_per_section,
+                          biome_lookup[0]);
             }
         }
 
-        const auto &block_states = section_tag.findTag<nbt::TagCompound>("block_states");
-
-        const nbt::TagList &palette = block_states.findTag<nbt::TagList>("palette");
-        std::vector<mc::BlockState> palette_blockstates(palette.payload.size());
-        std::vector<uint16_t> palette_lookup(palette.payload.size());
-
-        size_t i = 0;
-        for (auto it2 = palette.payload.begin(); it2 != palette.payload.end(); ++it2, ++i) {
-            const nbt::TagCompound &entry = (*it2)->cast<nbt::TagCompound>();
-            const nbt::TagString &name = entry.findTag<nbt::TagString>("Name");
-
-            mc::BlockState block(name.payload);
-            if (entry.hasTag<nbt::TagCompound>("Properties")) {
-                const nbt::TagCompound &properties = entry.findTag<nbt::TagCompound>("Properties");
-                for (auto it3 = properties.payload.begin(); it3 != properties.payload.end();
-                     ++it3) {
-                    std::string key = it3->first;
-                    std::string value = it3->second->cast<nbt::TagString>().payload;
-                    if (block_registry.isKnownProperty(block.getName(), key)) {
-                        block.setProperty(key, value);
-                    }
-                }
-            }
-            palette_blockstates[i] = block;
-            palette_lookup[i] = block_registry.getBlockID(block);
-        }
+        const PalettedContainer &block_states = section_tag.block_states;
+        if (!block_states.has_palette)
+            throw nbt::TagNotFound("Tag 'palette' not found!");
+        readBlockPalette(block_registry, reader, block_states.palette, palette_lookup);
 
         // create a ChunkSection-object
-        ChunkSection section;
-        section.y = y.payload;
-        if (block_states.hasArray<nbt::TagLongArray>("data")) {
-            const nbt::TagLongArray &block_states_data =
-                block_states.findTag<nbt::TagLongArray>("data");
-
-            readPackedShorts_v116(block_states_data.payload, section.block_ids);
-
-            int bits_per_entry = block_states_data.payload.size() * 64 / (16 * 16 * 16);
-            bool ok = true;
-            for (size_t i = 0; i < 16 * 16 * 16; i++) {
-                if (section.block_ids[i] >= palette_blockstates.size()) {
-                    LOG(ERROR) << "Incorrectly parsed palette ID " << section.block_ids[i]
-                               << " at index " << i << " (max is " << palette_blockstates.size() - 1
-                               << " with " << bits_per_entry << " bits per entry)";
-                    ok = false;
-                    break;
-                }
-                section.block_ids[i] = palette_lookup[section.block_ids[i]];
-            }
-            if (!ok) {
+        ChunkSection section(section_tag.y);
+        if (block_states.has_data && !block_states.data.empty()) {
+            if (!readBlockStates(PackedFormat::PADDED, block_states.data, palette_lookup,
+                                 section))
                 continue;
-            }
         } else {
-            if (palette_lookup[0] == air_id)
+            if (palette_lookup.empty())
+                throw nbt::NBTError("Empty block palette!");
+            if (palette_lookup[0] == data.air_id)
                 continue;
-            section.block_ids.fill(palette_lookup[0]);
+            section.setBlockIDs(palette_lookup[0]);
         }
 
-        if (section_tag.hasArray<nbt::TagByteArray>("BlockLight", 2048)) {
-            const nbt::TagByteArray &block_light =
-                section_tag.findTag<nbt::TagByteArray>("BlockLight");
-            std::copy(block_light.payload.begin(), block_light.payload.end(), section.block_light);
-        } else {
-            std::fill(&section.block_light[0], &section.block_light[2048], 0);
-        }
-        if (section_tag.hasArray<nbt::TagByteArray>("SkyLight", 2048)) {
-            const nbt::TagByteArray &sky_light = section_tag.findTag<nbt::TagByteArray>("SkyLight");
-            std::copy(sky_light.payload.begin(), sky_light.payload.end(), section.sky_light);
-        } else {
-            std::fill(&section.sky_light[0], &section.sky_light[2048], 0);
-        }
+        readLight(section_tag.has_block_light, section_tag.block_light, section, 0);
+        readLight(section_tag.has_sky_light, section_tag.sky_light, section, 1);
+        data.addSection(std::move(section));
+    }
 
-        // add this section to the section list
-        section_offsets[section.y - CHUNK_LOW] = sections.size();
-        sections.push_back(section);
+    // the heightmaps are only complete in fully generated chunks, and they are relative to
+    // the bottom of the world, which must be the one we expect
+    bool full = data.status == "full" || data.status == "minecraft:full";
+    bool has_heightmap = false;
+    if (full && root.has_heightmaps && (!root.has_y || root.y == CHUNK_LOW)) {
+        int8_t type;
+        std::string_view name;
+        reader.seek(root.heightmaps);
+        while (reader.readTagHeader(type, name)) {
+            if (name == "WORLD_SURFACE" && type == nbt::TagLongArray::TAG_TYPE) {
+                has_heightmap = data.readHeightmap(reader.readLongArray());
+                break;
+            }
+            reader.skip(type);
+        }
     }
+    if (!has_heightmap)
+        data.computeHeights();
 
     return true;
 }
 
 bool Chunk::readNBT(mc::BlockStateRegistry &block_registry, const char *data, size_t len,
-                    nbt::Compression compression) {
+                    nbt::Compression compression, std::vector<RawSign> *signs) {
     clear();
 
-    air_id = block_registry.getBlockID(mc::BlockState("minecraft:air"));
+    std::shared_ptr<ChunkData> loaded = std::make_shared<ChunkData>();
+    loaded->air_id = block_registry.getBlockID(mc::BlockState("minecraft:air"));
+
+    // the buffer is reused, so decompressing doesn't allocate memory in the long run
+    thread_local nbt::ByteBuffer buffer;
+    nbt::decompress(data, len, compression, buffer);
 
-    nbt::NBTFile nbt;
-    nbt.readNBT(data, len, compression);
+    // only the tags required to render the chunk are read, everything else is skipped
+    nbt::NBTReader reader(buffer.data(), buffer.size());
+    reader.readRoot();
+    NBTTags root;
+    root.read(reader, "sections");
 
     // Make sure we know which data format this chunk is built of
-    if (!nbt.hasTag<nbt::TagInt>("DataVersion")) {
+    if (!root.has_data_version) {
         LOG(ERROR) << "Corrupt chunk: No version tag found!";
         return false;
     }
-    int data_version = nbt.findTag<nbt::TagInt>("DataVersion").payload;
-
-    // nbt.dump(std::cout);
 
+    bool ok;
     // 1.18 chunk format
-    if (data_version >= 2860)
-        return readNBT118(block_registry, nbt);
+    if (root.data_version >= 2860)
+        ok = readNBT118(block_registry, reader, root, *loaded, signs);
     // the previous code
-    return readNBT117(block_registry, nbt);
+    else
+        ok = readNBT117(block_registry, reader, root, *loaded, signs);
+    setChunkData(loaded);
+    return ok;
+}
+
+bool Chunk::getContentHash(const char *data, size_t len, nbt::Compression compression,
+                           uint64_t &hash) {
+    thread_local nbt::ByteBuffer buffer;
+    nbt::decompress(data, len, compression, buffer);
+
+    nbt::NBTReader reader(buffer.data(), buffer.size());
+    reader.readRoot();
+    NBTTags root;
+    root.read(reader, "sections");
+    if (!root.has_data_version)
+        return false;
+
+    // chunks before 1.18 have their tags in the level compound
+    NBTTags level;
+    const NBTTags *tags = &root;
+    if (root.data_version < 2860) {
+        if (!root.has_level)
+            return false;
+        reader.seek(root.level);
+        level.read(reader, "Sections");
+        tags = &level;
+    }
+    if (!tags->has_x || !tags->has_z)
+        return false;
+
+    // the raw data of the sections has everything rendered (blocks, light, biomes since
+    // 1.18), entities, block entities, timestamps etc. are not part of it
+    int32_t header[] = {root.data_version, tags->x, tags->z, tags->y};
+    hash = util::hashBytes(reinterpret_cast<const uint8_t *>(header), sizeof(header));
+    hash = util::hashBytes(reinterpret_cast<const uint8_t *>(tags->status.data()),
+                           tags->status.size(), hash);
+    if (tags->has_sections)
+        hash = util::hashBytes(reader.getData() + tags->sections.offset,
+                               tags->sections_end - tags->sections.offset, hash);
+    const nbt::ArrayView<int8_t> &bytes = tags->biomes_bytes;
+    const nbt::ArrayView<int32_t> &ints = tags->biomes_ints;
+    const nbt::ArrayView<int64_t> &longs = tags->biomes_longs;
+    hash = util::hashBytes(bytes.data, bytes.size, hash);
+    hash = util::hashBytes(ints.data, ints.size * sizeof(int32_t), hash);
+    hash = util::hashBytes(longs.data, longs.size * sizeof(int64_t), hash);
+    return true;
+}
+
+std::shared_ptr<const ChunkData> Chunk::getChunkData() const { return data; }
+
+void Chunk::setChunkData(std::shared_ptr<const ChunkData> data) {
+    this->data = data;
+    chunkpos = data->pos;
+    if (rotation)
+        chunkpos.rotate(rotation);
+
+    // check whether this chunk is completely contained within the cropped world
+    chunk_completely_contained = world_crop.isChunkCompletelyContained(data->pos);
 }
 
 void Chunk::clear() {
-    sections.clear();
-    for (size_t i = 0; i < sizeof(section_offsets) / sizeof(section_offsets[0]); i++)
-        section_offsets[i] = -1;
-    std::fill(biomes, biomes + 256, 21 /* DEFAULT_BIOME */);
+    // all empty chunks can share the same data
+    static const std::shared_ptr<const ChunkData> empty = std::make_shared<ChunkData>();
+    data = empty;
 }
 
 bool Chunk::hasSection(int section) const {
     return section >= CHUNK_LOW && section < CHUNK_TOP &&
-           section_offsets[section - CHUNK_LOW] != -1;
+           data->section_offsets[section - CHUNK_LOW] != -1;
+}
+
+int getStepsInChunk(const LocalBlockPos &pos, const BlockPos &dir) {
+    int steps = pos.y - CHUNK_LOW * 16 + 1;
+    if (dir.x != 0)
+        steps = std::min(steps, dir.x > 0 ? 16 - pos.x : pos.x + 1);
+    if (dir.z != 0)
+        steps = std::min(steps, dir.z > 0 ? 16 - pos.z : pos.z + 1);
+    return steps;
 }
 
 void rotateBlockPos(int &x, int &z, int rotation) {
@@ -602,8 +1013,8 @@ void rotateBlockPos(int &x, int &z, int rotation) {
 uint16_t Chunk::getBlockID(const LocalBlockPos &pos, bool force) const {
     // at first find out the section and check if it's valid and contained
     int section = pos.y >> 4;
-    if (section < CHUNK_LOW || section >= CHUNK_TOP || section_offsets[section - CHUNK_LOW] == -1)
-        return air_id;
+    if (!data->isSectionOccupied(section))
+        return data->air_id;
     // FIXME sometimes this happens, fix this
     // if (sections.size() > 16 || sections.size() <= (unsigned) section_offsets[section-CHUNK_LOW])
     // { 	return 0;
@@ -617,29 +1028,55 @@ uint16_t Chunk::getBlockID(const LocalBlockPos &pos, bool force) const {
 
     // check whether this block is really rendered
     if (!checkBlockWorldCrop(x, z, pos.y))
-        return air_id;
+        return data->air_id;
 
     // calculate the offset and get the block ID
     // and don't forget the add data
     int offset = ((pos.y & 15) * 16 + z) * 16 + x;
-    uint16_t id = sections[section_offsets[section - CHUNK_LOW]].block_ids[offset];
+    uint16_t id = data->sections[data->section_offsets[section - CHUNK_LOW]].getBlockID(offset);
     if (!force && world_crop.hasBlockMask()) {
         const BlockMask *mask = world_crop.getBlockMask();
         BlockMask::BlockState block_state = mask->getBlockState(id);
         if (block_state == BlockMask::BlockState::COMPLETELY_HIDDEN)
-            return air_id;
+            return data->air_id;
         else if (block_state == BlockMask::BlockState::COMPLETELY_SHOWN)
             return id;
         if (mask->isHidden(id, 0 /*getBlockData(pos, true)*/))
-            return air_id;
+            return data->air_id;
     }
     return id;
 }
 
+int Chunk::getHighestBlock(const LocalBlockPos &pos) const {
+    int x = pos.x;
+    int z = pos.z;
+    if (rotation)
+        rotateBlockPos(x, z, rotation);
+    return data->heights[z * 16 + x];
+}
+
+int Chunk::getHighestBlock() const { return data->highest_block; }
+
+int Chunk::getAirSteps(const LocalBlockPos &pos, const BlockPos &dir) const {
+    // rays straight down stay in their column, other rays may leave it with every step
+    bool column = dir.x == 0 && dir.z == 0;
+    int y = std::min(pos.y, column ? getHighestBlock(pos) : getHighestBlock());
+    // go down to the top of the next section with blocks
+    while (y >= CHUNK_LOW * 16 && !data->isSectionOccupied(y >> 4))
+        y = (y & ~15) - 1;
+
+    int steps = pos.y - y;
+    if (!column)
+        steps = std::min(steps, getStepsInChunk(pos, dir));
+    if (steps == 0 && pos.y > getHighestBlock(pos))
+        steps = 1;
+    return steps;
+}
+
 bool Chunk::checkBlockWorldCrop(int x, int z, int y) const {
     // now about the actual world cropping:
     // get the global position of the block, with the original world rotation
-    BlockPos global_pos = LocalBlockPos(x, z, y).toGlobalPos(chunkpos_original);
+    BlockPos global_pos = LocalBlockPos(x, z, y).toGlobalPos(data->pos);
     // check whether the block is contained in the y-bounds.
     if (!world_crop.isBlockContainedY(global_pos))
         return false;
@@ -652,7 +1089,7 @@ bool Chunk::checkBlockWorldCrop(int x, int z, int y) const {
 uint8_t Chunk::getData(const LocalBlockPos &pos, int array, bool force) const {
     // at first find out the section and check if it's valid and contained
     int section = pos.y >> 4;
-    if (section < CHUNK_LOW || section >= CHUNK_TOP || section_offsets[section - CHUNK_LOW] == -1) {
+    if (!hasSection(section)) {
         // not existing sections should always have skylight
         return array == 1 ? 15 : 0;
     }
@@ -668,22 +1105,17 @@ uint8_t Chunk::getData(const LocalBlockPos &pos, int array, bool force) const {
         return array == 1 ? 15 : 0;
     }
 
-    uint8_t data = 0;
     // calculate the offset and get the block data
     int offset = ((pos.y & 15) * 16 + z) * 16 + x;
-    // handle bottom/top nibble
-    if ((offset % 2) == 0)
-        data = sections[section_offsets[section - CHUNK_LOW]].getArray(array)[offset / 2] & 0xf;
-    else
-        data = (sections[section_offsets[section - CHUNK_LOW]].getArray(array)[offset / 2] >> 4) &
-               0x0f;
+    uint8_t value =
+        data->sections[data->section_offsets[section - CHUNK_LOW]].getLight(array, offset);
     if (!force && world_crop.hasBlockMask()) {
         const BlockMask *mask = world_crop.getBlockMask();
-        if (mask->isHidden(getBlockID(pos, true), data)) {
+        if (mask->isHidden(getBlockID(pos, true), value)) {
             return array == 1 ? 15 : 0;
         }
     }
-    return data;
+    return value;
 }
 
 uint8_t Chunk::getBlockLight(const LocalBlockPos &pos) const { return getData(pos, 0); }
@@ -691,18 +1123,251 @@ uint8_t Chunk::getBlockLight(const LocalBlockPos &pos) const { return getData(po
 uint8_t Chunk::getSkyLight(const LocalBlockPos &pos) const { return getData(pos, 1); }
 
 uint8_t Chunk::getBiomeAt(const LocalBlockPos &pos) const {
-    int x = pos.x / 4;
-    int z = pos.z / 4;
+    // rotate the block position, the biomes are stored for 4x4x4 blocks
+    int x = pos.x;
+    int z = pos.z;
     int y = (pos.y - CHUNK_LOW * 16) / 4;
     assert(y >= 0 && y < (CHUNK_TOP - CHUNK_LOW) * 16 / 4);
 
     if (rotation)
         rotateBlockPos(x, z, rotation);
 
-    return biomes[(y * 16 + (z * 4 + x))];
+    return data->biomes[(y * 16 + (z / 4 * 4 + x / 4))];
 }
 
 const ChunkPos &Chunk::getPos() const { return chunkpos; }
 
+size_t Chunk::getMemoryUsage() const {
+    // unordered_map nodes: key, value, next pointer and cached hash
+    size_t extra_data_node = sizeof(int) + sizeof(uint16_t) + 2 * sizeof(void *);
+    return sizeof(Chunk) + extra_data_map.size() * extra_data_node + data->getMemoryUsage();
+}
+
+bool ChunkData::readHeightmap(const nbt::ArrayView<int64_t> &heightmap) {
+    // the heightmap values are the y-coordinate above the highest block, relative to the
+    // bottom of the world, and have as many bits as required for all values
+    const int world_height = (CHUNK_TOP - CHUNK_LOW) * 16;
+    int bits = 1;
+    while ((1 << bits) <= world_height)
+        bits++;
+    if ((size_t)heightmap.size != getPackedLongs(PackedFormat::PADDED, bits, 16 * 16))
+        return false;
+
+    uint16_t values[16 * 16];
+    UnpackFunction unpack = getUnpackFunction(PackedFormat::PADDED, bits, 16 * 16);
+    if (unpack(heightmap.data, getIdentityLookup(), values) > world_height)
+        return false;
+
+    highest_block = CHUNK_LOW * 16 - 1;
+    for (int i = 0; i < 16 * 16; i++) {
+        heights[i] = CHUNK_LOW * 16 + values[i] - 1;
+        highest_block = std::max(highest_block, heights[i]);
+    }
+    return true;
+}
+
+void ChunkData::computeHeights() {
+    int columns_left = 16 * 16;
+    for (int section = CHUNK_TOP - 1; section >= CHUNK_LOW && columns_left > 0; section--) {
+        if (!isSectionOccupied(section))
+            continue;
+        const ChunkSection &chunk_section = sections[section_offsets[section - CHUNK_LOW]];
+        for (int i = 0; i < 16 * 16; i++) {
+            if (heights[i] >= CHUNK_LOW * 16)
+                continue;
+            int y = chunk_section.getHighestBlock(i % 16, i / 16, air_id);
+            if (y != -1) {
+                heights[i] = section * 16 + y;
+                highest_block = std::max(highest_block, heights[i]);
+                columns_left--;
+            }
+        }
+    }
+}
+
+namespace {
+
+template <typename T> void writeValues(std::ostream &out, const T *values, size_t count) {
+    out.write(reinterpret_cast<const char *>(values), sizeof(T) * count);
+}
+
+template <typename T> void writeValue(std::ostream &out, const T &value) {
+    writeValues(out, &value, 1);
+}
+
+void writeString(std::ostream &out, const std::string &str) {
+    writeValue<uint16_t>(out, str.size());
+    out.write(str.data(), str.size());
+}
+
+template <typename T> bool readValues(std::istream &in, T *values, size_t count) {
+    return (bool)in.read(reinterpret_cast<char *>(values), sizeof(T) * count);
+}
+
+template <typename T> bool readValue(std::istream &in, T &value) {
+    return readValues(in, &value, 1);
+}
+
+bool readString(std::istream &in, std::string &str) {
+    uint16_t size;
+    if (!readValue(in, size))
+        return false;
+    str.resize(size);
+    return (bool)in.read(&str[0], size);
+}
+
+} // namespace
+
+void ChunkSection::getUsedBlockIDs(std::vector<uint16_t> &block_ids) const {
+    if (bits == 0)
+        block_ids.push_back(uniform_id);
+    else if (bits < 16)
+        block_ids.insert(block_ids.end(), palette.begin(), palette.end());
+    else
+        for (int i = 0; i < 4096; i++)
+            block_ids.push_back(getBlockID(i));
+}
+
+void ChunkSection::write(std::ostream &out, const std::vector<uint16_t> &lookup) const {
+    writeValue(out, y);
+    writeValue<uint8_t>(out, bits);
+    if (bits == 0) {
+        writeValue(out, lookup[uniform_id]);
+    } else if (bits == 16) {
+        for (int i = 0; i < 4096; i++)
+            writeValue(out, lookup[getBlockID(i)]);
+    } else {
+        writeValue<uint16_t>(out, palette.size());
+        for (size_t i = 0; i < palette.size(); i++)
+            writeValue(out, lookup[palette[i]]);
+        writeValues(out, indices.data(), indices.size());
+    }
+
+    for (int array = 0; array < 2; array++) {
+        writeValue<uint8_t>(out, !light[array].empty());
+        if (light[array].empty())
+            writeValue(out, uniform_light[array]);
+        else
+            writeValues(out, light[array].data(), light[array].size());
+    }
+}
+
+bool ChunkSection::read(std::istream &in, const std::vector<uint16_t> &lookup) {
+    uint8_t read_bits;
+    if (!readValue(in, y) || !readValue(in, read_bits))
+        return false;
+
+    if (read_bits == 0 || read_bits == 16) {
+        std::vector<uint16_t> block_ids(read_bits == 0 ? 1 : 4096);
+        if (!readValues(in, block_ids.data(), block_ids.size()))
+            return false;
+        for (size_t i = 0; i < block_ids.size(); i++) {
+            if (block_ids[i] >= lookup.size())
+                return false;
+            block_ids[i] = lookup[block_ids[i]];
+        }
+        if (read_bits == 0)
+            setBlockIDs(block_ids[0]);
+        else
+            setBlockIDs(block_ids.data());
+    } else if (read_bits == 1 || read_bits == 2 || read_bits == 4 || read_bits == 8) {
+        uint16_t palette_size;
+        if (!readValue(in, palette_size) || palette_size > (1 << read_bits))
+            return false;
+        bits = read_bits;
+        mask = (1 << bits) - 1;
+        palette.resize(palette_size);
+        indices.resize(4096 * bits / 64);
+        if (!readValues(in, palette.data(), palette.size()) ||
+            !readValues(in, indices.data(), indices.size()))
+            return false;
+        for (size_t i = 0; i < palette.size(); i++) {
+            if (palette[i] >= lookup.size())
+                return false;
+            palette[i] = lookup[palette[i]];
+        }
+        // the indices must be valid palette indices
+        for (int i = 0; i < 4096; i++)
+            if (((indices[i * bits >> 6] >> (i * bits & 63)) & mask) >= palette_size)
+                return false;
+    } else {
+        return false;
+    }
+
+    for (int array = 0; array < 2; array++) {
+        uint8_t stored;
+        if (!readValue(in, stored))
+            return false;
+        if (stored) {
+            light[array].resize(2048);
+            if (!readValues(in, light[array].data(), light[array].size()))
+                return false;
+        } else {
+            light[array].clear();
+            if (!readValue(in, uniform_light[array]))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool ChunkData::write(std::ostream &out, const BlockStateRegistry &block_registry) const {
+    // the block states used in this chunk, the sections refer to them by index
+    std::vector<uint16_t> block_ids(1, air_id);
+    for (auto it = sections.begin(); it != sections.end(); ++it)
+        it->getUsedBlockIDs(block_ids);
+    std::sort(block_ids.begin(), block_ids.end());
+    block_ids.erase(std::unique(block_ids.begin(), block_ids.end()), block_ids.end());
+    std::vector<uint16_t> lookup(block_ids.back() + 1);
+    writeValue<uint32_t>(out, block_ids.size());
+    for (size_t i = 0; i < block_ids.size(); i++) {
+        lookup[block_ids[i]] = i;
+        const BlockState &block_state = block_registry.getBlockState(block_ids[i]);
+        writeString(out, block_state.getName());
+        writeString(out, block_state.getVariantDescription());
+    }
+
+    writeValue(out, pos.x);
+    writeValue(out, pos.z);
+    writeString(out, status);
+    writeValue(out, lookup[air_id]);
+    writeValue<uint32_t>(out, sections.size());
+    for (auto it = sections.begin(); it != sections.end(); ++it)
+        it->write(out, lookup);
+    writeValues(out, heights, 16 * 16);
+    writeValue(out, highest_block);
+    writeValues(out, biomes, BIOMES_ARRAY_SIZE);
+    return (bool)out;
+}
+
+bool ChunkData::read(std::istream &in, BlockStateRegistry &block_registry) {
+    uint32_t block_count;
+    if (!readValue(in, block_count) || block_count == 0 || block_count > 65536)
+        return false;
+    std::vector<uint16_t> lookup(block_count);
+    std::string name, variant;
+    for (uint32_t i = 0; i < block_count; i++) {
+        if (!readString(in, name) || !readString(in, variant))
+            return false;
+        lookup[i] = block_registry.getBlockID(BlockState::parse(name, variant));
+    }
+
+    uint16_t air_index;
+    uint32_t section_count;
+    if (!readValue(in, pos.x) || !readValue(in, pos.z) || !readString(in, status) ||
+        !readValue(in, air_index) || air_index >= block_count ||
+        !readValue(in, section_count) || section_count > CHUNK_TOP - CHUNK_LOW)
+        return false;
+    air_id = lookup[air_index];
+    for (uint32_t i = 0; i < section_count; i++) {
+        ChunkSection section;
+        if (!section.read(in, lookup) || section.y < CHUNK_LOW || section.y >= CHUNK_TOP)
+            return false;
+        addSection(std::move(section));
+    }
+    return readValues(in, heights, 16 * 16) && readValue(in, highest_block) &&
+           readValues(in, biomes, BIOMES_ARRAY_SIZE);
+}
+
 } // namespace mc
 } // namespace mapcrafter
@@ -21,45 +21,217 @@
 #define CHUNK_H_
 
 #include "nbt.h"
+#include "nbtreader.h"
 #include "pos.h"
 #include "worldcrop.h"
 
+#include <iostream>
+#include <memory>
 #include <stdint.h>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace mapcrafter {
 namespace mc {
 
 class BlockStateRegistry;
+struct RawSign;
 
 // chunk height in sections
 const int CHUNK_LOW = -64 / 16;
 const int CHUNK_TOP = 320 / 16;
 const int BIOMES_ARRAY_SIZE = 16 / 4 * 16 / 4 * ((CHUNK_TOP - CHUNK_LOW) * 16) / 4;
 
+static_assert(CHUNK_TOP - CHUNK_LOW <= 32, "occupied sections of a chunk must fit in 32 bits");
+
+/**
+ * Returns how many steps a ray of blocks can go from a position until it leaves the chunk
+ * of the position or the bottom of the world. The ray goes one block down with each step,
+ * and by -1, 0 or 1 in x- and z-direction (like the isometric (1, -1, -1) and top-down
+ * (0, 0, -1) rays).
+ */
+int getStepsInChunk(const LocalBlockPos &pos, const BlockPos &dir);
+
 /**
  * A 16x16x16 section of a chunk.
+ *
+ * To save memory, the block IDs are stored as bit-packed indices into a palette of the
+ * section (1, 2, 4 or 8 bits per block), or as a single value if all blocks are the
+ * same. Sections with more than 256 different blocks store the block IDs directly.
+ * Light arrays are stored only if not all of their values are the same.
+ *
+ * Blocks are indexed as (y * 16 + z) * 16 + x.
  */
-struct ChunkSection {
+class ChunkSection {
+  public:
+    ChunkSection(int8_t y = 0);
+
+    /**
+     * Sets the block IDs of all 16*16*16 blocks, or of all blocks to the same ID.
+     */
+    void setBlockIDs(const uint16_t *block_ids);
+    void setBlockIDs(uint16_t block_id);
+
+    /**
+     * Sets the block IDs of all blocks as indices into a palette of block IDs. The
+     * indices must be valid.
+     */
+    void setBlockIDs(const uint16_t *indices, const uint16_t *palette, size_t palette_size);
+
+    /**
+     * Sets a light array (0: block light, 1: sky light) from 2048 bytes with two 4-bit
+     * values each, or sets all light values to the same value.
+     */
+    void setLight(int array, const uint8_t *light);
+    void setLight(int array, uint8_t value);
+
+    /**
+     * Returns whether the section has only air and the light of not existing sections
+     * (no block light, full sky light), so it doesn't need to be stored at all.
+     */
+    bool isEmpty(uint16_t air_id) const;
+
+    /**
+     * Returns whether the section has blocks which are not air.
+     */
+    bool hasBlocks(uint16_t air_id) const;
+
+    /**
+     * Returns the y-coordinate (0 to 15) of the highest block in a column which is not
+     * air, or -1 if the column has only air.
+     */
+    int getHighestBlock(int x, int z, uint16_t air_id) const;
+
+    uint16_t getBlockID(int index) const {
+        if (bits == 0)
+            return uniform_id;
+        int bit = index * bits;
+        uint16_t value = (indices[bit >> 6] >> (bit & 63)) & mask;
+        return bits == 16 ? value : palette[value];
+    }
+
+    uint8_t getLight(int array, int index) const {
+        if (light[array].empty())
+            return uniform_light[array];
+        uint8_t value = light[array][index / 2];
+        return index % 2 == 0 ? value & 0x0f : value >> 4;
+    }
+
+    /**
+     * Appends the block IDs used in this section to a vector (maybe some more than once).
+     */
+    void getUsedBlockIDs(std::vector<uint16_t> &block_ids) const;
+
+    /**
+     * Writes the section to a stream with the block IDs translated by a lookup table, or
+     * reads it from one with the block IDs translated back. Reading returns false if the
+     * data is invalid.
+     */
+    void write(std::ostream &out, const std::vector<uint16_t> &lookup) const;
+    bool read(std::istream &in, const std::vector<uint16_t> &lookup);
+
+    /**
+     * Returns the approximate count of bytes this section occupies in memory.
+     */
+    size_t getMemoryUsage() const;
+
     int8_t y;
-    uint8_t block_light[16 * 16 * 8];
-    uint8_t sky_light[16 * 16 * 8];
-    std::array<uint16_t, 4096> block_ids;
-
-    inline const uint8_t *getArray(int index) const {
-        if (index == 0) {
-            return block_light;
-        } else {
-            return sky_light;
-        }
+
+  private:
+    // bits per block: 0 if all blocks are the same, 16 if the block IDs are stored
+    // directly, otherwise the width of the palette indices
+    int bits;
+    uint16_t mask;
+    uint16_t uniform_id;
+    std::vector<uint16_t> palette;
+    std::vector<uint64_t> indices;
+
+    // the light arrays, empty if all values are the uniform value
+    std::vector<uint8_t> light[2];
+    uint8_t uniform_light[2];
+};
+
+/**
+ * The decoded data of a chunk: its sections, the heights of its columns and its biomes,
+ * all in the original rotation of the world. It doesn't change once the chunk is loaded,
+ * so the chunks of all rotations and maps of a world can share it (see ChunkStore).
+ */
+struct ChunkData {
+    ChunkData();
+
+    /**
+     * Adds a section, unless it's empty.
+     */
+    void addSection(ChunkSection &&section);
+
+    /**
+     * Returns whether a section exists and has blocks which are not air.
+     */
+    bool isSectionOccupied(int section) const {
+        return section >= CHUNK_LOW && section < CHUNK_TOP &&
+               (occupied_sections & (1u << (section - CHUNK_LOW)));
     }
+
+    /**
+     * Reads the heights of the columns from the WORLD_SURFACE heightmap of a chunk.
+     * Returns false if there is no valid heightmap.
+     */
+    bool readHeightmap(const nbt::ArrayView<int64_t> &heightmap);
+
+    /**
+     * Sets the heights of the columns from the highest blocks of the sections, for chunks
+     * without usable heightmap.
+     */
+    void computeHeights();
+
+    /**
+     * Writes the data to a stream, with the block states as names and variants, so it can
+     * be read again with a different block state registry. Returns false if an error
+     * occured while writing.
+     */
+    bool write(std::ostream &out, const BlockStateRegistry &block_registry) const;
+
+    /**
+     * Reads the data written with the write method. Returns false if the data is
+     * invalid.
+     */
+    bool read(std::istream &in, BlockStateRegistry &block_registry);
+
+    /**
+     * Returns the approximate count of bytes this data occupies in memory.
+     */
+    size_t getMemoryUsage() const;
+
+    // the original position of the chunk
+    ChunkPos pos;
+    std::string status;
+    uint16_t air_id;
+
+    // the index of the chunk sections in the sections array
+    // or -1 if section does not exist
+    int section_offsets[CHUNK_TOP - CHUNK_LOW];
+    // the array with the sections, see indexes above
+    std::vector<ChunkSection> sections;
+    // bitmask of the sections with blocks which are not air (bit section - CHUNK_LOW)
+    uint32_t occupied_sections;
+
+    // the highest block which may not be air of each column as index z * 16 + x, and of
+    // the whole chunk
+    int16_t heights[16 * 16];
+    int16_t highest_block;
+
+    // the biomes in this chunk, as index y * 16 + z * 4 + x
+    uint32_t biomes[BIOMES_ARRAY_SIZE];
 };
 
 /**
  * This class represents a Minecraft Chunk and provides an read-only interface to chunk
  * data such as block IDs, block data values and block lighting data.
  *
- * To save memory, the class stores only the sections which exist in the NBT data.
+ * The decoded data of the chunk is in its original rotation, the chunk applies the
+ * rotation and the boundaries of the world when accessing it. To save memory, the data
+ * has only the sections which exist in the NBT data.
  */
 class Chunk {
   public:
@@ -78,10 +250,32 @@ class Chunk {
 
     /**
      * Reads the NBT data of the chunk from a buffer. You need to specify a compression
-     * type of the raw data.
+     * type of the raw data. If a vector for signs is specified, the signs of the chunk are
+     * read from its block entities as well.
      */
     bool readNBT(BlockStateRegistry &block_registry, const char *data, size_t len,
-                 nbt::Compression compression = nbt::Compression::ZLIB);
+                 nbt::Compression compression = nbt::Compression::ZLIB,
+                 std::vector<RawSign> *signs = nullptr);
+
+    /**
+     * Computes a hash of the parts of the NBT data of a chunk which are rendered (the
+     * sections with blocks, light and biomes), without entities, block entities,
+     * timestamps and so on. So the hash changes only if the rendered chunk may change.
+     * Returns false if the data is not a valid chunk, throws an NBTError like readNBT.
+     */
+    static bool getContentHash(const char *data, size_t len, nbt::Compression compression,
+                               uint64_t &hash);
+
+    /**
+     * Returns the decoded data of the chunk.
+     */
+    std::shared_ptr<const ChunkData> getChunkData() const;
+
+    /**
+     * Uses already decoded data (for example of the chunk in another rotation) instead of
+     * reading the NBT data. Set the rotation and world boundaries before.
+     */
+    void setChunkData(std::shared_ptr<const ChunkData> data);
 
     /**
      * Clears all loaded chunk data.
@@ -98,6 +292,28 @@ class Chunk {
      */
     uint16_t getBlockID(const LocalBlockPos &pos, bool force = false) const;
 
+    /**
+     * Returns the y-coordinate of the highest block of a column (local coordinates, the
+     * y-coordinate is ignored) which may not be air. Every block above it is air. Returns
+     * a y-coordinate below the world if the whole column is air.
+     */
+    int getHighestBlock(const LocalBlockPos &pos) const;
+
+    /**
+     * Returns the y-coordinate of the highest block of the whole chunk which may not be
+     * air, like getHighestBlock for every column.
+     */
+    int getHighestBlock() const;
+
+    /**
+     * Returns how many steps a ray of blocks through this chunk (starting at a position and
+     * going one block down with each step, see getStepsInChunk) can skip because they are
+     * air: Blocks above the highest block of the column or chunk, and blocks in sections
+     * without any blocks. The ray doesn't go beyond the chunk, returns 0 if the block at
+     * the position may not be air.
+     */
+    int getAirSteps(const LocalBlockPos &pos, const BlockPos &dir) const;
+
     /**
      * Returns the block light at a specific position (local coordinates).
      */
@@ -119,11 +335,16 @@ class Chunk {
      */
     const ChunkPos &getPos() const;
 
+    /**
+     * Returns the approximate count of bytes this chunk occupies in memory.
+     */
+    size_t getMemoryUsage() const;
+
     bool simulateSunLight() const;
 
   private:
-    // internal original chunk position and public chunk position (which may be rotated)
-    ChunkPos chunkpos, chunkpos_original;
+    // public chunk position (which may be rotated), the original one is in the data
+    ChunkPos chunkpos;
 
     // rotation and cropping of the world
     int rotation;
@@ -131,18 +352,7 @@ class Chunk {
     // whether the chunk is completely contained (according x- and z-coordinates, not y)
     bool chunk_completely_contained;
 
-    uint16_t air_id;
-
-    std::string chunk_status;
-
-    // the index of the chunk sections in the sections array
-    // or -1 if section does not exist
-    int section_offsets[CHUNK_TOP - CHUNK_LOW];
-    // the array with the sections, see indexes above
-    std::vector<ChunkSection> sections;
-
-    // the biomes in this chunk, as index y * 16 + z * 4 + x
-    uint32_t biomes[BIOMES_ARRAY_SIZE];
+    std::shared_ptr<const ChunkData> data;
 
     // extra_data (e.g. from attributes read from NBT data, like beds) are stored in this map
     std::unordered_map<int, uint16_t> extra_data_map;
@@ -165,9 +375,14 @@ class Chunk {
     void insertExtraData(const LocalBlockPos &pos, uint16_t extra_data);
     uint16_t getExtraData(const LocalBlockPos &pos, uint16_t default_value = 0) const;
 
-    bool readNBT117(BlockStateRegistry &block_registry, const nbt::NBTFile &nbt);
+    // the tags of a chunk compound required to load the chunk, see chunk.cpp
+    struct NBTTags;
+
+    bool readNBT117(BlockStateRegistry &block_registry, nbt::NBTReader &reader,
+                    const NBTTags &root, ChunkData &data, std::vector<RawSign> *signs);
 
-    bool readNBT118(BlockStateRegistry &block_registry, const nbt::NBTFile &nbt);
+    bool readNBT118(BlockStateRegistry &block_registry, nbt::NBTReader &reader,
+                    const NBTTags &root, ChunkData &data, std::vector<RawSign> *signs);
 };
 
 } // namespace mc
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunkneighborhood.h"
+
+#include "chunk.h"
+
+namespace mapcrafter {
+namespace mc {
+
+namespace {
+
+uint64_t getSectionKey(const ChunkPos &chunk, int section) {
+    return (uint64_t(chunk.x) & 0xffffff) | (uint64_t(chunk.z) & 0xffffff) << 24 |
+           (uint64_t(section - CHUNK_LOW) & 0xff) << 48;
+}
+
+} // namespace
+
+ChunkNeighborhood::Section::Section() : used(0), section(0), fields(0) {}
+
+ChunkNeighborhood::ChunkNeighborhood(WorldCache *world)
+    : world(world), current(nullptr), time(0) {
+    sections.reserve(CAPACITY);
+}
+
+Block ChunkNeighborhood::getBlock(const BlockPos &pos, int get) {
+    // this can happen when we check for the bottom block shadow edges
+    if (pos.y < CHUNK_LOW * 16)
+        return Block();
+
+    // the neighbors of the blocks of the current section are in its border
+    if (current != nullptr && (current->fields & get) == get) {
+        int x = pos.x - current->chunk.x * 16;
+        int z = pos.z - current->chunk.z * 16;
+        int y = pos.y - current->section * 16;
+        if (x >= -1 && x <= 16 && z >= -1 && z <= 16 && y >= -1 && y <= 16)
+            return getBlock(*current, pos, x, z, y, get);
+    }
+
+    const Section &section = getSection(pos, get);
+    return getBlock(section, pos, pos.x - section.chunk.x * 16, pos.z - section.chunk.z * 16,
+                    pos.y - section.section * 16, get);
+}
+
+void ChunkNeighborhood::getNeighbors6(const BlockPos &pos, Block neighbors[6], int get) {
+    // north, south, east, west, top, bottom
+    static const int offsets[6][3] = {{0, -1, 0}, {0, 1, 0},  {1, 0, 0},
+                                      {-1, 0, 0}, {0, 0, 1}, {0, 0, -1}};
+
+    const Section &section = getSection(pos, get);
+    int x = pos.x - section.chunk.x * 16;
+    int z = pos.z - section.chunk.z * 16;
+    int y = pos.y - section.section * 16;
+    for (int i = 0; i < 6; i++) {
+        const int *d = offsets[i];
+        BlockPos other(pos.x + d[0], pos.z + d[1], pos.y + d[2]);
+        neighbors[i] = getBlock(section, other, x + d[0], z + d[1], y + d[2], get);
+    }
+}
+
+void ChunkNeighborhood::getNeighbors26(const BlockPos &pos, Block neighbors[27], int get) {
+    const Section &section = getSection(pos, get);
+    int x = pos.x - section.chunk.x * 16;
+    int z = pos.z - section.chunk.z * 16;
+    int y = pos.y - section.section * 16;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                BlockPos other(pos.x + dx, pos.z + dz, pos.y + dy);
+                neighbors[((dy + 1) * 3 + dz + 1) * 3 + dx + 1] =
+                    getBlock(section, other, x + dx, z + dz, y + dy, get);
+            }
+        }
+    }
+}
+
+ChunkNeighborhood::Section &ChunkNeighborhood::getSection(const BlockPos &pos, int get) {
+    ChunkPos chunk(pos);
+    int section = pos.y >> 4;
+    if (current == nullptr || current->section != section || current->chunk != chunk) {
+        uint64_t key = getSectionKey(chunk, section);
+        auto it = section_indices.find(key);
+        if (it != section_indices.end()) {
+            current = &sections[it->second];
+        } else {
+            size_t index = sections.size();
+            if (index < CAPACITY) {
+                sections.emplace_back();
+            } else {
+                // replace the least recently used section
+                index = 0;
+                for (size_t i = 1; i < sections.size(); i++)
+                    if (sections[i].used < sections[index].used)
+                        index = i;
+                section_indices.erase(
+                    getSectionKey(sections[index].chunk, sections[index].section));
+            }
+            section_indices[key] = index;
+            current = &sections[index];
+            current->chunk = chunk;
+            current->section = section;
+            current->fields = 0;
+        }
+        current->used = ++time;
+    }
+
+    get &= GET_ID | GET_BIOME | GET_LIGHT;
+    if ((current->fields & get) != get)
+        readSection(*current, get & ~current->fields);
+    return *current;
+}
+
+void ChunkNeighborhood::readSection(Section &section, int get) {
+    if (get & GET_ID)
+        section.ids.resize(SIZE);
+    if (get & GET_BIOME)
+        section.biomes.resize(SIZE);
+    if (get & GET_BLOCK_LIGHT)
+        section.block_light.resize(SIZE);
+    if (get & GET_SKY_LIGHT)
+        section.sky_light.resize(SIZE);
+    section.columns.resize(WIDTH * WIDTH);
+
+    // copy the blocks of the section and its border from the (up to) nine chunks,
+    // with the x- and z-coordinates of the parts of the section in these chunks
+    const int begin[3] = {-1, 0, 16}, end[3] = {0, 16, 17};
+    for (int cx = 0; cx < 3; cx++) {
+        for (int cz = 0; cz < 3; cz++) {
+            ChunkPos chunk_pos(section.chunk.x + cx - 1, section.chunk.z + cz - 1);
+            const Chunk *chunk = world->getChunk(chunk_pos);
+            for (int z = begin[cz]; z < end[cz]; z++) {
+                for (int x = begin[cx]; x < end[cx]; x++) {
+                    section.columns[(z + 1) * WIDTH + x + 1] = chunk != nullptr;
+                    if (chunk == nullptr)
+                        continue;
+
+                    LocalBlockPos local(x & 15, z & 15, 0);
+                    for (int y = -1; y <= 16; y++) {
+                        local.y = section.section * 16 + y;
+                        if (local.y < CHUNK_LOW * 16)
+                            continue;
+                        int i = ((y + 1) * WIDTH + z + 1) * WIDTH + x + 1;
+                        if (get & GET_ID)
+                            section.ids[i] = chunk->getBlockID(local);
+                        if ((get & GET_BIOME) && local.y < CHUNK_TOP * 16)
+                            section.biomes[i] = chunk->getBiomeAt(local);
+                        if (get & GET_BLOCK_LIGHT)
+                            section.block_light[i] = chunk->getBlockLight(local);
+                        if (get & GET_SKY_LIGHT)
+                            section.sky_light[i] = chunk->getSkyLight(local);
+                    }
+                }
+            }
+        }
+    }
+    section.fields |= get;
+}
+
+Block ChunkNeighborhood::getBlock(const Section &section, const BlockPos &pos, int x, int z,
+                                  int y, int get) const {
+    if (pos.y < CHUNK_LOW * 16 || !section.columns[(z + 1) * WIDTH + x + 1])
+        return Block();
+
+    int i = ((y + 1) * WIDTH + z + 1) * WIDTH + x + 1;
+    Block block;
+    block.pos = pos;
+    if (get & GET_ID) {
+        block.id = section.ids[i];
+        block.fields_set |= GET_ID;
+    }
+    if (get & GET_BIOME) {
+        block.biome = section.biomes[i];
+        block.fields_set |= GET_BIOME;
+    }
+    if (get & GET_BLOCK_LIGHT) {
+        block.block_light = section.block_light[i];
+        block.fields_set |= GET_BLOCK_LIGHT;
+    }
+    if (get & GET_SKY_LIGHT) {
+        block.sky_light = section.sky_light[i];
+        block.fields_set |= GET_SKY_LIGHT;
+    }
+    return block;
+}
+
+} // namespace mc
+} // namespace mapcrafter
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNKNEIGHBORHOOD_H_
+#define CHUNKNEIGHBORHOOD_H_
+
+#include "pos.h"
+#include "worldcache.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace mapcrafter {
+namespace mc {
+
+class Chunk;
+
+/**
+ * A view of the blocks of a world cache to look up blocks together with their neighbors.
+ *
+ * The blocks are copied from the chunks one chunk section at a time: The block IDs, block
+ * light, sky light and biomes of a section and a one block wide border around it (from the
+ * neighbor sections and chunks) are stored in flat arrays with the rotation and boundaries
+ * of the world already applied. So a block in a section and all of its neighbors are
+ * looked up with plain array accesses. The recently used sections are cached, and every
+ * field of a section is copied only when it's required the first time.
+ *
+ * The blocks are exactly the same as the ones returned by WorldCache::getBlock.
+ */
+class ChunkNeighborhood {
+  public:
+    ChunkNeighborhood(WorldCache *world);
+
+    /**
+     * Returns a block with the requested fields (see WorldCache::getBlock).
+     */
+    Block getBlock(const BlockPos &pos, int get = GET_ID);
+
+    /**
+     * Returns the six direct neighbors of a block, in the order north, south, east, west,
+     * top, bottom.
+     */
+    void getNeighbors6(const BlockPos &pos, Block neighbors[6], int get = GET_ID);
+
+    /**
+     * Returns the 3x3x3 blocks around a block (the block itself and its 26 neighbors),
+     * the neighbor with the offset dx, dz, dy (-1 to 1) has the index
+     * ((dy + 1) * 3 + dz + 1) * 3 + dx + 1.
+     */
+    void getNeighbors26(const BlockPos &pos, Block neighbors[27], int get = GET_ID);
+
+  private:
+    // a section with a one block wide border, the blocks have the index
+    // ((y + 1) * WIDTH + z + 1) * WIDTH + x + 1 (x, z, y from -1 to 16)
+    static const int WIDTH = 16 + 2;
+    static const int SIZE = WIDTH * WIDTH * WIDTH;
+    // how many sections are cached at most, the least recently used one is replaced
+    static const size_t CAPACITY = 256;
+
+    struct Section {
+        Section();
+
+        // when the section was used the last time
+        uint64_t used;
+        ChunkPos chunk;
+        int section;
+        // which fields were already copied (GET_* flags)
+        int fields;
+        // whether the chunks of the columns exist
+        std::vector<bool> columns;
+        std::vector<uint16_t> ids;
+        std::vector<uint8_t> block_light, sky_light, biomes;
+    };
+
+    /**
+     * Returns the section with the block at a position in its interior (not in the border)
+     * and with the requested fields copied.
+     */
+    Section &getSection(const BlockPos &pos, int get);
+
+    /**
+     * Copies fields of a section from the chunks.
+     */
+    void readSection(Section &section, int get);
+
+    /**
+     * Returns a block of a section at a position relative to the section (x, z, y from -1
+     * to 16).
+     */
+    Block getBlock(const Section &section, const BlockPos &pos, int x, int z, int y,
+                   int get) const;
+
+    WorldCache *world;
+
+    // the cached sections, the indices of the sections by chunk position and section,
+    // and the section used last
+    std::vector<Section> sections;
+    std::unordered_map<uint64_t, size_t> section_indices;
+    Section *current;
+    uint64_t time;
+};
+
+} // namespace mc
+} // namespace mapcrafter
+
+#endif /* CHUNKNEIGHBORHOOD_H_ */
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunkstore.h"
+
+#include "../util.h"
+#include "blockstate.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace mapcrafter {
+namespace mc {
+
+namespace {
+
+// count of shards of the chunk store
+const int CHUNK_STORE_SHARDS = 64;
+
+// header of the files in the cache directory, the version must be increased when the
+// format of the chunk data changes
+const char CACHE_FILE_MAGIC[4] = {'M', 'C', 'C', 'D'};
+const uint32_t CACHE_FILE_VERSION = 1;
+
+} // namespace
+
+ChunkStore::ChunkStore(BlockStateRegistry &block_registry, size_t memory_budget,
+                       const fs::path &cache_dir)
+    : block_registry(block_registry), shard_memory_budget(memory_budget / CHUNK_STORE_SHARDS),
+      cache_dir(cache_dir), hits(0), misses(0), evictions(0) {
+    for (int i = 0; i < CHUNK_STORE_SHARDS; i++) {
+        shards.push_back(std::unique_ptr<Shard>(new Shard));
+        shards.back()->memory = 0;
+    }
+}
+
+ChunkStore::~ChunkStore() {}
+
+ChunkStore::Shard &ChunkStore::getShard(const ChunkPos &pos) {
+    return *shards[ChunkPosHash()(pos) % shards.size()];
+}
+
+std::shared_ptr<const ChunkData> ChunkStore::get(const std::string &region_filename,
+                                                 const ChunkPos &pos, uint32_t timestamp) {
+    {
+        Shard &shard = getShard(pos);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        auto it = shard.entries.find(pos);
+        if (it != shard.entries.end() && it->second.timestamp == timestamp &&
+            it->second.generation == block_registry.getGeneration()) {
+            // mark as most recently used
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_it);
+            hits++;
+            return it->second.data;
+        }
+    }
+
+    if (!cache_dir.empty()) {
+        std::shared_ptr<const ChunkData> data =
+            readCacheFile(getCacheFile(region_filename, pos), timestamp);
+        if (data && data->pos == pos) {
+            hits++;
+            return insert(pos, timestamp, data);
+        }
+    }
+    misses++;
+    return nullptr;
+}
+
+std::shared_ptr<const ChunkData> ChunkStore::put(const std::string &region_filename,
+                                                 const ChunkPos &pos, uint32_t timestamp,
+                                                 std::shared_ptr<const ChunkData> data) {
+    if (!cache_dir.empty())
+        writeCacheFile(getCacheFile(region_filename, pos), timestamp, *data);
+    return insert(pos, timestamp, data);
+}
+
+std::shared_ptr<const ChunkData> ChunkStore::insert(const ChunkPos &pos, uint32_t timestamp,
+                                                    std::shared_ptr<const ChunkData> data) {
+    uint64_t generation = block_registry.getGeneration();
+    Shard &shard = getShard(pos);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.entries.find(pos);
+    if (it != shard.entries.end()) {
+        Entry &entry = it->second;
+        if (entry.timestamp == timestamp && entry.generation == generation)
+            return entry.data;
+        // replace outdated data
+        shard.memory -= entry.memory;
+        shard.lru.erase(entry.lru_it);
+        shard.entries.erase(it);
+    }
+
+    Entry &entry = shard.entries[pos];
+    entry.data = data;
+    entry.timestamp = timestamp;
+    entry.generation = generation;
+    entry.memory = data->getMemoryUsage();
+    entry.lru_it = shard.lru.insert(shard.lru.begin(), pos);
+    shard.memory += entry.memory;
+
+    // evict least recently used chunks, but always keep the new one
+    while (shard.memory > shard_memory_budget && shard.lru.size() > 1) {
+        auto evicted = shard.entries.find(shard.lru.back());
+        shard.memory -= evicted->second.memory;
+        shard.entries.erase(evicted);
+        shard.lru.pop_back();
+        evictions++;
+    }
+    return data;
+}
+
+size_t ChunkStore::getMemoryUsage() const {
+    size_t memory = 0;
+    for (auto it = shards.begin(); it != shards.end(); ++it) {
+        std::lock_guard<std::mutex> guard((*it)->mutex);
+        memory += (*it)->memory;
+    }
+    return memory;
+}
+
+CacheStats ChunkStore::getStats() const {
+    CacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    return stats;
+}
+
+fs::path ChunkStore::getCacheFile(const std::string &region_filename,
+                                  const ChunkPos &pos) const {
+    // a hash of the region file path, so the cache directory doesn't need the structure
+    // of the world directories
+    uint64_t hash = util::hashBytes(reinterpret_cast<const uint8_t *>(region_filename.data()),
+                                    region_filename.size());
+    char region[17];
+    std::snprintf(region, sizeof(region), "%016llx", (unsigned long long)hash);
+    return cache_dir / region / (util::str(pos.x) + "." + util::str(pos.z) + ".chunk");
+}
+
+std::shared_ptr<const ChunkData> ChunkStore::readCacheFile(const fs::path &file,
+                                                           uint32_t timestamp) {
+    std::ifstream in(file.string(), std::ios::binary);
+    if (!in)
+        return nullptr;
+
+    char magic[4];
+    uint32_t version, file_timestamp;
+    uint64_t properties_hash;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char *>(&version), sizeof(version));
+    in.read(reinterpret_cast<char *>(&properties_hash), sizeof(properties_hash));
+    in.read(reinterpret_cast<char *>(&file_timestamp), sizeof(file_timestamp));
+    // the chunk data is only valid if the chunk hasn't changed and the block states were
+    // parsed the same way
+    if (!in || std::memcmp(magic, CACHE_FILE_MAGIC, 4) != 0 || version != CACHE_FILE_VERSION ||
+        properties_hash != block_registry.getKnownPropertiesHash() ||
+        file_timestamp != timestamp)
+        return nullptr;
+
+    std::shared_ptr<ChunkData> data = std::make_shared<ChunkData>();
+    if (!data->read(in, block_registry)) {
+        LOG(WARNING) << "Ignoring invalid chunk cache file " << file << ".";
+        return nullptr;
+    }
+    return data;
+}
+
+void ChunkStore::writeCacheFile(const fs::path &file, uint32_t timestamp,
+                                const ChunkData &data) {
+    boost::system::error_code error;
+    fs::create_directories(file.parent_path(), error);
+    if (error) {
+        LOG(WARNING) << "Unable to create chunk cache directory " << file.parent_path() << ": "
+                     << error.message();
+        return;
+    }
+
+    // write to a temporary file first, other threads may read the file in the meantime
+    std::ostringstream suffix;
+    suffix << ".tmp" << std::this_thread::get_id();
+    fs::path file_tmp = file.string() + suffix.str();
+    std::ofstream out(file_tmp.string(), std::ios::binary);
+    uint64_t properties_hash = block_registry.getKnownPropertiesHash();
+    out.write(CACHE_FILE_MAGIC, 4);
+    out.write(reinterpret_cast<const char *>(&CACHE_FILE_VERSION), sizeof(CACHE_FILE_VERSION));
+    out.write(reinterpret_cast<const char *>(&properties_hash), sizeof(properties_hash));
+    out.write(reinterpret_cast<const char *>(&timestamp), sizeof(timestamp));
+    bool ok = data.write(out, block_registry);
+    out.close();
+    if (ok && !out.fail())
+        fs::rename(file_tmp, file, error);
+    if (!ok || out.fail() || error) {
+        LOG(WARNING) << "Unable to write chunk cache file " << file << ".";
+        fs::remove(file_tmp, error);
+    }
+}
+
+} // namespace mc
+} // namespace mapcrafter
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNKSTORE_H_
+#define CHUNKSTORE_H_
+
+#include "chunk.h"
+#include "pos.h"
+#include "worldcache.h"
+
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace mc {
+
+class BlockStateRegistry;
+
+/**
+ * A store with the decoded data of the chunks of a world. The data is in the original
+ * rotation of the world, so the world caches of all render threads, rotations and maps of
+ * the world can share it, and a chunk is read from the region file and decoded roughly
+ * once per run.
+ *
+ * The store is split into shards (by chunk position), each shard has its own lock and
+ * evicts its least recently used chunks when it exceeds its part of the memory budget.
+ * The data of evicted chunks stays alive until no chunk uses it anymore.
+ *
+ * Optionally, the store also writes the decoded chunks to a cache directory, so chunks
+ * which haven't changed (according to the timestamps in the region files) don't need to
+ * be decoded again in the next run. The files of the cache directory are
+ * <region hash>/<x>.<z>.chunk, with the chunk data written by ChunkData::write.
+ *
+ * Since the block IDs depend on the block state registry, a store must only be used with
+ * one registry. Chunks decoded before known properties were added to the registry are not
+ * used anymore.
+ */
+class ChunkStore {
+  public:
+    ChunkStore(BlockStateRegistry &block_registry, size_t memory_budget,
+               const fs::path &cache_dir = "");
+    ~ChunkStore();
+
+    /**
+     * Returns the data of a chunk (original position) of a region file, or a null pointer
+     * if the store has no data of the chunk with this timestamp.
+     */
+    std::shared_ptr<const ChunkData> get(const std::string &region_filename,
+                                         const ChunkPos &pos, uint32_t timestamp);
+
+    /**
+     * Puts the data of a chunk into the store (and the cache directory). If another
+     * thread has put the same chunk into the store in the meantime, that data is
+     * returned, otherwise the given one.
+     */
+    std::shared_ptr<const ChunkData> put(const std::string &region_filename,
+                                         const ChunkPos &pos, uint32_t timestamp,
+                                         std::shared_ptr<const ChunkData> data);
+
+    /**
+     * Returns the count of bytes used by the chunks in memory.
+     */
+    size_t getMemoryUsage() const;
+
+    /**
+     * Returns the hit/miss/eviction statistics of the store. Chunks read from the cache
+     * directory count as hits.
+     */
+    CacheStats getStats() const;
+
+  private:
+    struct ChunkPosHash {
+        size_t operator()(const ChunkPos &pos) const {
+            return std::hash<int64_t>()((int64_t(pos.x) << 32) ^ uint32_t(pos.z));
+        }
+    };
+
+    struct Entry {
+        std::shared_ptr<const ChunkData> data;
+        uint32_t timestamp;
+        uint64_t generation;
+        size_t memory;
+        std::list<ChunkPos>::iterator lru_it;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<ChunkPos, Entry, ChunkPosHash> entries;
+        // least recently used chunks at the back
+        std::list<ChunkPos> lru;
+        size_t memory;
+    };
+
+    Shard &getShard(const ChunkPos &pos);
+
+    /**
+     * Puts chunk data into the memory of the store.
+     */
+    std::shared_ptr<const ChunkData> insert(const ChunkPos &pos, uint32_t timestamp,
+                                            std::shared_ptr<const ChunkData> data);
+
+    /**
+     * Returns the file of a chunk in the cache directory.
+     */
+    fs::path getCacheFile(const std::string &region_filename, const ChunkPos &pos) const;
+
+    /**
+     * Reads/writes the data of a chunk from/to the cache directory.
+     */
+    std::shared_ptr<const ChunkData> readCacheFile(const fs::path &file, uint32_t timestamp);
+    void writeCacheFile(const fs::path &file, uint32_t timestamp, const ChunkData &data);
+
+    BlockStateRegistry &block_registry;
+
+    size_t shard_memory_budget;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    fs::path cache_dir;
+
+    std::atomic<uint64_t> hits, misses, evictions;
+};
+
+} // namespace mc
+} // namespace mapcrafter
+
+#endif /* CHUNKSTORE_H_ */
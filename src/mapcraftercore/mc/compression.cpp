@@ -0,0 +1,325 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compression.h"
+
+#include "../config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+namespace mapcrafter {
+namespace mc {
+namespace nbt {
+
+namespace {
+
+// chunk data in region files is stored in sectors of 4KiB, the decompressed data of a
+// chunk is usually not larger than its sectors times this ratio
+const size_t REGION_SECTOR_SIZE = 4096;
+const size_t EXPECTED_RATIO = 8;
+
+// decompressed data larger than that is rejected
+const size_t MAX_DECOMPRESSED_SIZE = 256 * 1024 * 1024;
+
+// header of the LZ4 blocks written by lz4-java (LZ4BlockOutputStream):
+// magic, token (compression method | level), compressed size, decompressed size and
+// checksum, the integers little-endian
+const char LZ4_BLOCK_MAGIC[] = "LZ4Block";
+const size_t LZ4_BLOCK_MAGIC_LENGTH = 8;
+const size_t LZ4_BLOCK_HEADER_LENGTH = LZ4_BLOCK_MAGIC_LENGTH + 1 + 3 * 4;
+const uint8_t LZ4_METHOD_RAW = 0x10;
+const uint8_t LZ4_METHOD_LZ4 = 0x20;
+
+const char *getCompressionName(Compression compression) {
+    if (compression == Compression::LZ4)
+        return "LZ4";
+    return compression == Compression::GZIP ? "gzip" : "zlib";
+}
+
+NBTError decompressionError(Compression compression, const std::string &message) {
+    return NBTError(std::string("Error while decompressing ") + getCompressionName(compression) +
+                    " data: " + message);
+}
+
+/**
+ * Resizes the buffer to the expected size of the decompressed data. That's the size
+ * gzip data stores in its trailer, otherwise an estimation from the count of sectors
+ * the data occupies in a region file. The buffer isn't shrinked below its capacity.
+ */
+void prepareBuffer(const char *data, size_t len, Compression compression, ByteBuffer &buffer) {
+    size_t sectors = (len + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+    size_t size = std::max<size_t>(sectors, 1) * REGION_SECTOR_SIZE * EXPECTED_RATIO;
+    if (compression == Compression::GZIP && len >= 18) {
+        const uint8_t *isize = reinterpret_cast<const uint8_t *>(data + len - 4);
+        size = std::max<size_t>(size, isize[0] | (isize[1] << 8) | (isize[2] << 16) |
+                                          (uint32_t(isize[3]) << 24));
+    }
+    buffer.resize(std::min(std::max(size, buffer.capacity()), MAX_DECOMPRESSED_SIZE));
+}
+
+uint32_t readLittleEndian32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+/**
+ * Decompresses a raw LZ4 block into a buffer of the size of the decompressed data.
+ * Returns false if the block is malformed.
+ */
+bool decompressLZ4Block(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len) {
+    const uint8_t *ip = src, *iend = src + src_len;
+    uint8_t *op = dst, *oend = dst + dst_len;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        // literals
+        size_t length = token >> 4;
+        if (length == 15) {
+            uint8_t b;
+            do {
+                if (ip == iend)
+                    return false;
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        if (length > size_t(iend - ip) || length > size_t(oend - op))
+            return false;
+        std::memcpy(op, ip, length);
+        ip += length;
+        op += length;
+
+        // the last sequence has only literals
+        if (ip == iend)
+            break;
+
+        // match: offset and length
+        if (iend - ip < 2)
+            return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > size_t(op - dst))
+            return false;
+        length = token & 15;
+        if (length == 15) {
+            uint8_t b;
+            do {
+                if (ip == iend)
+                    return false;
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        length += 4;
+        if (length > size_t(oend - op))
+            return false;
+        // the match may overlap with the bytes it produces
+        const uint8_t *match = op - offset;
+        for (size_t i = 0; i < length; i++)
+            op[i] = match[i];
+        op += length;
+    }
+    return op == oend;
+}
+
+/**
+ * Decompresses the LZ4 blocks Minecraft writes (with lz4-java) into a buffer.
+ */
+void decompressLZ4(const char *data, size_t len, ByteBuffer &buffer) {
+    const uint8_t *ip = reinterpret_cast<const uint8_t *>(data);
+    const uint8_t *iend = ip + len;
+
+    buffer.clear();
+    while (iend - ip >= (std::ptrdiff_t)LZ4_BLOCK_HEADER_LENGTH) {
+        if (std::memcmp(ip, LZ4_BLOCK_MAGIC, LZ4_BLOCK_MAGIC_LENGTH) != 0)
+            throw decompressionError(Compression::LZ4, "Invalid block header");
+        uint8_t method = ip[LZ4_BLOCK_MAGIC_LENGTH] & 0xf0;
+        uint32_t compressed_size = readLittleEndian32(ip + LZ4_BLOCK_MAGIC_LENGTH + 1);
+        uint32_t size = readLittleEndian32(ip + LZ4_BLOCK_MAGIC_LENGTH + 5);
+        ip += LZ4_BLOCK_HEADER_LENGTH;
+
+        // an empty block marks the end of the stream
+        if (size == 0)
+            break;
+        if (compressed_size > size_t(iend - ip))
+            throw decompressionError(Compression::LZ4, "Unexpected end of data");
+        if (buffer.size() + size > MAX_DECOMPRESSED_SIZE)
+            throw decompressionError(Compression::LZ4, "Decompressed data too large");
+
+        size_t written = buffer.size();
+        buffer.resize(written + size);
+        if (method == LZ4_METHOD_RAW) {
+            if (compressed_size != size)
+                throw decompressionError(Compression::LZ4, "Invalid block size");
+            std::memcpy(buffer.data() + written, ip, size);
+        } else if (method == LZ4_METHOD_LZ4) {
+            if (!decompressLZ4Block(ip, compressed_size, buffer.data() + written, size))
+                throw decompressionError(Compression::LZ4, "Invalid data");
+        } else {
+            throw decompressionError(Compression::LZ4, "Unknown compression method");
+        }
+        ip += compressed_size;
+    }
+}
+
+class ZlibDecompressor : public Decompressor {
+  public:
+    ZlibDecompressor() {
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        stream.next_in = Z_NULL;
+        stream.avail_in = 0;
+        // detect zlib/gzip header automatically
+        if (inflateInit2(&stream, 15 + 32) != Z_OK)
+            throw NBTError("Unable to initialize zlib!");
+    }
+
+    ~ZlibDecompressor() { inflateEnd(&stream); }
+
+    const char *getName() const { return "zlib"; }
+
+  protected:
+    void inflate(const char *data, size_t len, Compression compression, ByteBuffer &buffer) {
+        inflateReset(&stream);
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        stream.avail_in = len;
+
+        size_t written = 0;
+        while (true) {
+            stream.next_out = buffer.data() + written;
+            stream.avail_out = buffer.size() - written;
+            int ret = ::inflate(&stream, Z_NO_FLUSH);
+            written = buffer.size() - stream.avail_out;
+            if (ret == Z_STREAM_END)
+                break;
+            if (ret != Z_OK && ret != Z_BUF_ERROR)
+                throw decompressionError(compression,
+                                         std::string(stream.msg != Z_NULL ? stream.msg
+                                                                          : "Invalid data") +
+                                             " (" + util::str(ret) + ")");
+            if (stream.avail_out == 0)
+                growBuffer(compression, buffer);
+            else if (stream.avail_in == 0)
+                throw decompressionError(compression, "Unexpected end of data");
+        }
+        buffer.resize(written);
+    }
+
+  private:
+    z_stream stream;
+};
+
+#ifdef HAVE_LIBDEFLATE
+
+class LibdeflateDecompressor : public Decompressor {
+  public:
+    LibdeflateDecompressor() : decompressor(libdeflate_alloc_decompressor()) {
+        if (decompressor == nullptr)
+            throw NBTError("Unable to initialize libdeflate!");
+    }
+
+    ~LibdeflateDecompressor() { libdeflate_free_decompressor(decompressor); }
+
+    const char *getName() const { return "libdeflate"; }
+
+  protected:
+    void inflate(const char *data, size_t len, Compression compression, ByteBuffer &buffer) {
+        while (true) {
+            size_t written = 0;
+            libdeflate_result result;
+            if (compression == Compression::GZIP)
+                result = libdeflate_gzip_decompress(decompressor, data, len, buffer.data(),
+                                                    buffer.size(), &written);
+            else
+                result = libdeflate_zlib_decompress(decompressor, data, len, buffer.data(),
+                                                    buffer.size(), &written);
+
+            if (result == LIBDEFLATE_SUCCESS) {
+                buffer.resize(written);
+                return;
+            }
+            if (result != LIBDEFLATE_INSUFFICIENT_SPACE)
+                throw decompressionError(compression, "Invalid data (" +
+                                                          util::str(static_cast<int>(result)) +
+                                                          ")");
+            growBuffer(compression, buffer);
+        }
+    }
+
+  private:
+    libdeflate_decompressor *decompressor;
+};
+
+#endif
+
+} // namespace
+
+Decompressor::~Decompressor() {}
+
+void Decompressor::decompress(const char *data, size_t len, Compression compression,
+                              ByteBuffer &buffer) {
+    if (compression == Compression::NO_COMPRESSION) {
+        buffer.assign(data, data + len);
+    } else if (compression == Compression::LZ4) {
+        decompressLZ4(data, len, buffer);
+    } else {
+        prepareBuffer(data, len, compression, buffer);
+        inflate(data, len, compression, buffer);
+    }
+}
+
+void Decompressor::growBuffer(Compression compression, ByteBuffer &buffer) {
+    if (buffer.size() >= MAX_DECOMPRESSED_SIZE)
+        throw decompressionError(compression, "Decompressed data too large");
+    buffer.resize(std::min(buffer.size() * 2, MAX_DECOMPRESSED_SIZE));
+}
+
+std::vector<std::string> getDecompressors() {
+    std::vector<std::string> decompressors;
+#ifdef HAVE_LIBDEFLATE
+    decompressors.push_back("libdeflate");
+#endif
+    decompressors.push_back("zlib");
+    return decompressors;
+}
+
+std::unique_ptr<Decompressor> createDecompressor(const std::string &name) {
+#ifdef HAVE_LIBDEFLATE
+    if (name.empty() || name == "libdeflate")
+        return std::unique_ptr<Decompressor>(new LibdeflateDecompressor());
+#endif
+    if (name.empty() || name == "zlib")
+        return std::unique_ptr<Decompressor>(new ZlibDecompressor());
+    return nullptr;
+}
+
+void decompress(const char *data, size_t len, Compression compression, ByteBuffer &buffer) {
+    thread_local std::unique_ptr<Decompressor> decompressor = createDecompressor();
+    decompressor->decompress(data, len, compression, buffer);
+}
+
+} // namespace nbt
+} // namespace mc
+} // namespace mapcrafter
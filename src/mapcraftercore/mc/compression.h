@@ -0,0 +1,123 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSION_H_
+#define COMPRESSION_H_
+
+#include "nbt.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mapcrafter {
+namespace mc {
+namespace nbt {
+
+/**
+ * An allocator which default-initializes elements instead of value-initializing them.
+ * Resizing a vector of bytes with it leaves the new bytes uninitialized, which is what
+ * we want for buffers that are overwritten anyway.
+ */
+template <typename T> class UninitializedAllocator : public std::allocator<T> {
+  public:
+    template <typename U> struct rebind { typedef UninitializedAllocator<U> other; };
+
+    UninitializedAllocator() noexcept {}
+    template <typename U> UninitializedAllocator(const UninitializedAllocator<U> &) noexcept {}
+
+    template <typename U> void construct(U *p) { ::new (static_cast<void *>(p)) U; }
+    template <typename U, typename... Args> void construct(U *p, Args &&...args) {
+        ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+/**
+ * A buffer for decompressed data.
+ */
+typedef std::vector<uint8_t, UninitializedAllocator<uint8_t>> ByteBuffer;
+
+/**
+ * Decompresses NBT data in one go. A decompressor can be reused, but must not be used by
+ * multiple threads at the same time.
+ *
+ * Every implementation uses a different library for zlib/gzip data, LZ4 data (as written
+ * by Minecraft, blocks of LZ4 data with the header of lz4-java) is decompressed by all
+ * decompressors the same way.
+ */
+class Decompressor {
+  public:
+    virtual ~Decompressor();
+
+    /**
+     * Returns the name of the decompression library used.
+     */
+    virtual const char *getName() const = 0;
+
+    /**
+     * Decompresses data into a buffer. The buffer is resized to the size of the
+     * decompressed data, but its capacity is reused, so decompressing into the same
+     * buffer again and again doesn't allocate memory after a while.
+     *
+     * Throws an NBTError if the data can't be decompressed.
+     */
+    void decompress(const char *data, size_t len, Compression compression, ByteBuffer &buffer);
+
+  protected:
+    /**
+     * Decompresses zlib/gzip data. The buffer is already resized to the expected size
+     * of the decompressed data, use growBuffer if the data doesn't fit into it.
+     */
+    virtual void inflate(const char *data, size_t len, Compression compression,
+                         ByteBuffer &buffer) = 0;
+
+    /**
+     * Doubles the size of the buffer. Throws an NBTError if the buffer is too large
+     * already, so corrupted data doesn't make us run out of memory.
+     */
+    void growBuffer(Compression compression, ByteBuffer &buffer);
+};
+
+/**
+ * Returns the names of the available decompressors, the fastest one first.
+ */
+std::vector<std::string> getDecompressors();
+
+/**
+ * Creates a decompressor by name (see getDecompressors), or the fastest available one
+ * if no name is specified. Returns a nullptr if there is no decompressor with that name.
+ */
+std::unique_ptr<Decompressor> createDecompressor(const std::string &name = "");
+
+/**
+ * Decompresses data into a buffer with the fastest available decompressor. Every
+ * thread has its own decompressor instance.
+ *
+ * Throws an NBTError if the data can't be decompressed.
+ */
+void decompress(const char *data, size_t len, Compression compression, ByteBuffer &buffer);
+
+} // namespace nbt
+} // namespace mc
+} // namespace mapcrafter
+
+#endif /* COMPRESSION_H_ */
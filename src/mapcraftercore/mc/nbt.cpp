@@ -19,10 +19,14 @@
 
 #include "nbt.h"
 
+#include "compression.h"
+
 #include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/stream.hpp>
 #include <fstream>
 
 namespace mapcrafter {
@@ -334,6 +338,9 @@ void NBTFile::decompressStream(std::istream &stream, std::stringstream &decompre
         in.push(boost::iostreams::gzip_decompressor());
     } else if (compression == Compression::ZLIB) {
         in.push(boost::iostreams::zlib_decompressor());
+    } else {
+        // LZ4 is only used for chunk data, which is decompressed from buffers
+        throw NBTError("Unable to decompress LZ4 data from a stream!");
     }
     try {
         in.push(stream);
@@ -350,6 +357,10 @@ void NBTFile::decompressStream(std::istream &stream, std::stringstream &decompre
 void NBTFile::readCompressed(std::istream &stream, Compression compression) {
     std::stringstream decompressed(std::ios::in | std::ios::out | std::ios::binary);
     decompressStream(stream, decompressed, compression);
+    readDecompressed(decompressed);
+}
+
+void NBTFile::readDecompressed(std::istream &decompressed) {
     int8_t type = ((TagByte &)TagByte().read(decompressed)).payload;
     if (type != TagCompound::TAG_TYPE)
         throw NBTError("First tag is not a tag compound!");
@@ -371,9 +382,11 @@ void NBTFile::readNBT(const char *filename, Compression compression) {
 }
 
 void NBTFile::readNBT(const char *buffer, size_t len, Compression compression) {
-    std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
-    stream.write(buffer, len);
-    readCompressed(stream, compression);
+    ByteBuffer decompressed;
+    decompress(buffer, len, compression, decompressed);
+    boost::iostreams::stream<boost::iostreams::array_source> stream(
+        reinterpret_cast<const char *>(decompressed.data()), decompressed.size());
+    readDecompressed(stream);
 }
 
 void NBTFile::writeNBT(std::ostream &stream, Compression compression) {
@@ -383,6 +396,8 @@ void NBTFile::writeNBT(std::ostream &stream, Compression compression) {
         out.push(boost::iostreams::gzip_compressor());
     } else if (compression == Compression::ZLIB) {
         out.push(boost::iostreams::zlib_compressor());
+    } else if (compression == Compression::LZ4) {
+        throw NBTError("Writing LZ4 compressed NBT data is not supported!");
     } else {
         write(stream);
         return;
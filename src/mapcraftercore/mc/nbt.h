@@ -69,7 +69,7 @@ enum class TagType : int8_t {
     TAG_LONG_ARRAY = 12,
 };
 
-enum class Compression { NO_COMPRESSION = 0, GZIP = 1, ZLIB = 2 };
+enum class Compression { NO_COMPRESSION = 0, GZIP = 1, ZLIB = 2, LZ4 = 3 };
 
 static const char *TAG_NAMES[] = {
     "TAG_End",      "TAG_Byte",      "TAG_Short",      "TAG_Int",    "TAG_Long",
@@ -328,6 +328,7 @@ class NBTFile : public TagCompound {
   private:
     void decompressStream(std::istream &stream, std::stringstream &decompressed,
                           Compression compression);
+    void readDecompressed(std::istream &decompressed);
 
   public:
     NBTFile();
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbtreader.h"
+
+#include <algorithm>
+
+namespace mapcrafter {
+namespace mc {
+namespace nbt {
+
+namespace {
+
+// maximum nesting depth of lists/compounds when skipping, like Minecraft itself
+const int MAX_DEPTH = 512;
+
+// size of the payload of fixed-size tags, 0 for all other tags
+size_t fixedPayloadSize(int8_t type) {
+    switch (type) {
+    case TagByte::TAG_TYPE:
+        return 1;
+    case TagShort::TAG_TYPE:
+        return 2;
+    case TagInt::TAG_TYPE:
+    case TagFloat::TAG_TYPE:
+        return 4;
+    case TagLong::TAG_TYPE:
+    case TagDouble::TAG_TYPE:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+} // namespace
+
+NBTReader::NBTReader(const uint8_t *data, size_t len) : data(data), len(len), pos(0) {}
+
+std::string_view NBTReader::readRoot() {
+    if (readByte() != TagCompound::TAG_TYPE)
+        throw NBTError("First tag is not a tag compound!");
+    return readString();
+}
+
+bool NBTReader::readTagHeader(int8_t &type, std::string_view &name) {
+    type = readByte();
+    if (type == TagEnd::TAG_TYPE)
+        return false;
+    name = readString();
+    return true;
+}
+
+int8_t NBTReader::readByte() { return static_cast<int8_t>(*require(1)); }
+
+int16_t NBTReader::readShort() {
+    const uint8_t *p = require(2);
+    return static_cast<int16_t>((p[0] << 8) | p[1]);
+}
+
+int32_t NBTReader::readInt() {
+    const uint8_t *p = require(4);
+    return static_cast<int32_t>((uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+                                (uint32_t(p[2]) << 8) | uint32_t(p[3]));
+}
+
+int64_t NBTReader::readLong() {
+    uint64_t high = static_cast<uint32_t>(readInt());
+    uint64_t low = static_cast<uint32_t>(readInt());
+    return static_cast<int64_t>((high << 32) | low);
+}
+
+std::string_view NBTReader::readString() {
+    uint16_t length = static_cast<uint16_t>(readShort());
+    return std::string_view(reinterpret_cast<const char *>(require(length)), length);
+}
+
+ArrayView<int8_t> NBTReader::readByteArray() {
+    ArrayView<int8_t> array;
+    array.size = std::max(readInt(), 0);
+    array.data = require(array.size);
+    return array;
+}
+
+ArrayView<int32_t> NBTReader::readIntArray() {
+    ArrayView<int32_t> array;
+    array.size = std::max(readInt(), 0);
+    array.data = require(size_t(array.size) * sizeof(int32_t));
+    return array;
+}
+
+ArrayView<int64_t> NBTReader::readLongArray() {
+    ArrayView<int64_t> array;
+    array.size = std::max(readInt(), 0);
+    array.data = require(size_t(array.size) * sizeof(int64_t));
+    return array;
+}
+
+ListView NBTReader::readList() {
+    ListView list;
+    list.tag_type = readByte();
+    list.size = std::max(readInt(), 0);
+    list.offset = pos;
+    // skip the elements like a list without header
+    pos -= 5;
+    skip(TagList::TAG_TYPE, 0);
+    return list;
+}
+
+size_t NBTReader::readCompound() {
+    size_t offset = pos;
+    skip(TagCompound::TAG_TYPE, 0);
+    return offset;
+}
+
+void NBTReader::skip(int8_t type) { skip(type, 0); }
+
+size_t NBTReader::tell() const { return pos; }
+
+void NBTReader::seek(size_t offset) {
+    if (offset > len)
+        throw NBTError("Invalid offset in NBT data!");
+    pos = offset;
+}
+
+const uint8_t *NBTReader::getData() const { return data; }
+
+const uint8_t *NBTReader::require(size_t bytes) {
+    if (bytes > len - pos)
+        throw NBTError("Unexpected end of NBT data!");
+    const uint8_t *p = data + pos;
+    pos += bytes;
+    return p;
+}
+
+void NBTReader::skip(int8_t type, int depth) {
+    if (depth > MAX_DEPTH)
+        throw NBTError("NBT data is nested too deep!");
+
+    size_t fixed_size = fixedPayloadSize(type);
+    if (fixed_size != 0) {
+        require(fixed_size);
+        return;
+    }
+
+    switch (type) {
+    case TagByteArray::TAG_TYPE:
+        readByteArray();
+        break;
+    case TagString::TAG_TYPE:
+        readString();
+        break;
+    case TagList::TAG_TYPE: {
+        int8_t tag_type = readByte();
+        int32_t length = std::max(readInt(), 0);
+        // lists of numbers are skipped at once
+        size_t fixed_size = fixedPayloadSize(tag_type);
+        if (fixed_size != 0) {
+            require(length * fixed_size);
+            break;
+        }
+        for (int32_t i = 0; i < length; i++)
+            skip(tag_type, depth + 1);
+        break;
+    }
+    case TagCompound::TAG_TYPE: {
+        int8_t tag_type;
+        std::string_view name;
+        while (readTagHeader(tag_type, name))
+            skip(tag_type, depth + 1);
+        break;
+    }
+    case TagIntArray::TAG_TYPE:
+        readIntArray();
+        break;
+    case TagLongArray::TAG_TYPE:
+        readLongArray();
+        break;
+    default:
+        throw NBTError(std::string("Unknown tag type with id ") +
+                       util::str(static_cast<int>(type)) + ". NBT data stream may be corrupted.");
+    }
+}
+
+} // namespace nbt
+} // namespace mc
+} // namespace mapcrafter
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NBTREADER_H_
+#define NBTREADER_H_
+
+#include "nbt.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace mapcrafter {
+namespace mc {
+namespace nbt {
+
+/**
+ * A view of the payload of an array tag (byte, int or long array). The values are
+ * stored big-endian inside the NBT data and converted when they are accessed.
+ */
+template <typename T> struct ArrayView {
+    const uint8_t *data = nullptr;
+    int32_t size = 0;
+
+    bool empty() const { return size == 0; }
+
+    T operator[](size_t i) const {
+        const uint8_t *p = data + i * sizeof(T);
+        uint64_t value = 0;
+        for (size_t j = 0; j < sizeof(T); j++)
+            value = (value << 8) | p[j];
+        return static_cast<T>(value);
+    }
+};
+
+/**
+ * A list tag inside the NBT data: the type of its elements, the count of elements and
+ * the offset of the first element. Seek to the offset to read the elements.
+ */
+struct ListView {
+    int8_t tag_type = TagEnd::TAG_TYPE;
+    int32_t size = 0;
+    size_t offset = 0;
+};
+
+/**
+ * A pull-style NBT reader that works directly on a (decompressed) buffer.
+ *
+ * It doesn't build any tags, you walk through the data yourself: read the header of a
+ * tag in a compound with readTagHeader and then either read its payload with the
+ * matching read method, or skip it with skip. Strings and arrays are returned as views
+ * of the buffer, so the buffer has to outlive everything read from it.
+ *
+ * All methods throw an NBTError if the data ends unexpectedly or is malformed.
+ */
+class NBTReader {
+  public:
+    NBTReader(const uint8_t *data, size_t len);
+
+    /**
+     * Reads the header of the root tag, which has to be a tag compound. Returns the
+     * name of the root tag, the reader is positioned at the first tag of it afterwards.
+     */
+    std::string_view readRoot();
+
+    /**
+     * Reads the type and name of the next tag of a compound. Returns false if the end
+     * of the compound is reached.
+     */
+    bool readTagHeader(int8_t &type, std::string_view &name);
+
+    int8_t readByte();
+    int16_t readShort();
+    int32_t readInt();
+    int64_t readLong();
+    std::string_view readString();
+
+    ArrayView<int8_t> readByteArray();
+    ArrayView<int32_t> readIntArray();
+    ArrayView<int64_t> readLongArray();
+
+    /**
+     * Reads the header of a list and skips its elements.
+     */
+    ListView readList();
+
+    /**
+     * Skips a compound and returns the offset of its first tag.
+     */
+    size_t readCompound();
+
+    /**
+     * Skips the payload of a tag with a specific type.
+     */
+    void skip(int8_t type);
+
+    size_t tell() const;
+    void seek(size_t offset);
+
+    /**
+     * Returns the buffer the reader reads from, e.g. to access the raw data between two
+     * offsets.
+     */
+    const uint8_t *getData() const;
+
+  private:
+    const uint8_t *require(size_t bytes);
+    void skip(int8_t type, int depth);
+
+    const uint8_t *data;
+    size_t len, pos;
+};
+
+} // namespace nbt
+} // namespace mc
+} // namespace mapcrafter
+
+#endif /* NBTREADER_H_ */
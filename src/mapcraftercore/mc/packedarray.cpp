@@ -0,0 +1,274 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "packedarray.h"
+
+#include "../config.h"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace mapcrafter {
+namespace mc {
+
+namespace {
+
+inline uint64_t readLong(const uint8_t *data) {
+    return (uint64_t)data[0] << 56 | (uint64_t)data[1] << 48 | (uint64_t)data[2] << 40 |
+           (uint64_t)data[3] << 32 | (uint64_t)data[4] << 24 | (uint64_t)data[5] << 16 |
+           (uint64_t)data[6] << 8 | (uint64_t)data[7];
+}
+
+/**
+ * Values are padded: Every long has 64 / BITS values, the remaining bits are unused.
+ */
+template <int BITS, size_t COUNT>
+uint16_t unpackPadded(const uint8_t *data, const uint16_t *lookup, uint16_t *out) {
+    const int per_long = 64 / BITS;
+    const uint64_t mask = (uint64_t(1) << BITS) - 1;
+
+    uint16_t max_index = 0;
+    for (size_t j = 0; j < COUNT / per_long; j++) {
+        uint64_t value = readLong(data + 8 * j);
+        for (int i = 0; i < per_long; i++) {
+            uint16_t index = (value >> (BITS * i)) & mask;
+            max_index = std::max(max_index, index);
+            *out++ = lookup[index];
+        }
+    }
+
+    // the last long is only partly used if the values don't fit evenly
+    if (COUNT % per_long != 0) {
+        uint64_t value = readLong(data + 8 * (COUNT / per_long));
+        for (size_t i = 0; i < COUNT % per_long; i++) {
+            uint16_t index = (value >> (BITS * i)) & mask;
+            max_index = std::max(max_index, index);
+            *out++ = lookup[index];
+        }
+    }
+    return max_index;
+}
+
+/**
+ * Values span longs: The longs are a continuous stream of bits, starting with the least
+ * significant bit of the first long.
+ */
+template <int BITS, size_t COUNT>
+uint16_t unpackSpanning(const uint8_t *data, const uint16_t *lookup, uint16_t *out) {
+    const uint64_t mask = (uint64_t(1) << BITS) - 1;
+
+    // bits of the current long which weren't used yet, and how many there are
+    uint64_t buffer = 0;
+    int buffered = 0;
+
+    uint16_t max_index = 0;
+    for (size_t i = 0; i < COUNT; i++) {
+        uint16_t index;
+        if (buffered >= BITS) {
+            index = buffer & mask;
+            buffer >>= BITS;
+            buffered -= BITS;
+        } else {
+            uint64_t value = readLong(data);
+            data += 8;
+            index = (buffer | (value << buffered)) & mask;
+            buffer = value >> (BITS - buffered);
+            buffered += 64 - BITS;
+        }
+        max_index = std::max(max_index, index);
+        out[i] = lookup[index];
+    }
+    return max_index;
+}
+
+#ifdef HAVE_X86_SIMD
+
+// With 4 bits per value (the most common case, palettes with up to 16 entries) every
+// byte has two palette indices and a long has 16 of them. Padded and spanning layout are
+// the same then. The SIMD versions translate 16 indices at once with byte shuffles, using
+// one table with the low and one with the high bytes of the 16 lookup entries.
+
+__attribute__((target("sse4.1"))) inline void loadLookupBytes(const uint16_t *lookup,
+                                                              __m128i &low, __m128i &high) {
+    __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lookup));
+    __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lookup + 8));
+    const __m128i byte = _mm_set1_epi16(0xff);
+    low = _mm_packus_epi16(_mm_and_si128(first, byte), _mm_and_si128(second, byte));
+    high = _mm_packus_epi16(_mm_srli_epi16(first, 8), _mm_srli_epi16(second, 8));
+}
+
+__attribute__((target("sse4.1"))) inline uint16_t horizontalMax(__m128i bytes) {
+    __m128i words = _mm_max_epu16(_mm_cvtepu8_epi16(bytes),
+                                  _mm_cvtepu8_epi16(_mm_srli_si128(bytes, 8)));
+    // the minimum of the inverted words is the inverted maximum
+    __m128i min = _mm_minpos_epu16(_mm_xor_si128(words, _mm_set1_epi16(-1)));
+    return 0xffff - (_mm_cvtsi128_si32(min) & 0xffff);
+}
+
+__attribute__((target("sse4.1"))) inline void translate4(__m128i indices, __m128i low_table,
+                                                         __m128i high_table, uint16_t *out) {
+    __m128i low = _mm_shuffle_epi8(low_table, indices);
+    __m128i high = _mm_shuffle_epi8(high_table, indices);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(low, high));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpackhi_epi8(low, high));
+}
+
+__attribute__((target("sse4.1"))) uint16_t unpack4SSE41(const uint8_t *data,
+                                                        const uint16_t *lookup, uint16_t *out) {
+    __m128i low_table, high_table;
+    loadLookupBytes(lookup, low_table, high_table);
+
+    // reverses the bytes of two big-endian longs
+    const __m128i swap = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+
+    __m128i max = _mm_setzero_si128();
+    for (int i = 0; i < 4096; i += 32) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i / 2));
+        bytes = _mm_shuffle_epi8(bytes, swap);
+        // the low nibble of a byte has the first index, the high nibble the second one
+        __m128i first = _mm_and_si128(bytes, nibble);
+        __m128i second = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+        max = _mm_max_epu8(max, _mm_max_epu8(first, second));
+
+        translate4(_mm_unpacklo_epi8(first, second), low_table, high_table, out + i);
+        translate4(_mm_unpackhi_epi8(first, second), low_table, high_table, out + i + 16);
+    }
+    return horizontalMax(max);
+}
+
+__attribute__((target("avx2"))) inline void translate4(__m256i indices, __m256i low_table,
+                                                       __m256i high_table, uint16_t *out) {
+    __m256i low = _mm256_shuffle_epi8(low_table, indices);
+    __m256i high = _mm256_shuffle_epi8(high_table, indices);
+    // the 128-bit lanes are unpacked separately, they have the values of different longs
+    __m256i first = _mm256_unpacklo_epi8(low, high);
+    __m256i second = _mm256_unpackhi_epi8(low, high);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                        _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 32),
+                        _mm256_permute2x128_si256(first, second, 0x31));
+}
+
+__attribute__((target("avx2"))) uint16_t unpack4AVX2(const uint8_t *data,
+                                                     const uint16_t *lookup, uint16_t *out) {
+    __m128i low_lookup, high_lookup;
+    loadLookupBytes(lookup, low_lookup, high_lookup);
+    __m256i low_table = _mm256_broadcastsi128_si256(low_lookup);
+    __m256i high_table = _mm256_broadcastsi128_si256(high_lookup);
+
+    const __m256i swap = _mm256_broadcastsi128_si256(
+        _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    __m256i max = _mm256_setzero_si256();
+    for (int i = 0; i < 4096; i += 64) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i / 2));
+        bytes = _mm256_shuffle_epi8(bytes, swap);
+        __m256i first = _mm256_and_si256(bytes, nibble);
+        __m256i second = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble);
+        max = _mm256_max_epu8(max, _mm256_max_epu8(first, second));
+
+        // has the indices of the first and third long, and the second and fourth one
+        translate4(_mm256_unpacklo_epi8(first, second), low_table, high_table, out + i);
+        translate4(_mm256_unpackhi_epi8(first, second), low_table, high_table, out + i + 16);
+    }
+    return horizontalMax(
+        _mm_max_epu8(_mm256_castsi256_si128(max), _mm256_extracti128_si256(max, 1)));
+}
+
+#endif
+
+typedef std::array<UnpackFunction, 17> UnpackFunctions;
+
+template <size_t COUNT, size_t... I>
+UnpackFunctions makePaddedFunctions(std::index_sequence<I...>) {
+    return {{nullptr, &unpackPadded<I + 1, COUNT>...}};
+}
+
+template <size_t COUNT, size_t... I>
+UnpackFunctions makeSpanningFunctions(std::index_sequence<I...>) {
+    return {{nullptr, &unpackSpanning<I + 1, COUNT>...}};
+}
+
+} // namespace
+
+size_t getPackedLongs(PackedFormat format, int bits, size_t count) {
+    if (format == PackedFormat::PADDED) {
+        size_t per_long = 64 / bits;
+        return (count + per_long - 1) / per_long;
+    }
+    return (count * bits + 63) / 64;
+}
+
+UnpackFunction getUnpackFunction(PackedFormat format, int bits, size_t count) {
+    return getUnpackFunction(format, bits, count, util::getInstructionSet());
+}
+
+UnpackFunction getUnpackFunction(PackedFormat format, int bits, size_t count,
+                                 util::InstructionSet instructions) {
+    static const UnpackFunctions padded_4096 =
+        makePaddedFunctions<4096>(std::make_index_sequence<16>());
+    static const UnpackFunctions padded_64 =
+        makePaddedFunctions<64>(std::make_index_sequence<16>());
+    static const UnpackFunctions spanning_4096 =
+        makeSpanningFunctions<4096>(std::make_index_sequence<16>());
+    static const UnpackFunctions spanning_64 =
+        makeSpanningFunctions<64>(std::make_index_sequence<16>());
+    static const UnpackFunctions padded_256 =
+        makePaddedFunctions<256>(std::make_index_sequence<16>());
+    static const UnpackFunctions spanning_256 =
+        makeSpanningFunctions<256>(std::make_index_sequence<16>());
+
+    if (bits < 1 || bits > 16 || (count != 4096 && count != 256 && count != 64))
+        return nullptr;
+
+#ifdef HAVE_X86_SIMD
+    if (bits == 4 && count == 4096) {
+        if (instructions == util::InstructionSet::AVX2)
+            return &unpack4AVX2;
+        if (instructions == util::InstructionSet::SSE41)
+            return &unpack4SSE41;
+    }
+#endif
+
+    if (count == 256)
+        return format == PackedFormat::PADDED ? padded_256[bits] : spanning_256[bits];
+    if (format == PackedFormat::PADDED)
+        return count == 4096 ? padded_4096[bits] : padded_64[bits];
+    return count == 4096 ? spanning_4096[bits] : spanning_64[bits];
+}
+
+const uint16_t *getIdentityLookup() {
+    static const std::array<uint16_t, 65536> identity = []() {
+        std::array<uint16_t, 65536> identity;
+        for (size_t i = 0; i < identity.size(); i++)
+            identity[i] = i;
+        return identity;
+    }();
+    return identity.data();
+}
+
+} // namespace mc
+} // namespace mapcrafter
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PACKEDARRAY_H_
+#define PACKEDARRAY_H_
+
+#include "../util/cpu.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mapcrafter {
+namespace mc {
+
+/**
+ * The layouts of packed palette indices (block states and biomes of chunk sections) in
+ * long arrays. Since 1.16 (data version 2529) the values of a long are padded and don't
+ * span into the next long, before that the longs are one continuous bit stream.
+ */
+enum class PackedFormat { PADDED, SPANNING };
+
+/**
+ * Unpacks the palette indices of a section from a packed long array and translates them
+ * with a palette lookup table in the same pass. The longs are read as big-endian, as they
+ * are stored in the NBT data. The lookup table must have an entry for every possible
+ * index, that is (1 << bits) entries.
+ *
+ * Returns the largest palette index found, the indices are all valid if it's smaller
+ * than the palette size.
+ */
+typedef uint16_t (*UnpackFunction)(const uint8_t *data, const uint16_t *lookup,
+                                   uint16_t *out);
+
+/**
+ * Returns the count of longs a packed array of values with a specific bit width has.
+ */
+size_t getPackedLongs(PackedFormat format, int bits, size_t count);
+
+/**
+ * Returns the unpack function for a packed array of 4096 (block states), 256 (heightmaps)
+ * or 64 (biomes) values with a bit width from 1 to 16, or nullptr if there is none.
+ *
+ * The function uses the fastest implementation the CPU supports, unless you ask for
+ * specific instructions (which the CPU must support then).
+ */
+UnpackFunction getUnpackFunction(PackedFormat format, int bits, size_t count);
+UnpackFunction getUnpackFunction(PackedFormat format, int bits, size_t count,
+                                 util::InstructionSet instructions);
+
+/**
+ * Returns a lookup table which maps every 16-bit palette index to itself. Use it to
+ * unpack palette indices without translating them.
+ */
+const uint16_t *getIdentityLookup();
+
+} // namespace mc
+} // namespace mapcrafter
+
+#endif /* PACKEDARRAY_H_ */
@@ -27,30 +27,66 @@
 namespace mapcrafter {
 namespace mc {
 
-RegionFile::RegionFile() : rotation(0) {}
+bool ChunkDataView::getCompression(nbt::Compression &compression) const {
+    switch (this->compression) {
+    case RegionFile::COMPRESSION_GZIP:
+        compression = nbt::Compression::GZIP;
+        return true;
+    case RegionFile::COMPRESSION_ZLIB:
+        compression = nbt::Compression::ZLIB;
+        return true;
+    case RegionFile::COMPRESSION_NONE:
+        compression = nbt::Compression::NO_COMPRESSION;
+        return true;
+    case RegionFile::COMPRESSION_LZ4:
+        compression = nbt::Compression::LZ4;
+        return true;
+    default:
+        return false;
+    }
+}
 
-RegionFile::RegionFile(const std::string &filename) : filename(filename), rotation(0) {
-    regionpos_original = RegionPos::byFilename(filename);
-    regionpos = regionpos_original;
+RegionFile::RegionFile() : rotation(0), read_into_memory(false) { reset(""); }
+
+RegionFile::RegionFile(const std::string &filename) : rotation(0), read_into_memory(false) {
+    reset(filename);
 }
 
 RegionFile::~RegionFile() {}
 
-bool RegionFile::readHeaders(std::ifstream &file, uint32_t chunk_offsets[1024]) {
-    if (!file)
-        return false;
+void RegionFile::reset(const std::string &filename) {
+    this->filename = filename;
+    if (!filename.empty()) {
+        regionpos_original = RegionPos::byFilename(filename);
+        regionpos = regionpos_original;
+    }
+    rotation = 0;
+    world_crop = WorldCrop();
+    read_into_memory = false;
+
+    mapping.reset();
+    external_chunks.clear();
+    containing_chunks.clear();
+    for (int i = 0; i < 1024; i++) {
+        chunk_exists[i] = false;
+        chunk_timestamps[i] = 0;
+        chunk_offsets[i] = 0;
+        chunk_data_compression[i] = 0;
+        chunk_data[i].clear();
+    }
+}
 
+bool RegionFile::readHeaders(const uint8_t *header, size_t filesize) {
+    external_chunks.clear();
     containing_chunks.clear();
     for (int i = 0; i < 1024; i++) {
         chunk_offsets[i] = 0;
         chunk_exists[i] = false;
         chunk_timestamps[i] = 0;
         chunk_data_compression[i] = 0;
+        chunk_data[i].clear();
     }
 
-    file.seekg(0, std::ios::end);
-    size_t filesize = file.tellg();
-    file.seekg(0, std::ios::beg);
     // make sure the region file has a header
     if (filesize < 8192) {
         LOG(ERROR) << "Corrupt region '" << filename << "': Header is too short.";
@@ -59,23 +95,20 @@ bool RegionFile::readHeaders(std::ifstream &file, uint32_t chunk_offsets[1024])
 
     for (int x = 0; x < 32; x++) {
         for (int z = 0; z < 32; z++) {
-            file.seekg(4 * (x + z * 32), std::ios::beg);
-            int tmp;
-            file.read(reinterpret_cast<char *>(&tmp), 4);
-            if (tmp == 0)
+            // 3 bytes offset (in 4096 byte sectors) and 1 byte sector count
+            const uint8_t *location = header + 4 * (x + z * 32);
+            if (location[0] == 0 && location[1] == 0 && location[2] == 0 && location[3] == 0)
                 continue;
-            uint32_t offset = util::bigEndian32(tmp << 8) * 4096;
+            uint32_t offset = ((location[0] << 16) | (location[1] << 8) | location[2]) * 4096;
             if (filesize < offset + 5) {
                 LOG(ERROR) << "Corrupt region '" << filename << "': Invalid offset of chunk " << x
                            << ":" << z << ".";
                 return false;
             }
-            // uint8_t sectors = ((uint8_t*) &tmp)[3];
 
-            file.seekg(4096, std::ios::cur);
-            uint32_t timestamp;
-            file.read(reinterpret_cast<char *>(&timestamp), 4);
-            timestamp = util::bigEndian32(timestamp);
+            const uint8_t *timestamp_ptr = location + 4096;
+            uint32_t timestamp = (timestamp_ptr[0] << 24) | (timestamp_ptr[1] << 16) |
+                                 (timestamp_ptr[2] << 8) | timestamp_ptr[3];
 
             // get the original (not rotated) position of the chunk
             ChunkPos chunkpos(x + regionpos_original.x * 32, z + regionpos_original.z * 32);
@@ -118,55 +151,35 @@ void RegionFile::setRotation(int rotation) {
 
 void RegionFile::setWorldCrop(const WorldCrop &world_crop) { this->world_crop = world_crop; }
 
+void RegionFile::setReadIntoMemory(bool read_into_memory) {
+    this->read_into_memory = read_into_memory;
+}
+
 bool RegionFile::read() {
-    std::ifstream file(filename.c_str(), std::ios_base::binary);
-    uint32_t chunk_offsets[1024];
-    if (!readHeaders(file, chunk_offsets))
+    std::shared_ptr<util::MappedFile> file = std::make_shared<util::MappedFile>();
+    if (!file->open(filename, !read_into_memory)) {
+        LOG(ERROR) << "Unable to read region '" << filename << "'.";
         return false;
-    file.seekg(0, std::ios::end);
-    size_t filesize = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    std::vector<uint8_t> regiondata(filesize);
-    file.read(reinterpret_cast<char *>(&regiondata[0]), filesize);
-
-    for (int i = 0; i < 1024; i++) {
-        // get the offsets, where the chunk data starts
-        int offset = chunk_offsets[i];
-        if (offset == 0)
-            continue;
-
-        // i = x + z * 32
-        int x = i % 32;
-        int z = (i - x) / 32;
-
-        // get data size and compression type
-        uint32_t size = *(reinterpret_cast<uint32_t *>(&regiondata[offset]));
-        if (size == 0) {
-            LOG(ERROR) << "Corrupt region '" << filename << "': Size of chunk " << x << ":" << z
-                       << " is zero.";
-            return false;
-        }
-        size = util::bigEndian32(size) - 1;
-        uint8_t compression = regiondata[offset + 4];
-        if (filesize < offset + 5 + size) {
-            LOG(ERROR) << "Corrupt region '" << filename << "': Invalid size of chunk " << x << ":"
-                       << z << ".";
-            return false;
-        }
-
-        chunk_data_compression[i] = compression;
-        chunk_data[i].resize(size);
-        std::copy(&regiondata[offset + 5], &regiondata[offset + 5 + size], chunk_data[i].begin());
     }
-
+    if (!readHeaders(file->getData(), file->getSize()))
+        return false;
+    mapping = file;
     return true;
 }
 
 bool RegionFile::readOnlyHeaders() {
     std::ifstream file(filename.c_str(), std::ios_base::binary);
-    uint32_t chunk_offsets[1024];
-    return readHeaders(file, chunk_offsets);
+    if (!file)
+        return false;
+    file.seekg(0, std::ios::end);
+    size_t filesize = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    uint8_t header[8192];
+    if (filesize >= 8192)
+        file.read(reinterpret_cast<char *>(header), 8192);
+    mapping.reset();
+    return readHeaders(header, filesize);
 }
 
 bool RegionFile::write(std::string filename) const {
@@ -184,7 +197,8 @@ bool RegionFile::write(std::string filename) const {
     // write chunk data to a temporary string stream
     int position = 8192;
     for (int i = 0; i < 1024; i++) {
-        if (chunk_data[i].size() == 0)
+        ChunkDataView data = getChunkData(i);
+        if (data.empty())
             continue;
         // pad every chunk data with zeros to the next n*4096 bytes
         if (position % 4096 != 0) {
@@ -198,16 +212,15 @@ bool RegionFile::write(std::string filename) const {
         offsets[i] = position / 4096;
 
         // get chunk data, size and compression type
-        const std::vector<uint8_t> &data = chunk_data[i];
-        uint32_t size = data.size();
+        uint32_t size = data.size;
         size = util::bigEndian32(size + 1);
-        uint8_t compression = chunk_data_compression[i];
+        uint8_t compression = data.compression;
 
         // append everything to the data
         out_data.write(reinterpret_cast<char *>(&size), 4);
         out_data.write(reinterpret_cast<char *>(&compression), 1);
-        out_data.write(reinterpret_cast<const char *>(&data[0]), data.size());
-        position += data.size() + 5;
+        out_data.write(reinterpret_cast<const char *>(data.data), data.size);
+        position += data.size + 5;
     }
 
     // create the header with offsets and timestamps
@@ -222,12 +235,18 @@ bool RegionFile::write(std::string filename) const {
     }
 
     // write complete region file
-    std::ofstream out(filename, std::ios::binary);
+    // to a temporary file first, the region file itself may be mapped into memory
+    std::string filename_tmp = filename + ".tmp";
+    std::ofstream out(filename_tmp, std::ios::binary);
     if (!out)
         return false;
     out << out_header.rdbuf() << out_data.rdbuf();
     out.close();
-    return !out.fail();
+    if (out.fail())
+        return false;
+    boost::system::error_code error;
+    fs::rename(filename_tmp, filename, error);
+    return !error;
 }
 
 const std::string &RegionFile::getFilename() const { return filename; }
@@ -250,12 +269,69 @@ void RegionFile::setChunkTimestamp(const ChunkPos &chunk, uint32_t timestamp) {
     chunk_timestamps[getChunkIndex(chunk)] = timestamp;
 }
 
-const std::vector<uint8_t> &RegionFile::getChunkData(const ChunkPos &chunk) const {
-    return chunk_data[getChunkIndex(chunk)];
+ChunkDataView RegionFile::getChunkData(const ChunkPos &chunk) const {
+    return getChunkData(getChunkIndex(chunk));
+}
+
+ChunkDataView RegionFile::getChunkData(size_t index) const {
+    ChunkDataView view;
+    if (!chunk_data[index].empty()) {
+        view.data = chunk_data[index].data();
+        view.size = chunk_data[index].size();
+        view.compression = chunk_data_compression[index];
+        return view;
+    }
+
+    uint32_t offset = chunk_offsets[index];
+    if (!chunk_exists[index] || offset == 0 || !mapping)
+        return view;
+
+    // the chunk data starts with 4 bytes data size (+1) and 1 byte compression type
+    const uint8_t *data = mapping->getData();
+    size_t filesize = mapping->getSize();
+    uint32_t size = (data[offset] << 24) | (data[offset + 1] << 16) | (data[offset + 2] << 8) |
+                    data[offset + 3];
+    if (size == 0 || filesize < size_t(offset) + 4 + size)
+        return view;
+
+    uint8_t compression = data[offset + 4];
+    if (compression & COMPRESSION_EXTERNAL)
+        return getExternalChunkData(index, compression & ~COMPRESSION_EXTERNAL);
+    if (size == 1)
+        return view;
+
+    view.data = data + offset + 5;
+    view.size = size - 1;
+    view.compression = compression;
+    return view;
+}
+
+ChunkDataView RegionFile::getExternalChunkData(size_t index, uint8_t compression) const {
+    ChunkDataView view;
+    auto it = external_chunks.find(index);
+    if (it == external_chunks.end()) {
+        // external files are named by the (original) global position of the chunk
+        int x = regionpos_original.x * 32 + index % 32;
+        int z = regionpos_original.z * 32 + index / 32;
+        fs::path path = fs::path(filename).parent_path() /
+                        ("c." + util::str(x) + "." + util::str(z) + ".mcc");
+
+        std::shared_ptr<util::MappedFile> file = std::make_shared<util::MappedFile>();
+        if (!file->open(path.string(), !read_into_memory)) {
+            LOG(ERROR) << "Unable to read external chunk data '" << path.string() << "'.";
+            return view;
+        }
+        it = external_chunks.insert(std::make_pair(index, file)).first;
+    }
+
+    view.data = it->second->getData();
+    view.size = it->second->getSize();
+    view.compression = compression;
+    return view;
 }
 
 uint8_t RegionFile::getChunkDataCompression(const ChunkPos &chunk) const {
-    return chunk_data_compression[getChunkIndex(chunk)];
+    return getChunkData(chunk).compression;
 }
 
 void RegionFile::setChunkData(const ChunkPos &chunk, const std::vector<uint8_t> &data,
@@ -276,29 +352,35 @@ void RegionFile::setChunkData(const ChunkPos &chunk, const std::vector<uint8_t>
 /**
  * This method tries to load a chunk from the region data and returns a status.
  */
-int RegionFile::loadChunk(const ChunkPos &pos, BlockStateRegistry &block_registry, Chunk &chunk) {
+int RegionFile::loadChunk(const ChunkPos &pos, BlockStateRegistry &block_registry, Chunk &chunk,
+                          std::vector<RawSign> *signs) {
     int index = getChunkIndex(pos);
 
     // check if the chunk exists
-    if (chunk_data[index].size() == 0)
+    if (!chunk_exists[index] || (chunk_offsets[index] == 0 && chunk_data[index].empty()))
         return CHUNK_DOES_NOT_EXIST;
 
-    // get compression type and size of the data
-    uint8_t compression = chunk_data_compression[index];
-    nbt::Compression comp = nbt::Compression::NO_COMPRESSION;
-    if (compression == 1)
-        comp = nbt::Compression::GZIP;
-    else if (compression == 2)
-        comp = nbt::Compression::ZLIB;
-    size_t size = chunk_data[index].size();
+    ChunkDataView data = getChunkData(index);
+    if (data.empty()) {
+        LOG(ERROR) << "Corrupt region '" << filename << "': Invalid size of chunk " << pos << ".";
+        return CHUNK_DATA_INVALID;
+    }
+
+    // get compression type of the data
+    nbt::Compression comp;
+    if (!data.getCompression(comp)) {
+        LOG(ERROR) << "Corrupt region '" << filename << "': Unknown compression type "
+                   << (int)data.compression << " of chunk " << pos << ".";
+        return CHUNK_DATA_INVALID;
+    }
 
     // set the chunk rotation
     chunk.setRotation(rotation);
     chunk.setWorldCrop(world_crop);
-    // try to load the chunk
+    // try to load the chunk, it's decompressed directly from the region data
     try {
-        if (!chunk.readNBT(block_registry, reinterpret_cast<char *>(&chunk_data[index][0]), size,
-                           comp))
+        if (!chunk.readNBT(block_registry, reinterpret_cast<const char *>(data.data), data.size,
+                           comp, signs))
             return CHUNK_DATA_INVALID;
     } catch (const nbt::NBTError &err) {
         LOG(ERROR) << "Unable to read chunk at " << pos << ": " << err.what();
@@ -307,5 +389,25 @@ int RegionFile::loadChunk(const ChunkPos &pos, BlockStateRegistry &block_registr
     return CHUNK_OK;
 }
 
+int RegionFile::getChunkContentHash(const ChunkPos &pos, uint64_t &hash) const {
+    int index = getChunkIndex(pos);
+    if (!chunk_exists[index] || (chunk_offsets[index] == 0 && chunk_data[index].empty()))
+        return CHUNK_DOES_NOT_EXIST;
+
+    ChunkDataView data = getChunkData(index);
+    nbt::Compression comp;
+    if (data.empty() || !data.getCompression(comp))
+        return CHUNK_DATA_INVALID;
+
+    try {
+        if (!Chunk::getContentHash(reinterpret_cast<const char *>(data.data), data.size, comp,
+                                   hash))
+            return CHUNK_DATA_INVALID;
+    } catch (const nbt::NBTError &err) {
+        return CHUNK_NBT_ERROR;
+    }
+    return CHUNK_OK;
+}
+
 } // namespace mc
 } // namespace mapcrafter
@@ -24,17 +24,48 @@
 #include "pos.h"
 #include "worldcrop.h"
 
+#include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
 namespace mapcrafter {
+
+namespace util {
+class MappedFile;
+}
+
 namespace mc {
 
 class BlockStateRegistry;
 
+/**
+ * A view of the raw (compressed) data of a chunk in a region file. The data pointer is
+ * only valid as long as the region file object (or a copy of it) exists and isn't
+ * read again.
+ */
+struct ChunkDataView {
+    ChunkDataView() : data(nullptr), size(0), compression(0) {}
+
+    bool empty() const { return size == 0; }
+
+    /**
+     * Returns the NBT compression of the chunk data. Returns false if the compression
+     * type is unknown.
+     */
+    bool getCompression(nbt::Compression &compression) const;
+
+    const uint8_t *data;
+    size_t size;
+    uint8_t compression;
+};
+
 /**
  * This class represents a Minecraft region file.
+ *
+ * The region file is memory-mapped when it is read. Only the header is parsed then, the
+ * data of the chunks is accessed (and decompressed) not until a chunk is loaded.
  */
 class RegionFile {
   public:
@@ -46,10 +77,25 @@ class RegionFile {
     static const int CHUNK_DATA_INVALID = 3;
     static const int CHUNK_NBT_ERROR = 4;
 
+    // compression types of the chunk data
+    static const uint8_t COMPRESSION_GZIP = 1;
+    static const uint8_t COMPRESSION_ZLIB = 2;
+    static const uint8_t COMPRESSION_NONE = 3;
+    static const uint8_t COMPRESSION_LZ4 = 4;
+    // flag of the compression type if the chunk data is too large for the region file
+    // and stored in an external c.<x>.<z>.mcc file next to it
+    static const uint8_t COMPRESSION_EXTERNAL = 0x80;
+
     RegionFile();
     RegionFile(const std::string &filename);
     ~RegionFile();
 
+    /**
+     * Resets this object to an other (not yet read) region file. This reuses the object
+     * instead of assigning a new one.
+     */
+    void reset(const std::string &filename);
+
     /**
      * Sets the rotation of the world. You have to call this before loading a world.
      */
@@ -61,8 +107,16 @@ class RegionFile {
     void setWorldCrop(const WorldCrop &world_crop);
 
     /**
-     * Reads the whole region file with the data of all chunks. Returns false if the
-     * region file is corrupted.
+     * Sets whether the region file (and external chunk files) are read into memory
+     * instead of mapping them, see util::MappedFile::open. Use this if the files are
+     * possibly written while they are read. Like the rotation, this is reset by reset.
+     */
+    void setReadIntoMemory(bool read_into_memory);
+
+    /**
+     * Reads the region file: Maps the file into memory (or reads it into memory, see
+     * setReadIntoMemory) and reads the headers. Returns false if the region file can't
+     * be read or its header is corrupted.
      */
     bool read();
 
@@ -74,7 +128,8 @@ class RegionFile {
 
     /**
      * Writes the region to a file. You can also specify a different filename to write
-     * the region file to.
+     * the region file to. Chunks stored in external files are written into the region
+     * file itself.
      */
     bool write(std::string filename = "") const;
 
@@ -110,10 +165,12 @@ class RegionFile {
     void setChunkTimestamp(const ChunkPos &chunk, uint32_t timestamp);
 
     /**
-     * Returns the raw (compressed) data of a specific chunk. Returns an empty array if
-     * the chunk does not exist.
+     * Returns the raw (compressed) data of a specific chunk. Returns an empty view if
+     * the chunk does not exist or its data is corrupted. The data of chunks stored in
+     * external files is read from these files (and the external flag is removed from
+     * the compression type).
      */
-    const std::vector<uint8_t> &getChunkData(const ChunkPos &chunk) const;
+    ChunkDataView getChunkData(const ChunkPos &chunk) const;
 
     /**
      * Returns the type of the compressed chunk data (one byte, see specification of
@@ -129,10 +186,18 @@ class RegionFile {
     void setChunkData(const ChunkPos &chunk, const std::vector<uint8_t> &data, uint8_t compression);
 
     /**
-     * Loads a specific chunk into the supplied Chunk-object.
+     * Loads a specific chunk into the supplied Chunk-object, and the signs of the chunk
+     * into the vector if one is specified.
+     * Returns as integer one of the RegionFile::CHUNK_* status codes.
+     */
+    int loadChunk(const ChunkPos &pos, BlockStateRegistry &block_registry, Chunk &chunk,
+                  std::vector<RawSign> *signs = nullptr);
+
+    /**
+     * Computes the content hash of a specific chunk (see Chunk::getContentHash).
      * Returns as integer one of the RegionFile::CHUNK_* status codes.
      */
-    int loadChunk(const ChunkPos &pos, BlockStateRegistry &block_registry, Chunk &chunk);
+    int getChunkContentHash(const ChunkPos &pos, uint64_t &hash) const;
 
   private:
     std::string filename;
@@ -142,6 +207,8 @@ class RegionFile {
     int rotation;
     // and possible boundaries of the world
     WorldCrop world_crop;
+    // whether the files are read into memory instead of mapping them
+    bool read_into_memory;
 
     // a set with all available chunks
     ChunkMap containing_chunks;
@@ -155,14 +222,34 @@ class RegionFile {
     // timestamps of the chunks
     uint32_t chunk_timestamps[1024];
 
-    // actual chunk data with compression type
+    // offsets of the chunk data in the (mapped) region file
+    uint32_t chunk_offsets[1024];
+    std::shared_ptr<util::MappedFile> mapping;
+
+    // chunk data with compression type which was set with setChunkData,
+    // this has priority over the data of the region file
     uint8_t chunk_data_compression[1024];
     std::vector<uint8_t> chunk_data[1024];
 
+    // (mapped) external files of chunks which are too large for the region file,
+    // they are opened not until their chunk data is accessed
+    mutable std::map<size_t, std::shared_ptr<util::MappedFile>> external_chunks;
+
+    /**
+     * Reads the headers of a region file. Needs the first 8192 bytes of the region file
+     * and the size of the whole file.
+     */
+    bool readHeaders(const uint8_t *header, size_t filesize);
+
+    /**
+     * Returns the raw data of a chunk by its index.
+     */
+    ChunkDataView getChunkData(size_t index) const;
+
     /**
-     * Reads the headers of a region file.
+     * Returns the data of a chunk which is stored in an external file.
      */
-    bool readHeaders(std::ifstream &file, uint32_t chunk_offsets[1024]);
+    ChunkDataView getExternalChunkData(size_t index, uint8_t compression) const;
 
     /**
      * Calculates the index (chunk_* arrays) for a specific chunks.
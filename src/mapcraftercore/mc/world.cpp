@@ -38,7 +38,7 @@ std::ostream &operator<<(std::ostream &out, Dimension dimension) {
 }
 
 World::World(std::string world_dir, Dimension dimension)
-    : world_dir(world_dir), dimension(dimension), rotation(0) {
+    : world_dir(world_dir), dimension(dimension), rotation(0), read_regions_into_memory(false) {
     std::string world_name = BOOST_FS_FILENAME(this->world_dir);
 
     // try to find the region directory
@@ -101,6 +101,12 @@ WorldCrop World::getWorldCrop() const { return world_crop; }
 
 void World::setWorldCrop(const WorldCrop &world_crop) { this->world_crop = world_crop; }
 
+bool World::getReadRegionsIntoMemory() const { return read_regions_into_memory; }
+
+void World::setReadRegionsIntoMemory(bool read_regions_into_memory) {
+    this->read_regions_into_memory = read_regions_into_memory;
+}
+
 bool World::load() {
     if (!fs::exists(world_dir)) {
         std::cerr << "Error: World directory " << world_dir;
@@ -132,9 +138,10 @@ bool World::getRegion(const RegionPos &pos, RegionFile &region) const {
     RegionMap::const_iterator it = region_files.find(pos);
     if (it == region_files.end())
         return false;
-    region = RegionFile(it->second);
+    region.reset(it->second);
     region.setRotation(rotation);
     region.setWorldCrop(world_crop);
+    region.setReadIntoMemory(read_regions_into_memory);
     return true;
 }
 
@@ -107,6 +107,14 @@ class World {
     WorldCrop getWorldCrop() const;
     void setWorldCrop(const WorldCrop &world_crop);
 
+    /**
+     * Returns/Sets whether the region files are read into memory instead of mapping them
+     * (see RegionFile::setReadIntoMemory). Set this if the world is possibly modified
+     * while it is read, for example if it is watched while the game is running.
+     */
+    bool getReadRegionsIntoMemory() const;
+    void setReadRegionsIntoMemory(bool read_regions_into_memory);
+
     /**
      * Loads a world from the specified directory. Returns false if the world- or region
      * directory does not exist.
@@ -165,6 +173,8 @@ class World {
     // rotation and possible boundaries of the world
     int rotation;
     WorldCrop world_crop;
+    // whether the region files are read into memory instead of mapping them
+    bool read_regions_into_memory;
 
     // (hash-) set containing positions of available region files
     RegionSet available_regions;
@@ -20,6 +20,8 @@
 #include "worldcache.h"
 
 #include "blockstate.h"
+#include "chunkstore.h"
+#include "worldentities.h"
 
 namespace mapcrafter {
 namespace mc {
@@ -31,8 +33,10 @@ Block::Block()
 Block::Block(const mc::BlockPos &pos, uint16_t id)
     : pos(pos), id(id), biome(0), block_light(0), sky_light(15), fields_set(GET_ID) {}
 
-WorldCache::WorldCache(mc::BlockStateRegistry &block_registry, const World &world)
-    : block_registry(block_registry), world(world) {
+WorldCache::WorldCache(mc::BlockStateRegistry &block_registry, const World &world,
+                       ChunkStore *chunk_store, SignSink *sign_sink)
+    : block_registry(block_registry), world(world), chunk_store(chunk_store),
+      sign_sink(sign_sink) {
     for (int i = 0; i < RSIZE; i++)
         regioncache[i].used = false;
     for (int i = 0; i < CSIZE; i++)
@@ -92,29 +96,59 @@ Chunk *WorldCache::getChunk(const ChunkPos &pos) {
     CacheEntry<ChunkPos, Chunk> &entry = chunkcache[getChunkCacheIndex(pos)];
     // check if chunk is already in cache
     if (entry.used && entry.key == pos) {
-        // chunkstats.hits++;
+        chunkstats.hits++;
         return &entry.value;
     }
+    chunkstats.misses++;
+
+    // make sure we did not already try to load the chunk and it was broken
+    if (chunks_broken.count(pos))
+        return nullptr;
 
     // if not try to get the region of the chunk from the cache
     RegionFile *region = getRegion(pos.getRegion());
     if (region == nullptr) {
-        // chunkstats.unavailable++;
+        chunkstats.region_not_found++;
         return nullptr;
     }
 
-    // then try to load the chunk
-    // but make sure we did not already try to load the chunk and it was broken
-    if (chunks_broken.count(pos))
+    // the chunk does not exist, chunk in cache was not modified
+    if (!region->hasChunk(pos)) {
+        chunkstats.not_found++;
         return nullptr;
+    }
+
+    // maybe the chunk was already loaded by another render thread or for another
+    // rotation or map of the world
+    ChunkPos original = pos;
+    if (world.getRotation())
+        original.rotate(4 - world.getRotation());
+    uint32_t timestamp = region->getChunkTimestamp(pos);
+    if (chunk_store != nullptr) {
+        std::shared_ptr<const ChunkData> data =
+            chunk_store->get(region->getFilename(), original, timestamp);
+        if (data) {
+            entry.value.setRotation(world.getRotation());
+            entry.value.setWorldCrop(world.getWorldCrop());
+            entry.value.setChunkData(data);
+            entry.used = true;
+            entry.key = pos;
+            return &entry.value;
+        }
+    }
 
-    int status = region->loadChunk(pos, block_registry, entry.value);
+    // then try to load the chunk
+    std::vector<RawSign> signs;
+    int status = region->loadChunk(pos, block_registry, entry.value,
+                                   sign_sink != nullptr ? &signs : nullptr);
     // the chunk does not exist, chunk in cache was not modified
-    if (status == RegionFile::CHUNK_DOES_NOT_EXIST)
+    if (status == RegionFile::CHUNK_DOES_NOT_EXIST) {
+        chunkstats.not_found++;
         return nullptr;
+    }
 
     if (status != RegionFile::CHUNK_OK) {
-        // chunkstats.unavailable++;
+        chunkstats.invalid++;
         //  the chunk is not valid, chunk in cache was probably modified
         entry.used = false;
         // remember this chunk as broken and do not try to load it again
@@ -124,7 +158,11 @@ Chunk *WorldCache::getChunk(const ChunkPos &pos) {
 
     entry.used = true;
     entry.key = pos;
-    // chunkstats.misses++;
+    if (sign_sink != nullptr)
+        sign_sink->addChunk(original, timestamp, std::move(signs));
+    if (chunk_store != nullptr)
+        entry.value.setChunkData(chunk_store->put(region->getFilename(), original, timestamp,
+                                                  entry.value.getChunkData()));
     return &entry.value;
 }
 
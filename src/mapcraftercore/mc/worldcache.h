@@ -31,6 +31,8 @@ namespace mapcrafter {
 namespace mc {
 
 class BlockStateRegistry;
+class ChunkStore;
+class SignSink;
 
 /**
  * A block with id/data/biome/lighting data.
@@ -57,24 +59,28 @@ const int GET_SKY_LIGHT = 16;
 const int GET_LIGHT = GET_BLOCK_LIGHT | GET_SKY_LIGHT;
 
 /**
- * Some cache statistics for debugging. Not used at the moment.
+ * Some cache statistics for debugging. Also used for the statistics of the chunk store
+ * (see ChunkStore::getStats).
  *
  * Maybe add a set of corrupt chunks/regions to dump them at the end of the rendering.
  */
 struct CacheStats {
-    CacheStats() : hits(0), misses(0), region_not_found(0), not_found(0), invalid(0) {}
+    CacheStats()
+        : hits(0), misses(0), evictions(0), region_not_found(0), not_found(0), invalid(0) {}
 
     void print(const std::string &name) const {
         std::cout << name << ":" << std::endl;
         std::cout << "  hits: " << hits << std::endl
                   << "  misses: " << misses << std::endl
+                  << "  evictions: " << evictions << std::endl
                   << "  region_not_found: " << region_not_found << std::endl
                   << "  not_found: " << not_found << std::endl
                   << "  invalid: " << invalid << std::endl;
     }
 
-    int hits;
-    int misses;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
 
     int region_not_found;
     int not_found;
@@ -120,6 +126,12 @@ template <typename Key, typename Value> struct CacheEntry {
  * the coordinate of the requested region/chunk. If yes, the cache returns the objects.
  * If not, the cache tries to load the chunk/region and puts it in this cache entry
  * (overwrites an already loaded region/chunk at this cache position).
+ *
+ * Optionally, the world cache can use a chunk store shared with other world caches of the
+ * world. The decoded data of chunks which are not in the cache of this world cache is then
+ * looked up in the store first, and chunks loaded from the region files are also put into
+ * the store. The signs of the chunks loaded from the region files can be collected in a
+ * sign sink, too.
  */
 class WorldCache {
   private:
@@ -129,6 +141,10 @@ class WorldCache {
     CacheEntry<RegionPos, RegionFile> regioncache[RSIZE];
     CacheEntry<ChunkPos, Chunk> chunkcache[CSIZE];
 
+    // shared chunk store and sign sink (may be nullptr)
+    ChunkStore *chunk_store;
+    SignSink *sign_sink;
+
     // provisional set to keep track of broken regions/chunks
     // we do not want to try to load them again and again
     std::set<RegionPos> regions_broken;
@@ -141,7 +157,8 @@ class WorldCache {
     int getChunkCacheIndex(const ChunkPos &pos) const;
 
   public:
-    WorldCache(mc::BlockStateRegistry &block_registry, const World &world);
+    WorldCache(mc::BlockStateRegistry &block_registry, const World &world,
+               ChunkStore *chunk_store = nullptr, SignSink *sign_sink = nullptr);
 
     const World &getWorld() const;
 
@@ -20,6 +20,14 @@
 #include "worldentities.h"
 
 #include "../util/picojson.h"
+#include "compression.h"
+
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <thread>
 
 namespace mapcrafter {
 namespace mc {
@@ -114,167 +122,412 @@ const SignEntity::Lines &SignEntity::getLines() const { return lines; }
 
 const std::string &SignEntity::getText() const { return text; }
 
+namespace {
+
+// header of the entity cache files
+const char ENTITIES_CACHE_MAGIC[4] = {'M', 'C', 'E', 'C'};
+const uint32_t ENTITIES_CACHE_VERSION = 1;
+
+template <typename T> void writeValue(std::ostream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> bool readValue(std::istream &in, T &value) {
+    return (bool)in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+void writeString(std::ostream &out, const std::string &str) {
+    writeValue<uint32_t>(out, str.size());
+    out.write(str.data(), str.size());
+}
+
+bool readString(std::istream &in, std::string &str) {
+    uint32_t size;
+    // sign lines are short, everything else means that the file is broken
+    if (!readValue(in, size) || size > (1 << 16))
+        return false;
+    str.resize(size);
+    return (bool)in.read(&str[0], size);
+}
+
+} // namespace
+
+void readSigns(nbt::NBTReader &reader, const nbt::ListView &block_entities,
+               std::vector<RawSign> &signs) {
+    if (block_entities.tag_type != nbt::TagCompound::TAG_TYPE)
+        return;
+
+    // read only the tags of the block entities which are required for signs
+    reader.seek(block_entities.offset);
+    for (int32_t i = 0; i < block_entities.size; i++) {
+        std::string_view id;
+        int32_t x = 0, y = 0, z = 0;
+        std::array<std::string_view, 4> lines;
+        int8_t type;
+        std::string_view name;
+        while (reader.readTagHeader(type, name)) {
+            if (type == nbt::TagString::TAG_TYPE && name == "id")
+                id = reader.readString();
+            else if (type == nbt::TagInt::TAG_TYPE && name == "x")
+                x = reader.readInt();
+            else if (type == nbt::TagInt::TAG_TYPE && name == "y")
+                y = reader.readInt();
+            else if (type == nbt::TagInt::TAG_TYPE && name == "z")
+                z = reader.readInt();
+            else if (type == nbt::TagString::TAG_TYPE && name.size() == 5 &&
+                     name.substr(0, 4) == "Text" && name[4] >= '1' && name[4] <= '4')
+                lines[name[4] - '1'] = reader.readString();
+            else
+                reader.skip(type);
+        }
+
+        if (id != "Sign" && id != "minecraft:sign")
+            continue;
+        RawSign sign;
+        sign.pos = mc::BlockPos(x, z, y);
+        for (int j = 0; j < 4; j++)
+            sign.lines[j] = std::string(lines[j]);
+        signs.push_back(sign);
+    }
+}
+
+SignSink::SignSink() {}
+
+SignSink::~SignSink() {}
+
+void SignSink::addChunk(const ChunkPos &pos, uint32_t timestamp, std::vector<RawSign> &&signs) {
+    thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+    CollectedChunk &chunk = chunks[pos];
+    chunk.timestamp = timestamp;
+    chunk.signs = std::move(signs);
+}
+
+const SignSink::CollectedChunk *SignSink::getChunk(const ChunkPos &pos) const {
+    auto it = chunks.find(pos);
+    if (it == chunks.end())
+        return nullptr;
+    return &it->second;
+}
+
+size_t SignSink::getChunkCount() const { return chunks.size(); }
+
+void SignSink::clear() {
+    thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+    chunks.clear();
+}
+
 WorldEntitiesCache::WorldEntitiesCache(const World &world)
-    : world(world), cache_file(world.getRegionDir() / "entities.nbt.gz") {}
+    : world(world), cache_file(world.getRegionDir() / "entities.cache"), cache_file_regions(0),
+      cache_file_invalid(true) {}
 
 WorldEntitiesCache::~WorldEntitiesCache() {}
 
-unsigned int WorldEntitiesCache::readCacheFile() {
-    if (!fs::exists(cache_file)) {
-        LOG(DEBUG) << "Cache file " << cache_file << " does not exist.";
-        return 0;
+bool WorldEntitiesCache::scanRegion(const RegionPos &pos, int64_t timestamp,
+                                    const SignSink *collected, CachedRegion &region) const {
+    RegionFile region_file;
+    if (!world.getRegion(pos, region_file) || !region_file.read())
+        return false;
+
+    // forget the chunks which don't exist anymore
+    const RegionFile::ChunkMap &chunks = region_file.getContainingChunks();
+    for (auto chunk_it = region.chunks.begin(); chunk_it != region.chunks.end();) {
+        if (!chunks.count(chunk_it->first))
+            chunk_it = region.chunks.erase(chunk_it);
+        else
+            ++chunk_it;
     }
 
-    nbt::NBTFile nbt_file;
-    nbt_file.readNBT(cache_file.string().c_str(), nbt::Compression::GZIP);
+    for (auto chunk_it = chunks.begin(); chunk_it != chunks.end(); ++chunk_it) {
+        uint32_t chunk_timestamp = region_file.getChunkTimestamp(*chunk_it);
+        if (chunk_timestamp < region.timestamp)
+            continue;
 
-    nbt::TagList nbt_regions = nbt_file.findTag<nbt::TagList>("regions");
-    for (auto region_it = nbt_regions.payload.begin(); region_it != nbt_regions.payload.end();
-         ++region_it) {
-        nbt::TagCompound region = (*region_it)->cast<nbt::TagCompound>();
-        nbt::TagList chunks = region.findTag<nbt::TagList>("chunks");
-        mc::RegionPos region_pos;
-        region_pos.x = region.findTag<nbt::TagInt>("x").payload;
-        region_pos.z = region.findTag<nbt::TagInt>("z").payload;
-
-        for (auto chunk_it = chunks.payload.begin(); chunk_it != chunks.payload.end(); ++chunk_it) {
-            nbt::TagCompound chunk = (*chunk_it)->cast<nbt::TagCompound>();
-            nbt::TagList entities = chunk.findTag<nbt::TagList>("entities");
-            mc::ChunkPos chunk_pos;
-            chunk_pos.x = chunk.findTag<nbt::TagInt>("x").payload;
-            chunk_pos.z = chunk.findTag<nbt::TagInt>("z").payload;
-
-            for (auto entity_it = entities.payload.begin(); entity_it != entities.payload.end();
-                 ++entity_it) {
-                nbt::TagCompound entity = (*entity_it)->cast<nbt::TagCompound>();
-                this->entities[region_pos][chunk_pos].push_back(entity);
+        std::vector<RawSign> signs;
+        const SignSink::CollectedChunk *collected_chunk =
+            collected != nullptr ? collected->getChunk(*chunk_it) : nullptr;
+        if (collected_chunk != nullptr && collected_chunk->timestamp == chunk_timestamp) {
+            signs = collected_chunk->signs;
+        } else {
+            try {
+                scanChunk(region_file.getChunkData(*chunk_it), signs);
+            } catch (const nbt::NBTError &e) {
+                LOG(ERROR) << "Unable to read chunk " << *chunk_it << " of region "
+                           << region_file.getFilename() << ": " << e.what() << ".";
             }
         }
+        if (signs.empty())
+            region.chunks.erase(*chunk_it);
+        else
+            region.chunks[*chunk_it] = std::move(signs);
     }
 
-    LOG(DEBUG) << "Read cache file " << cache_file << ". Last modification time was "
-               << fs::last_write_time(cache_file) << ".";
-    return fs::last_write_time(cache_file);
+    region.timestamp = timestamp;
+    return true;
 }
 
-void WorldEntitiesCache::writeCacheFile() const {
-    nbt::NBTFile nbt_file;
-    nbt::TagList nbt_regions(nbt::TagCompound::TAG_TYPE);
-
-    for (auto region_it = entities.begin(); region_it != entities.end(); ++region_it) {
-        nbt::TagCompound nbt_region;
-        nbt_region.addTag("x", nbt::TagInt(region_it->first.x));
-        nbt_region.addTag("z", nbt::TagInt(region_it->first.z));
-        nbt::TagList nbt_chunks(nbt::TagCompound::TAG_TYPE);
-        for (auto chunk_it = region_it->second.begin(); chunk_it != region_it->second.end();
-             ++chunk_it) {
-            nbt::TagCompound nbt_chunk;
-            nbt_chunk.addTag("x", nbt::TagInt(chunk_it->first.x));
-            nbt_chunk.addTag("z", nbt::TagInt(chunk_it->first.z));
-            nbt::TagList nbt_entities(nbt::TagCompound::TAG_TYPE);
-            for (auto entity_it = chunk_it->second.begin(); entity_it != chunk_it->second.end();
-                 ++entity_it) {
-                nbt_entities.payload.push_back(nbt::TagPtr(entity_it->clone()));
-            }
-            nbt_chunk.addTag("entities", nbt_entities);
-            nbt_chunks.payload.push_back(nbt::TagPtr(nbt_chunk.clone()));
+void WorldEntitiesCache::scanChunk(const ChunkDataView &data, std::vector<RawSign> &signs) {
+    nbt::Compression compression;
+    if (data.empty() || !data.getCompression(compression))
+        return;
+    thread_local nbt::ByteBuffer buffer;
+    nbt::decompress(reinterpret_cast<const char *>(data.data), data.size, compression, buffer);
+
+    // find the list of block entities, it is in the root compound since 1.18 and in the
+    // level compound (with a different name) before
+    nbt::NBTReader reader(buffer.data(), buffer.size());
+    reader.readRoot();
+    nbt::ListView entities;
+    int8_t type;
+    std::string_view name;
+    while (reader.readTagHeader(type, name)) {
+        if (type == nbt::TagCompound::TAG_TYPE && name == "Level")
+            // just continue with the tags inside the level compound
+            continue;
+        if (type == nbt::TagList::TAG_TYPE &&
+            (name == "block_entities" || name == "TileEntities")) {
+            entities = reader.readList();
+            break;
         }
-        nbt_region.addTag("chunks", nbt_chunks);
-        nbt_regions.payload.push_back(nbt::TagPtr(nbt_region.clone()));
+        reader.skip(type);
     }
+    readSigns(reader, entities, signs);
+}
 
-    nbt_file.addTag("regions", nbt_regions);
-    nbt_file.writeNBT(cache_file.string().c_str(), nbt::Compression::GZIP);
+void WorldEntitiesCache::writeRegion(std::ostream &out, const RegionPos &pos,
+                                     const CachedRegion &region) {
+    writeValue<int32_t>(out, pos.x);
+    writeValue<int32_t>(out, pos.z);
+    writeValue<int64_t>(out, region.timestamp);
+    writeValue<uint32_t>(out, region.chunks.size());
+    for (auto chunk_it = region.chunks.begin(); chunk_it != region.chunks.end(); ++chunk_it) {
+        writeValue<int32_t>(out, chunk_it->first.x);
+        writeValue<int32_t>(out, chunk_it->first.z);
+        writeValue<uint32_t>(out, chunk_it->second.size());
+        for (auto sign_it = chunk_it->second.begin(); sign_it != chunk_it->second.end();
+             ++sign_it) {
+            writeValue<int32_t>(out, sign_it->pos.x);
+            writeValue<int32_t>(out, sign_it->pos.z);
+            writeValue<int32_t>(out, sign_it->pos.y);
+            for (int i = 0; i < 4; i++)
+                writeString(out, sign_it->lines[i]);
+        }
+    }
 }
 
-void WorldEntitiesCache::update(util::IProgressHandler *progress) {
-    unsigned int timestamp = readCacheFile();
+bool WorldEntitiesCache::readRegion(std::istream &in, RegionPos &pos, CachedRegion &region) {
+    int32_t region_x, region_z;
+    uint32_t chunk_count;
+    if (!readValue(in, region_x) || !readValue(in, region_z) ||
+        !readValue(in, region.timestamp) || !readValue(in, chunk_count) || chunk_count > 1024)
+        return false;
+    pos = RegionPos(region_x, region_z);
+
+    for (uint32_t i = 0; i < chunk_count; i++) {
+        int32_t chunk_x, chunk_z;
+        uint32_t sign_count;
+        if (!readValue(in, chunk_x) || !readValue(in, chunk_z) || !readValue(in, sign_count))
+            return false;
+        std::vector<RawSign> &signs = region.chunks[ChunkPos(chunk_x, chunk_z)];
+        for (uint32_t j = 0; j < sign_count; j++) {
+            int32_t x, z, y;
+            RawSign sign;
+            if (!readValue(in, x) || !readValue(in, z) || !readValue(in, y))
+                return false;
+            sign.pos = BlockPos(x, z, y);
+            for (int k = 0; k < 4; k++)
+                if (!readString(in, sign.lines[k]))
+                    return false;
+            signs.push_back(sign);
+        }
+    }
+    return true;
+}
 
-    auto regions = world.getAvailableRegions();
-    if (progress != nullptr)
-        progress->setMax(regions.size());
-    for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it) {
+void WorldEntitiesCache::readCacheFile() {
+    regions.clear();
+    cache_file_regions = 0;
+    cache_file_invalid = true;
+
+    std::ifstream in(cache_file.string(), std::ios::binary);
+    if (!in) {
+        LOG(DEBUG) << "Cache file " << cache_file << " does not exist.";
+        return;
+    }
+    char magic[4];
+    uint32_t version;
+    in.read(magic, 4);
+    if (!in || std::memcmp(magic, ENTITIES_CACHE_MAGIC, 4) != 0 || !readValue(in, version) ||
+        version != ENTITIES_CACHE_VERSION) {
+        LOG(DEBUG) << "Cache file " << cache_file << " is invalid.";
+        return;
+    }
 
+    // regions appended later replace the ones appended before
+    while (in.peek() != std::ifstream::traits_type::eof()) {
+        RegionPos pos;
+        CachedRegion region;
+        if (!readRegion(in, pos, region)) {
+            // keep the regions read so far, the file is rewritten anyways
+            LOG(DEBUG) << "Cache file " << cache_file << " is truncated.";
+            return;
+        }
+        regions[pos] = std::move(region);
+        cache_file_regions++;
+    }
+    cache_file_invalid = false;
+    LOG(DEBUG) << "Read cache file " << cache_file << " with " << regions.size() << " regions.";
+}
+
+bool WorldEntitiesCache::appendCacheFile(const std::vector<RegionPos> &updated_regions) {
+    // write all regions at once, so the file is not left with a half-written region
+    // if writing fails in between
+    std::ostringstream buffer;
+    for (auto region_it = updated_regions.begin(); region_it != updated_regions.end();
+         ++region_it)
+        writeRegion(buffer, *region_it, regions.at(*region_it));
+    std::string data = buffer.str();
+
+    std::ofstream out(cache_file.string(), std::ios::binary | std::ios::app);
+    out.write(data.data(), data.size());
+    out.close();
+    if (!out)
+        return false;
+    cache_file_regions += updated_regions.size();
+    return true;
+}
+
+bool WorldEntitiesCache::writeCacheFile() {
+    fs::path tmp_file = cache_file.string() + ".tmp";
+    std::ofstream out(tmp_file.string(), std::ios::binary);
+    out.write(ENTITIES_CACHE_MAGIC, 4);
+    writeValue(out, ENTITIES_CACHE_VERSION);
+    for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it)
+        writeRegion(out, region_it->first, region_it->second);
+    out.close();
+
+    boost::system::error_code error;
+    if (!out || (fs::rename(tmp_file, cache_file, error), error)) {
+        fs::remove(tmp_file, error);
+        return false;
+    }
+    cache_file_regions = regions.size();
+    cache_file_invalid = false;
+    return true;
+}
+
+void WorldEntitiesCache::update(util::IProgressHandler *progress, int threads,
+                                const SignSink *collected) {
+    readCacheFile();
+
+    // forget the regions which don't exist anymore
+    const World::RegionSet &available_regions = world.getAvailableRegions();
+    size_t regions_before = regions.size();
+    for (auto region_it = regions.begin(); region_it != regions.end();) {
+        if (!available_regions.count(region_it->first))
+            region_it = regions.erase(region_it);
+        else
+            ++region_it;
+    }
+    bool regions_removed = regions.size() != regions_before;
+
+    // find the regions which changed since they were scanned the last time
+    std::vector<RegionPos> outdated_regions;
+    for (auto region_it = available_regions.begin(); region_it != available_regions.end();
+         ++region_it) {
         fs::path region_path = world.getRegionPath(*region_it);
-        if (fs::last_write_time(region_path) < timestamp) {
+        auto cached_it = regions.find(*region_it);
+        if (cached_it != regions.end() &&
+            fs::last_write_time(region_path) < cached_it->second.timestamp) {
             LOG(DEBUG) << "Entities of region " << region_path.filename()
                        << " are cached (mtime region " << fs::last_write_time(region_path)
-                       << " < mtime cache " << timestamp << ").";
-            if (progress != nullptr)
-                progress->setValue(progress->getValue() + 1);
+                       << " < scan time " << cached_it->second.timestamp << ").";
             continue;
-        } else {
-            LOG(DEBUG) << "Entities of region " << region_path.filename()
-                       << " are outdated. (mtime region file " << fs::last_write_time(region_path)
-                       << " >= mtime cache " << timestamp << "). Updating.";
         }
+        LOG(DEBUG) << "Entities of region " << region_path.filename() << " are outdated.";
+        outdated_regions.push_back(*region_it);
+    }
 
-        RegionFile region;
-        world.getRegion(*region_it, region);
-        region.read();
-
-        auto chunks = region.getContainingChunks();
-        for (auto chunk_it = chunks.begin(); chunk_it != chunks.end(); ++chunk_it) {
-            if (region.getChunkTimestamp(*chunk_it) < timestamp)
-                continue;
-
-            this->entities[*region_it][*chunk_it].clear();
+    if (progress != nullptr) {
+        progress->setMax(available_regions.size());
+        progress->setValue(available_regions.size() - outdated_regions.size());
+    }
 
-            mc::nbt::NBTFile nbt;
-            const std::vector<uint8_t> &data = region.getChunkData(*chunk_it);
-            nbt.readNBT(reinterpret_cast<const char *>(&data[0]), data.size(),
-                        mc::nbt::Compression::ZLIB);
+    // scan the outdated regions in parallel, each region is scanned by one thread, the
+    // regions are scanned with the time before scanning, so regions modified in the
+    // meantime are scanned again next time
+    int64_t timestamp = std::time(nullptr);
+    std::vector<CachedRegion> scanned_regions(outdated_regions.size());
+    std::vector<char> scanned(outdated_regions.size(), false);
+    for (size_t i = 0; i < outdated_regions.size(); i++) {
+        auto cached_it = regions.find(outdated_regions[i]);
+        if (cached_it != regions.end())
+            scanned_regions[i] = std::move(cached_it->second);
+    }
 
-            // nbt::TagCompound& level = nbt.findTag<nbt::TagCompound>("Level");
-            if (!nbt.hasTag<nbt::TagList>("block_entities")) {
-                continue;
-            }
-            nbt::TagList &entities = nbt.findTag<nbt::TagList>("block_entities");
-            for (auto entity_it = entities.payload.begin(); entity_it != entities.payload.end();
-                 ++entity_it) {
-                nbt::TagCompound entity = (*entity_it)->cast<nbt::TagCompound>();
-                this->entities[*region_it][*chunk_it].push_back(entity);
+    std::atomic<size_t> next_region(0);
+    thread_ns::mutex progress_mutex;
+    auto scan = [&]() {
+        size_t i;
+        while ((i = next_region++) < outdated_regions.size()) {
+            scanned[i] =
+                scanRegion(outdated_regions[i], timestamp, collected, scanned_regions[i]);
+            if (!scanned[i])
+                LOG(WARNING) << "Unable to read region "
+                             << world.getRegionPath(outdated_regions[i]) << ".";
+            if (progress != nullptr) {
+                thread_ns::unique_lock<thread_ns::mutex> lock(progress_mutex);
+                progress->setValue(progress->getValue() + 1);
             }
         }
-        if (progress != nullptr)
-            progress->setValue(progress->getValue() + 1);
+    };
+    std::vector<thread_ns::thread> pool;
+    for (int i = 1; i < threads && size_t(i) < outdated_regions.size(); i++)
+        pool.push_back(thread_ns::thread(scan));
+    scan();
+    for (auto thread_it = pool.begin(); thread_it != pool.end(); ++thread_it)
+        thread_it->join();
+
+    std::vector<RegionPos> updated_regions;
+    for (size_t i = 0; i < outdated_regions.size(); i++) {
+        regions[outdated_regions[i]] = std::move(scanned_regions[i]);
+        if (scanned[i])
+            updated_regions.push_back(outdated_regions[i]);
     }
 
-    LOG(DEBUG) << "Writing cache file " << cache_file << " at " << std::time(nullptr) << ".";
-    writeCacheFile();
+    // rewrite the cache file if required or if it has too many outdated regions,
+    // otherwise just append the updated regions
+    if (updated_regions.empty() && !regions_removed && !cache_file_invalid)
+        return;
+    bool ok;
+    if (cache_file_invalid || regions_removed ||
+        cache_file_regions + updated_regions.size() > 2 * regions.size() + 16) {
+        LOG(DEBUG) << "Writing cache file " << cache_file << ".";
+        ok = writeCacheFile();
+    } else {
+        LOG(DEBUG) << "Appending " << updated_regions.size() << " regions to cache file "
+                   << cache_file << ".";
+        ok = appendCacheFile(updated_regions);
+    }
+    if (!ok)
+        LOG(WARNING) << "Unable to write entity cache file " << cache_file << ".";
 }
 
 std::vector<SignEntity> WorldEntitiesCache::getSigns(WorldCrop world_crop) const {
     std::vector<SignEntity> signs;
 
-    for (auto region_it = entities.begin(); region_it != entities.end(); ++region_it) {
+    for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it) {
         if (!world_crop.isRegionContained(region_it->first))
             continue;
-        for (auto chunk_it = region_it->second.begin(); chunk_it != region_it->second.end();
-             ++chunk_it) {
+        const auto &chunks = region_it->second.chunks;
+        for (auto chunk_it = chunks.begin(); chunk_it != chunks.end(); ++chunk_it) {
             if (!world_crop.isChunkContained(chunk_it->first))
                 continue;
-            for (auto entity_it = chunk_it->second.begin(); entity_it != chunk_it->second.end();
-                 ++entity_it) {
-                const nbt::TagCompound &entity = *entity_it;
-
-                if (entity.findTag<nbt::TagString>("id").payload != "Sign" &&
-                    entity.findTag<nbt::TagString>("id").payload != "minecraft:sign")
+            for (auto sign_it = chunk_it->second.begin(); sign_it != chunk_it->second.end();
+                 ++sign_it) {
+                if (!world_crop.isBlockContainedXZ(sign_it->pos) ||
+                    !world_crop.isBlockContainedY(sign_it->pos))
                     continue;
-
-                mc::BlockPos pos(entity.findTag<nbt::TagInt>("x").payload,
-                                 entity.findTag<nbt::TagInt>("z").payload,
-                                 entity.findTag<nbt::TagInt>("y").payload);
-
-                if (!world_crop.isBlockContainedXZ(pos) || !world_crop.isBlockContainedY(pos))
-                    continue;
-
-                mc::SignEntity::Lines lines = {{entity.findTag<nbt::TagString>("Text1").payload,
-                                                entity.findTag<nbt::TagString>("Text2").payload,
-                                                entity.findTag<nbt::TagString>("Text3").payload,
-                                                entity.findTag<nbt::TagString>("Text4").payload}};
-
-                signs.push_back(mc::SignEntity(pos, lines));
+                signs.push_back(mc::SignEntity(sign_it->pos, sign_it->lines));
             }
         }
     }
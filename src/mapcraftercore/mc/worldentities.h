@@ -20,13 +20,16 @@
 #ifndef WORLDENTITIES_H_
 #define WORLDENTITIES_H_
 
+#include "../compat/thread.h"
 #include "nbt.h"
+#include "nbtreader.h"
 #include "pos.h"
 #include "world.h"
 #include "worldcrop.h"
 
 #include <array>
 #include <boost/filesystem.hpp>
+#include <cstdint>
 #include <map>
 #include <vector>
 
@@ -65,34 +68,133 @@ class SignEntity {
     std::string text;
 };
 
+/**
+ * A sign as it is stored in the chunk. The lines are parsed when the actual sign
+ * entities are created.
+ */
+struct RawSign {
+    BlockPos pos;
+    SignEntity::Lines lines;
+};
+
+/**
+ * Reads the signs of a list of block entities, the reader is positioned somewhere after
+ * the list afterwards.
+ */
+void readSigns(nbt::NBTReader &reader, const nbt::ListView &block_entities,
+               std::vector<RawSign> &signs);
+
+/**
+ * Collects the signs of the chunks which are read while rendering a world, so the
+ * entity cache doesn't have to read these chunks again. Chunks can be added by
+ * multiple threads at the same time.
+ */
+class SignSink {
+  public:
+    /**
+     * The signs of a chunk and the timestamp of the chunk they were read at.
+     */
+    struct CollectedChunk {
+        uint32_t timestamp;
+        std::vector<RawSign> signs;
+    };
+
+    SignSink();
+    ~SignSink();
+
+    /**
+     * Adds the signs of a chunk (with its original, not rotated position).
+     */
+    void addChunk(const ChunkPos &pos, uint32_t timestamp, std::vector<RawSign> &&signs);
+
+    /**
+     * Returns the collected signs of a chunk, or nullptr if the chunk wasn't read. Must
+     * not be called while chunks are added.
+     */
+    const CollectedChunk *getChunk(const ChunkPos &pos) const;
+
+    size_t getChunkCount() const;
+
+    void clear();
+
+  private:
+    thread_ns::mutex mutex;
+    std::map<ChunkPos, CollectedChunk> chunks;
+};
+
+/**
+ * Caches the sign block entities of a world. Only the chunks which changed since the
+ * last update are scanned again, the regions are processed in parallel.
+ *
+ * The cache file is an append-only log of regions: every update appends the signs of
+ * the regions which changed, a region appended later replaces the one appended before.
+ * The file is rewritten from time to time when it contains too many outdated regions.
+ */
 class WorldEntitiesCache {
   public:
     WorldEntitiesCache(const World &world);
     ~WorldEntitiesCache();
 
     /**
-     * Updates the entity cache.
+     * Updates the entity cache using the specified count of threads. The signs of chunks
+     * collected while rendering are used instead of reading these chunks again.
      */
-    void update(util::IProgressHandler *progress = nullptr);
+    void update(util::IProgressHandler *progress = nullptr, int threads = 1,
+                const SignSink *collected = nullptr);
 
     std::vector<SignEntity> getSigns(WorldCrop crop = WorldCrop()) const;
 
   private:
+    /**
+     * The signs of the chunks of a region and the time the region was scanned at.
+     */
+    struct CachedRegion {
+        int64_t timestamp = 0;
+        std::map<ChunkPos, std::vector<RawSign>> chunks;
+    };
+
     World world;
     fs::path cache_file;
 
-    std::map<RegionPos, std::map<ChunkPos, std::vector<nbt::TagCompound>>> entities;
+    std::map<RegionPos, CachedRegion> regions;
+    // count of regions in the cache file, including the outdated ones,
+    // and whether the file needs to be rewritten because it is invalid
+    size_t cache_file_regions;
+    bool cache_file_invalid;
+
+    /**
+     * Scans the signs of the chunks of a region which changed since the region was
+     * scanned the last time, the region gets the specified timestamp afterwards. Chunks
+     * collected while rendering are not read again if they didn't change since then.
+     * Returns false if the region file can't be read.
+     */
+    bool scanRegion(const RegionPos &pos, int64_t timestamp, const SignSink *collected,
+                    CachedRegion &region) const;
+
+    /**
+     * Extracts the signs from the (compressed) NBT data of a chunk without parsing the
+     * whole chunk.
+     */
+    static void scanChunk(const ChunkDataView &data, std::vector<RawSign> &signs);
+
+    static void writeRegion(std::ostream &out, const RegionPos &pos, const CachedRegion &region);
+    static bool readRegion(std::istream &in, RegionPos &pos, CachedRegion &region);
+
+    /**
+     * Reads the file with the cached entities.
+     */
+    void readCacheFile();
 
     /**
-     * Reads the file with the cached entities and returns a timestamp when this cache
-     * was updated the last time.
+     * Appends regions to the file with the cached entities. Returns false if the file
+     * can't be written.
      */
-    unsigned int readCacheFile();
+    bool appendCacheFile(const std::vector<RegionPos> &updated_regions);
 
     /**
-     * Writes the file with the cached entities.
+     * Rewrites the file with the cached entities with only the current regions.
      */
-    void writeCacheFile() const;
+    bool writeCacheFile();
 };
 
 } /* namespace mc */
@@ -42,6 +42,15 @@ Biome::Biome(uint16_t id, double temperature, double rainfall, uint32_t green_ti
  */
 uint16_t Biome::getID() const { return id; }
 
+/**
+ * Returns whether the color of the biome is the same for all blocks with the same
+ * y-coordinate, i.e. it doesn't depend on the x- and z-coordinates (like the swamp grass
+ * noise does).
+ */
+bool Biome::isColorUniform(const ColorMapType &color_type) const {
+    return !((id == 6 || id == 134) && color_type == ColorMapType::GRASS);
+}
+
 /**
  * Calculates the color of the biome with a biome color image.
  */
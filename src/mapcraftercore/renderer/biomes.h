@@ -64,6 +64,7 @@ class Biome {
           uint32_t water_tint = default_water);
 
     uint16_t getID() const;
+    bool isColorUniform(const ColorMapType &color_type) const;
     uint32_t getColor(const mc::BlockPos &pos, const ColorMapType &color_type,
                       const ColorMap &color_map) const;
 };
@@ -22,6 +22,7 @@
 #include "../mc/blockstate.h"
 #include "../util.h"
 #include "biomes.h"
+#include "image/kernels.h"
 
 #include <chrono>
 #include <map>
@@ -174,121 +175,23 @@ void blockImageMultiplyExcept(RGBAImage &block, const RGBAImage &uv_mask, uint8_
     }
 }
 
-namespace {
-
-/*
-inline uint32_t divide255(uint32_t v1, uint32_t v2) {
-        uint32_t t = v1 * v2 + 128;
-        return ((t >> 8) + t) >> 8;
-}
-*/
-
-inline uint32_t mix(uint32_t x, uint32_t y, uint32_t a) {
-    // >> 8 = / 256, serves as approximation for division by 255
-    return ((x * (255 - a)) + (y * a)) >> 8;
-}
-
-} // namespace
-
 void blockImageMultiply(RGBAImage &block, const RGBAImage &uv_mask,
                         const CornerValues &factors_left, const CornerValues &factors_right,
                         const CornerValues &factors_up) {
     assert(block.getWidth() == uv_mask.getWidth());
     assert(block.getHeight() == uv_mask.getHeight());
 
-    uint32_t fl[4], fr[4], fu[4];
+    const uint8_t faces[3] = {FACE_LEFT_INDEX, FACE_RIGHT_INDEX, FACE_UP_INDEX};
+    uint32_t factors[3][4];
     for (int i = 0; i < 4; i++) {
-        fl[i] = factors_left[i] * 255;
-        fr[i] = factors_right[i] * 255;
-        fu[i] = factors_up[i] * 255;
+        factors[0][i] = factors_left[i] * 255;
+        factors[1][i] = factors_right[i] * 255;
+        factors[2][i] = factors_up[i] * 255;
     }
 
-    size_t n = block.getWidth() * block.getHeight();
-    for (size_t i = 0; i < n; i++) {
-        uint32_t &pixel = block.data[i];
-        uint32_t uv_pixel = uv_mask.data[i];
-        if (rgba_alpha(uv_pixel) == 0) {
-            continue;
-        }
-
-        // const CornerValues* vptr = nullptr;
-        uint32_t *f = nullptr;
-        uint8_t side = rgba_blue(uv_pixel);
-        if (side == FACE_LEFT_INDEX) {
-            // vptr = &factors_left;
-            f = fl;
-        } else if (side == FACE_RIGHT_INDEX) {
-            // vptr = &factors_right;
-            f = fr;
-        } else if (side == FACE_UP_INDEX) {
-            // vptr = &factors_up;
-            f = fu;
-        } else {
-            continue;
-        }
-
-        /*
-        const CornerValues& values = *vptr;
-        float u = (float) rgba_red(uv_pixel) / 255.0;
-        float v = (float) rgba_green(uv_pixel) / 255.0;
-        float ab = (1-u) * values[0] + u * values[1];
-        float cd = (1-u) * values[2] + u * values[3];
-        float x = (1-v) * ab + v * cd;
-        */
-
-        uint32_t u = rgba_red(uv_pixel);
-        uint32_t v = rgba_green(uv_pixel);
-
-        // uint32_t ab = divide255((255-u), f[0]) + divide255(u, f[1]);
-        // uint32_t cd = divide255((255-u), f[2]) + divide255(u, f[3]);
-        // uint32_t x = divide255((255-v), ab) + divide255(v,  cd);
-
-        // jetzt sogar 34.17
-        // und mit noch mehr rgba_multiply sogar 35.28
-        uint32_t ab = mix(f[0], f[1], u); // divide255((255-u) * f[0], u * f[1]);
-        uint32_t cd = mix(f[2], f[3], u); // divide255((255-u) * f[2], u * f[3]);
-        uint32_t x = mix(ab, cd, v);      // divide255((255-v) * ab, v * cd);
-
-        // OHNE BASIS
-        // 45.68
-        // pixel = rgba_multiply(pixel, 0.5);
-
-        // 34.44
-        // float x = 0.5;
-        // pixel = rgba_multiply(pixel, x, x, x);
-
-        // FLOAT ALS BASIS
-        // 25.68
-        // pixel = rgba_multiply(pixel, x, x, x);
-
-        // geht. aber vielleicht auch nicht mega viel schneller
-        // uint8_t factor = x * 255;
-        // pixel = rgba_multiply(pixel, factor, factor, factor);
-
-        // geht, 29.13
-        // int factor = x * 255;
-        // assert(factor >= 0 && factor <= 255);
-        // pixel = rgba_multiply(pixel, factor);
-
-        // INTEGER ALS BASIS
-        // assert(x >= 0 && x <= 255);
-
-        // geht, 28.93
-        // double factor = (double) x / 255;
-        // pixel = rgba_multiply(pixel, factor, factor, factor);
-
-        // geht, 28.00
-        // uint8_t factor = x;
-        // pixel = rgba_multiply(pixel, factor, factor, factor);
-
-        // geht, 29.83
-        // ohne uv-alpha check sogar 32.15
-        // ohne uv-alpha check und uint8_t 32.39
-        // ... div255 32.60
-        // ... anderes div255 32.88
-        // rgba_ inline: 33.64
-        pixel = rgba_multiply_scalar(pixel, x);
-    }
+    // the pixel loop is one of the image kernels
+    getImageKernels().multiplyFaces(block.data.data(), uv_mask.data.data(),
+                                    block.getWidth() * block.getHeight(), faces, factors);
 }
 
 void blockImageMultiply(RGBAImage &block, uint8_t factor) {
@@ -302,28 +205,12 @@ void blockImageTint(RGBAImage &block, const RGBAImage &mask, uint32_t color) {
     assert(block.getWidth() == mask.getWidth());
     assert(block.getHeight() == mask.getHeight());
 
-    size_t n = block.getWidth() * block.getHeight();
-    for (size_t i = 0; i < n; i++) {
-        uint32_t mask_pixel = mask.data[i];
-        if (rgba_alpha(mask_pixel)) {
-            uint32_t &pixel = block.data[i];
-            // The mask is not supposed to be transfered directly
-            // but to be blend in with block pixel
-            // This will avoid white pixels on edges of the mask
-            RGBAPixel colored_mask_pixel = rgba_multiply(mask_pixel, color);
-            blend(pixel, colored_mask_pixel);
-        }
-    }
+    getImageKernels().tintMask(block.data.data(), mask.data.data(),
+                               block.getWidth() * block.getHeight(), color);
 }
 
 void blockImageTint(RGBAImage &block, uint32_t color) {
-    size_t n = block.getWidth() * block.getHeight();
-    for (size_t i = 0; i < n; i++) {
-        uint32_t pixel = block.data[i];
-        if (rgba_alpha(pixel)) {
-            block.data[i] = rgba_multiply(pixel, color);
-        }
-    }
+    getImageKernels().tint(block.data.data(), block.getWidth() * block.getHeight(), color);
 }
 
 void blockImageTintHighContrast(RGBAImage &block, uint32_t color) {
@@ -344,13 +231,8 @@ void blockImageTintHighContrast(RGBAImage &block, uint32_t color) {
     int ng = (rgba_green(color) - luminance) / alpha_factor;
     int nb = (rgba_blue(color) - luminance) / alpha_factor;
 
-    size_t n = block.getWidth() * block.getHeight();
-    for (size_t i = 0; i < n; i++) {
-        RGBAPixel &pixel = block.data[i];
-        if ((pixel & 0xff000000) > 0) {
-            pixel = rgba_add_clamp(pixel, nr, ng, nb, 0);
-        }
-    }
+    getImageKernels().addClamp(block.data.data(), block.getWidth() * block.getHeight(), nr, ng,
+                               nb);
 }
 
 void blockImageTintHighContrast(RGBAImage &block, const RGBAImage &mask, int face, uint32_t color) {
@@ -364,14 +246,8 @@ void blockImageTintHighContrast(RGBAImage &block, const RGBAImage &mask, int fac
     int ng = (rgba_green(color) - luminance) / alpha_factor;
     int nb = (rgba_blue(color) - luminance) / alpha_factor;
 
-    size_t n = block.getWidth() * block.getHeight();
-    for (size_t i = 0; i < n; i++) {
-        RGBAPixel &pixel = block.data[i];
-        RGBAPixel mask_pixel = mask.data[i];
-        if (rgba_blue(mask_pixel) == face) {
-            pixel = rgba_add_clamp(pixel, nr, ng, nb, 0);
-        }
-    }
+    getImageKernels().addClampFace(block.data.data(), mask.data.data(),
+                                   block.getWidth() * block.getHeight(), face, nr, ng, nb);
 }
 
 void blockImageBlendTop(RGBAImage &block, const RGBAImage &uv_mask, const RGBAImage &top,
@@ -407,14 +283,12 @@ void blockImageBlendTop(RGBAImage &block, const RGBAImage &uv_mask, const RGBAIm
     }
 }
 
-void blockImageShadowEdges(RGBAImage &block, const RGBAImage &uv_mask, uint8_t north, uint8_t south,
-                           uint8_t east, uint8_t west, uint8_t bottom) {
-    assert(block.getWidth() == uv_mask.getWidth());
-    assert(block.getHeight() == uv_mask.getHeight());
-
-    size_t n = block.getWidth() * block.getHeight();
+void blockImageShadowEdgeFactors(const RGBAImage &uv_mask, uint8_t north, uint8_t south,
+                                 uint8_t east, uint8_t west, uint8_t bottom,
+                                 std::vector<uint8_t> &factors) {
+    size_t n = uv_mask.getWidth() * uv_mask.getHeight();
+    factors.resize(n);
     for (size_t i = 0; i < n; i++) {
-        RGBAPixel &pixel = block.data[i];
         const RGBAPixel &uv_pixel = uv_mask.data[i];
 
         // TODO
@@ -458,12 +332,19 @@ void blockImageShadowEdges(RGBAImage &block, const RGBAImage &uv_mask, uint8_t n
 
 #undef setalpha
 
-        pixel = rgba_multiply_scalar(pixel, 255 - alpha);
-        /*
-        if (alpha != 0) {
-                pixel = rgba_multiply(pixel, rgba(255 - alpha, 0, 0));
-        }
-        */
+        factors[i] = 255 - alpha;
+    }
+}
+
+void blockImageShadowEdges(RGBAImage &block, const RGBAImage &uv_mask, uint8_t north, uint8_t south,
+                           uint8_t east, uint8_t west, uint8_t bottom) {
+    assert(block.getWidth() == uv_mask.getWidth());
+    assert(block.getHeight() == uv_mask.getHeight());
+
+    std::vector<uint8_t> factors;
+    blockImageShadowEdgeFactors(uv_mask, north, south, east, west, bottom, factors);
+    for (size_t i = 0; i < factors.size(); i++) {
+        block.data[i] = rgba_multiply_scalar(block.data[i], factors[i]);
     }
 }
 
@@ -509,6 +390,26 @@ std::array<bool, 3> blockImageGetSideMask(const RGBAImage &uv) {
     return side_mask;
 }
 
+std::array<PixelSpans, 3> blockImageGetFaceSpans(const RGBAImage &uv) {
+    std::array<PixelSpans, 3> face_spans;
+    uint8_t mask_indices[3] = {FACE_LEFT_INDEX, FACE_RIGHT_INDEX, FACE_UP_INDEX};
+    uint32_t n = uv.getWidth() * uv.getHeight();
+    for (uint8_t i = 0; i < 3; i++) {
+        for (uint32_t begin = 0; begin < n; begin++) {
+            if (rgba_blue(uv.data[begin]) != mask_indices[i]) {
+                continue;
+            }
+            uint32_t end = begin + 1;
+            while (end < n && rgba_blue(uv.data[end]) == mask_indices[i]) {
+                end++;
+            }
+            face_spans[i].push_back(std::make_pair(begin, end));
+            begin = end;
+        }
+    }
+    return face_spans;
+}
+
 RenderedBlockImages::RenderedBlockImages(mc::BlockStateRegistry &block_registry)
     : block_registry(block_registry), darken_left(1.0), darken_right(1.0) {}
 
@@ -773,6 +674,9 @@ void RenderedBlockImages::prepareBlockImages() {
     assert(block_images.size() > solid_id && block_images[solid_id] != nullptr);
     const BlockImage &solid = *block_images[solid_id];
 
+    // block images with the same uv image (lots of them are full blocks) share an index
+    std::map<std::vector<RGBAPixel>, int> uv_indices;
+
     for (uint16_t id = 0; id < block_images.size(); ++id) {
         if (block_images[id] == nullptr) {
             continue;
@@ -791,6 +695,9 @@ void RenderedBlockImages::prepareBlockImages() {
         }
 
         block.side_mask = blockImageGetSideMask(block.uv_image);
+        block.face_spans = blockImageGetFaceSpans(block.uv_image);
+        auto uv_index = uv_indices.insert(std::make_pair(block.uv_image.data, uv_indices.size()));
+        block.uv_index = uv_index.first->second;
 
         if (blockImageIsTransparent(block.image, solid.uv_image)) {
             // LOG(INFO) << block_state.getName() << " " << block_state.getVariantDescription() << "
@@ -30,6 +30,8 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace fs = boost::filesystem;
 
@@ -92,9 +94,18 @@ void blockImageBlendTop(RGBAImage &block, const RGBAImage &uv_mask, const RGBAIm
                         const RGBAImage &top_uv_mask);
 void blockImageShadowEdges(RGBAImage &block, const RGBAImage &uv_mask, uint8_t north, uint8_t south,
                            uint8_t east, uint8_t west, uint8_t bottom);
+// the factors blockImageShadowEdges multiplies each pixel with
+void blockImageShadowEdgeFactors(const RGBAImage &uv_mask, uint8_t north, uint8_t south,
+                                 uint8_t east, uint8_t west, uint8_t bottom,
+                                 std::vector<uint8_t> &factors);
 bool blockImageIsTransparent(RGBAImage &block, const RGBAImage &uv_mask);
 std::array<bool, 3> blockImageGetSideMask(const RGBAImage &uv);
 
+// ranges [begin, end) of pixel indices
+typedef std::vector<std::pair<uint32_t, uint32_t>> PixelSpans;
+// pixel spans of the left, right and up face
+std::array<PixelSpans, 3> blockImageGetFaceSpans(const RGBAImage &uv);
+
 enum class LightingType {
     NONE,
     SIMPLE,
@@ -106,10 +117,14 @@ enum class LightingType {
 struct BlockImage {
     // TODO
     // this needs some order and refactoring
-    BlockImage() : lighting_specified(false) {}
+    BlockImage() : uv_index(-1), lighting_specified(false) {}
 
     RGBAImage image, uv_image;
     std::array<bool, 3> side_mask;
+    // pixels of the left, right and up face, to strip faces hidden by neighbor blocks
+    std::array<PixelSpans, 3> face_spans;
+    // block images with the same uv image have the same index (shadow edges depend on it)
+    int uv_index;
     bool is_transparent, is_air, is_full_water, is_ice;
 
     bool is_biome;
@@ -25,6 +25,7 @@
 
 #include "../util.h"
 #include "image/dithering.h"
+#include "image/kernels.h"
 #include "image/quantization.h"
 #include "image/scaling.h"
 
@@ -186,14 +187,13 @@ void RGBAImage::simpleAlphaBlit(const RGBAImage &image, int x, int y) {
     */
 
     int sx = std::max(0, -x);
-    int sy;
-    for (; sx < image.width && sx + x < width; sx++) {
-        sy = std::max(0, -y);
-        for (; sy < image.height && sy + y < height; sy++) {
-            if (rgba_alpha(image.data[sy * image.width + sx]) != 0) {
-                data[(sy + y) * width + (sx + x)] = image.data[sy * image.width + sx];
-            }
-        }
+    int w = std::min(image.width, width - x) - sx;
+    if (w <= 0)
+        return;
+    const ImageKernels &kernels = getImageKernels();
+    for (int sy = std::max(0, -y); sy < image.height && sy + y < height; sy++) {
+        kernels.alphaCopy(&data[(sy + y) * width + (sx + x)], &image.data[sy * image.width + sx],
+                          w);
     }
 }
 
@@ -214,12 +214,12 @@ void RGBAImage::alphaBlit(const RGBAImage &image, int x, int y) {
     */
 
     int sx = std::max(0, -x);
-    int sy;
-    for (; sx < image.width && sx + x < width; sx++) {
-        sy = std::max(0, -y);
-        for (; sy < image.height && sy + y < height; sy++) {
-            blend(data[(sy + y) * width + (sx + x)], image.data[sy * image.width + sx]);
-        }
+    int w = std::min(image.width, width - x) - sx;
+    if (w <= 0)
+        return;
+    const ImageKernels &kernels = getImageKernels();
+    for (int sy = std::max(0, -y); sy < image.height && sy + y < height; sy++) {
+        kernels.blend(&data[(sy + y) * width + (sx + x)], &image.data[sy * image.width + sx], w);
     }
 }
 
@@ -0,0 +1,525 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernels.h"
+
+#include "../../config.h"
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+void blendScalar(RGBAPixel *dest, const RGBAPixel *source, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        blend(dest[i], source[i]);
+    }
+}
+
+void alphaCopyScalar(RGBAPixel *dest, const RGBAPixel *source, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (rgba_alpha(source[i]) != 0) {
+            dest[i] = source[i];
+        }
+    }
+}
+
+inline uint32_t mix(uint32_t x, uint32_t y, uint32_t a) {
+    // >> 8 = / 256, serves as approximation for division by 255
+    return ((x * (255 - a)) + (y * a)) >> 8;
+}
+
+void multiplyFacesScalar(RGBAPixel *pixels, const RGBAPixel *uv, size_t n,
+                         const uint8_t faces[3], const uint32_t factors[3][4]) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t uv_pixel = uv[i];
+        if (rgba_alpha(uv_pixel) == 0) {
+            continue;
+        }
+
+        const uint32_t *f = nullptr;
+        uint8_t side = rgba_blue(uv_pixel);
+        if (side == faces[0]) {
+            f = factors[0];
+        } else if (side == faces[1]) {
+            f = factors[1];
+        } else if (side == faces[2]) {
+            f = factors[2];
+        } else {
+            continue;
+        }
+
+        uint32_t u = rgba_red(uv_pixel);
+        uint32_t v = rgba_green(uv_pixel);
+        uint32_t ab = mix(f[0], f[1], u);
+        uint32_t cd = mix(f[2], f[3], u);
+        uint32_t x = mix(ab, cd, v);
+        pixels[i] = rgba_multiply_scalar(pixels[i], x);
+    }
+}
+
+void tintScalar(RGBAPixel *pixels, size_t n, RGBAPixel color) {
+    for (size_t i = 0; i < n; i++) {
+        if (rgba_alpha(pixels[i])) {
+            pixels[i] = rgba_multiply(pixels[i], color);
+        }
+    }
+}
+
+void tintMaskScalar(RGBAPixel *pixels, const RGBAPixel *mask, size_t n, RGBAPixel color) {
+    for (size_t i = 0; i < n; i++) {
+        if (rgba_alpha(mask[i])) {
+            // The mask is not supposed to be transfered directly
+            // but to be blend in with block pixel
+            // This will avoid white pixels on edges of the mask
+            blend(pixels[i], rgba_multiply(mask[i], color));
+        }
+    }
+}
+
+void addClampScalar(RGBAPixel *pixels, size_t n, int r, int g, int b) {
+    for (size_t i = 0; i < n; i++) {
+        if ((pixels[i] & 0xff000000) > 0) {
+            pixels[i] = rgba_add_clamp(pixels[i], r, g, b, 0);
+        }
+    }
+}
+
+void addClampFaceScalar(RGBAPixel *pixels, const RGBAPixel *uv, size_t n, uint8_t face, int r,
+                        int g, int b) {
+    for (size_t i = 0; i < n; i++) {
+        if (rgba_blue(uv[i]) == face) {
+            pixels[i] = rgba_add_clamp(pixels[i], r, g, b, 0);
+        }
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+// The SIMD versions work on 4 (SSE4.1) or 8 (AVX2) pixels at once, the remaining pixels
+// of a row are done by the scalar versions. Everything that is computed with 8-bit
+// channels widened to 16 bits fits into 16 bits, the face multiplication uses 32-bit
+// arithmetic like the scalar code (so even factors out of range give the same results).
+
+__attribute__((target("sse4.1"))) inline __m128i load4(const RGBAPixel *pixels) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels));
+}
+
+__attribute__((target("sse4.1"))) inline void store4(RGBAPixel *pixels, __m128i value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels), value);
+}
+
+// broadcasts the alpha channel of two pixels (with 16-bit channels) to their channels
+__attribute__((target("sse4.1"))) inline __m128i alpha16(__m128i pixels) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, 0xff), 0xff);
+}
+
+// blend() of two pixels with 16-bit channels, without the special cases
+__attribute__((target("sse4.1"))) inline __m128i blend16(__m128i dest, __m128i source) {
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i full = _mm_set1_epi16(256);
+    __m128i sa = _mm_add_epi16(alpha16(source), one);
+    __m128i sainv = _mm_sub_epi16(_mm_set1_epi16(257), sa);
+    __m128i rgb = _mm_srli_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(source, sa), _mm_mullo_epi16(dest, sainv)), 8);
+    __m128i dainv = _mm_sub_epi16(full, alpha16(dest));
+    __m128i a = _mm_srli_epi16(_mm_sub_epi16(_mm_mullo_epi16(sainv, dainv), one), 8);
+    a = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    return _mm_blend_epi16(rgb, a, 0x88);
+}
+
+__attribute__((target("sse4.1"))) inline __m128i blend4(__m128i dest, __m128i source) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = blend16(_mm_unpacklo_epi8(dest, zero), _mm_unpacklo_epi8(source, zero));
+    __m128i high = blend16(_mm_unpackhi_epi8(dest, zero), _mm_unpackhi_epi8(source, zero));
+    __m128i result = _mm_packus_epi16(low, high);
+
+    // opaque source or transparent dest: source, transparent source: dest
+    __m128i sa = _mm_srli_epi32(source, 24);
+    __m128i da = _mm_srli_epi32(dest, 24);
+    __m128i copy = _mm_or_si128(_mm_cmpeq_epi32(da, zero),
+                                _mm_cmpeq_epi32(sa, _mm_set1_epi32(255)));
+    result = _mm_blendv_epi8(result, source, copy);
+    return _mm_blendv_epi8(result, dest, _mm_cmpeq_epi32(sa, zero));
+}
+
+// rgba_multiply of two pixels with 16-bit channels with a color (alpha channel 256)
+__attribute__((target("sse4.1"))) inline __m128i multiply4(__m128i pixels, __m128i color16) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), color16), 8);
+    __m128i high = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), color16), 8);
+    return _mm_packus_epi16(low, high);
+}
+
+__attribute__((target("sse4.1"))) inline __m128i color16(RGBAPixel color) {
+    return _mm_setr_epi16(rgba_red(color), rgba_green(color), rgba_blue(color), 256,
+                          rgba_red(color), rgba_green(color), rgba_blue(color), 256);
+}
+
+__attribute__((target("sse4.1"))) inline __m128i addClamp4(__m128i pixels, __m128i values) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = _mm_adds_epi16(_mm_unpacklo_epi8(pixels, zero), values);
+    __m128i high = _mm_adds_epi16(_mm_unpackhi_epi8(pixels, zero), values);
+    return _mm_packus_epi16(low, high);
+}
+
+__attribute__((target("sse4.1"))) inline __m128i mix4(__m128i x, __m128i y, __m128i a) {
+    __m128i ainv = _mm_sub_epi32(_mm_set1_epi32(255), a);
+    return _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(x, ainv), _mm_mullo_epi32(y, a)), 8);
+}
+
+__attribute__((target("sse4.1"))) void blendSSE41(RGBAPixel *dest, const RGBAPixel *source,
+                                                  size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        store4(dest + i, blend4(load4(dest + i), load4(source + i)));
+    }
+    blendScalar(dest + i, source + i, n - i);
+}
+
+__attribute__((target("sse4.1"))) void alphaCopySSE41(RGBAPixel *dest, const RGBAPixel *source,
+                                                      size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = load4(source + i);
+        __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(s, 24), _mm_setzero_si128());
+        store4(dest + i, _mm_blendv_epi8(s, load4(dest + i), transparent));
+    }
+    alphaCopyScalar(dest + i, source + i, n - i);
+}
+
+__attribute__((target("sse4.1"))) void multiplyFacesSSE41(RGBAPixel *pixels,
+                                                          const RGBAPixel *uv, size_t n,
+                                                          const uint8_t faces[3],
+                                                          const uint32_t factors[3][4]) {
+    const __m128i byte = _mm_set1_epi32(0xff);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i uv_pixels = load4(uv + i);
+        __m128i side = _mm_and_si128(_mm_srli_epi32(uv_pixels, 16), byte);
+        __m128i f[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(),
+                        _mm_setzero_si128()};
+        __m128i any_face = _mm_setzero_si128();
+        // the first matching face wins, like in the scalar version
+        for (int k = 2; k >= 0; k--) {
+            __m128i is_face = _mm_cmpeq_epi32(side, _mm_set1_epi32(faces[k]));
+            any_face = _mm_or_si128(any_face, is_face);
+            for (int j = 0; j < 4; j++) {
+                f[j] = _mm_blendv_epi8(f[j], _mm_set1_epi32(factors[k][j]), is_face);
+            }
+        }
+        __m128i transparent =
+            _mm_cmpeq_epi32(_mm_srli_epi32(uv_pixels, 24), _mm_setzero_si128());
+        __m128i apply = _mm_andnot_si128(transparent, any_face);
+        if (_mm_testz_si128(apply, apply)) {
+            continue;
+        }
+
+        __m128i u = _mm_and_si128(uv_pixels, byte);
+        __m128i v = _mm_and_si128(_mm_srli_epi32(uv_pixels, 8), byte);
+        __m128i x = mix4(mix4(f[0], f[1], u), mix4(f[2], f[3], u), v);
+
+        // rgba_multiply_scalar
+        __m128i p = load4(pixels + i);
+        __m128i g = _mm_and_si128(
+            _mm_srli_epi32(_mm_mullo_epi32(_mm_and_si128(p, _mm_set1_epi32(0xff00)), x), 8),
+            _mm_set1_epi32(0xff00));
+        __m128i br = _mm_and_si128(
+            _mm_srli_epi32(_mm_mullo_epi32(_mm_and_si128(p, _mm_set1_epi32(0xff00ff)), x), 8),
+            _mm_set1_epi32(0xff00ff));
+        __m128i a = _mm_and_si128(p, _mm_set1_epi32(0xff000000));
+        __m128i result = _mm_or_si128(a, _mm_or_si128(g, br));
+        store4(pixels + i, _mm_blendv_epi8(p, result, apply));
+    }
+    multiplyFacesScalar(pixels + i, uv + i, n - i, faces, factors);
+}
+
+__attribute__((target("sse4.1"))) void tintSSE41(RGBAPixel *pixels, size_t n, RGBAPixel color) {
+    __m128i color_channels = color16(color);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = load4(pixels + i);
+        __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(p, 24), _mm_setzero_si128());
+        store4(pixels + i, _mm_blendv_epi8(multiply4(p, color_channels), p, transparent));
+    }
+    tintScalar(pixels + i, n - i, color);
+}
+
+__attribute__((target("sse4.1"))) void tintMaskSSE41(RGBAPixel *pixels, const RGBAPixel *mask,
+                                                     size_t n, RGBAPixel color) {
+    __m128i color_channels = color16(color);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // blending a transparent mask pixel doesn't change anything
+        __m128i colored = multiply4(load4(mask + i), color_channels);
+        store4(pixels + i, blend4(load4(pixels + i), colored));
+    }
+    tintMaskScalar(pixels + i, mask + i, n - i, color);
+}
+
+__attribute__((target("sse4.1"))) void addClampSSE41(RGBAPixel *pixels, size_t n, int r, int g,
+                                                     int b) {
+    __m128i values = _mm_setr_epi16(r, g, b, 0, r, g, b, 0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = load4(pixels + i);
+        __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(p, 24), _mm_setzero_si128());
+        store4(pixels + i, _mm_blendv_epi8(addClamp4(p, values), p, transparent));
+    }
+    addClampScalar(pixels + i, n - i, r, g, b);
+}
+
+__attribute__((target("sse4.1"))) void addClampFaceSSE41(RGBAPixel *pixels, const RGBAPixel *uv,
+                                                         size_t n, uint8_t face, int r, int g,
+                                                         int b) {
+    __m128i values = _mm_setr_epi16(r, g, b, 0, r, g, b, 0);
+    __m128i face_value = _mm_set1_epi32(face);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i side = _mm_and_si128(_mm_srli_epi32(load4(uv + i), 16), _mm_set1_epi32(0xff));
+        __m128i p = load4(pixels + i);
+        __m128i is_face = _mm_cmpeq_epi32(side, face_value);
+        store4(pixels + i, _mm_blendv_epi8(p, addClamp4(p, values), is_face));
+    }
+    addClampFaceScalar(pixels + i, uv + i, n - i, face, r, g, b);
+}
+
+__attribute__((target("avx2"))) inline __m256i load8(const RGBAPixel *pixels) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels));
+}
+
+__attribute__((target("avx2"))) inline void store8(RGBAPixel *pixels, __m256i value) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(pixels), value);
+}
+
+// the 256-bit versions unpack and pack the 128-bit lanes separately, the order of the
+// pixels is the same again after packing. The remaining pixels are done by the SSE4.1
+// versions, the upper halves of the registers are cleared before to avoid the penalty
+// of mixing AVX and SSE instructions
+
+__attribute__((target("avx2"))) inline __m256i alpha16(__m256i pixels) {
+    return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels, 0xff), 0xff);
+}
+
+__attribute__((target("avx2"))) inline __m256i blend16(__m256i dest, __m256i source) {
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i full = _mm256_set1_epi16(256);
+    __m256i sa = _mm256_add_epi16(alpha16(source), one);
+    __m256i sainv = _mm256_sub_epi16(_mm256_set1_epi16(257), sa);
+    __m256i rgb = _mm256_srli_epi16(
+        _mm256_add_epi16(_mm256_mullo_epi16(source, sa), _mm256_mullo_epi16(dest, sainv)), 8);
+    __m256i dainv = _mm256_sub_epi16(full, alpha16(dest));
+    __m256i a = _mm256_srli_epi16(_mm256_sub_epi16(_mm256_mullo_epi16(sainv, dainv), one), 8);
+    a = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+    return _mm256_blend_epi16(rgb, a, 0x88);
+}
+
+__attribute__((target("avx2"))) inline __m256i blend8(__m256i dest, __m256i source) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i low = blend16(_mm256_unpacklo_epi8(dest, zero), _mm256_unpacklo_epi8(source, zero));
+    __m256i high =
+        blend16(_mm256_unpackhi_epi8(dest, zero), _mm256_unpackhi_epi8(source, zero));
+    __m256i result = _mm256_packus_epi16(low, high);
+
+    __m256i sa = _mm256_srli_epi32(source, 24);
+    __m256i da = _mm256_srli_epi32(dest, 24);
+    __m256i copy = _mm256_or_si256(_mm256_cmpeq_epi32(da, zero),
+                                   _mm256_cmpeq_epi32(sa, _mm256_set1_epi32(255)));
+    result = _mm256_blendv_epi8(result, source, copy);
+    return _mm256_blendv_epi8(result, dest, _mm256_cmpeq_epi32(sa, zero));
+}
+
+__attribute__((target("avx2"))) inline __m256i multiply8(__m256i pixels, __m256i color16) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i low =
+        _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(pixels, zero), color16), 8);
+    __m256i high =
+        _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(pixels, zero), color16), 8);
+    return _mm256_packus_epi16(low, high);
+}
+
+__attribute__((target("avx2"))) inline __m256i addClamp8(__m256i pixels, __m256i values) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i low = _mm256_adds_epi16(_mm256_unpacklo_epi8(pixels, zero), values);
+    __m256i high = _mm256_adds_epi16(_mm256_unpackhi_epi8(pixels, zero), values);
+    return _mm256_packus_epi16(low, high);
+}
+
+__attribute__((target("avx2"))) inline __m256i mix8(__m256i x, __m256i y, __m256i a) {
+    __m256i ainv = _mm256_sub_epi32(_mm256_set1_epi32(255), a);
+    return _mm256_srli_epi32(
+        _mm256_add_epi32(_mm256_mullo_epi32(x, ainv), _mm256_mullo_epi32(y, a)), 8);
+}
+
+__attribute__((target("avx2"))) void blendAVX2(RGBAPixel *dest, const RGBAPixel *source,
+                                               size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        store8(dest + i, blend8(load8(dest + i), load8(source + i)));
+    }
+    _mm256_zeroupper();
+    blendSSE41(dest + i, source + i, n - i);
+}
+
+__attribute__((target("avx2"))) void alphaCopyAVX2(RGBAPixel *dest, const RGBAPixel *source,
+                                                   size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s = load8(source + i);
+        __m256i transparent =
+            _mm256_cmpeq_epi32(_mm256_srli_epi32(s, 24), _mm256_setzero_si256());
+        store8(dest + i, _mm256_blendv_epi8(s, load8(dest + i), transparent));
+    }
+    _mm256_zeroupper();
+    alphaCopySSE41(dest + i, source + i, n - i);
+}
+
+__attribute__((target("avx2"))) void multiplyFacesAVX2(RGBAPixel *pixels, const RGBAPixel *uv,
+                                                       size_t n, const uint8_t faces[3],
+                                                       const uint32_t factors[3][4]) {
+    const __m256i byte = _mm256_set1_epi32(0xff);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i uv_pixels = load8(uv + i);
+        __m256i side = _mm256_and_si256(_mm256_srli_epi32(uv_pixels, 16), byte);
+        __m256i f[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+                        _mm256_setzero_si256(), _mm256_setzero_si256()};
+        __m256i any_face = _mm256_setzero_si256();
+        for (int k = 2; k >= 0; k--) {
+            __m256i is_face = _mm256_cmpeq_epi32(side, _mm256_set1_epi32(faces[k]));
+            any_face = _mm256_or_si256(any_face, is_face);
+            for (int j = 0; j < 4; j++) {
+                f[j] = _mm256_blendv_epi8(f[j], _mm256_set1_epi32(factors[k][j]), is_face);
+            }
+        }
+        __m256i transparent =
+            _mm256_cmpeq_epi32(_mm256_srli_epi32(uv_pixels, 24), _mm256_setzero_si256());
+        __m256i apply = _mm256_andnot_si256(transparent, any_face);
+        if (_mm256_testz_si256(apply, apply)) {
+            continue;
+        }
+
+        __m256i u = _mm256_and_si256(uv_pixels, byte);
+        __m256i v = _mm256_and_si256(_mm256_srli_epi32(uv_pixels, 8), byte);
+        __m256i x = mix8(mix8(f[0], f[1], u), mix8(f[2], f[3], u), v);
+
+        __m256i p = load8(pixels + i);
+        __m256i g = _mm256_and_si256(
+            _mm256_srli_epi32(
+                _mm256_mullo_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xff00)), x), 8),
+            _mm256_set1_epi32(0xff00));
+        __m256i br = _mm256_and_si256(
+            _mm256_srli_epi32(
+                _mm256_mullo_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xff00ff)), x), 8),
+            _mm256_set1_epi32(0xff00ff));
+        __m256i a = _mm256_and_si256(p, _mm256_set1_epi32(0xff000000));
+        __m256i result = _mm256_or_si256(a, _mm256_or_si256(g, br));
+        store8(pixels + i, _mm256_blendv_epi8(p, result, apply));
+    }
+    _mm256_zeroupper();
+    multiplyFacesSSE41(pixels + i, uv + i, n - i, faces, factors);
+}
+
+__attribute__((target("avx2"))) void tintAVX2(RGBAPixel *pixels, size_t n, RGBAPixel color) {
+    __m256i color_channels = _mm256_broadcastsi128_si256(color16(color));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p = load8(pixels + i);
+        __m256i transparent =
+            _mm256_cmpeq_epi32(_mm256_srli_epi32(p, 24), _mm256_setzero_si256());
+        store8(pixels + i, _mm256_blendv_epi8(multiply8(p, color_channels), p, transparent));
+    }
+    _mm256_zeroupper();
+    tintSSE41(pixels + i, n - i, color);
+}
+
+__attribute__((target("avx2"))) void tintMaskAVX2(RGBAPixel *pixels, const RGBAPixel *mask,
+                                                  size_t n, RGBAPixel color) {
+    __m256i color_channels = _mm256_broadcastsi128_si256(color16(color));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i colored = multiply8(load8(mask + i), color_channels);
+        store8(pixels + i, blend8(load8(pixels + i), colored));
+    }
+    _mm256_zeroupper();
+    tintMaskSSE41(pixels + i, mask + i, n - i, color);
+}
+
+__attribute__((target("avx2"))) void addClampAVX2(RGBAPixel *pixels, size_t n, int r, int g,
+                                                  int b) {
+    __m256i values = _mm256_setr_epi16(r, g, b, 0, r, g, b, 0, r, g, b, 0, r, g, b, 0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p = load8(pixels + i);
+        __m256i transparent =
+            _mm256_cmpeq_epi32(_mm256_srli_epi32(p, 24), _mm256_setzero_si256());
+        store8(pixels + i, _mm256_blendv_epi8(addClamp8(p, values), p, transparent));
+    }
+    _mm256_zeroupper();
+    addClampSSE41(pixels + i, n - i, r, g, b);
+}
+
+__attribute__((target("avx2"))) void addClampFaceAVX2(RGBAPixel *pixels, const RGBAPixel *uv,
+                                                      size_t n, uint8_t face, int r, int g,
+                                                      int b) {
+    __m256i values = _mm256_setr_epi16(r, g, b, 0, r, g, b, 0, r, g, b, 0, r, g, b, 0);
+    __m256i face_value = _mm256_set1_epi32(face);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i side =
+            _mm256_and_si256(_mm256_srli_epi32(load8(uv + i), 16), _mm256_set1_epi32(0xff));
+        __m256i p = load8(pixels + i);
+        __m256i is_face = _mm256_cmpeq_epi32(side, face_value);
+        store8(pixels + i, _mm256_blendv_epi8(p, addClamp8(p, values), is_face));
+    }
+    _mm256_zeroupper();
+    addClampFaceSSE41(pixels + i, uv + i, n - i, face, r, g, b);
+}
+
+#endif
+
+} // namespace
+
+const ImageKernels &getImageKernels() { return getImageKernels(util::getInstructionSet()); }
+
+const ImageKernels &getImageKernels(util::InstructionSet instructions) {
+    static const ImageKernels scalar = {&blendScalar,    &alphaCopyScalar, &multiplyFacesScalar,
+                                        &tintScalar,     &tintMaskScalar,  &addClampScalar,
+                                        &addClampFaceScalar};
+#ifdef HAVE_X86_SIMD
+    static const ImageKernels sse41 = {&blendSSE41,    &alphaCopySSE41, &multiplyFacesSSE41,
+                                       &tintSSE41,     &tintMaskSSE41,  &addClampSSE41,
+                                       &addClampFaceSSE41};
+    static const ImageKernels avx2 = {&blendAVX2,    &alphaCopyAVX2, &multiplyFacesAVX2,
+                                      &tintAVX2,     &tintMaskAVX2,  &addClampAVX2,
+                                      &addClampFaceAVX2};
+    if (instructions == util::InstructionSet::AVX2)
+        return avx2;
+    if (instructions == util::InstructionSet::SSE41)
+        return sse41;
+#endif
+    return scalar;
+}
+
+} // namespace renderer
+} // namespace mapcrafter
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_KERNELS_H_
+#define IMAGE_KERNELS_H_
+
+#include "../../util/cpu.h"
+#include "../image.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mapcrafter {
+namespace renderer {
+
+/**
+ * The pixel loops of blitting images and shading block images. They all work on rows of
+ * n pixels, the pixels are modified in place (or blitted onto dest).
+ *
+ * There are scalar implementations and SSE4.1/AVX2 ones which give exactly the same
+ * results. The scalar ones are the reference implementation.
+ */
+struct ImageKernels {
+    /**
+     * Blends the source pixels onto the dest pixels, just like blend() does.
+     */
+    void (*blend)(RGBAPixel *dest, const RGBAPixel *source, size_t n);
+
+    /**
+     * Copies the source pixels that aren't completely transparent onto the dest pixels.
+     */
+    void (*alphaCopy)(RGBAPixel *dest, const RGBAPixel *source, size_t n);
+
+    /**
+     * Multiplies the colors of the pixels that belong to one of three block faces (blue
+     * channel of the uv pixel, the uv pixel must not be transparent) with a factor. The
+     * factor is interpolated (with the uv coordinates) from four corner factors (0-255)
+     * of the face. See blockImageMultiply().
+     */
+    void (*multiplyFaces)(RGBAPixel *pixels, const RGBAPixel *uv, size_t n,
+                          const uint8_t faces[3], const uint32_t factors[3][4]);
+
+    /**
+     * Multiplies the colors of the pixels that aren't completely transparent with a color
+     * (rgba_multiply).
+     */
+    void (*tint)(RGBAPixel *pixels, size_t n, RGBAPixel color);
+
+    /**
+     * Blends the mask pixels multiplied with a color onto the pixels.
+     */
+    void (*tintMask)(RGBAPixel *pixels, const RGBAPixel *mask, size_t n, RGBAPixel color);
+
+    /**
+     * Adds values to the color channels of the pixels that aren't completely transparent,
+     * clamped to 0-255 (rgba_add_clamp).
+     */
+    void (*addClamp)(RGBAPixel *pixels, size_t n, int r, int g, int b);
+
+    /**
+     * Same as addClamp, but only for the pixels of a block face (blue channel of the uv
+     * pixel).
+     */
+    void (*addClampFace)(RGBAPixel *pixels, const RGBAPixel *uv, size_t n, uint8_t face, int r,
+                         int g, int b);
+};
+
+/**
+ * Returns the image kernels with the fastest implementation the CPU supports, unless you
+ * ask for specific instructions (which the CPU must support then).
+ */
+const ImageKernels &getImageKernels();
+const ImageKernels &getImageKernels(util::InstructionSet instructions);
+
+} // namespace renderer
+} // namespace mapcrafter
+
+#endif /* IMAGE_KERNELS_H_ */
@@ -22,18 +22,22 @@
 #include "../config/loggingconfig.h"
 #include "../mc/blockstate.h"
 #include "../thread/dispatcher.h"
-#include "../thread/impl/multithreading.h"
 #include "../thread/impl/singlethread.h"
+#include "../thread/impl/workstealing.h"
 #include "../util.h"
 #include "../version.h"
 #include "blockimages.h"
+#include "markers.h"
 #include "renderview.h"
+#include "tilerenderer.h"
 #include "tilerenderworker.h"
 
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <fstream>
 #include <memory>
+#include <sstream>
 #include <thread>
 #include <tuple>
 
@@ -141,12 +145,17 @@ RenderBehaviors RenderBehaviors::fromRenderOpts(const config::MapcrafterConfig &
 }
 
 RenderManager::RenderManager(const config::MapcrafterConfig &config)
-    : config(config), web_config(config), time_started_scanning(0) {}
+    : config(config), web_config(config), work_stealing_single_thread(false),
+      time_started_scanning(0), read_regions_into_memory(false), keep_block_images(false) {}
 
 void RenderManager::setRenderBehaviors(const RenderBehaviors &render_behaviors) {
     this->render_behaviors = render_behaviors;
 }
 
+void RenderManager::setWorkStealingSingleThread(bool work_stealing_single_thread) {
+    this->work_stealing_single_thread = work_stealing_single_thread;
+}
+
 bool RenderManager::initialize() {
     // an output directory would be nice -- create one if it does not exist
     if (!fs::is_directory(config.getOutputDir()) &&
@@ -164,6 +173,9 @@ bool RenderManager::scanWorlds() {
     auto config_maps = config.getMaps();
 
     time_started_scanning = std::time(nullptr);
+    // the worlds may be scanned again, the max zoom level may have changed since then
+    required_maps.clear();
+    map_initialized.clear();
 
     // first of all check which maps/rotations are required
     // and which tile sets (world, render view, tile width) with which rotations are needed
@@ -206,6 +218,7 @@ bool RenderManager::scanWorlds() {
         mc::World world(world_config.getInputDir().string(), world_config.getDimension());
         world.setRotation(tile_set_it->rotation);
         world.setWorldCrop(world_config.getWorldCrop());
+        world.setReadRegionsIntoMemory(read_regions_into_memory);
         if (!world.load()) {
             LOG(FATAL) << "Unable to load world " << tile_set_it->world_name << "!";
             return false;
@@ -227,8 +240,21 @@ bool RenderManager::scanWorlds() {
             return false;
         }
 
-        // create a tile set for this world
-        std::shared_ptr<TileSet> tile_set(render_view->createTileSet(tile_set_it->tile_width));
+        // the tiles of the regions found the last time are stored in an index file, the
+        // index is valid as long as the world configuration and the tile set are the same
+        std::ostringstream index_id;
+        world_config.dump(index_id);
+        index_id << tile_set_it->toString();
+        std::string index_key = index_id.str();
+        uint64_t key = util::hashBytes(reinterpret_cast<const uint8_t *>(index_key.data()),
+                                       index_key.size());
+        fs::path index_file = config.getOutputPath(tile_set_it->toString() + ".tileset");
+        // create a tile set for this world, or reuse the one of the last scan
+        std::shared_ptr<TileSet> &tile_set = tile_sets[*tile_set_it];
+        if (!tile_set) {
+            tile_set.reset(render_view->createTileSet(tile_set_it->tile_width));
+            tile_set->readIndex(index_file, key);
+        }
         // and scan the tiles of this world,
         // we automatically center the tiles for cropped worlds, but only...
         //  - the circular cropped ones and
@@ -240,6 +266,8 @@ bool RenderManager::scanWorlds() {
         } else {
             tile_set->scan(world);
         }
+        if (!tile_set->writeIndex(index_file, key))
+            LOG(WARNING) << "Unable to write tile set index " << index_file << ".";
 
         // key of this tile_sets_max_zoom map is a TileSetGroupID, not TileSetID as we access it
         // since TileSetID is a subclass of TileSetGroupID, only the TileSetGroupID-'functionality'
@@ -247,9 +275,8 @@ bool RenderManager::scanWorlds() {
         int &max_zoom = tile_sets_max_zoom[*tile_set_it];
         max_zoom = std::max(max_zoom, tile_set->getDepth());
 
-        // set world- and tileset object in the map
+        // set world object in the map
         worlds[tile_set_it->world_name][tile_set_it->rotation] = world;
-        tile_sets[*tile_set_it] = tile_set;
 
         // clean up render view
         delete render_view;
@@ -284,8 +311,12 @@ void RenderManager::renderMap(const std::string &map, int rotation, int threads,
     config::MapSection map_config = config.getMap(map);
     config::WorldSection world_config = config.getWorld(map_config.getWorld());
 
-    // TODO keep block state registry global per map. or are there any reasons to make more global?
-    mc::BlockStateRegistry block_registry;
+    // maps with the same block files share their block state registry (and chunk store)
+    std::unique_ptr<mc::BlockStateRegistry> &block_registry_ptr = block_registries[std::make_pair(
+        map_config.getBlockDir(), util::str(map_config.getRenderView()))];
+    if (!block_registry_ptr)
+        block_registry_ptr.reset(new mc::BlockStateRegistry());
+    mc::BlockStateRegistry &block_registry = *block_registry_ptr;
     std::shared_ptr<RenderView> render_view(createRenderView(map_config.getRenderView()));
 
     // output a small notice if we render this map incrementally
@@ -300,38 +331,67 @@ void RenderManager::renderMap(const std::string &map, int rotation, int threads,
     fs::path output_dir = config.getOutputPath(map + "/" + config::ROTATION_NAMES_SHORT[rotation]);
     // get the tile set
     TileSet *tile_set = tile_sets[map_config.getTileSet(rotation)].get();
+    // the content hashes of the chunks when the map was rendered last time
+    ChunkHashIndex chunk_hashes;
+    fs::path chunk_hashes_file = output_dir / "chunk_hashes.dat";
+    if (map_config.useChunkHashes())
+        chunk_hashes.read(chunk_hashes_file);
     if (render_behaviors.getRenderBehavior(map, rotation) == RenderBehavior::AUTO) {
         // if incremental render, scan which tiles might have changed
         LOG(INFO) << "Scanning required tiles...";
         // use the incremental check method specified in the config
-        if (map_config.useImageModificationTimes())
+        if (map_config.useChunkHashes())
+            tile_set->scanRequiredByChunkHashes(worlds[map_config.getWorld()][rotation],
+                                                web_config.getMapLastRendered(map, rotation),
+                                                chunk_hashes,
+                                                chunk_hash_caches[map_config.getWorld()],
+                                                threads);
+        else if (map_config.useImageModificationTimes())
             tile_set->scanRequiredByFiletimes(output_dir, map_config.getImageFormatSuffix());
         else
             // tile_set->scanRequiredByTimestamp(settings.last_render[rotation]);
             tile_set->scanRequiredByTimestamp(web_config.getMapLastRendered(map, rotation));
     } else {
-        // or just set all tiles required if force-rendering
+        // or just set all tiles required if force-rendering,
+        // the chunk hashes are still needed for the next incremental rendering
+        if (map_config.useChunkHashes())
+            tile_set->scanRequiredByChunkHashes(worlds[map_config.getWorld()][rotation],
+                                                web_config.getMapLastRendered(map, rotation),
+                                                chunk_hashes,
+                                                chunk_hash_caches[map_config.getWorld()],
+                                                threads);
         tile_set->resetRequired();
     }
 
     // maybe we don't have to render anything at all
     if (tile_set->getRequiredRenderTilesCount() == 0) {
         LOG(INFO) << "No tiles need to get rendered.";
+        if (map_config.useChunkHashes())
+            chunk_hashes.write(chunk_hashes_file);
         return;
     }
 
     // create other stuff for the render dispatcher
-    std::shared_ptr<BlockImages> block_images(render_view->createBlockImages(block_registry));
-    render_view->configureBlockImages(block_images.get(), world_config, map_config);
-
-    RenderedBlockImages *new_block_images = dynamic_cast<RenderedBlockImages *>(block_images.get());
-    if (new_block_images != nullptr) {
-        if (!new_block_images->loadBlockImages(map_config.getBlockDir().string(),
-                                               util::str(map_config.getRenderView()), rotation,
-                                               map_config.getTextureSize())) {
-            LOG(ERROR) << "Skipping remaining rotations.";
-            return;
+    std::shared_ptr<BlockImages> block_images;
+    auto loaded_it = loaded_block_images.find(std::make_pair(map, rotation));
+    if (loaded_it != loaded_block_images.end()) {
+        block_images = loaded_it->second;
+    } else {
+        block_images.reset(render_view->createBlockImages(block_registry));
+        render_view->configureBlockImages(block_images.get(), world_config, map_config);
+
+        RenderedBlockImages *new_block_images =
+            dynamic_cast<RenderedBlockImages *>(block_images.get());
+        if (new_block_images != nullptr) {
+            if (!new_block_images->loadBlockImages(map_config.getBlockDir().string(),
+                                                   util::str(map_config.getRenderView()),
+                                                   rotation, map_config.getTextureSize())) {
+                LOG(ERROR) << "Skipping remaining rotations.";
+                return;
+            }
         }
+        if (keep_block_images)
+            loaded_block_images[std::make_pair(map, rotation)] = block_images;
     }
 
     RenderContext context;
@@ -344,6 +404,25 @@ void RenderManager::renderMap(const std::string &map, int rotation, int threads,
     context.tile_set = tile_set;
     context.block_registry = &block_registry;
     context.world = worlds[map_config.getWorld()][rotation];
+    if (config.getChunkCacheSize() > 0 || !config.getChunkCacheDir().empty()) {
+        std::shared_ptr<mc::ChunkStore> &chunk_store =
+            chunk_stores[std::make_pair(map_config.getWorld(), &block_registry)];
+        if (!chunk_store)
+            chunk_store = std::make_shared<mc::ChunkStore>(
+                block_registry, size_t(config.getChunkCacheSize()) * 1024 * 1024,
+                config.getChunkCacheDir());
+        context.chunk_store = chunk_store;
+    }
+    if (config.generateMarkers() && !config.getMarkers().empty()) {
+        std::shared_ptr<mc::SignSink> &sign_sink = sign_sinks[map_config.getWorld()];
+        if (!sign_sink)
+            sign_sink = std::make_shared<mc::SignSink>();
+        context.sign_sink = sign_sink;
+    }
+    mc::CacheStats stats_before;
+    if (context.chunk_store)
+        stats_before = context.chunk_store->getStats();
+    context.sprite_cache_stats = std::make_shared<SpriteCacheStats>();
     context.initializeTileRenderer();
 
     // update map parameters in web config
@@ -354,14 +433,36 @@ void RenderManager::renderMap(const std::string &map, int rotation, int threads,
     web_config.writeConfigJS();
 
     std::shared_ptr<thread::Dispatcher> dispatcher;
-    if (threads == 1 || tile_set->getRequiredRenderTilesCount() == 1)
+    if ((threads == 1 && !work_stealing_single_thread) ||
+        tile_set->getRequiredRenderTilesCount() == 1)
         dispatcher = std::make_shared<thread::SingleThreadDispatcher>();
     else
-        dispatcher = std::make_shared<thread::MultiThreadingDispatcher>(threads);
+        dispatcher = std::make_shared<thread::WorkStealingDispatcher>(threads);
 
     // do the dance
     dispatcher->dispatch(context, progress);
 
+    if (context.chunk_store) {
+        mc::CacheStats stats = context.chunk_store->getStats();
+        uint64_t hits = stats.hits - stats_before.hits;
+        uint64_t misses = stats.misses - stats_before.misses;
+        uint64_t lookups = std::max<uint64_t>(hits + misses, 1);
+        LOG(INFO) << "Chunk store: " << hits << " hits, " << misses << " misses ("
+                  << int(100.0 * hits / lookups) << "% hit rate), "
+                  << stats.evictions - stats_before.evictions << " evictions.";
+    }
+    uint64_t sprite_hits = context.sprite_cache_stats->hits;
+    uint64_t sprite_misses = context.sprite_cache_stats->misses;
+    if (sprite_hits + sprite_misses > 0) {
+        LOG(INFO) << "Sprite cache: " << sprite_hits << " hits, " << sprite_misses
+                  << " misses (" << int(100.0 * sprite_hits / (sprite_hits + sprite_misses))
+                  << "% hit rate), " << context.sprite_cache_stats->evictions << " evictions.";
+    }
+
+    // the tiles are rendered with the chunks as they were when they were hashed
+    if (map_config.useChunkHashes() && !chunk_hashes.write(chunk_hashes_file))
+        LOG(WARNING) << "Unable to write chunk hashes to " << chunk_hashes_file << ".";
+
     // update the map settings with last render time
     web_config.setMapLastRendered(map, rotation, time_started_scanning);
     web_config.writeConfigJS();
@@ -375,9 +476,77 @@ bool RenderManager::run(int threads, bool batch) {
     if (!scanWorlds())
         return false;
 
+    std::time_t time_start_all = std::time(nullptr);
+    renderRequiredMaps(threads, batch);
+    writeMarkers(threads);
+    std::time_t took_all = std::time(nullptr) - time_start_all;
+    LOG(INFO) << "Rendering all worlds took " << took_all << " seconds.";
+    LOG(INFO) << "Finished.....aaand it's gone!";
+    return true;
+}
+
+bool RenderManager::watch(int threads, bool batch, int quiet_period) {
+    read_regions_into_memory = true;
+    keep_block_images = true;
+    if (!run(threads, batch))
+        return false;
+
+    // watch the region directories of the worlds of all rendered maps
+    util::DirectoryWatcher watcher;
+    std::set<std::string> watched_worlds;
+    for (auto map_it = required_maps.begin(); map_it != required_maps.end(); ++map_it) {
+        std::string world_name = config.getMap(map_it->first).getWorld();
+        if (!watched_worlds.insert(world_name).second)
+            continue;
+        config::WorldSection world_config = config.getWorld(world_name);
+        mc::World world(world_config.getInputDir().string(), world_config.getDimension());
+        if (!watcher.addDirectory(world.getRegionDir())) {
+            LOG(ERROR) << "Unable to watch region directory " << world.getRegionDir() << "!";
+            return false;
+        }
+    }
+
+    // force-rendered maps are rendered completely only the first time
+    auto config_maps = config.getMaps();
+    for (auto map_it = config_maps.begin(); map_it != config_maps.end(); ++map_it) {
+        std::string map = map_it->getShortName();
+        auto rotations = map_it->getRotations();
+        for (auto rotation_it = rotations.begin(); rotation_it != rotations.end(); ++rotation_it)
+            if (render_behaviors.getRenderBehavior(map, *rotation_it) == RenderBehavior::FORCE)
+                render_behaviors.setRenderBehavior(map, *rotation_it, RenderBehavior::AUTO);
+    }
+
+    while (true) {
+        LOG(INFO) << "Waiting for changes of the worlds...";
+        std::set<fs::path> changed;
+        if (!watcher.waitForChanges(changed, quiet_period)) {
+            LOG(ERROR) << "Unable to watch the region directories for changes!";
+            return false;
+        }
+
+        int changed_regions = 0;
+        for (auto it = changed.begin(); it != changed.end(); ++it)
+            if (it->extension() == ".mca")
+                changed_regions++;
+        if (changed_regions == 0)
+            continue;
+        LOG(INFO) << changed_regions << " region file(s) changed, scanning worlds...";
+
+        // the tile sets read only the headers of the changed regions again and
+        // the incremental rendering renders only the tiles of the changed chunks
+        std::time_t time_start = std::time(nullptr);
+        if (!scanWorlds())
+            return false;
+        renderRequiredMaps(threads, batch);
+        writeMarkers(threads);
+        LOG(INFO) << "Rendering the changes took " << std::time(nullptr) - time_start
+                  << " seconds.";
+    }
+}
+
+void RenderManager::renderRequiredMaps(int threads, bool batch) {
     int progress_maps = 0;
     int progress_maps_all = required_maps.size();
-    int time_start_all = std::time(nullptr);
 
     // go through all required maps
     for (auto map_it = required_maps.begin(); map_it != required_maps.end(); ++map_it) {
@@ -430,11 +599,36 @@ bool RenderManager::run(int threads, bool batch) {
                       << took << " seconds.";
         }
     }
+}
 
-    std::time_t took_all = std::time(nullptr) - time_start_all;
-    LOG(INFO) << "Rendering all worlds took " << took_all << " seconds.";
-    LOG(INFO) << "Finished.....aaand it's gone!";
-    return true;
+void RenderManager::writeMarkers(int threads) {
+    if (!config.generateMarkers() || config.getMarkers().empty())
+        return;
+
+    // the entity caches read only the changed chunks which weren't read while rendering
+    size_t collected_chunks = 0;
+    for (auto sink_it = sign_sinks.begin(); sink_it != sign_sinks.end(); ++sink_it)
+        collected_chunks += sink_it->second->getChunkCount();
+    LOG(INFO) << "Generating markers (collected the signs of " << collected_chunks
+              << " chunks while rendering)...";
+    Markers markers = findMarkers(config, threads, sign_sinks, read_regions_into_memory);
+    logMarkerStats(config, markers);
+    // write the markers to a temporary file first, so the web interface never loads a
+    // partially written file
+    fs::path markers_file = config.getOutputPath("markers-generated.js");
+    fs::path markers_file_tmp = markers_file.string() + ".tmp";
+    std::ofstream out(markers_file_tmp.string());
+    out << createMarkersJSON(config, markers);
+    out.close();
+    boost::system::error_code error;
+    if (!out || (fs::rename(markers_file_tmp, markers_file, error), error)) {
+        fs::remove(markers_file_tmp, error);
+        LOG(ERROR) << "Unable to write markers to " << markers_file << "!";
+    }
+
+    // the signs of the next renders are collected from scratch
+    for (auto sink_it = sign_sinks.begin(); sink_it != sign_sinks.end(); ++sink_it)
+        sink_it->second->clear();
 }
 
 const std::vector<std::pair<std::string, std::set<int>>> &RenderManager::getRequiredMaps() const {
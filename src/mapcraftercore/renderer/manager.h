@@ -22,14 +22,18 @@
 
 #include "../config/mapcrafterconfig.h"
 #include "../config/webconfig.h"
+#include "../mc/blockstate.h"
+#include "../mc/chunkstore.h"
 #include "../mc/world.h"
 #include "../mc/worldcache.h"
+#include "../mc/worldentities.h"
 #include "tilerenderer.h"
 #include "tileset.h"
 
 #include <boost/filesystem.hpp>
 #include <ctime>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -54,6 +58,11 @@ struct RenderOpts {
     std::vector<std::string> render_skip, render_auto, render_force;
     bool skip_all, force_all;
     int jobs;
+
+    // whether to keep running and render the changes of the worlds,
+    // and how many seconds the region files must not be written before rendering
+    bool watch;
+    int watch_delay;
 };
 
 /**
@@ -121,6 +130,12 @@ class RenderManager {
      */
     void setRenderBehaviors(const RenderBehaviors &render_behaviors);
 
+    /**
+     * Sets whether maps rendered with one thread use the work-stealing dispatcher instead
+     * of the single thread dispatcher. Useful to benchmark the dispatcher.
+     */
+    void setWorkStealingSingleThread(bool work_stealing_single_thread);
+
     /**
      * Some basic initialization things. blah.
      *
@@ -154,12 +169,35 @@ class RenderManager {
      */
     bool run(int threads, bool batch);
 
+    /**
+     * Like run, but afterwards keeps running and watches the region directories of the
+     * worlds. When region files were written (and then not written for quiet_period
+     * seconds), the worlds are rescanned and the maps are rendered incrementally. The
+     * block images, block state registries, chunk stores and tile sets stay in memory
+     * between the renders. Because the game possibly writes the region files while they
+     * are read, they are read into memory instead of mapping them (see
+     * mc::World::setReadRegionsIntoMemory).
+     *
+     * Returns only if an error occured.
+     */
+    bool watch(int threads, bool batch, int quiet_period);
+
     /**
      * Returns which maps with which rotations need to get rendered.
      */
     const std::vector<std::pair<std::string, std::set<int>>> &getRequiredMaps() const;
 
   private:
+    /**
+     * Renders all required maps/rotations and outputs the progress.
+     */
+    void renderRequiredMaps(int threads, bool batch);
+
+    /**
+     * Writes the markers-generated.js file if markers are generated while rendering.
+     */
+    void writeMarkers(int threads);
+
     /**
      * Copies a file from the template directory to the output directory and replaces the
      * variables from the map (every "{key}" in the file becomes "value").
@@ -199,6 +237,8 @@ class RenderManager {
     config::WebConfig web_config;
 
     RenderBehaviors render_behaviors;
+    // whether maps rendered with one thread use the work-stealing dispatcher as well
+    bool work_stealing_single_thread;
 
     // time when we started scanning the worlds, used as last last render time of the maps
     std::time_t time_started_scanning;
@@ -211,6 +251,27 @@ class RenderManager {
     // (world, render view, rotation) -> tile set
     std::map<config::TileSetID, std::shared_ptr<TileSet>> tile_sets;
 
+    // block state registries of the maps, the block IDs (and which block properties are
+    // used) depend on the block files, so the key is (block directory, render view)
+    std::map<std::pair<fs::path, std::string>, std::unique_ptr<mc::BlockStateRegistry>>
+        block_registries;
+    // (world, block state registry) -> store of decoded chunks of all rotations and maps
+    std::map<std::pair<std::string, mc::BlockStateRegistry *>, std::shared_ptr<mc::ChunkStore>>
+        chunk_stores;
+    // world -> current content hashes of its chunks, shared by the chunk hash indices of
+    // all rotations and maps of the world
+    std::map<std::string, ChunkHashCache> chunk_hash_caches;
+    // world -> signs of the chunks read while rendering, if markers are generated
+    std::map<std::string, std::shared_ptr<mc::SignSink>> sign_sinks;
+
+    // whether the region files are read into memory instead of mapping them, because the
+    // watched worlds are possibly written by the game while they are read
+    bool read_regions_into_memory;
+
+    // whether the block images of the maps are kept in memory, (map, rotation) -> images
+    bool keep_block_images;
+    std::map<std::pair<std::string, int>, std::shared_ptr<BlockImages>> loaded_block_images;
+
     // all required (= not skipped) maps and rotations
     // as pair (map name, required rotations)
     std::vector<std::pair<std::string, std::set<int>>> required_maps;
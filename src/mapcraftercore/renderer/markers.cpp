@@ -0,0 +1,180 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "markers.h"
+
+#include "../mc/world.h"
+#include "../mc/worldentities.h"
+#include "../util.h"
+
+#include <sstream>
+
+namespace mapcrafter {
+namespace renderer {
+
+std::string Marker::toJSON() const {
+    std::string json = "{";
+    json += "\"pos\": [" + util::str(pos.x) + "," + util::str(pos.z) + "," + util::str(pos.y) +
+            "], ";
+    json += "\"title\": \"" + util::escapeJSON(title) + "\", ";
+    json += "\"text\": \"" + util::escapeJSON(text) + "\", ";
+    return json + "}";
+}
+
+Markers findMarkers(const config::MapcrafterConfig &config, int threads,
+                    const std::map<std::string, std::shared_ptr<mc::SignSink>> &sign_sinks,
+                    bool read_regions_into_memory) {
+    Markers markers;
+    auto groups = config.getMarkers();
+    for (auto group_it = groups.begin(); group_it != groups.end(); ++group_it)
+        markers[group_it->getShortName()];
+
+    auto config_worlds = config.getWorlds();
+    auto config_markers = config.getMarkers();
+    for (auto world_it = config_worlds.begin(); world_it != config_worlds.end(); ++world_it) {
+        mc::WorldCrop world_crop = world_it->second.getWorldCrop();
+        mc::World world(world_it->second.getInputDir().string(), world_it->second.getDimension());
+        world.setWorldCrop(world_crop);
+        world.setReadRegionsIntoMemory(read_regions_into_memory);
+        if (!world.load()) {
+            LOG(ERROR) << "Unable to load world " << world_it->first << "!";
+            continue;
+        }
+
+        LOGN(INFO, "progress") << "Loading entities of world '" << world_it->first << "' ...";
+        mc::WorldEntitiesCache entities(world);
+        util::LogOutputProgressHandler progress;
+        auto sink_it = sign_sinks.find(world_it->first);
+        entities.update(&progress, threads,
+                        sink_it != sign_sinks.end() ? sink_it->second.get() : nullptr);
+
+        // use name of the world section as world name, not the world_name
+        std::string world_name = world_it->second.getShortName();
+        std::vector<mc::SignEntity> signs = entities.getSigns(world.getWorldCrop());
+        for (auto sign_it = signs.begin(); sign_it != signs.end(); ++sign_it) {
+            // don't use signs not contained in the world boundaries
+            if (!world_crop.isBlockContainedXZ(sign_it->getPos()) &&
+                !world_crop.isBlockContainedY(sign_it->getPos()))
+                continue;
+            for (auto marker_it = config_markers.begin(); marker_it != config_markers.end();
+                 ++marker_it) {
+                if (!marker_it->matchesSign(*sign_it))
+                    continue;
+                Marker marker;
+                marker.pos = sign_it->getPos();
+                marker.title = marker_it->formatTitle(*sign_it);
+                marker.text = marker_it->formatText(*sign_it);
+                markers[marker_it->getShortName()][world_name].push_back(marker);
+                LOG(DEBUG) << "Found marker (prefix '" << marker_it->getPrefix() << "'): '"
+                           << marker.title << "' at '" << world_it->first << "':" << marker.pos;
+                break;
+            }
+        }
+    }
+    return markers;
+}
+
+std::string createMarkersJSON(const config::MapcrafterConfig &config,
+                              const Markers &markers_found) {
+    auto markers = config.getMarkers();
+    std::stringstream ss;
+
+    ss << "// This file is automatically generated. Do not edit this file." << std::endl;
+    ss << "// Use the markers.js for your own markers instead." << std::endl << std::endl;
+    ss << "MAPCRAFTER_MARKERS_GENERATED = [" << std::endl;
+    for (auto marker_config_it = markers.begin(); marker_config_it != markers.end();
+         ++marker_config_it) {
+        config::MarkerSection marker_config = *marker_config_it;
+        std::string group = marker_config.getShortName();
+        ss << "  {" << std::endl;
+        ss << "    \"id\" : \"" << group << "\"," << std::endl;
+        ss << "    \"name\" : \"" << marker_config.getLongName() << "\"," << std::endl;
+        if (!marker_config.getIcon().empty()) {
+            ss << "    \"icon\" : \"" << marker_config.getIcon() << "\"," << std::endl;
+            if (!marker_config.getIconSize().empty())
+                ss << "    \"iconSize\" : " << marker_config.getIconSize() << "," << std::endl;
+        }
+        ss << "    \"showDefault\" : ";
+        ss << (marker_config.isShownByDefault() ? "true" : "false") << "," << std::endl;
+        ss << "    \"markers\" : {" << std::endl;
+
+        if (!markers_found.count(group)) {
+            ss << "    }," << std::endl;
+            ss << "  }," << std::endl;
+            continue;
+        }
+
+        for (auto world_it = markers_found.at(group).begin();
+             world_it != markers_found.at(group).end(); ++world_it) {
+            ss << "      \"" << world_it->first << "\" : [" << std::endl;
+            for (auto marker_it = world_it->second.begin(); marker_it != world_it->second.end();
+                 ++marker_it) {
+                ss << "        " << marker_it->toJSON() << "," << std::endl;
+            }
+            ss << "      ]," << std::endl;
+        }
+        ss << "    }," << std::endl;
+        ss << "  }," << std::endl;
+    }
+    ss << "];" << std::endl;
+
+    return ss.str();
+}
+
+namespace {
+
+size_t getMarkerCount(const Markers &markers, const std::string &group,
+                      const std::string &world) {
+    auto group_it = markers.find(group);
+    if (group_it == markers.end() || !group_it->second.count(world))
+        return 0;
+    return group_it->second.at(world).size();
+}
+
+} // namespace
+
+void logMarkerStats(const config::MapcrafterConfig &config, const Markers &markers) {
+    // count how many markers / markers of which group were found
+    int markers_count = 0;
+    std::map<std::string, int> groups_count;
+
+    auto worlds = config.getWorlds();
+    auto groups = config.getMarkers();
+    for (auto group_it = groups.begin(); group_it != groups.end(); ++group_it) {
+        std::string group = group_it->getShortName();
+        groups_count[group] = 0;
+        for (auto world_it = worlds.begin(); world_it != worlds.end(); ++world_it)
+            groups_count[group] += getMarkerCount(markers, group, world_it->first);
+        markers_count += groups_count[group];
+    }
+
+    // and log some stats about that
+    LOG(INFO) << "Found " << markers_count << " markers in " << markers.size() << " categories:";
+    for (auto group_it = groups.begin(); group_it != groups.end(); ++group_it) {
+        std::string group = group_it->getShortName();
+        LOG(INFO) << "  Markers with prefix '" << config.getMarker(group).getPrefix()
+                  << "': " << groups_count[group];
+        for (auto world_it = worlds.begin(); world_it != worlds.end(); ++world_it)
+            LOG(INFO) << "    in world '" << world_it->first
+                      << "': " << getMarkerCount(markers, group, world_it->first);
+    }
+}
+
+} // namespace renderer
+} // namespace mapcrafter
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MARKERS_H_
+#define MARKERS_H_
+
+#include "../config/mapcrafterconfig.h"
+#include "../mc/pos.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mapcrafter {
+
+namespace mc {
+class SignSink;
+}
+
+namespace renderer {
+
+/**
+ * A marker generated from a sign.
+ */
+struct Marker {
+    mc::BlockPos pos;
+    std::string title, text;
+
+    std::string toJSON() const;
+};
+
+typedef std::map<std::string, std::vector<Marker>> MarkerGroup;
+// map (marker group name -> map ( world name -> array of markers) )
+typedef std::map<std::string, MarkerGroup> Markers;
+
+/**
+ * Finds the markers of the signs of all worlds of a configuration. The signs are read
+ * with the entity cache of each world. Signs collected while rendering a world can be
+ * specified (world name -> sign sink), the chunks of them aren't read again then.
+ * Whether the region files are read into memory is passed to the worlds (see
+ * mc::World::setReadRegionsIntoMemory).
+ */
+Markers findMarkers(const config::MapcrafterConfig &config, int threads,
+                    const std::map<std::string, std::shared_ptr<mc::SignSink>> &sign_sinks =
+                        std::map<std::string, std::shared_ptr<mc::SignSink>>(),
+                    bool read_regions_into_memory = false);
+
+/**
+ * Creates the contents of the markers-generated.js file.
+ */
+std::string createMarkersJSON(const config::MapcrafterConfig &config, const Markers &markers);
+
+/**
+ * Logs how many markers of each group were found in which world.
+ */
+void logMarkerStats(const config::MapcrafterConfig &config, const Markers &markers);
+
+} // namespace renderer
+} // namespace mapcrafter
+
+#endif /* MARKERS_H_ */
@@ -22,6 +22,7 @@
 #include "../config/configsections/map.h"
 #include "../config/configsections/world.h"
 #include "../mc/chunk.h"
+#include "../mc/chunkneighborhood.h"
 #include "../mc/pos.h"
 #include "../mc/world.h"
 #include "../util.h"
@@ -41,17 +42,20 @@ namespace mapcrafter {
 namespace renderer {
 
 BaseRenderMode::BaseRenderMode()
-    : images(nullptr), block_images(nullptr), world(nullptr), current_chunk(nullptr) {}
+    : images(nullptr), block_images(nullptr), world(nullptr), current_chunk(nullptr),
+      neighborhood(nullptr) {}
 
 BaseRenderMode::~BaseRenderMode() {}
 
 void BaseRenderMode::initialize(const RenderView *render_view, BlockImages *images,
-                                mc::WorldCache *world, mc::Chunk **current_chunk) {
+                                mc::WorldCache *world, mc::Chunk **current_chunk,
+                                mc::ChunkNeighborhood *neighborhood) {
     this->images = images;
     this->block_images = dynamic_cast<RenderedBlockImages *>(images);
     assert(this->block_images != nullptr);
     this->world = world;
     this->current_chunk = current_chunk;
+    this->neighborhood = neighborhood;
 }
 
 bool BaseRenderMode::isHidden(const mc::BlockPos &pos, uint16_t id, uint16_t data) { return false; }
@@ -59,7 +63,7 @@ bool BaseRenderMode::isHidden(const mc::BlockPos &pos, uint16_t id, uint16_t dat
 void BaseRenderMode::draw(RGBAImage &image, const mc::BlockPos &pos, uint16_t id, uint16_t data) {}
 
 mc::Block BaseRenderMode::getBlock(const mc::BlockPos &pos, int get) {
-    return world->getBlock(pos, *current_chunk, get);
+    return neighborhood->getBlock(pos, get);
 }
 
 MultiplexingRenderMode::~MultiplexingRenderMode() {
@@ -72,9 +76,10 @@ void MultiplexingRenderMode::addRenderMode(RenderMode *render_mode) {
 }
 
 void MultiplexingRenderMode::initialize(const RenderView *render_view, BlockImages *images,
-                                        mc::WorldCache *world, mc::Chunk **current_chunk) {
+                                        mc::WorldCache *world, mc::Chunk **current_chunk,
+                                        mc::ChunkNeighborhood *neighborhood) {
     for (auto it = render_modes.begin(); it != render_modes.end(); ++it)
-        (*it)->initialize(render_view, images, world, current_chunk);
+        (*it)->initialize(render_view, images, world, current_chunk, neighborhood);
 }
 
 bool MultiplexingRenderMode::isHidden(const mc::BlockPos &pos, uint16_t id, uint16_t data) {
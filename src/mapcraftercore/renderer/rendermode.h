@@ -42,6 +42,7 @@ namespace mc {
 struct Block;
 class BlockPos;
 class Chunk;
+class ChunkNeighborhood;
 } // namespace mc
 
 namespace renderer {
@@ -60,13 +61,16 @@ class RenderMode {
     /**
      * Sets stuff (block images and world cache) that is required for the render mode
      * to operate. There is a pointer to the current chunk that is used by the tile
-     * renderer, that way you (mostly) don't need to access the world cache.
+     * renderer, that way you (mostly) don't need to access the world cache. The blocks
+     * and their neighbors should be looked up with the chunk neighborhood of the tile
+     * renderer.
      *
      * The render view is required because some render modes need render view specific
      * methods to modify the block images.
      */
     virtual void initialize(const RenderView *render_view, BlockImages *images,
-                            mc::WorldCache *world, mc::Chunk **current_chunk) = 0;
+                            mc::WorldCache *world, mc::Chunk **current_chunk,
+                            mc::ChunkNeighborhood *neighborhood) = 0;
 
     /**
      * This method is called by the tile renderer to check if a block should be hidden.
@@ -87,8 +91,8 @@ class RenderMode {
 
 /**
  * The base render mode class already implements handling of the initialize-method and
- * some other stuff (a comfortable getBlock-method that takes the current_chunk into
- * account).
+ * some other stuff (a comfortable getBlock-method that looks the blocks up with the chunk
+ * neighborhood).
  */
 class BaseRenderMode : public RenderMode {
   public:
@@ -100,7 +104,8 @@ class BaseRenderMode : public RenderMode {
      * renderer with the render view.
      */
     virtual void initialize(const RenderView *render_view, BlockImages *images,
-                            mc::WorldCache *world, mc::Chunk **current_chunk);
+                            mc::WorldCache *world, mc::Chunk **current_chunk,
+                            mc::ChunkNeighborhood *neighborhood);
 
     /**
      * Dummy implementation of interface method. Returns false as default.
@@ -119,6 +124,7 @@ class BaseRenderMode : public RenderMode {
     RenderedBlockImages *block_images;
     mc::WorldCache *world;
     mc::Chunk **current_chunk;
+    mc::ChunkNeighborhood *neighborhood;
 };
 
 /**
@@ -138,7 +144,8 @@ class MultiplexingRenderMode : public RenderMode {
      * Passes the supplied render data to the render modes.
      */
     virtual void initialize(const RenderView *render_view, BlockImages *images,
-                            mc::WorldCache *world, mc::Chunk **current_chunk);
+                            mc::WorldCache *world, mc::Chunk **current_chunk,
+                            mc::ChunkNeighborhood *neighborhood);
 
     /**
      * Calls this method of each render mode and returns true if one render mode returns
@@ -20,6 +20,7 @@
 #include "cave.h"
 
 #include "../../mc/chunk.h"
+#include "../../mc/chunkneighborhood.h"
 #include "../blockimages.h"
 #include "../image.h"
 
@@ -34,11 +35,12 @@ CaveRenderMode::~CaveRenderMode() {}
 bool CaveRenderMode::isHidden(const mc::BlockPos &pos, uint16_t id, uint16_t data) { return false; }
 
 bool CaveRenderMode::isHidden(const mc::BlockPos &pos, const BlockImage &block_image) {
-    mc::BlockPos directions[6] = {mc::DIR_NORTH, mc::DIR_SOUTH, mc::DIR_EAST,
-                                  mc::DIR_WEST,  mc::DIR_TOP,   mc::DIR_BOTTOM};
+    // north, south, east, west, top, bottom
+    mc::Block neighbors[6];
+    neighborhood->getNeighbors6(pos, neighbors, mc::GET_ID | mc::GET_SKY_LIGHT);
     // check if this block touches sky light
     for (int i = 0; i < 6; i++) {
-        if (getBlock(pos + directions[i], mc::GET_SKY_LIGHT).sky_light > 0) {
+        if (neighbors[i].sky_light > 0) {
             return true;
         }
     }
@@ -49,7 +51,7 @@ bool CaveRenderMode::isHidden(const mc::BlockPos &pos, const BlockImage &block_i
     // we need to check if there is sunlight on the surface of the water
     // if yes => no cave, hide block
     // if no  => lake in a cave, show it
-    mc::Block top = getBlock(pos + mc::DIR_TOP, mc::GET_ID | mc::GET_SKY_LIGHT);
+    mc::Block top = neighbors[4];
     const BlockImage *top_image = &block_images->getBlockImage(top.id);
     if (block_image.is_full_water || block_image.is_waterlogged || block_image.is_ice ||
         top_image->is_full_water || top_image->is_waterlogged || top_image->is_ice) {
@@ -20,11 +20,13 @@
 #include "lighting.h"
 
 #include "../../mc/chunk.h"
+#include "../../mc/chunkneighborhood.h"
 #include "../../mc/pos.h"
 #include "../../util.h"
 #include "../blockimages.h"
 #include "../image.h"
 
+#include <algorithm>
 #include <cmath>
 
 namespace mapcrafter {
@@ -87,51 +89,9 @@ uint8_t LightingData::getLightLevel(bool day) const {
     return std::max(block_light + 0, sky_light - 11);
 }
 
-namespace {
-
-bool isSpecialTransparent(uint16_t id) {
-    // not to be called anymore
-    assert(false);
-
-    // blocks which are transparent but don't have correct lighting data
-
-    // they need skylight from the block above
-    // (or the block above above, if the block above is also one of this blocks)
-
-    // they need an average blocklight from near blocks
-    return id == 44                // stone slabs
-           || id == 53             // oak wood stairs
-           || id == 64 || id == 71 // doors
-           || id == 67             // cobble stairs
-           || id == 108            // brick stairs
-           || id == 109            // stone brick stairs
-           || id == 114            // nether brick stairs
-           || id == 126            // wooden slabs
-           || id == 128            // sandstone stairs
-           || id == 134            // spruce wood stairs
-           || id == 135            // birch wood stairs
-           || id == 136            // jungle wood stairs
-           || id == 145            // anvil
-           || id == 156            // quartz stairs
-           || id == 163            // acacia wood stairs
-           || id == 164            // dark oak wood stairs
-           || id == 180            // red sandstone stairs
-           || id == 182            // stone2 slabs
-           || id == 203            // purpur stairs
-           || id == 205            // purpur slabs
-           || id == 208            // grass paths
-        ;
-}
-
-} // namespace
-
 LightingData LightingData::estimate(const mc::Block &block, RenderedBlockImages *block_images,
-                                    mc::WorldCache *world, mc::Chunk *current_chunk) {
+                                    mc::ChunkNeighborhood *neighborhood) {
     // estimate the light if this is a special block
-    /*
-    if (!isSpecialTransparent(block.id))
-            return LightingData(block.block_light, block.sky_light);
-    */
     if (!block_images->getBlockImage(block.id).has_faulty_lighting) {
         return LightingData(block.block_light, block.sky_light);
     }
@@ -142,12 +102,8 @@ LightingData LightingData::estimate(const mc::Block &block, RenderedBlockImages
     mc::BlockPos off(0, 0, 0);
     mc::Block above;
     while (++off.y) {
-        above = world->getBlock(block.pos + off, current_chunk, mc::GET_ID | mc::GET_SKY_LIGHT);
+        above = neighborhood->getBlock(block.pos + off, mc::GET_ID | mc::GET_SKY_LIGHT);
         const BlockImage &above_block = block_images->getBlockImage(above.id);
-        /*
-        if (isSpecialTransparent(above.id))
-                continue;
-        */
         if (above_block.has_faulty_lighting) {
             continue;
         }
@@ -162,26 +118,17 @@ LightingData LightingData::estimate(const mc::Block &block, RenderedBlockImages
     // get the block light from the neighbor blocks
     int block_lights = 0;
     int block_lights_count = 0;
-    for (int dx = -1; dx <= 1; dx++)
-        for (int dz = -1; dz <= 1; dz++)
-            for (int dy = -1; dy <= 1; dy++) {
-                mc::Block other = world->getBlock(block.pos + mc::BlockPos(dx, dz, dy),
-                                                  current_chunk, mc::GET_ID | mc::GET_BLOCK_LIGHT);
-                const BlockImage &other_block = block_images->getBlockImage(other.id);
-                /*
-                if ((other.id == 0
-                                || images->isBlockTransparent(other.id, other.data))
-                                && !isSpecialTransparent(other.id)) {
-                        block_lights += other.block_light;
-                        block_lights_count++;
-                }
-                */
-                if ((other_block.is_air || other_block.is_transparent) &&
-                    !other_block.has_faulty_lighting) {
-                    block_lights += other.block_light;
-                    block_lights_count++;
-                }
-            }
+    mc::Block others[27];
+    neighborhood->getNeighbors26(block.pos, others, mc::GET_ID | mc::GET_BLOCK_LIGHT);
+    for (int i = 0; i < 27; i++) {
+        const mc::Block &other = others[i];
+        const BlockImage &other_block = block_images->getBlockImage(other.id);
+        if ((other_block.is_air || other_block.is_transparent) &&
+            !other_block.has_faulty_lighting) {
+            block_lights += other.block_light;
+            block_lights_count++;
+        }
+    }
 
     if (block_lights_count > 0)
         block_light = block_lights / block_lights_count;
@@ -191,7 +138,8 @@ LightingData LightingData::estimate(const mc::Block &block, RenderedBlockImages
 LightingRenderMode::LightingRenderMode(bool day, double lighting_intensity,
                                        double lighting_water_intensity, bool simulate_sun_light)
     : day(day), lighting_intensity(lighting_intensity),
-      lighting_water_intensity(lighting_water_intensity), simulate_sun_light(simulate_sun_light) {}
+      lighting_water_intensity(lighting_water_intensity), simulate_sun_light(simulate_sun_light),
+      has_neighbor_color() {}
 
 LightingRenderMode::~LightingRenderMode() {}
 
@@ -228,16 +176,18 @@ void LightingRenderMode::draw(RGBAImage &image, const BlockImage &block_image,
     } else if (block_image.lighting_type == LightingType::SIMPLE) {
         doSimpleLight(image, block_image, pos, id);
     } else if (block_image.lighting_type == LightingType::SMOOTH_TOP_REMAINING_SIMPLE) {
+        setNeighbors(pos);
         CornerValues id = {1.0, 1.0, 1.0, 1.0};
-        CornerValues up = getCornerColors(pos, CORNERS_TOP, lighting_intensity);
+        CornerValues up = getCornerColors(CORNERS_TOP, lighting_intensity);
         blockImageMultiply(image, block_image.uv_image, id, id, up);
 
         float factor = getLightingColor(pos, lighting_intensity);
         blockImageMultiplyExcept(image, block_image.uv_image, FACE_UP_INDEX, factor);
     } else if (block_image.lighting_type == LightingType::SMOOTH_BOTTOM) {
-        CornerValues left = getCornerColors(pos, CORNERS_LEFT, lighting_intensity);
-        CornerValues right = getCornerColors(pos, CORNERS_RIGHT, lighting_intensity);
-        CornerValues up = getCornerColors(pos, CORNERS_BOTTOM, lighting_intensity);
+        setNeighbors(pos);
+        CornerValues left = getCornerColors(CORNERS_LEFT, lighting_intensity);
+        CornerValues right = getCornerColors(CORNERS_RIGHT, lighting_intensity);
+        CornerValues up = getCornerColors(CORNERS_BOTTOM, lighting_intensity);
         blockImageMultiply(image, block_image.uv_image, left, right, up);
     }
 }
@@ -247,8 +197,11 @@ LightingColor LightingRenderMode::calculateLightingColor(const LightingData &lig
 }
 
 LightingData LightingRenderMode::getBlockLight(const mc::BlockPos &pos) {
-    mc::Block block = getBlock(pos, mc::GET_ID | mc::GET_LIGHT);
-    LightingData light = LightingData::estimate(block, block_images, world, *current_chunk);
+    return getBlockLight(pos, getBlock(pos, mc::GET_ID | mc::GET_LIGHT));
+}
+
+LightingData LightingRenderMode::getBlockLight(const mc::BlockPos &pos, const mc::Block &block) {
+    LightingData light = LightingData::estimate(block, block_images, neighborhood);
 
     // TODO also move this to LightingData class?
     // lighting fix for The End
@@ -279,25 +232,43 @@ LightingColor LightingRenderMode::getLightingColor(const mc::BlockPos &pos, doub
     return color + (1 - color) * (1 - intensity);
 }
 
-LightingColor LightingRenderMode::getCornerColor(const mc::BlockPos &pos,
-                                                 const CornerNeighbors &corner, double intensity) {
+void LightingRenderMode::setNeighbors(const mc::BlockPos &pos) {
+    neighbors_pos = pos;
+    neighborhood->getNeighbors26(pos, neighbors, mc::GET_ID | mc::GET_LIGHT);
+    std::fill(has_neighbor_color, has_neighbor_color + 27, false);
+}
+
+LightingColor LightingRenderMode::getNeighborColor(const mc::BlockPos &neighbor,
+                                                   double intensity) {
+    assert(std::abs(neighbor.x) <= 1 && std::abs(neighbor.z) <= 1 && std::abs(neighbor.y) <= 1);
+    int i = ((neighbor.y + 1) * 3 + neighbor.z + 1) * 3 + neighbor.x + 1;
+    if (!has_neighbor_color[i]) {
+        LightingData lighting = getBlockLight(neighbors_pos + neighbor, neighbors[i]);
+        neighbor_colors[i] = calculateLightingColor(lighting);
+        has_neighbor_color[i] = true;
+    }
+    LightingColor color = neighbor_colors[i];
+    return color + (1 - color) * (1 - intensity);
+}
+
+LightingColor LightingRenderMode::getCornerColor(const CornerNeighbors &corner,
+                                                 double intensity) {
     LightingColor color = 0;
-    color += getLightingColor(pos + corner.pos1, intensity) * 0.25;
-    color += getLightingColor(pos + corner.pos2, intensity) * 0.25;
-    color += getLightingColor(pos + corner.pos3, intensity) * 0.25;
-    color += getLightingColor(pos + corner.pos4, intensity) * 0.25;
+    color += getNeighborColor(corner.pos1, intensity) * 0.25;
+    color += getNeighborColor(corner.pos2, intensity) * 0.25;
+    color += getNeighborColor(corner.pos3, intensity) * 0.25;
+    color += getNeighborColor(corner.pos4, intensity) * 0.25;
     return color;
 }
 
-CornerColors LightingRenderMode::getCornerColors(const mc::BlockPos &pos,
-                                                 const FaceCorners &corners, double intensity) {
+CornerColors LightingRenderMode::getCornerColors(const FaceCorners &corners, double intensity) {
     if (intensity < 0)
         intensity = lighting_intensity;
     CornerColors colors = {{
-        getCornerColor(pos, corners.corner1, intensity),
-        getCornerColor(pos, corners.corner2, intensity),
-        getCornerColor(pos, corners.corner3, intensity),
-        getCornerColor(pos, corners.corner4, intensity),
+        getCornerColor(corners.corner1, intensity),
+        getCornerColor(corners.corner2, intensity),
+        getCornerColor(corners.corner3, intensity),
+        getCornerColor(corners.corner4, intensity),
     }};
     return colors;
 }
@@ -310,13 +281,16 @@ void LightingRenderMode::doSmoothLight(RGBAImage &image, const BlockImage &block
     // - light only visible faces
     // - underwater
 
+    setNeighbors(pos);
+
     std::array<bool, 3> side_mask = block_image.side_mask;
     bool under_water[3] = {false, false, false};
 
-    mc::BlockPos dirs[3] = {mc::DIR_WEST, mc::DIR_SOUTH, mc::DIR_TOP};
+    // the west, south and top neighbors in the 3x3x3 neighbors
+    int dirs[3] = {12, 16, 22};
     for (int i = 0; i < 3; i++) {
         if (side_mask[i]) {
-            const BlockImage &block = block_images->getBlockImage(getBlock(pos + dirs[i]).id);
+            const BlockImage &block = block_images->getBlockImage(neighbors[dirs[i]].id);
             under_water[i] = block.is_full_water || block.is_waterlogged;
             side_mask[i] = block.is_air || block.is_transparent;
         }
@@ -327,15 +301,15 @@ void LightingRenderMode::doSmoothLight(RGBAImage &image, const BlockImage &block
     CornerValues up = {1.0, 1.0, 1.0, 1.0};
 
     if (side_mask[0]) {
-        left = getCornerColors(pos, CORNERS_LEFT,
+        left = getCornerColors(CORNERS_LEFT,
                                under_water[0] ? lighting_water_intensity : lighting_intensity);
     }
     if (side_mask[1]) {
-        right = getCornerColors(pos, CORNERS_RIGHT,
+        right = getCornerColors(CORNERS_RIGHT,
                                 under_water[1] ? lighting_water_intensity : lighting_intensity);
     }
     if (side_mask[2]) {
-        up = getCornerColors(pos, use_bottom_corners ? CORNERS_BOTTOM : CORNERS_TOP,
+        up = getCornerColors(use_bottom_corners ? CORNERS_BOTTOM : CORNERS_TOP,
                              under_water[2] ? lighting_water_intensity : lighting_intensity);
     }
     blockImageMultiply(image, block_image.uv_image, left, right, up);
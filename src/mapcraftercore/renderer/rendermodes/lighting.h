@@ -78,7 +78,7 @@ class LightingData {
     uint8_t getLightLevel(bool day) const;
 
     static LightingData estimate(const mc::Block &block, RenderedBlockImages *block_images,
-                                 mc::WorldCache *world, mc::Chunk *current_chunk);
+                                 mc::ChunkNeighborhood *neighborhood);
 
   protected:
     uint8_t block_light, sky_light;
@@ -105,6 +105,13 @@ class LightingRenderMode : public BaseRenderMode {
     double lighting_intensity, lighting_water_intensity;
     bool simulate_sun_light;
 
+    // the 3x3x3 blocks around the block that is lit (see setNeighbors) and their lighting
+    // colors, as index ((dy + 1) * 3 + dz + 1) * 3 + dx + 1
+    mc::BlockPos neighbors_pos;
+    mc::Block neighbors[27];
+    LightingColor neighbor_colors[27];
+    bool has_neighbor_color[27];
+
     /**
      * Calculates the color of the light of a block.
      *
@@ -118,24 +125,36 @@ class LightingRenderMode : public BaseRenderMode {
      * estimated if the block is a special transparent block.
      */
     LightingData getBlockLight(const mc::BlockPos &pos);
+    LightingData getBlockLight(const mc::BlockPos &pos, const mc::Block &block);
 
     /**
      * Returns the lighting color of a block.
      */
     LightingColor getLightingColor(const mc::BlockPos &pos, double intensity);
 
+    /**
+     * Looks up the 3x3x3 blocks around a block, the faces of the block are lit with
+     * the lighting colors of these neighbors.
+     */
+    void setNeighbors(const mc::BlockPos &pos);
+
+    /**
+     * Returns the lighting color of a neighbor (relative position) of the block of the
+     * last setNeighbors call. The lighting colors are computed once per neighbor.
+     */
+    LightingColor getNeighborColor(const mc::BlockPos &neighbor, double intensity);
+
     /**
      * Returns the lighting color of a corner by calculating the average lighting color of
      * the four neighbor blocks.
      */
-    LightingColor getCornerColor(const mc::BlockPos &pos, const CornerNeighbors &corner,
-                                 double intensity);
+    LightingColor getCornerColor(const CornerNeighbors &corner, double intensity);
 
     /**
-     * Returns the corner lighting colors of a block face.
+     * Returns the corner lighting colors of a block face of the block of the last
+     * setNeighbors call.
      */
-    CornerColors getCornerColors(const mc::BlockPos &pos, const FaceCorners &corners,
-                                 double intensity = -1);
+    CornerColors getCornerColors(const FaceCorners &corners, double intensity = -1);
 
     /**
      * Applies the smooth lighting to a block by adding lighting to the top, left and
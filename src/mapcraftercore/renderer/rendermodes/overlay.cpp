@@ -19,6 +19,7 @@
 
 #include "overlay.h"
 
+#include "../../mc/chunkneighborhood.h"
 #include "../../mc/pos.h"
 #include "../blockimages.h"
 #include "../image.h"
@@ -49,11 +50,11 @@ void OverlayRenderMode::draw(RGBAImage &image, const BlockImage &block_image,
                 return;
             blockImageTintHighContrast(image, color);
         } else {
-            mc::Block top, left, right;
+            // north, south, east, west, top, bottom
+            mc::Block neighbors[6];
+            neighborhood->getNeighbors6(pos, neighbors, mc::GET_ID);
+            const mc::Block &top = neighbors[4], &left = neighbors[3], &right = neighbors[1];
             RGBAPixel color_top, color_left, color_right;
-            top = getBlock(pos + mc::DIR_TOP, mc::GET_ID);
-            left = getBlock(pos + mc::DIR_WEST, mc::GET_ID);
-            right = getBlock(pos + mc::DIR_SOUTH, mc::GET_ID);
             color_top = getBlockColor(pos + mc::DIR_TOP, block_images->getBlockImage(top.id));
             color_left = getBlockColor(pos + mc::DIR_WEST, block_images->getBlockImage(left.id));
             color_right = getBlockColor(pos + mc::DIR_SOUTH, block_images->getBlockImage(right.id));
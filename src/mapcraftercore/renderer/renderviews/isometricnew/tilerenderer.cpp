@@ -377,8 +377,7 @@ int NewIsometricTileRenderer::getTileSize() const {
     return images->getBlockSize() * 16 * tile_width;
 }
 
-void NewIsometricTileRenderer::renderTopBlocks(const TilePos &tile_pos,
-                                               std::set<TileImage> &tile_images) {
+void NewIsometricTileRenderer::renderTopBlocks(const TilePos &tile_pos, TileImages &tile_images) {
     int block_size = images->getBlockSize();
     for (old::TileTopBlockIterator it(tile_pos, block_size, tile_width); !it.end(); it.next()) {
         renderBlocks(it.draw_x, it.draw_y, it.current, mc::BlockPos(1, -1, -1), tile_images);
@@ -107,7 +107,7 @@ class NewIsometricTileRenderer : public TileRenderer {
     virtual int getTileSize() const;
 
   protected:
-    virtual void renderTopBlocks(const TilePos &tile_pos, std::set<TileImage> &tile_images);
+    virtual void renderTopBlocks(const TilePos &tile_pos, TileImages &tile_images);
 };
 
 } // namespace renderer
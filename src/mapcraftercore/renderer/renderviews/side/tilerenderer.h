@@ -41,7 +41,7 @@ class SideTileRenderer : public TileRenderer {
     virtual int getTileHeight() const;
 
   protected:
-    virtual void renderTopBlocks(const TilePos &tile_pos, std::set<TileImage> &tile_images);
+    virtual void renderTopBlocks(const TilePos &tile_pos, TileImages &tile_images);
 };
 
 } // namespace renderer
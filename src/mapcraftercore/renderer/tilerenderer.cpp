@@ -23,10 +23,13 @@
 #include "../mc/pos.h"
 #include "../util.h"
 #include "blockimages.h"
+#include "image/kernels.h"
 #include "rendermode.h"
 #include "renderview.h"
 #include "tileset.h"
 
+#include <algorithm>
+
 namespace mapcrafter {
 namespace renderer {
 
@@ -37,15 +40,266 @@ bool TileImage::operator<(const TileImage &other) const {
     return pos < other.pos;
 }
 
+namespace {
+
+/**
+ * Returns the number of bits required to store values from 0 to range (inclusive).
+ */
+int bitsForRange(uint64_t range) {
+    int bits = 0;
+    while (bits < 64 && (range >> bits) != 0) {
+        bits++;
+    }
+    return bits;
+}
+
+} // namespace
+
+TileImages::TileImages() : skipped(0) {}
+
+TileImages::~TileImages() {}
+
+void TileImages::clear() { tile_images.clear(); }
+
+void TileImages::add(int x, int y, const mc::BlockPos &pos, int z_index, uint16_t id,
+                     const BlockImage &block_image) {
+    TileImage tile_image;
+    tile_image.x = x;
+    tile_image.y = y;
+    tile_image.pos = pos;
+    tile_image.z_index = z_index;
+    tile_image.id = id;
+    tile_image.block_image = &block_image;
+    tile_image.image = 0;
+    tile_images.push_back(tile_image);
+}
+
+size_t TileImages::size() const { return tile_images.size(); }
+
+size_t TileImages::getSkippedCount() const { return skipped; }
+
+void TileImages::sort() {
+    size_t n = tile_images.size();
+    order.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    if (n < 2) {
+        return;
+    }
+
+    // the order of TileImage::operator<: y ascending, x descending, z ascending, z-index
+    // ascending -- pack these fields relative to their minimum into one integer key
+    int64_t min_x = INT64_MAX, min_y = INT64_MAX, min_z = INT64_MAX, min_z_index = INT64_MAX;
+    int64_t max_x = INT64_MIN, max_y = INT64_MIN, max_z = INT64_MIN, max_z_index = INT64_MIN;
+    for (const TileImage &tile_image : tile_images) {
+        min_x = std::min<int64_t>(min_x, tile_image.pos.x);
+        max_x = std::max<int64_t>(max_x, tile_image.pos.x);
+        min_y = std::min<int64_t>(min_y, tile_image.pos.y);
+        max_y = std::max<int64_t>(max_y, tile_image.pos.y);
+        min_z = std::min<int64_t>(min_z, tile_image.pos.z);
+        max_z = std::max<int64_t>(max_z, tile_image.pos.z);
+        min_z_index = std::min<int64_t>(min_z_index, tile_image.z_index);
+        max_z_index = std::max<int64_t>(max_z_index, tile_image.z_index);
+    }
+    int bits_x = bitsForRange(max_x - min_x);
+    int bits_y = bitsForRange(max_y - min_y);
+    int bits_z = bitsForRange(max_z - min_z);
+    int bits_z_index = bitsForRange(max_z_index - min_z_index);
+    if (bits_x + bits_y + bits_z + bits_z_index > 64) {
+        std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return tile_images[a] < tile_images[b];
+        });
+        return;
+    }
+
+    int shift_z = bits_z_index;
+    int shift_x = shift_z + bits_z;
+    int shift_y = shift_x + bits_x;
+    keys.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        const TileImage &tile_image = tile_images[i];
+        keys[i] = ((uint64_t)(tile_image.z_index - min_z_index)) |
+                  ((uint64_t)(tile_image.pos.z - min_z) << shift_z) |
+                  ((uint64_t)(max_x - tile_image.pos.x) << shift_x) |
+                  ((uint64_t)(tile_image.pos.y - min_y) << shift_y);
+    }
+
+    // stable LSD radix sort with 8 bit digits, skipping digits that are the same
+    // for all keys (most of the key bits are usually zero)
+    keys_tmp.resize(n);
+    order_tmp.resize(n);
+    int key_bits = shift_y + bits_y;
+    for (int shift = 0; shift < key_bits; shift += 8) {
+        size_t count[256] = {0};
+        for (size_t i = 0; i < n; i++) {
+            count[(keys[i] >> shift) & 0xff]++;
+        }
+        if (count[(keys[0] >> shift) & 0xff] == n) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t i = 0; i < 256; i++) {
+            size_t c = count[i];
+            count[i] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            size_t j = count[(keys[i] >> shift) & 0xff]++;
+            keys_tmp[j] = keys[i];
+            order_tmp[j] = order[i];
+        }
+        keys.swap(keys_tmp);
+        order.swap(order_tmp);
+    }
+}
+
+void TileImages::composite(RGBAImage &tile, const DrawFunction &draw) {
+    sort();
+
+    // the same block can be reached twice (for example by rays at the border of
+    // two chunks), but it must be drawn only once
+    size_t count = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        const TileImage &tile_image = tile_images[order[i]];
+        if (count > 0) {
+            const TileImage &last = tile_images[order[count - 1]];
+            if (last.pos == tile_image.pos && last.z_index == tile_image.z_index) {
+                continue;
+            }
+        }
+        order[count++] = order[i];
+    }
+    order.resize(count);
+    skipped = tile_images.size() - count;
+
+    int width = tile.getWidth();
+    int height = tile.getHeight();
+    occluders.assign(width * height, 0);
+
+    // front to back: draw only the block images that have at least one pixel that isn't
+    // hidden yet, and remember which one is the first opaque one at each pixel
+    size_t pool_size = 0;
+    for (size_t i = count; i-- > 0;) {
+        TileImage &tile_image = tile_images[order[i]];
+        const RGBAImage &block = tile_image.block_image->image;
+        int x1 = std::max(0, tile_image.x), x2 = std::min(width, tile_image.x + block.width);
+        int y1 = std::max(0, tile_image.y), y2 = std::min(height, tile_image.y + block.height);
+
+        bool visible = false;
+        for (int y = y1; y < y2 && !visible; y++) {
+            const uint32_t *row = &occluders[y * width];
+            for (int x = x1; x < x2; x++) {
+                if (row[x] == 0) {
+                    visible = true;
+                    break;
+                }
+            }
+        }
+        if (!visible) {
+            tile_image.image = SIZE_MAX;
+            skipped++;
+            continue;
+        }
+
+        if (image_pool.size() <= pool_size) {
+            image_pool.resize(pool_size + 1);
+        }
+        tile_image.image = pool_size++;
+        RGBAImage &image = image_pool[tile_image.image];
+        draw(tile_image, image);
+
+        for (int y = y1; y < y2; y++) {
+            uint32_t *row = &occluders[y * width];
+            const RGBAPixel *pixels = &image.data[(y - tile_image.y) * image.width];
+            for (int x = x1; x < x2; x++) {
+                if (row[x] == 0 && pixels[x - tile_image.x] >= 0xff000000) {
+                    row[x] = i + 1;
+                }
+            }
+        }
+    }
+
+    // back to front: blend the visible pixels, the frontmost opaque pixel replaces
+    // everything behind it anyways
+    const ImageKernels &kernels = getImageKernels();
+    for (size_t i = 0; i < count; i++) {
+        const TileImage &tile_image = tile_images[order[i]];
+        if (tile_image.image == SIZE_MAX) {
+            continue;
+        }
+        const RGBAImage &image = image_pool[tile_image.image];
+        int x1 = std::max(0, tile_image.x), x2 = std::min(width, tile_image.x + image.width);
+        int y1 = std::max(0, tile_image.y), y2 = std::min(height, tile_image.y + image.height);
+        for (int y = y1; y < y2; y++) {
+            const uint32_t *row = &occluders[y * width];
+            const RGBAPixel *pixels = &image.data[(y - tile_image.y) * image.width];
+            RGBAPixel *dest = &tile.data[y * width];
+            // blend the runs of visible pixels
+            for (int x = x1; x < x2;) {
+                if (row[x] > i + 1) {
+                    x++;
+                    continue;
+                }
+                int end = x + 1;
+                while (end < x2 && row[end] <= i + 1) {
+                    end++;
+                }
+                kernels.blend(dest + x, pixels + (x - tile_image.x), end - x);
+                x = end;
+            }
+        }
+    }
+}
+
+SpriteCache::SpriteCache(size_t capacity)
+    : capacity(std::max(capacity, size_t(1))), hits(0), misses(0), evictions(0) {}
+
+bool SpriteCache::get(uint16_t id, uint8_t strip, uint32_t color, uint32_t waterlog_color,
+                      RGBAImage *&sprite) {
+    Key key = {id, strip, color, waterlog_color};
+    auto it = index.find(key);
+    if (it != index.end()) {
+        hits++;
+        sprites.splice(sprites.begin(), sprites, it->second);
+        sprite = &it->second->second;
+        return true;
+    }
+
+    misses++;
+    if (sprites.size() >= capacity) {
+        // reuse the least recently used entry (and the memory of its image)
+        evictions++;
+        index.erase(sprites.back().first);
+        sprites.splice(sprites.begin(), sprites, std::prev(sprites.end()));
+        sprites.front().first = key;
+    } else {
+        sprites.emplace_front(key, RGBAImage());
+    }
+    index[key] = sprites.begin();
+    sprite = &sprites.front().second;
+    return false;
+}
+
+size_t SpriteCache::size() const { return sprites.size(); }
+
+void SpriteCache::addStats(SpriteCacheStats &stats) {
+    stats.hits += hits;
+    stats.misses += misses;
+    stats.evictions += evictions;
+    hits = misses = evictions = 0;
+}
+
 TileRenderer::TileRenderer(const RenderView *render_view, mc::BlockStateRegistry &block_registry,
                            BlockImages *images, int tile_width, mc::WorldCache *world,
                            RenderMode *render_mode)
     : block_registry(block_registry), images(images),
       block_images(dynamic_cast<RenderedBlockImages *>(images)), tile_width(tile_width),
-      world(world), current_chunk(nullptr), render_mode(render_mode), render_biomes(true),
-      use_preblit_water(false), shadow_edges({0, 0, 0, 0, 0}) {
+      world(world), current_chunk(nullptr), neighborhood(world), render_mode(render_mode),
+      render_biomes(true), use_preblit_water(false), shadow_edges({0, 0, 0, 0, 0}) {
     assert(block_images);
-    render_mode->initialize(render_view, images, world, &current_chunk);
+    render_mode->initialize(render_view, images, world, &current_chunk, &neighborhood);
 
     // TODO can we make this somehow less hardcoded?
     full_water_ids.insert(
@@ -111,14 +365,21 @@ void TileRenderer::setShadowEdges(std::array<uint8_t, 5> shadow_edges) {
     this->shadow_edges = shadow_edges;
 }
 
+void TileRenderer::setSpriteCacheStats(std::shared_ptr<SpriteCacheStats> sprite_cache_stats) {
+    this->sprite_cache_stats = sprite_cache_stats;
+}
+
 void TileRenderer::renderTile(const TilePos &tile_pos, RGBAImage &tile) {
     tile.setSize(getTileWidth(), getTileHeight());
 
-    std::set<TileImage> tile_images;
-    renderTopBlocks(tile_pos, tile_images);
+    tile_images_buffer.clear();
+    renderTopBlocks(tile_pos, tile_images_buffer);
+    tile_images_buffer.composite(tile, [this](const TileImage &tile_image, RGBAImage &image) {
+        drawTileImage(tile_image, image);
+    });
 
-    for (auto it = tile_images.begin(); it != tile_images.end(); ++it) {
-        tile.alphaBlit(it->image, it->x, it->y);
+    if (sprite_cache_stats) {
+        sprite_cache.addStats(*sprite_cache_stats);
     }
 }
 
@@ -127,7 +388,7 @@ int TileRenderer::getTileWidth() const { return getTileSize(); }
 int TileRenderer::getTileHeight() const { return getTileSize(); }
 
 void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockPos &dir,
-                                std::set<TileImage> &tile_images) {
+                                TileImages &tile_images) {
     for (; top.y >= mc::CHUNK_LOW * 16; top += dir) {
         // get current chunk position
         mc::ChunkPos current_chunk_pos(top);
@@ -139,13 +400,19 @@ void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockP
             //	continue;
             current_chunk = world->getChunk(current_chunk_pos);
         }
-        if (current_chunk == nullptr) {
-            continue;
-        }
-
         // get local block position
         mc::LocalBlockPos local(top);
 
+        // skip the rest of the ray in a chunk that doesn't exist, and the air blocks above
+        // the highest blocks and in sections without blocks
+        int skip = current_chunk == nullptr ? mc::getStepsInChunk(local, dir)
+                                            : current_chunk->getAirSteps(local, dir);
+        if (skip > 0) {
+            skip--;
+            top += mc::BlockPos(dir.x * skip, dir.z * skip, dir.y * skip);
+            continue;
+        }
+
         uint16_t id = current_chunk->getBlockID(local);
         const BlockImage *block_image = &block_images->getBlockImage(id);
         if (block_image->is_air || render_mode->isHidden(top, *block_image)) {
@@ -161,9 +428,11 @@ void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockP
         // };
 
         if (full_water_ids.count(id)) {
-            uint16_t up = getBlock(top + mc::DIR_TOP).id;
-            uint16_t south = getBlock(top + mc::DIR_SOUTH).id;
-            uint16_t west = getBlock(top + mc::DIR_WEST).id;
+            mc::Block neighbors[6];
+            neighborhood.getNeighbors6(top, neighbors);
+            uint16_t up = neighbors[4].id;
+            uint16_t south = neighbors[1].id;
+            uint16_t west = neighbors[3].id;
 
             uint8_t index =
                 is_full_water(up) | (is_full_water(south) << 1) | (is_full_water(west) << 2);
@@ -198,159 +467,271 @@ void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockP
             }
         }
 
-        auto addTileImage = [this, x, y, top, &tile_images](
-                                uint16_t id, const BlockImage &block_image, int z_index) {
-            TileImage tile_image;
-            tile_image.x = x;
-            tile_image.y = y;
-            tile_image.pos = top;
-            tile_image.z_index = z_index;
-
-            // Check which side can be stripped, if any
-            // This is speeding up the rendering as it minimizes the amount of shadow and lighting
-            // that needs to be done 133 sec with stripping 144 without stripping
-            bool strip_up = false;
-            bool strip_left = false;
-            bool strip_right = false;
-            if (block_image.can_partial) {
-                strip_up = id == getBlock(top + mc::DIR_TOP).id;
-                strip_left = id == getBlock(top + mc::DIR_WEST).id;
-                strip_right = id == getBlock(top + mc::DIR_SOUTH).id;
-            } else if (!block_image.is_transparent) {
-                strip_up =
-                    block_images->getBlockImage((getBlock(top + mc::DIR_TOP).id)).is_transparent ==
-                    false;
-                strip_left =
-                    block_images->getBlockImage((getBlock(top + mc::DIR_WEST).id)).is_transparent ==
-                    false;
-                strip_right = block_images->getBlockImage((getBlock(top + mc::DIR_SOUTH).id))
-                                  .is_transparent == false;
-            }
+        tile_images.add(x, y, top, 0, id, *block_image);
 
-            tile_image.image.setSize(block_image.image.width, block_image.image.height);
-
-            if (strip_up || strip_left || strip_right) {
-                const RGBAImage &uv = block_image.uv_image;
-                for (int i = 0; i < tile_image.image.width * tile_image.image.height; i++) {
-                    RGBAPixel puv = uv.data[i];
-                    RGBAPixel p = block_image.image.data[i];
-                    switch (rgba_blue(puv)) {
-                    case FACE_UP_INDEX:
-                        if (strip_up) {
-                            p = 0;
-                        }
-                        break;
-                    case FACE_LEFT_INDEX:
-                        if (strip_left) {
-                            p = 0;
-                        }
-                        break;
-                    case FACE_RIGHT_INDEX:
-                        if (strip_right) {
-                            p = 0;
-                        }
-                        break;
-                    }
-                    tile_image.image.data[i] = p;
-                }
-            } else {
-                std::copy(block_image.image.data.begin(), block_image.image.data.end(),
-                          tile_image.image.data.begin());
-            }
+        // if this block is not transparent, then stop looking for more blocks
+        if (!block_image->is_transparent) {
+            break;
+        }
+    }
+}
 
-            if (block_image.is_biome) {
-                block_images->prepareBiomeBlockImage(
-                    tile_image.image, block_image, getBiomeColor(top, block_image, current_chunk));
-            }
+void TileRenderer::drawTileImage(const TileImage &tile_image, RGBAImage &image) {
+    const mc::BlockPos &top = tile_image.pos;
+    uint16_t id = tile_image.id;
+    const BlockImage &block_image = *tile_image.block_image;
 
-            if (block_image.has_water_top) {
-                // get waterlog block image and biomize it
-                RGBAImage waterlog = waterlog_block_image->image;
-                const RGBAImage &waterlog_uv = waterlog_block_image->uv_image;
-                block_images->prepareBiomeBlockImage(
-                    waterlog, *waterlog_block_image,
-                    getBiomeColor(top, *waterlog_block_image, current_chunk));
+    // the block images are drawn after all blocks of the tile were traversed,
+    // make sure that the current chunk (used by the render modes) is the block's chunk
+    mc::ChunkPos chunk_pos(top);
+    if (current_chunk == nullptr || current_chunk->getPos() != chunk_pos) {
+        current_chunk = world->getChunk(chunk_pos);
+    }
 
-                // blend waterlog water surface on top of block
-                blockImageBlendTop(tile_image.image, block_image.uv_image, waterlog, waterlog_uv);
-            }
+    // Check which side can be stripped, if any
+    // This is speeding up the rendering as it minimizes the amount of shadow and lighting
+    // that needs to be done 133 sec with stripping 144 without stripping
+    // north, south, east, west, top, bottom
+    mc::Block neighbors[6];
+    neighborhood.getNeighbors6(top, neighbors);
+    uint16_t up_id = neighbors[4].id, west_id = neighbors[3].id, south_id = neighbors[1].id;
+
+    bool strip_up = false;
+    bool strip_left = false;
+    bool strip_right = false;
+    if (block_image.can_partial) {
+        strip_up = id == up_id;
+        strip_left = id == west_id;
+        strip_right = id == south_id;
+    } else if (!block_image.is_transparent) {
+        strip_up = block_images->getBlockImage(up_id).is_transparent == false;
+        strip_left = block_images->getBlockImage(west_id).is_transparent == false;
+        strip_right = block_images->getBlockImage(south_id).is_transparent == false;
+    }
 
-            if (block_image.shadow_edges > 0) {
-                auto shadow_edge = [this, top](const mc::BlockPos &dir) {
-                    const BlockImage &b = block_images->getBlockImage(getBlock(top + dir).id);
-                    // return b.is_transparent && !(b.is_full_water || b.is_waterlogged);
-                    return b.shadow_edges == 0;
-                };
-                uint8_t north = shadow_edges[0] && shadow_edge(mc::DIR_NORTH);
-                uint8_t south = shadow_edges[1] && shadow_edge(mc::DIR_SOUTH);
-                uint8_t east = shadow_edges[2] && shadow_edge(mc::DIR_EAST);
-                uint8_t west = shadow_edges[3] && shadow_edge(mc::DIR_WEST);
-                uint8_t bottom = shadow_edges[4] && shadow_edge(mc::DIR_BOTTOM);
-
-                if (north + south + east + west + bottom != 0) {
-                    int f = block_image.shadow_edges;
-                    north *= shadow_edges[0] * f;
-                    south *= shadow_edges[1] * f;
-                    east *= shadow_edges[2] * f;
-                    west *= shadow_edges[3] * f;
-                    bottom *= shadow_edges[4] * f;
-                    blockImageShadowEdges(tile_image.image, block_image.uv_image, north, south,
-                                          east, west, bottom);
-                }
-            }
+    uint8_t strip = strip_left | strip_right << 1 | strip_up << 2;
+    if (block_image.is_biome || block_image.has_water_top) {
+        // tinting and blending the water surface is the same for lots of blocks,
+        // so these sprites are cached
+        uint32_t color = 0, waterlog_color = 0;
+        if (block_image.is_biome) {
+            color = getBiomeColor(top, block_image, current_chunk);
+        }
+        if (block_image.has_water_top) {
+            waterlog_color = getBiomeColor(top, *waterlog_block_image, current_chunk);
+        }
 
-            // let the render mode do their magic with the block image
-            // render_mode->draw(node.image, node.pos, id, data);
-            render_mode->draw(tile_image.image, block_image, tile_image.pos, id);
+        RGBAImage *sprite;
+        if (!sprite_cache.get(id, strip, color, waterlog_color, sprite)) {
+            prepareSprite(block_image, strip, color, waterlog_color, *sprite);
+        }
+        image.setSize(sprite->width, sprite->height);
+        std::copy(sprite->data.begin(), sprite->data.end(), image.data.begin());
+    } else {
+        prepareSprite(block_image, strip, 0, 0, image);
+    }
 
-            tile_images.insert(tile_image);
+    if (block_image.shadow_edges > 0) {
+        auto shadow_edge = [this](const mc::Block &neighbor) {
+            const BlockImage &b = block_images->getBlockImage(neighbor.id);
+            // return b.is_transparent && !(b.is_full_water || b.is_waterlogged);
+            return b.shadow_edges == 0;
         };
+        uint8_t north = shadow_edges[0] && shadow_edge(neighbors[0]);
+        uint8_t south = shadow_edges[1] && shadow_edge(neighbors[1]);
+        uint8_t east = shadow_edges[2] && shadow_edge(neighbors[2]);
+        uint8_t west = shadow_edges[3] && shadow_edge(neighbors[3]);
+        uint8_t bottom = shadow_edges[4] && shadow_edge(neighbors[5]);
+
+        if (north + south + east + west + bottom != 0) {
+            int f = block_image.shadow_edges;
+            north *= shadow_edges[0] * f;
+            south *= shadow_edges[1] * f;
+            east *= shadow_edges[2] * f;
+            west *= shadow_edges[3] * f;
+            bottom *= shadow_edges[4] * f;
+            const std::vector<uint8_t> &factors =
+                getShadowEdgeFactors(block_image, north, south, east, west, bottom);
+            for (size_t i = 0; i < factors.size(); i++) {
+                image.data[i] = rgba_multiply_scalar(image.data[i], factors[i]);
+            }
+        }
+    }
 
-        addTileImage(id, *block_image, 0);
+    // let the render mode do their magic with the block image
+    // render_mode->draw(node.image, node.pos, id, data);
+    render_mode->draw(image, block_image, top, id);
+}
 
-        // if this block is not transparent, then stop looking for more blocks
-        if (!block_image->is_transparent) {
-            break;
+void TileRenderer::prepareSprite(const BlockImage &block_image, uint8_t strip, uint32_t color,
+                                 uint32_t waterlog_color, RGBAImage &sprite) {
+    sprite.setSize(block_image.image.width, block_image.image.height);
+    std::copy(block_image.image.data.begin(), block_image.image.data.end(),
+              sprite.data.begin());
+
+    // clear the precomputed pixel spans of the stripped faces (left, right, up)
+    for (int i = 0; i < 3; i++) {
+        if (!(strip & (1 << i))) {
+            continue;
         }
+        for (const auto &span : block_image.face_spans[i]) {
+            std::fill(sprite.data.begin() + span.first, sprite.data.begin() + span.second, 0);
+        }
+    }
+
+    if (block_image.is_biome) {
+        block_images->prepareBiomeBlockImage(sprite, block_image, color);
+    }
+
+    if (block_image.has_water_top) {
+        // get waterlog block image and biomize it
+        waterlog_image = waterlog_block_image->image;
+        const RGBAImage &waterlog_uv = waterlog_block_image->uv_image;
+        block_images->prepareBiomeBlockImage(waterlog_image, *waterlog_block_image,
+                                             waterlog_color);
+
+        // blend waterlog water surface on top of block
+        blockImageBlendTop(sprite, block_image.uv_image, waterlog_image, waterlog_uv);
     }
 }
 
+const std::vector<uint8_t> &TileRenderer::getShadowEdgeFactors(const BlockImage &block_image,
+                                                              uint8_t north, uint8_t south,
+                                                              uint8_t east, uint8_t west,
+                                                              uint8_t bottom) {
+    // the shadow edges depend only on the uv image and the edge factors
+    uint64_t key = (uint64_t)north | (uint64_t)south << 8 | (uint64_t)east << 16 |
+                   (uint64_t)west << 24 | (uint64_t)bottom << 32;
+    if (block_image.uv_index < 0) {
+        blockImageShadowEdgeFactors(block_image.uv_image, north, south, east, west, bottom,
+                                    uncached_shadow_edge_factors);
+        return uncached_shadow_edge_factors;
+    }
+    key |= (uint64_t)block_image.uv_index << 40;
+
+    auto it = shadow_edge_factors.find(key);
+    if (it == shadow_edge_factors.end()) {
+        it = shadow_edge_factors.insert(std::make_pair(key, std::vector<uint8_t>())).first;
+        blockImageShadowEdgeFactors(block_image.uv_image, north, south, east, west, bottom,
+                                    it->second);
+    }
+    return it->second;
+}
+
 mc::Block TileRenderer::getBlock(const mc::BlockPos &pos, int get) {
-    return world->getBlock(pos, current_chunk, get);
+    return neighborhood.getBlock(pos, get);
 }
 
 uint32_t TileRenderer::getBiomeColor(const mc::BlockPos &pos, const BlockImage &block,
                                      const mc::Chunk *chunk) {
+    mc::LocalBlockPos local(pos);
+    return getBiomeColors(chunk, pos.y, block)[local.z * 16 + local.x];
+}
+
+const std::array<uint32_t, 16 * 16> &
+TileRenderer::getBiomeColors(const mc::Chunk *chunk, int y, const BlockImage &block) {
+    // blocks with the same colormap type and colors share the biome colors
+    size_t colormap = 0;
+    while (colormap < biome_colormaps.size() &&
+           (biome_colormaps[colormap].first != block.biome_color ||
+            biome_colormaps[colormap].second != block.biome_colormap.colors)) {
+        colormap++;
+    }
+    if (colormap == biome_colormaps.size()) {
+        biome_colormaps.push_back(std::make_pair(block.biome_color, block.biome_colormap.colors));
+    }
+
+    const mc::ChunkPos &chunk_pos = chunk->getPos();
+    uint64_t key = ((uint64_t)chunk_pos.x & 0xffffff) | ((uint64_t)chunk_pos.z & 0xffffff) << 24 |
+                   (uint64_t)(y - mc::CHUNK_LOW * 16) << 48 | (uint64_t)colormap << 57;
+    auto it = biome_colors.find(key);
+    if (it != biome_colors.end()) {
+        return it->second;
+    }
+
+    // forget all cached colors once in a while, the tiles are rendered in an order where
+    // the chunks of the next tiles are mostly close to the previous ones anyway
+    if (biome_colors.size() >= 4096) {
+        biome_colors.clear();
+    }
+    std::array<uint32_t, 16 * 16> &colors = biome_colors[key];
+
+    // the colors of the columns of the chunk and of the columns of the neighbor chunks
+    // within the blending radius, and whether the columns exist at all
     const int radius = 2;
-    float f = ((2 * radius + 1) * (2 * radius + 1));
-    float r = 0.0, g = 0.0, b = 0.0;
-
-    for (int dx = -radius; dx <= radius; dx++) {
-        for (int dz = -radius; dz <= radius; dz++) {
-            mc::BlockPos other = pos + mc::BlockPos(dx, dz, 0);
-            mc::ChunkPos chunk_pos(other);
-
-            uint16_t biome_id;
-            mc::LocalBlockPos local(other);
-            if (chunk_pos != chunk->getPos()) {
-                mc::Chunk *other_chunk = world->getChunk(chunk_pos);
-                if (other_chunk == nullptr) {
-                    f -= 1.0f;
-                    continue;
-                }
-                biome_id = other_chunk->getBiomeAt(local);
+    const int width = 16 + 2 * radius;
+    int red[width * width], green[width * width], blue[width * width], count[width * width];
+
+    // biomes whose color is the same for all columns share it
+    uint32_t uniform_colors[256];
+    bool has_uniform_color[256] = {false};
+
+    mc::Chunk *chunks[3][3];
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            mc::ChunkPos other(chunk_pos.x + dx, chunk_pos.z + dz);
+            chunks[dx + 1][dz + 1] = world->getChunk(other);
+        }
+    }
+
+    for (int z = 0; z < width; z++) {
+        for (int x = 0; x < width; x++) {
+            int i = z * width + x;
+            mc::BlockPos pos(chunk_pos.x * 16 + x - radius, chunk_pos.z * 16 + z - radius, y);
+            mc::Chunk *other_chunk =
+                chunks[util::floordiv(x - radius, 16) + 1][util::floordiv(z - radius, 16) + 1];
+            if (other_chunk == nullptr) {
+                red[i] = green[i] = blue[i] = count[i] = 0;
+                continue;
+            }
+
+            uint8_t biome_id = other_chunk->getBiomeAt(mc::LocalBlockPos(pos));
+            uint32_t c;
+            if (has_uniform_color[biome_id]) {
+                c = uniform_colors[biome_id];
             } else {
-                biome_id = chunk->getBiomeAt(local);
+                Biome biome = getBiome(biome_id);
+                c = biome.getColor(pos, block.biome_color, block.biome_colormap);
+                if (biome.isColorUniform(block.biome_color)) {
+                    uniform_colors[biome_id] = c;
+                    has_uniform_color[biome_id] = true;
+                }
             }
-            Biome biome = getBiome(biome_id);
-            uint32_t c = biome.getColor(other, block.biome_color, block.biome_colormap);
-            r += (float)rgba_red(c);
-            g += (float)rgba_green(c);
-            b += (float)rgba_blue(c);
+            red[i] = rgba_red(c);
+            green[i] = rgba_green(c);
+            blue[i] = rgba_blue(c);
+            count[i] = 1;
         }
     }
 
-    return rgba(r / f, g / f, b / f, 255);
+    // sum up the colors of the 5x5 columns around each block, first along the z-axis,
+    // then along the x-axis (the sums are integers, so they are exactly the same as when
+    // summing up the colors of every block one by one as floats)
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < width; x++) {
+            int i = z * width + x;
+            for (int dz = 1; dz <= 2 * radius; dz++) {
+                int j = i + dz * width;
+                red[i] += red[j];
+                green[i] += green[j];
+                blue[i] += blue[j];
+                count[i] += count[j];
+            }
+        }
+        for (int x = 0; x < 16; x++) {
+            int i = z * width + x;
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int dx = 0; dx <= 2 * radius; dx++) {
+                r += red[i + dx];
+                g += green[i + dx];
+                b += blue[i + dx];
+                n += count[i + dx];
+            }
+            float f = n;
+            colors[z * 16 + x] = rgba((float)r / f, (float)g / f, (float)b / f, 255);
+        }
+    }
+    return colors;
 }
 
 } // namespace renderer
@@ -20,12 +20,18 @@
 #ifndef TILERENDERER_H_
 #define TILERENDERER_H_
 
+#include "../mc/chunkneighborhood.h"
 #include "../mc/worldcache.h" // mc::DIR_*
 #include "biomes.h"
 #include "image.h"
 
 #include <array>
+#include <atomic>
 #include <boost/filesystem.hpp>
+#include <functional>
+#include <list>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace fs = boost::filesystem;
@@ -50,13 +56,157 @@ class RenderView;
 
 struct TileImage {
     int x, y;
-    RGBAImage image;
     mc::BlockPos pos;
     int z_index;
 
+    // the block image that is drawn at this position
+    uint16_t id;
+    const BlockImage *block_image;
+
+    // index of the drawn block image in the image pool of the tile images
+    size_t image;
+
     bool operator<(const TileImage &other) const;
 };
 
+/**
+ * The block images that are drawn onto a tile. Block images are recorded in any order
+ * and composited (ordered by block position and z-index) onto the tile.
+ *
+ * Compositing walks the block images front to back first and keeps track of the
+ * frontmost opaque block image of every pixel. Block images that are completely hidden
+ * behind opaque pixels aren't drawn at all (i.e. not lighted, tinted etc.), and hidden
+ * pixels aren't blended. As an opaque pixel replaces everything behind it, the result
+ * is exactly the same as blending all block images back to front.
+ *
+ * The drawn images are kept in a pool that is reused between tiles, so a tile renderer
+ * doesn't need to allocate memory for the block images of every single tile.
+ */
+class TileImages {
+  public:
+    /**
+     * Draws the (modified) block image of a tile image into the supplied image.
+     */
+    typedef std::function<void(const TileImage &tile_image, RGBAImage &image)> DrawFunction;
+
+    TileImages();
+    ~TileImages();
+
+    /**
+     * Removes all recorded block images. The memory of the image pool is kept.
+     */
+    void clear();
+
+    /**
+     * Records a block image at a position of the tile.
+     */
+    void add(int x, int y, const mc::BlockPos &pos, int z_index, uint16_t id,
+             const BlockImage &block_image);
+
+    /**
+     * Returns the number of recorded block images.
+     */
+    size_t size() const;
+
+    /**
+     * Returns how many of the recorded block images were skipped by the last composite
+     * call because they were hidden (or recorded twice).
+     */
+    size_t getSkippedCount() const;
+
+    /**
+     * Sorts the recorded block images and blits the visible ones onto the tile. Block
+     * images with the same position and z-index are drawn only once (the first recorded
+     * one).
+     */
+    void composite(RGBAImage &tile, const DrawFunction &draw);
+
+  private:
+    /**
+     * Sorts the tile images with a radix sort on packed sort keys, or falls back to a
+     * comparison sort if the block positions span a too wide range.
+     */
+    void sort();
+
+    std::vector<TileImage> tile_images;
+    std::vector<RGBAImage> image_pool;
+    size_t skipped;
+
+    // buffers of the radix sort
+    std::vector<uint64_t> keys, keys_tmp;
+    std::vector<uint32_t> order, order_tmp;
+
+    // index (+ 1) of the frontmost tile image with an opaque pixel at each pixel of the tile
+    std::vector<uint32_t> occluders;
+};
+
+/**
+ * Counts of hits, misses and evictions of the sprite caches of the tile renderers of all
+ * threads rendering a map.
+ */
+struct SpriteCacheStats {
+    SpriteCacheStats() : hits(0), misses(0), evictions(0) {}
+
+    std::atomic<uint64_t> hits, misses, evictions;
+};
+
+/**
+ * A least recently used cache of finished block images (sprites) which are the same for
+ * lots of blocks, but expensive to prepare: Biome blocks with their tint color and blocks
+ * with a water surface on top. The sprites are identified by block ID, the mask of the
+ * stripped faces and the tint colors of the block and of the water surface.
+ */
+class SpriteCache {
+  public:
+    SpriteCache(size_t capacity = 1024);
+
+    /**
+     * Looks up a sprite and sets the pointer to it. Returns true if the sprite is cached.
+     * Otherwise the pointer is set to a new cache entry (the least recently used one if
+     * the cache is full) which the caller has to fill with the sprite, and returns false.
+     */
+    bool get(uint16_t id, uint8_t strip, uint32_t color, uint32_t waterlog_color,
+             RGBAImage *&sprite);
+
+    /**
+     * Returns the number of cached sprites.
+     */
+    size_t size() const;
+
+    /**
+     * Adds the counts of hits, misses and evictions since the last call to the
+     * statistics.
+     */
+    void addStats(SpriteCacheStats &stats);
+
+  private:
+    struct Key {
+        uint16_t id;
+        uint8_t strip;
+        uint32_t color, waterlog_color;
+
+        bool operator==(const Key &other) const {
+            return id == other.id && strip == other.strip && color == other.color &&
+                   waterlog_color == other.waterlog_color;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const {
+            uint64_t colors = uint64_t(key.color) << 32 | key.waterlog_color;
+            return std::hash<uint64_t>()(colors ^ (uint64_t(key.id) << 3 | key.strip) *
+                                                      0x9e3779b97f4a7c15ULL);
+        }
+    };
+
+    size_t capacity;
+    // the sprites, the most recently used one first
+    std::list<std::pair<Key, RGBAImage>> sprites;
+    std::unordered_map<Key, std::list<std::pair<Key, RGBAImage>>::iterator, KeyHash> index;
+
+    uint64_t hits, misses, evictions;
+};
+
 class TileRenderer {
   public:
     TileRenderer(const RenderView *render_view, mc::BlockStateRegistry &block_registry,
@@ -67,6 +217,7 @@ class TileRenderer {
     void setRenderBiomes(bool render_biomes);
     void setUsePreblitWater(bool use_preblit_water);
     void setShadowEdges(std::array<uint8_t, 5> shadow_edges);
+    void setSpriteCacheStats(std::shared_ptr<SpriteCacheStats> sprite_cache_stats);
 
     virtual void renderTile(const TilePos &tile_pos, RGBAImage &tile);
 
@@ -76,13 +227,48 @@ class TileRenderer {
 
   protected:
     void renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockPos &dir,
-                      std::set<TileImage> &tile_images);
-    virtual void renderTopBlocks(const TilePos &tile_pos, std::set<TileImage> &tile_images) {}
+                      TileImages &tile_images);
+    virtual void renderTopBlocks(const TilePos &tile_pos, TileImages &tile_images) {}
+
+    /**
+     * Applies all block image modifications (stripped faces, biome colors, shadow
+     * edges, render mode) to a recorded block image.
+     */
+    void drawTileImage(const TileImage &tile_image, RGBAImage &image);
+
+    /**
+     * Prepares the sprite of a block image: Strips the faces of the mask (bit 0: left,
+     * 1: right, 2: up), tints it with the biome color (if it's a biome block) and blends
+     * the water surface tinted with the water color on top (if the block has one).
+     */
+    void prepareSprite(const BlockImage &block_image, uint8_t strip, uint32_t color,
+                       uint32_t waterlog_color, RGBAImage &sprite);
+
+    /**
+     * Returns the factors (per pixel) of the shadow edges of a block image. They are
+     * cached per uv image and edge factors.
+     */
+    const std::vector<uint8_t> &getShadowEdgeFactors(const BlockImage &block_image,
+                                                     uint8_t north, uint8_t south, uint8_t east,
+                                                     uint8_t west, uint8_t bottom);
 
     mc::Block getBlock(const mc::BlockPos &pos, int get = mc::GET_ID);
+
+    /**
+     * Returns the biome color of a block, blended with the biomes of the 5x5 columns
+     * around it. The position must be in the specified chunk.
+     */
     uint32_t getBiomeColor(const mc::BlockPos &pos, const BlockImage &block,
                            const mc::Chunk *chunk);
 
+    /**
+     * Returns the blended biome colors of all 16x16 blocks of a chunk with a specific
+     * y-coordinate (as index z * 16 + x) for the colormap of a block. They are computed
+     * once per chunk, y-coordinate and colormap, and cached.
+     */
+    const std::array<uint32_t, 16 * 16> &getBiomeColors(const mc::Chunk *chunk, int y,
+                                                        const BlockImage &block);
+
     mc::BlockStateRegistry &block_registry;
 
     BlockImages *images;
@@ -90,6 +276,8 @@ class TileRenderer {
     int tile_width;
     mc::WorldCache *world;
     mc::Chunk *current_chunk;
+    // to look up the blocks and their neighbors
+    mc::ChunkNeighborhood neighborhood;
     RenderMode *render_mode;
 
     bool render_biomes;
@@ -110,6 +298,21 @@ class TileRenderer {
 
     uint16_t waterlog_id;
     const BlockImage *waterlog_block_image;
+
+    // reused between tiles to avoid allocating memory for every block image
+    TileImages tile_images_buffer;
+    RGBAImage waterlog_image;
+
+    SpriteCache sprite_cache;
+    std::shared_ptr<SpriteCacheStats> sprite_cache_stats;
+
+    std::unordered_map<uint64_t, std::vector<uint8_t>> shadow_edge_factors;
+    std::vector<uint8_t> uncached_shadow_edge_factors;
+
+    // the different colormaps (type and colors) of the biome blocks, and the blended biome
+    // colors per chunk, y-coordinate and index of the colormap
+    std::vector<std::pair<ColorMapType, std::array<uint32_t, 3>>> biome_colormaps;
+    std::unordered_map<uint64_t, std::array<uint32_t, 16 * 16>> biome_colors;
 };
 
 } // namespace renderer
@@ -33,12 +33,14 @@ namespace mapcrafter {
 namespace renderer {
 
 void RenderContext::initializeTileRenderer() {
-    world_cache.reset(new mc::WorldCache(*block_registry, world));
+    world_cache.reset(
+        new mc::WorldCache(*block_registry, world, chunk_store.get(), sign_sink.get()));
     render_mode.reset(createRenderMode(world_config, map_config, world.getRotation()));
     tile_renderer.reset(render_view->createTileRenderer(*block_registry, block_images,
                                                         map_config.getTileWidth(),
                                                         world_cache.get(), render_mode.get()));
     render_view->configureTileRenderer(tile_renderer.get(), world_config, map_config);
+    tile_renderer->setSpriteCacheStats(sprite_cache_stats);
 }
 
 TileRenderWorker::TileRenderWorker() : progress(nullptr) {}
@@ -35,6 +35,8 @@ namespace mapcrafter {
 
 namespace mc {
 class BlockStateRegistry;
+class ChunkStore;
+class SignSink;
 class WorldCache;
 } // namespace mc
 
@@ -44,6 +46,7 @@ class BlockImages;
 class RenderMode;
 class RenderView;
 class RGBAImage;
+struct SpriteCacheStats;
 class TilePath;
 class TileRenderer;
 class TileSet;
@@ -60,6 +63,13 @@ struct RenderContext {
     mc::BlockStateRegistry *block_registry;
     mc::World world;
 
+    // optional store of decoded chunks shared by the world caches of the world
+    std::shared_ptr<mc::ChunkStore> chunk_store;
+    // optional sink for the signs of the chunks read while rendering
+    std::shared_ptr<mc::SignSink> sign_sink;
+    // optional statistics of the sprite caches of the tile renderers
+    std::shared_ptr<SpriteCacheStats> sprite_cache_stats;
+
     std::shared_ptr<mc::WorldCache> world_cache;
     std::shared_ptr<RenderMode> render_mode;
     std::shared_ptr<TileRenderer> tile_renderer;
@@ -19,18 +19,26 @@
 
 #include "tileset.h"
 
+#include "../compat/thread.h"
 #include "../mc/chunk.h"
 #include "../mc/pos.h"
+#include "../mc/region.h"
 #include "../mc/world.h"
+#include "../util.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
 #include <iostream>
 #include <limits>
 #include <set>
 #include <sstream>
+#include <thread>
 
 namespace mapcrafter {
 namespace renderer {
@@ -197,14 +205,117 @@ TilePath TilePath::byTilePos(const TilePos &tile, int depth) {
     return path;
 }
 
+namespace {
+
+// header of chunk hash index files
+const char CHUNK_HASH_INDEX_MAGIC[4] = {'M', 'C', 'H', 'I'};
+const uint32_t CHUNK_HASH_INDEX_VERSION = 1;
+
+struct ChunkHashEntry {
+    int32_t x, z;
+    uint64_t hash;
+};
+
+} // namespace
+
+ChunkHashIndex::ChunkHashIndex() {}
+
+ChunkHashIndex::~ChunkHashIndex() {}
+
+bool ChunkHashIndex::read(const fs::path &filename) {
+    hashes.clear();
+    std::ifstream in(filename.string(), std::ios::binary);
+    if (!in)
+        return false;
+
+    char magic[4];
+    uint32_t version, count;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char *>(&version), sizeof(version));
+    in.read(reinterpret_cast<char *>(&count), sizeof(count));
+    if (!in || std::memcmp(magic, CHUNK_HASH_INDEX_MAGIC, 4) != 0 ||
+        version != CHUNK_HASH_INDEX_VERSION)
+        return false;
+
+    // don't trust the count of a truncated or otherwise corrupt file
+    std::streamoff header_size = in.tellg();
+    in.seekg(0, std::ios::end);
+    std::streamoff remaining = in.tellg() - header_size;
+    in.seekg(header_size);
+    if (remaining != std::streamoff(uint64_t(count) * sizeof(ChunkHashEntry)))
+        return false;
+
+    std::vector<ChunkHashEntry> entries(count);
+    if (!in.read(reinterpret_cast<char *>(entries.data()), count * sizeof(ChunkHashEntry)))
+        return false;
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+        hashes[mc::ChunkPos(it->x, it->z)] = it->hash;
+    return true;
+}
+
+bool ChunkHashIndex::write(const fs::path &filename) const {
+    std::vector<ChunkHashEntry> entries;
+    entries.reserve(hashes.size());
+    for (auto it = hashes.begin(); it != hashes.end(); ++it)
+        entries.push_back({it->first.x, it->first.z, it->second});
+
+    fs::path tmp_file = filename.string() + ".tmp";
+    std::ofstream out(tmp_file.string(), std::ios::binary);
+    uint32_t count = entries.size();
+    out.write(CHUNK_HASH_INDEX_MAGIC, 4);
+    out.write(reinterpret_cast<const char *>(&CHUNK_HASH_INDEX_VERSION),
+              sizeof(CHUNK_HASH_INDEX_VERSION));
+    out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char *>(entries.data()), count * sizeof(ChunkHashEntry));
+    out.close();
+
+    boost::system::error_code error;
+    if (!out || (fs::rename(tmp_file, filename, error), error)) {
+        fs::remove(tmp_file, error);
+        return false;
+    }
+    return true;
+}
+
+bool ChunkHashIndex::get(const mc::ChunkPos &chunk, uint64_t &hash) const {
+    auto it = hashes.find(chunk);
+    if (it == hashes.end())
+        return false;
+    hash = it->second;
+    return true;
+}
+
+const std::map<mc::ChunkPos, uint64_t> &ChunkHashIndex::getHashes() const { return hashes; }
+
+void ChunkHashIndex::setHashes(const std::map<mc::ChunkPos, uint64_t> &hashes) {
+    this->hashes = hashes;
+}
+
+ChunkHashCache::ChunkHashCache() {}
+
+ChunkHashCache::~ChunkHashCache() {}
+
+bool ChunkHashCache::get(const mc::ChunkPos &chunk, uint32_t timestamp, uint64_t &hash) const {
+    auto it = hashes.find(chunk);
+    if (it == hashes.end() || it->second.first != timestamp)
+        return false;
+    hash = it->second.second;
+    return true;
+}
+
+void ChunkHashCache::set(const mc::ChunkPos &chunk, uint32_t timestamp, uint64_t hash) {
+    hashes[chunk] = std::make_pair(timestamp, hash);
+}
+
 TileSet::TileSet(int tile_width) : tile_width(tile_width), min_depth(0), depth(0) {}
 
 TileSet::~TileSet() {}
 
 void TileSet::findRenderTiles(const mc::World &world, bool auto_center, TilePos &tile_offset) {
-    // clear maybe already calculated tiles
+    // clear maybe already calculated tiles, also when the world is scanned again
     render_tiles.clear();
     required_render_tiles.clear();
+    tile_timestamps.clear();
 
     // the min/max x/y coordinates of the tiles in the world
     int tiles_x_min = std::numeric_limits<int>::max(),
@@ -212,41 +323,83 @@ void TileSet::findRenderTiles(const mc::World &world, bool auto_center, TilePos
         tiles_y_min = std::numeric_limits<int>::max(),
         tiles_y_max = std::numeric_limits<int>::min();
 
-    // go through all chunks in the world
+    // regions modified this recently may be modified again within the same second,
+    // their tiles must not be reused because the modification time wouldn't change
+    int64_t racy_mtime = std::time(nullptr) - 1;
+    int regions_read = 0;
+
+    // go through all chunks in the world, the tiles of regions which haven't changed
+    // since the last scan are reused
+    std::map<mc::RegionPos, RegionTiles> new_region_tiles;
     auto regions = world.getAvailableRegions();
     for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it) {
-        mc::RegionFile region;
-        if (!world.getRegion(*region_it, region) || !region.readOnlyHeaders())
+        fs::path path = world.getRegionPath(*region_it);
+        boost::system::error_code error_mtime, error_size;
+        int64_t mtime = fs::last_write_time(path, error_mtime);
+        uint64_t size = fs::file_size(path, error_size);
+        if (error_mtime || error_size)
             continue;
-        const std::set<mc::ChunkPos> &region_chunks = region.getContainingChunks();
-        for (auto chunk_it = region_chunks.begin(); chunk_it != region_chunks.end(); ++chunk_it) {
-            int timestamp = region.getChunkTimestamp(*chunk_it);
-
-            // now get all tiles of the chunk
-            std::set<TilePos> tiles;
-            mapChunkToTiles(*chunk_it, tiles);
-            for (std::set<TilePos>::const_iterator tile_it = tiles.begin(); tile_it != tiles.end();
-                 ++tile_it) {
-
-                // and update the bounds
-                tiles_x_min = std::min(tiles_x_min, tile_it->getX());
-                tiles_x_max = std::max(tiles_x_max, tile_it->getX());
-                tiles_y_min = std::min(tiles_y_min, tile_it->getY());
-                tiles_y_max = std::max(tiles_y_max, tile_it->getY());
-
-                // update tile timestamp
-                if (!render_tiles.count(*tile_it))
-                    tile_timestamps[*tile_it] = timestamp;
-                else
-                    tile_timestamps[*tile_it] = std::max(tile_timestamps[*tile_it], timestamp);
-
-                // insert the tile to the set of available render tiles
-                // and also make it required by default
-                render_tiles.insert(*tile_it);
-                required_render_tiles.insert(*tile_it);
+
+        RegionTiles &entry = new_region_tiles[*region_it];
+        auto cached = region_tiles.find(*region_it);
+        if (cached != region_tiles.end() && cached->second.mtime == mtime &&
+            cached->second.size == size) {
+            entry = std::move(cached->second);
+        } else {
+            regions_read++;
+            mc::RegionFile region;
+            if (!world.getRegion(*region_it, region) || !region.readOnlyHeaders()) {
+                // don't keep the region in the index, maybe it can be read next time
+                new_region_tiles.erase(*region_it);
+                continue;
             }
+
+            entry.mtime = mtime < racy_mtime ? mtime : -1;
+            entry.size = size;
+            std::map<TilePos, int> tiles;
+            const std::set<mc::ChunkPos> &region_chunks = region.getContainingChunks();
+            for (auto chunk_it = region_chunks.begin(); chunk_it != region_chunks.end();
+                 ++chunk_it) {
+                int timestamp = region.getChunkTimestamp(*chunk_it);
+
+                // now get all tiles of the chunk
+                std::set<TilePos> chunk_tiles;
+                mapChunkToTiles(*chunk_it, chunk_tiles);
+                for (auto tile_it = chunk_tiles.begin(); tile_it != chunk_tiles.end();
+                     ++tile_it) {
+                    auto tile = tiles.insert(std::make_pair(*tile_it, timestamp)).first;
+                    tile->second = std::max(tile->second, timestamp);
+                }
+            }
+            entry.tiles.assign(tiles.begin(), tiles.end());
+        }
+
+        for (auto tile_it = entry.tiles.begin(); tile_it != entry.tiles.end(); ++tile_it) {
+            const TilePos &tile = tile_it->first;
+            int timestamp = tile_it->second;
+
+            // update the bounds
+            tiles_x_min = std::min(tiles_x_min, tile.getX());
+            tiles_x_max = std::max(tiles_x_max, tile.getX());
+            tiles_y_min = std::min(tiles_y_min, tile.getY());
+            tiles_y_max = std::max(tiles_y_max, tile.getY());
+
+            // update tile timestamp
+            if (!render_tiles.count(tile))
+                tile_timestamps[tile] = timestamp;
+            else
+                tile_timestamps[tile] = std::max(tile_timestamps[tile], timestamp);
+
+            // insert the tile to the set of available render tiles
+            // and also make it required by default
+            render_tiles.insert(tile);
+            required_render_tiles.insert(tile);
         }
     }
+    region_tiles.swap(new_region_tiles);
+    if (regions_read < (int)regions.size())
+        LOG(INFO) << "Read the headers of " << regions_read << " of " << regions.size()
+                  << " regions, the other ones haven't changed.";
 
     // center tiles
     if (auto_center || tile_offset != TilePos(0, 0)) {
@@ -333,6 +486,93 @@ void TileSet::scan(const mc::World &world, bool auto_center, TilePos &tile_offse
     setDepth(min_depth);
 }
 
+namespace {
+
+// header of tile set index files
+const char TILE_SET_INDEX_MAGIC[4] = {'M', 'C', 'T', 'S'};
+const uint32_t TILE_SET_INDEX_VERSION = 1;
+
+template <typename T> bool readValue(std::istream &in, T &value) {
+    return (bool)in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+template <typename T> void writeValue(std::ostream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+} // namespace
+
+bool TileSet::readIndex(const fs::path &filename, uint64_t key) {
+    region_tiles.clear();
+    std::ifstream in(filename.string(), std::ios::binary);
+    if (!in)
+        return false;
+
+    char magic[4];
+    uint32_t version, region_count;
+    uint64_t index_key;
+    in.read(magic, 4);
+    if (!in || std::memcmp(magic, TILE_SET_INDEX_MAGIC, 4) != 0 || !readValue(in, version) ||
+        version != TILE_SET_INDEX_VERSION || !readValue(in, index_key) || index_key != key ||
+        !readValue(in, region_count))
+        return false;
+
+    for (uint32_t i = 0; i < region_count; i++) {
+        int32_t region_x, region_z;
+        uint32_t tile_count;
+        RegionTiles entry;
+        if (!readValue(in, region_x) || !readValue(in, region_z) ||
+            !readValue(in, entry.mtime) || !readValue(in, entry.size) ||
+            !readValue(in, tile_count) || tile_count > 1024 * 1024) {
+            region_tiles.clear();
+            return false;
+        }
+        std::vector<int32_t> tiles(tile_count * 3);
+        if (!in.read(reinterpret_cast<char *>(tiles.data()), tiles.size() * sizeof(int32_t))) {
+            region_tiles.clear();
+            return false;
+        }
+        for (uint32_t j = 0; j < tile_count; j++)
+            entry.tiles.push_back(
+                std::make_pair(TilePos(tiles[j * 3], tiles[j * 3 + 1]), tiles[j * 3 + 2]));
+        region_tiles[mc::RegionPos(region_x, region_z)] = std::move(entry);
+    }
+    return true;
+}
+
+bool TileSet::writeIndex(const fs::path &filename, uint64_t key) const {
+    fs::path tmp_file = filename.string() + ".tmp";
+    std::ofstream out(tmp_file.string(), std::ios::binary);
+    out.write(TILE_SET_INDEX_MAGIC, 4);
+    writeValue(out, TILE_SET_INDEX_VERSION);
+    writeValue(out, key);
+    writeValue<uint32_t>(out, region_tiles.size());
+    for (auto it = region_tiles.begin(); it != region_tiles.end(); ++it) {
+        const RegionTiles &entry = it->second;
+        writeValue<int32_t>(out, it->first.x);
+        writeValue<int32_t>(out, it->first.z);
+        writeValue(out, entry.mtime);
+        writeValue(out, entry.size);
+        writeValue<uint32_t>(out, entry.tiles.size());
+        std::vector<int32_t> tiles;
+        tiles.reserve(entry.tiles.size() * 3);
+        for (auto tile_it = entry.tiles.begin(); tile_it != entry.tiles.end(); ++tile_it) {
+            tiles.push_back(tile_it->first.getX());
+            tiles.push_back(tile_it->first.getY());
+            tiles.push_back(tile_it->second);
+        }
+        out.write(reinterpret_cast<const char *>(tiles.data()), tiles.size() * sizeof(int32_t));
+    }
+    out.close();
+
+    boost::system::error_code error;
+    if (!out || (fs::rename(tmp_file, filename, error), error)) {
+        fs::remove(tmp_file, error);
+        return false;
+    }
+    return true;
+}
+
 void TileSet::resetRequired() {
     required_render_tiles.clear();
 
@@ -377,6 +617,140 @@ void TileSet::scanRequiredByFiletimes(const fs::path &output_dir, std::string im
     updateContainingRenderTiles();
 }
 
+void TileSet::scanRequiredByChunkHashes(const mc::World &world, int last_change,
+                                        ChunkHashIndex &index, ChunkHashCache &cache,
+                                        int threads) {
+    required_render_tiles.clear();
+
+    struct ScannedChunk {
+        mc::ChunkPos pos;
+        uint32_t timestamp;
+        uint64_t hash;
+        // whether the chunk has a valid hash, is changed or was hashed now
+        bool valid, changed, hashed;
+    };
+
+    // the hashes of all chunks of the world, the ones not changed since last_change are
+    // taken from the index, the other ones from the cache or the chunk data, the regions
+    // are scanned in parallel and only read the index and the cache
+    std::vector<mc::RegionPos> regions(world.getAvailableRegions().begin(),
+                                       world.getAvailableRegions().end());
+    std::vector<std::vector<ScannedChunk>> scanned_regions(regions.size());
+    int unrotate = (4 - world.getRotation()) % 4;
+
+    // the chunks in the index of every region, regions which weren't modified since the
+    // last rendering still have the same chunks, so they don't need to be opened at all
+    std::map<mc::RegionPos, std::vector<ScannedChunk>> indexed_regions;
+    const std::map<mc::ChunkPos, uint64_t> &indexed_hashes = index.getHashes();
+    for (auto it = indexed_hashes.begin(); it != indexed_hashes.end(); ++it) {
+        ScannedChunk chunk;
+        chunk.pos = it->first;
+        chunk.timestamp = 0;
+        chunk.hash = it->second;
+        chunk.valid = true;
+        chunk.changed = chunk.hashed = false;
+        indexed_regions[it->first.getRegion()].push_back(chunk);
+    }
+
+    std::atomic<size_t> next_region(0);
+    auto scan = [&]() {
+        size_t i;
+        while ((i = next_region++) < regions.size()) {
+            auto indexed_it = indexed_regions.find(regions[i]);
+            if (indexed_it != indexed_regions.end()) {
+                boost::system::error_code error;
+                std::time_t mtime = fs::last_write_time(world.getRegionPath(regions[i]), error);
+                if (!error && mtime < last_change) {
+                    scanned_regions[i] = indexed_it->second;
+                    continue;
+                }
+            }
+
+            mc::RegionFile region;
+            if (!world.getRegion(regions[i], region) || !region.read())
+                continue;
+            const std::set<mc::ChunkPos> &region_chunks = region.getContainingChunks();
+            for (auto chunk_it = region_chunks.begin(); chunk_it != region_chunks.end();
+                 ++chunk_it) {
+                ScannedChunk chunk;
+                chunk.pos = *chunk_it;
+                chunk.timestamp = region.getChunkTimestamp(*chunk_it);
+                chunk.valid = true;
+                chunk.changed = chunk.hashed = false;
+
+                uint64_t old_hash;
+                bool known = index.get(*chunk_it, old_hash);
+                bool maybe_changed = (int)chunk.timestamp >= last_change;
+                if (known && !maybe_changed) {
+                    chunk.hash = old_hash;
+                    scanned_regions[i].push_back(chunk);
+                    continue;
+                }
+
+                // chunks not in the index yet are hashed even if they are older than the
+                // last rendering, so the index is complete after the first rendering with it
+                mc::ChunkPos original = *chunk_it;
+                original.rotate(unrotate);
+                if (!cache.get(original, chunk.timestamp, chunk.hash)) {
+                    // let the renderer report invalid chunks
+                    int status = region.getChunkContentHash(*chunk_it, chunk.hash);
+                    chunk.valid = chunk.hashed = status == mc::RegionFile::CHUNK_OK;
+                }
+                chunk.changed =
+                    maybe_changed && (!chunk.valid || !known || chunk.hash != old_hash);
+                scanned_regions[i].push_back(chunk);
+            }
+        }
+    };
+    std::vector<thread_ns::thread> pool;
+    for (int i = 1; i < threads && size_t(i) < regions.size(); i++)
+        pool.push_back(thread_ns::thread(scan));
+    scan();
+    for (auto thread_it = pool.begin(); thread_it != pool.end(); ++thread_it)
+        thread_it->join();
+
+    std::map<mc::ChunkPos, uint64_t> hashes;
+    std::set<mc::ChunkPos> changed_chunks;
+    int hashed = 0;
+    for (auto region_it = scanned_regions.begin(); region_it != scanned_regions.end();
+         ++region_it) {
+        for (auto chunk_it = region_it->begin(); chunk_it != region_it->end(); ++chunk_it) {
+            if (chunk_it->valid)
+                hashes[chunk_it->pos] = chunk_it->hash;
+            if (chunk_it->changed)
+                changed_chunks.insert(chunk_it->pos);
+            if (chunk_it->hashed) {
+                mc::ChunkPos original = chunk_it->pos;
+                original.rotate(unrotate);
+                cache.set(original, chunk_it->timestamp, chunk_it->hash);
+                hashed++;
+            }
+        }
+    }
+
+    // chunks which don't exist anymore
+    const std::map<mc::ChunkPos, uint64_t> &old_hashes = index.getHashes();
+    for (auto it = old_hashes.begin(); it != old_hashes.end(); ++it)
+        if (!hashes.count(it->first))
+            changed_chunks.insert(it->first);
+
+    for (auto chunk_it = changed_chunks.begin(); chunk_it != changed_chunks.end(); ++chunk_it) {
+        std::set<TilePos> tiles;
+        mapChunkToTiles(*chunk_it, tiles);
+        for (auto tile_it = tiles.begin(); tile_it != tiles.end(); ++tile_it)
+            if (render_tiles.count(*tile_it - tile_offset))
+                required_render_tiles.insert(*tile_it - tile_offset);
+    }
+    LOG(INFO) << "Hashed " << hashed << " chunks, " << changed_chunks.size()
+              << " chunks were changed, added or removed.";
+    index.setHashes(hashes);
+
+    required_composite_tiles.clear();
+    findRequiredCompositeTiles(required_render_tiles, required_composite_tiles);
+
+    updateContainingRenderTiles();
+}
+
 int TileSet::getTileWidth() const { return tile_width; }
 
 int TileSet::getMinDepth() const { return min_depth; }
@@ -20,6 +20,8 @@
 #ifndef TILE_H_
 #define TILE_H_
 
+#include "../mc/pos.h"
+
 #include <boost/filesystem.hpp>
 #include <map>
 #include <set>
@@ -61,7 +63,6 @@ namespace fs = boost::filesystem;
 namespace mapcrafter {
 
 namespace mc {
-class ChunkPos;
 class World;
 } // namespace mc
 
@@ -159,6 +160,73 @@ class TilePath {
 
 std::ostream &operator<<(std::ostream &stream, const TilePath &path);
 
+/**
+ * The hashes of the contents of the chunks (see mc::Chunk::getContentHash) of a map
+ * rotation at the time it was rendered, used to re-render only the tiles whose chunks
+ * have actually changed. The index is stored in a file next to the tiles.
+ */
+class ChunkHashIndex {
+  public:
+    ChunkHashIndex();
+    ~ChunkHashIndex();
+
+    /**
+     * Reads the index from a file. Returns false (and leaves the index empty) if the
+     * file doesn't exist or is invalid.
+     */
+    bool read(const fs::path &filename);
+
+    /**
+     * Writes the index to a file. The index is written to a temporary file first, so an
+     * interrupted write doesn't leave a broken index behind.
+     */
+    bool write(const fs::path &filename) const;
+
+    /**
+     * Returns the hash of a chunk, returns false if the chunk is not in the index.
+     */
+    bool get(const mc::ChunkPos &chunk, uint64_t &hash) const;
+
+    /**
+     * Returns the hashes of all chunks.
+     */
+    const std::map<mc::ChunkPos, uint64_t> &getHashes() const;
+
+    /**
+     * Sets the hashes of all chunks.
+     */
+    void setHashes(const std::map<mc::ChunkPos, uint64_t> &hashes);
+
+  private:
+    std::map<mc::ChunkPos, uint64_t> hashes;
+};
+
+/**
+ * The current content hashes of the chunks of a world, shared by all rotations and maps
+ * of the world, so every chunk is hashed only once even if the chunk hash indices of
+ * multiple rotations need its hash. The chunks are identified by their original (not
+ * rotated) position, a hash is valid as long as the timestamp of the chunk is the same.
+ */
+class ChunkHashCache {
+  public:
+    ChunkHashCache();
+    ~ChunkHashCache();
+
+    /**
+     * Returns the hash of a chunk with a specific timestamp, returns false if the hash
+     * is not known.
+     */
+    bool get(const mc::ChunkPos &chunk, uint32_t timestamp, uint64_t &hash) const;
+
+    /**
+     * Sets the hash of a chunk with a specific timestamp.
+     */
+    void set(const mc::ChunkPos &chunk, uint32_t timestamp, uint64_t hash);
+
+  private:
+    std::map<mc::ChunkPos, std::pair<uint32_t, uint64_t>> hashes;
+};
+
 /**
  * This class manages all tiles required to render a world.
  */
@@ -182,6 +250,18 @@ class TileSet {
     void scan(const mc::World &world);
     void scan(const mc::World &world, bool auto_center, TilePos &tile_offset);
 
+    /**
+     * Reads/writes the tiles of the regions found by scanning a world from/to an index
+     * file, so the next scan needs to read only the headers of regions which have
+     * changed since then (according to modification time and size of the region files).
+     * The key identifies the world (with its boundaries and rotation) and kind of tile
+     * set, an index with a different key is ignored. Read the index before scanning.
+     * The index is written to a temporary file first, so an interrupted write doesn't
+     * leave a truncated index behind.
+     */
+    bool readIndex(const fs::path &filename, uint64_t key);
+    bool writeIndex(const fs::path &filename, uint64_t key) const;
+
     /**
      * Resets which tiles are required / not required. All tiles will be required.
      */
@@ -199,6 +279,21 @@ class TileSet {
      */
     void scanRequiredByFiletimes(const fs::path &output_dir, std::string image_format = "png");
 
+    /**
+     * Scans which tiles are required by comparing the content hashes of the chunks with
+     * the ones in a chunk hash index. Only chunks which were probably changed since the
+     * timestamp last_change are hashed. Tiles of new chunks, changed chunks and removed
+     * chunks are required. The index is updated with the current hashes. Regions which
+     * were not modified since last_change and have chunks in the index are not opened,
+     * their hashes are taken from the index.
+     *
+     * The regions are hashed with multiple threads, hashes already in the cache are not
+     * computed again and new hashes are added to the cache.
+     */
+    void scanRequiredByChunkHashes(const mc::World &world, int last_change,
+                                   ChunkHashIndex &index, ChunkHashCache &cache,
+                                   int threads = 1);
+
     /**
      * Returns the width of the tiles in chunks.
      */
@@ -290,6 +385,16 @@ class TileSet {
     // count of required render tiles contained in a composite tile
     std::map<TilePath, int> containing_render_tiles;
 
+    // the tiles of the chunks of a region file (not centered) with the highest timestamp
+    // of the chunks in each tile, and modification time and size of the region file
+    struct RegionTiles {
+        int64_t mtime;
+        uint64_t size;
+        std::vector<std::pair<TilePos, int>> tiles;
+    };
+    // the tiles of the regions found by the last scan, or read from an index file
+    std::map<mc::RegionPos, RegionTiles> region_tiles;
+
     /**
      * This method finds out which render level tiles a world has and which maximum
      * zoom level would be required to render them.
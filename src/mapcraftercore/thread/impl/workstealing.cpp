@@ -0,0 +1,215 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "workstealing.h"
+
+#include "../../mc/worldcache.h"
+#include "../../renderer/tileset.h"
+#include "../../util.h"
+
+#include <algorithm>
+#include <map>
+
+namespace mapcrafter {
+namespace thread {
+
+// how often an idle thread tries to steal work before it goes to sleep
+const int STEAL_ATTEMPTS_BEFORE_SLEEP = 64;
+
+WorkStealingDispatcher::WorkStealingDispatcher(int threads)
+    : thread_count(threads), works_queued(0), threads_sleeping(0), finished(false),
+      progress(nullptr) {}
+
+WorkStealingDispatcher::~WorkStealingDispatcher() {}
+
+void WorkStealingDispatcher::dispatch(const renderer::RenderContext &context,
+                                      util::IProgressHandler *progress) {
+    const std::set<renderer::TilePath> &tiles = context.tile_set->getRequiredCompositeTiles();
+    if (tiles.size() == 0)
+        return;
+
+    this->progress = progress;
+    finished = false;
+    works.clear();
+    work_parents.clear();
+    deques.clear();
+    overflow.clear();
+    threads.clear();
+
+    // the composite tiles two zoom levels above the render tiles are the initial works,
+    // every thread renders the whole subtree of such a tile
+    int start_depth = std::max(0, context.tile_set->getDepth() - 2);
+    std::map<renderer::TilePath, int> work_indices;
+    for (auto tile_it = tiles.begin(); tile_it != tiles.end(); ++tile_it)
+        if (tile_it->getDepth() == start_depth) {
+            renderer::RenderWork work;
+            work.tiles.insert(*tile_it);
+            work_indices[*tile_it] = works.size();
+            works.push_back(work);
+        }
+    int initial_works = works.size();
+
+    // the composite tiles above are composed from their already rendered children
+    for (auto tile_it = tiles.begin(); tile_it != tiles.end(); ++tile_it)
+        if (tile_it->getDepth() < start_depth) {
+            renderer::RenderWork work;
+            work.tiles.insert(*tile_it);
+            for (int i = 1; i <= 4; i++)
+                if (context.tile_set->hasTile(*tile_it + i))
+                    work.tiles_skip.insert(*tile_it + i);
+            work_indices[*tile_it] = works.size();
+            works.push_back(work);
+        }
+
+    work_parents.resize(works.size(), -1);
+    work_pending_children.reset(new std::atomic<int>[works.size()]);
+    for (size_t i = 0; i < works.size(); i++)
+        work_pending_children[i] = 0;
+    for (size_t i = 0; i < works.size(); i++) {
+        const renderer::TilePath &tile = *works[i].tiles.begin();
+        if (tile.getDepth() == 0)
+            continue;
+        work_parents[i] = work_indices.at(tile.parent());
+        work_pending_children[work_parents[i]]++;
+    }
+
+    // every thread gets a contiguous range of the initial works (neighboring tiles share
+    // most of their chunks), a deque must also be able to take every parent work
+    int per_thread = (initial_works + thread_count - 1) / thread_count;
+    for (int i = 0; i < thread_count; i++)
+        deques.push_back(std::unique_ptr<WorkStealingDeque<int>>(
+            new WorkStealingDeque<int>(per_thread + works.size() - initial_works + 1)));
+    for (int i = 0; i < thread_count; i++) {
+        int begin = std::min(initial_works, i * per_thread);
+        int end = std::min(initial_works, (i + 1) * per_thread);
+        // push in reverse order, the owner pops the first tile of its range first and
+        // thieves steal from the end of it
+        for (int work = end - 1; work >= begin; work--)
+            if (!deques[i]->push(work))
+                overflow.push_back(work);
+    }
+    works_queued = initial_works;
+
+    int render_tiles = context.tile_set->getRequiredRenderTilesCount();
+    LOG(INFO) << thread_count << " threads will render " << render_tiles << " render tiles.";
+    progress->setMax(render_tiles);
+
+    for (int i = 0; i < thread_count; i++) {
+        renderer::RenderContext thread_context = context;
+        thread_context.initializeTileRenderer();
+        threads.push_back(thread_ns::thread([this, i, thread_context]() {
+            runWorker(i, thread_context);
+        }));
+    }
+
+    for (int i = 0; i < thread_count; i++)
+        threads[i].join();
+    threads.clear();
+}
+
+bool WorkStealingDispatcher::getWork(int thread, int &work) {
+    int attempts = 0;
+    while (!finished) {
+        if (deques[thread]->pop(work)) {
+            works_queued--;
+            return true;
+        }
+
+        for (int i = 1; i < thread_count; i++) {
+            int victim = (thread + i) % thread_count;
+            if (deques[victim]->steal(work)) {
+                works_queued--;
+                return true;
+            }
+        }
+
+        if (works_queued > 0) {
+            thread_ns::unique_lock<thread_ns::mutex> lock(overflow_mutex);
+            if (!overflow.empty()) {
+                work = overflow.front();
+                overflow.pop_front();
+                works_queued--;
+                return true;
+            }
+        }
+
+        if (++attempts < STEAL_ATTEMPTS_BEFORE_SLEEP) {
+            thread_ns::this_thread::yield();
+            continue;
+        }
+
+        // nothing to do, wait until some work is pushed or the rendering is finished
+        thread_ns::unique_lock<thread_ns::mutex> lock(sleep_mutex);
+        threads_sleeping++;
+        while (!finished && works_queued == 0)
+            sleep_condition.wait(lock);
+        threads_sleeping--;
+        attempts = 0;
+    }
+    return false;
+}
+
+void WorkStealingDispatcher::workFinished(int thread, int work,
+                                          const renderer::RenderWorkResult &result) {
+    {
+        thread_ns::unique_lock<thread_ns::mutex> lock(progress_mutex);
+        progress->setValue(progress->getValue() + result.tiles_rendered);
+    }
+
+    int parent = work_parents[work];
+    if (parent == -1) {
+        // the top level tile is rendered, we are done
+        thread_ns::unique_lock<thread_ns::mutex> lock(sleep_mutex);
+        finished = true;
+        sleep_condition.notify_all();
+        return;
+    }
+
+    // the thread which finished the last child also renders the parent tile
+    if (--work_pending_children[parent] == 0)
+        pushWork(thread, parent);
+}
+
+void WorkStealingDispatcher::pushWork(int thread, int work) {
+    if (!deques[thread]->push(work)) {
+        thread_ns::unique_lock<thread_ns::mutex> lock(overflow_mutex);
+        overflow.push_back(work);
+    }
+    works_queued++;
+    if (threads_sleeping > 0) {
+        thread_ns::unique_lock<thread_ns::mutex> lock(sleep_mutex);
+        sleep_condition.notify_one();
+    }
+}
+
+void WorkStealingDispatcher::runWorker(int thread, renderer::RenderContext context) {
+    renderer::TileRenderWorker render_worker;
+    render_worker.setRenderContext(context);
+
+    int work;
+    while (getWork(thread, work)) {
+        render_worker.setRenderWork(works[work]);
+        render_worker();
+
+        workFinished(thread, work, render_worker.getRenderWorkResult());
+    }
+}
+
+} /* namespace thread */
+} /* namespace mapcrafter */
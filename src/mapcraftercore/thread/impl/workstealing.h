@@ -0,0 +1,110 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKSTEALING_H_
+#define WORKSTEALING_H_
+
+#include "../../compat/thread.h"
+#include "../../renderer/tilerenderworker.h"
+#include "../dispatcher.h"
+#include "workstealingdeque.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace mapcrafter {
+namespace thread {
+
+/**
+ * A render dispatcher which distributes the render work over per-thread work-stealing
+ * deques instead of one global, mutex protected work queue.
+ *
+ * Every thread starts with a contiguous range of the composite tiles on the lowest
+ * dispatched zoom level. When a thread runs out of work, it steals work from the other
+ * end of another thread's deque. Composite tiles of the upper zoom levels are not
+ * scheduled by a central loop: each parent tile has an atomic counter of its unfinished
+ * children, and the thread which finishes the last child pushes the parent tile onto its
+ * own deque.
+ */
+class WorkStealingDispatcher : public Dispatcher {
+  public:
+    WorkStealingDispatcher(int threads);
+    virtual ~WorkStealingDispatcher();
+
+    virtual void dispatch(const renderer::RenderContext &context, util::IProgressHandler *progress);
+
+  private:
+    /**
+     * Returns the index of the next work for a thread. Takes work from the own deque
+     * first, tries to steal from the other threads and waits if there is no work at all.
+     * Returns false when the rendering is finished.
+     */
+    bool getWork(int thread, int &work);
+
+    /**
+     * Called by a thread when it has finished a work. Updates the progress and pushes the
+     * parent tile onto the deque of the thread if all its children are rendered now.
+     */
+    void workFinished(int thread, int work, const renderer::RenderWorkResult &result);
+
+    /**
+     * Pushes a work onto the deque of a thread and wakes a sleeping thread up. If the
+     * deque is full, the work is put into the shared overflow queue.
+     */
+    void pushWork(int thread, int work);
+
+    /**
+     * The main loop of a render thread.
+     */
+    void runWorker(int thread, renderer::RenderContext context);
+
+    int thread_count;
+
+    // all render works, the works on the lowest zoom level are the first ones
+    std::vector<renderer::RenderWork> works;
+    // index of the work of the parent tile of every work, -1 for the top level tile
+    std::vector<int> work_parents;
+    // count of not yet rendered children of every work
+    std::unique_ptr<std::atomic<int>[]> work_pending_children;
+
+    std::vector<std::unique_ptr<WorkStealingDeque<int>>> deques;
+    // works which did not fit into the deque of a thread, taken by any thread
+    std::deque<int> overflow;
+    thread_ns::mutex overflow_mutex;
+    std::vector<thread_ns::thread> threads;
+
+    // count of works which are currently in the deques and in the overflow queue
+    std::atomic<int> works_queued;
+    // count of threads which are waiting for work
+    std::atomic<int> threads_sleeping;
+    std::atomic<bool> finished;
+    thread_ns::mutex sleep_mutex;
+    thread_ns::condition_variable sleep_condition;
+
+    util::IProgressHandler *progress;
+    thread_ns::mutex progress_mutex;
+};
+
+} /* namespace thread */
+} /* namespace mapcrafter */
+
+#endif /* WORKSTEALING_H_ */
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKSTEALINGDEQUE_H_
+#define WORKSTEALINGDEQUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mapcrafter {
+namespace thread {
+
+/**
+ * A lock-free work-stealing deque (Chase-Lev, with the memory orderings from Le et al.,
+ * "Correct and Efficient Work-Stealing for Weak Memory Models").
+ *
+ * Only the owning thread may call push and pop (which work on the bottom end), every
+ * other thread may call steal (which takes items from the top end). The capacity is
+ * fixed and rounded up to the next power of two, the deque is not resized.
+ *
+ * T should be a small, trivially copyable type (like an index or a pointer).
+ */
+template <typename T> class WorkStealingDeque {
+  public:
+    WorkStealingDeque(size_t capacity = 1024);
+    ~WorkStealingDeque();
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    /**
+     * Returns the (approximate, if called by another thread) count of items.
+     */
+    size_t size() const;
+
+    /**
+     * Pushes an item to the bottom of the deque. Owner thread only.
+     * Returns false if the deque is full.
+     */
+    bool push(T item);
+
+    /**
+     * Pops an item from the bottom of the deque. Owner thread only.
+     * Returns false if the deque is empty.
+     */
+    bool pop(T &item);
+
+    /**
+     * Steals an item from the top of the deque. May be called by any thread.
+     * Returns false if the deque is empty or if another thread won the race for the item.
+     */
+    bool steal(T &item);
+
+  private:
+    int64_t mask;
+    std::vector<std::atomic<T>> buffer;
+
+    // top and bottom are on separate cache lines, thieves hammer top, the owner bottom
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+};
+
+template <typename T>
+WorkStealingDeque<T>::WorkStealingDeque(size_t capacity)
+    : mask(0), buffer(), top(0), bottom(0) {
+    size_t size = 1;
+    while (size < capacity)
+        size *= 2;
+    mask = size - 1;
+    buffer = std::vector<std::atomic<T>>(size);
+}
+
+template <typename T> WorkStealingDeque<T>::~WorkStealingDeque() {}
+
+template <typename T> size_t WorkStealingDeque<T>::size() const {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_relaxed);
+    return b > t ? b - t : 0;
+}
+
+template <typename T> bool WorkStealingDeque<T>::push(T item) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t > mask)
+        return false;
+    buffer[b & mask].store(item, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template <typename T> bool WorkStealingDeque<T>::pop(T &item) {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // deque was already empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    item = buffer[b & mask].load(std::memory_order_relaxed);
+    if (t == b) {
+        // this was the last item, race against the thieves for it
+        bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                               std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+template <typename T> bool WorkStealingDeque<T>::steal(T &item) {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return false;
+
+    item = buffer[t & mask].load(std::memory_order_relaxed);
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed);
+}
+
+} /* namespace thread */
+} /* namespace mapcrafter */
+
+#endif /* WORKSTEALINGDEQUE_H_ */
@@ -31,6 +31,7 @@
 #include "compat/boost.h"
 #include "compat/nullptr.h"
 
+#include "util/cpu.h"
 #include "util/filesystem.h"
 #include "util/json.h"
 #include "util/logging.h"
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cpu.h"
+
+#include "../config.h"
+
+namespace mapcrafter {
+namespace util {
+
+InstructionSet getInstructionSet() {
+    static InstructionSet instructions = []() {
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return InstructionSet::AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return InstructionSet::SSE41;
+#endif
+        return InstructionSet::SCALAR;
+    }();
+    return instructions;
+}
+
+bool isInstructionSetSupported(InstructionSet instructions) {
+    return static_cast<int>(instructions) <= static_cast<int>(getInstructionSet());
+}
+
+const char *getInstructionSetName(InstructionSet instructions) {
+    switch (instructions) {
+    case InstructionSet::SSE41:
+        return "sse4.1";
+    case InstructionSet::AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+} /* namespace util */
+} /* namespace mapcrafter */
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CPU_H_
+#define CPU_H_
+
+namespace mapcrafter {
+namespace util {
+
+/**
+ * Instruction set extensions some performance critical code has optimized
+ * implementations for. Every instruction set includes the ones before it.
+ */
+enum class InstructionSet { SCALAR = 0, SSE41 = 1, AVX2 = 2 };
+
+/**
+ * Returns the best instruction set the CPU supports. It's always the scalar one if
+ * mapcrafter wasn't compiled with x86 SIMD support.
+ */
+InstructionSet getInstructionSet();
+
+/**
+ * Returns whether the CPU supports an instruction set.
+ */
+bool isInstructionSetSupported(InstructionSet instructions);
+
+/**
+ * Returns the name of an instruction set ("scalar", "sse4.1" or "avx2").
+ */
+const char *getInstructionSetName(InstructionSet instructions);
+
+} /* namespace util */
+} /* namespace mapcrafter */
+
+#endif /* CPU_H_ */
@@ -21,8 +21,12 @@
 
 #include "../util.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <thread>
 
 #if defined(__APPLE__)
 #include <mach-o/dyld.h>
@@ -32,6 +36,19 @@
 #include <windows.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 namespace mapcrafter {
 namespace util {
 
@@ -76,6 +93,208 @@ bool moveFile(const fs::path &from, const fs::path &to) {
     return true;
 }
 
+MappedFile::MappedFile() : data(nullptr), size(0), mapped(false) {}
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string &filename, bool map) {
+    close();
+
+#ifdef HAVE_SYS_MMAN_H
+    if (!map)
+        return readIntoBuffer(filename);
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size = st.st_size;
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void *ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after closing the file descriptor
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        size = 0;
+        return false;
+    }
+    data = static_cast<const uint8_t *>(ptr);
+    mapped = true;
+    return true;
+#else
+    return readIntoBuffer(filename);
+#endif
+}
+
+void MappedFile::close() {
+#ifdef HAVE_SYS_MMAN_H
+    if (mapped)
+        munmap(const_cast<uint8_t *>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    buffer.clear();
+}
+
+bool MappedFile::readIntoBuffer(const std::string &filename) {
+    // the file might be written while it is read, so the size and modification time are
+    // checked before and after reading it and the file is read again if they changed
+    for (int tries = 0; tries < 5; tries++) {
+        boost::system::error_code error;
+        std::uintmax_t size_before = fs::file_size(filename, error);
+        std::time_t mtime_before = fs::last_write_time(filename, error);
+        if (error)
+            return false;
+
+        std::ifstream in(filename.c_str(), std::ios::binary);
+        if (!in)
+            return false;
+        in.seekg(0, std::ios::end);
+        buffer.resize(in.tellg());
+        in.seekg(0, std::ios::beg);
+        in.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+        if (!in) {
+            buffer.clear();
+            return false;
+        }
+        in.close();
+
+        std::uintmax_t size_after = fs::file_size(filename, error);
+        std::time_t mtime_after = fs::last_write_time(filename, error);
+        if (error) {
+            buffer.clear();
+            return false;
+        }
+        if (size_before == size_after && size_after == buffer.size() &&
+            mtime_before == mtime_after) {
+            data = buffer.data();
+            size = buffer.size();
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    buffer.clear();
+    return false;
+}
+
+const uint8_t *MappedFile::getData() const { return data; }
+
+size_t MappedFile::getSize() const { return size; }
+
+DirectoryWatcher::DirectoryWatcher() : inotify_fd(-1) {
+#ifdef HAVE_SYS_INOTIFY_H
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd == -1)
+        LOG(WARNING) << "Unable to initialize inotify, polling the directories instead.";
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+#ifdef HAVE_SYS_INOTIFY_H
+    if (inotify_fd != -1)
+        ::close(inotify_fd);
+#endif
+}
+
+bool DirectoryWatcher::addDirectory(const fs::path &dir) {
+    if (!fs::is_directory(dir))
+        return false;
+#ifdef HAVE_SYS_INOTIFY_H
+    if (inotify_fd != -1) {
+        // Minecraft keeps the region files open and writes them in place, so modifications
+        // are interesting as well and not only closed files
+        int wd = inotify_add_watch(inotify_fd, dir.string().c_str(),
+                                   IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd == -1)
+            return false;
+        watches[wd] = dir;
+        return true;
+    }
+#endif
+    directories.push_back(dir);
+    // remember the current state of the files, only later changes are reported
+    std::set<fs::path> existing;
+    bool written;
+    return collectChanges(existing, 0, written);
+}
+
+bool DirectoryWatcher::waitForChanges(std::set<fs::path> &changed, int quiet_period) {
+    bool written = false;
+    while (!written)
+        if (!collectChanges(changed, -1, written))
+            return false;
+    // wait until the files are not written anymore, every write starts the quiet period
+    // again, also writes to files which are already known as changed
+    while (written)
+        if (!collectChanges(changed, std::max(quiet_period, 0), written))
+            return false;
+    return true;
+}
+
+bool DirectoryWatcher::collectChanges(std::set<fs::path> &changed, int timeout,
+                                      bool &written) {
+    written = false;
+#ifdef HAVE_SYS_INOTIFY_H
+    if (inotify_fd != -1) {
+        struct pollfd pfd;
+        pfd.fd = inotify_fd;
+        pfd.events = POLLIN;
+        int ready = poll(&pfd, 1, timeout < 0 ? -1 : timeout * 1000);
+        if (ready == -1)
+            return errno == EINTR;
+        if (ready == 0)
+            return true;
+
+        alignas(struct inotify_event) char buffer[4096];
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length == -1)
+            return errno == EINTR || errno == EAGAIN;
+        for (ssize_t i = 0; i < length;) {
+            const struct inotify_event *event =
+                reinterpret_cast<const struct inotify_event *>(buffer + i);
+            auto it = watches.find(event->wd);
+            if (it != watches.end() && event->len > 0) {
+                changed.insert(it->second / event->name);
+                written = true;
+            }
+            i += sizeof(struct inotify_event) + event->len;
+        }
+        return true;
+    }
+#endif
+
+    // without inotify poll the directories every second until the timeout is over
+    for (int waited = 0;; waited++) {
+        for (auto dir_it = directories.begin(); dir_it != directories.end(); ++dir_it) {
+            boost::system::error_code error;
+            fs::directory_iterator end;
+            for (fs::directory_iterator it(*dir_it, error); !error && it != end;
+                 it.increment(error)) {
+                std::time_t mtime = fs::last_write_time(it->path(), error);
+                uintmax_t size = fs::file_size(it->path(), error);
+                if (error)
+                    continue;
+                auto state = std::make_pair(mtime, size);
+                auto file_it = files.find(it->path());
+                if (file_it == files.end() || file_it->second != state) {
+                    files[it->path()] = state;
+                    changed.insert(it->path());
+                    written = true;
+                }
+            }
+        }
+        if (written || (timeout >= 0 && waited >= timeout))
+            return true;
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
 fs::path findHomeDir() {
     char *path;
 #if defined(OS_WINDOWS)
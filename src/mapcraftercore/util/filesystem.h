@@ -21,6 +21,11 @@
 #define FILESYSTEM_H_
 
 #include <boost/filesystem.hpp>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
 #include <vector>
 
 namespace fs = boost::filesystem;
@@ -32,6 +37,100 @@ bool copyFile(const fs::path &from, const fs::path &to);
 bool copyDirectory(const fs::path &from, const fs::path &to);
 bool moveFile(const fs::path &from, const fs::path &to);
 
+/**
+ * A read-only view of the contents of a file. The file is memory-mapped if the platform
+ * supports it, otherwise it is read into memory.
+ *
+ * Keep in mind that the contents of a mapped file change when someone else writes to
+ * the file (and accessing a mapped file which is truncated meanwhile even crashes), so
+ * files which are possibly modified while they are in use should be read into memory.
+ */
+class MappedFile {
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * Opens a file. Returns false if the file can't be opened or read.
+     *
+     * If map is false, the file is read into memory instead of mapping it. Its size and
+     * modification time are compared before and after reading it and it is read again
+     * if they changed, so the data is not torn by someone writing to the file meanwhile.
+     * Returns false too if the file doesn't stop changing after some tries.
+     */
+    bool open(const std::string &filename, bool map = true);
+
+    /**
+     * Closes the file, data returned by getData is invalid afterwards.
+     */
+    void close();
+
+    const uint8_t *getData() const;
+    size_t getSize() const;
+
+  private:
+    /**
+     * Reads the file into the buffer, see open.
+     */
+    bool readIntoBuffer(const std::string &filename);
+
+    const uint8_t *data;
+    size_t size;
+
+    // whether the data is mapped, otherwise it is stored in the buffer
+    bool mapped;
+    std::vector<uint8_t> buffer;
+};
+
+/**
+ * Watches directories for files which are written. Uses inotify if the platform supports
+ * it, otherwise the modification times and sizes of the files are polled.
+ */
+class DirectoryWatcher {
+  public:
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher &) = delete;
+    DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+    /**
+     * Starts watching a directory (not recursively). Returns false if the directory
+     * can't be watched.
+     */
+    bool addDirectory(const fs::path &dir);
+
+    /**
+     * Blocks until files in the watched directories were written and then waits until
+     * there was no write for quiet_period seconds (also no write to files which were
+     * already written), so files which are written in several steps are reported only
+     * once. The written files are added to the set.
+     *
+     * Returns false if waiting for changes failed.
+     */
+    bool waitForChanges(std::set<fs::path> &changed, int quiet_period);
+
+  private:
+    /**
+     * Collects the changes which happened within the timeout (in seconds, -1 to wait
+     * until something happens). written is set to whether any file was written, even if
+     * it is already in the set. Returns false if an error occured.
+     */
+    bool collectChanges(std::set<fs::path> &changed, int timeout, bool &written);
+
+    // inotify file descriptor, -1 if polling is used
+    int inotify_fd;
+    // inotify watch descriptor -> directory
+    std::map<int, fs::path> watches;
+
+    // when polling: watched directories and the (modification time, size) of their files
+    std::vector<fs::path> directories;
+    std::map<fs::path, std::pair<std::time_t, uintmax_t>> files;
+};
+
 /**
  * Returns the home directory of the current user.
  *
@@ -22,6 +22,7 @@
 #include "../config.h"
 
 #include <cctype>
+#include <cstring>
 
 #ifdef HAVE_ENDIAN_H
 #ifdef ENDIAN_H_FREEBSD
@@ -86,6 +87,19 @@ int64_t bigEndian64(int64_t x) {
 #endif
 }
 
+uint64_t hashBytes(const uint8_t *data, size_t len, uint64_t seed) {
+    // FNV-1a, but with eight bytes at once
+    uint64_t hash = (0xcbf29ce484222325ULL ^ len) + seed * 0x9e3779b97f4a7c15ULL;
+    for (; len >= 8; data += 8, len -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (; len > 0; data++, len--)
+        hash = (hash ^ *data) * 0x100000001b3ULL;
+    return hash ^ (hash >> 29);
+}
+
 // nicer bool -> string conversion
 template <> std::string str<bool>(bool value) { return value ? "true" : "false"; }
 
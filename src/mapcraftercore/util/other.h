@@ -35,6 +35,12 @@ int16_t bigEndian16(int16_t x);
 int32_t bigEndian32(int32_t x);
 int64_t bigEndian64(int64_t x);
 
+/**
+ * Returns a fast (not cryptographic) 64-bit hash of some bytes. A hash of several parts
+ * can be computed by passing the hash of the previous parts as seed.
+ */
+uint64_t hashBytes(const uint8_t *data, size_t len, uint64_t seed = 0);
+
 template <typename T> std::string str(T value) {
     std::stringstream ss;
     ss << value;
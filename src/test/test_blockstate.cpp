@@ -19,10 +19,13 @@
 
 #include "../mapcraftercore/mc/blockstate.h"
 
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <sstream>
+#include <thread>
 
 namespace mc = mapcrafter::mc;
 
@@ -76,3 +79,94 @@ BOOST_AUTO_TEST_CASE(blockstate_testRegistry) {
     BOOST_CHECK_EQUAL(block_compare.getName(), block.getName());
     BOOST_CHECK_EQUAL(block_compare.getVariantDescription(), block.getVariantDescription());
 }
+
+BOOST_AUTO_TEST_CASE(blockstate_testRegistryThreads) {
+    mc::BlockStateRegistry registry;
+
+    // more block states than fit into the initial table and the first blocks
+    std::vector<mc::BlockState> blocks;
+    for (int i = 0; i < 3000; i++) {
+        mc::BlockState block("mapcrafter:test" + std::to_string(i % 100));
+        block.setProperty("index", std::to_string(i / 100));
+        blocks.push_back(block);
+    }
+
+    // all threads add the same block states in a different order
+    const int thread_count = 8;
+    std::vector<std::vector<uint16_t>> ids(thread_count, std::vector<uint16_t>(blocks.size()));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&, t]() {
+            std::vector<size_t> order(blocks.size());
+            for (size_t i = 0; i < order.size(); i++)
+                order[i] = i;
+            std::shuffle(order.begin(), order.end(), std::mt19937(t));
+            for (size_t i : order)
+                ids[t][i] = registry.getBlockID(blocks[i]);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    BOOST_CHECK_EQUAL(registry.size(), blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+        for (int t = 1; t < thread_count; t++)
+            BOOST_REQUIRE_EQUAL(ids[t][i], ids[0][i]);
+        const mc::BlockState &block = registry.getBlockState(ids[0][i]);
+        BOOST_CHECK_EQUAL(block.getName(), blocks[i].getName());
+        BOOST_CHECK_EQUAL(block.getVariantDescription(), blocks[i].getVariantDescription());
+        BOOST_CHECK_EQUAL(registry.getBlockID(blocks[i]), ids[0][i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockstate_testPaletteMemo) {
+    mc::BlockStateRegistry registry;
+    mc::BlockPaletteMemo memo;
+
+    std::vector<std::string> entries;
+    for (int i = 0; i < 1000; i++)
+        entries.push_back("entry " + std::to_string(i));
+    auto data = [&entries](int i) {
+        return reinterpret_cast<const uint8_t *>(entries[i].data());
+    };
+
+    // remembers entries by their data, also after growing
+    uint16_t id;
+    BOOST_CHECK(!memo.lookup(registry, data(0), entries[0].size(), id));
+    for (int i = 0; i < 1000; i++)
+        memo.insert(registry, data(i), entries[i].size(), i);
+    BOOST_CHECK_EQUAL(memo.size(), 1000);
+    for (int i = 0; i < 1000; i++) {
+        BOOST_CHECK(memo.lookup(registry, data(i), entries[i].size(), id));
+        BOOST_CHECK_EQUAL(id, i);
+    }
+    // a prefix of an entry is a different entry
+    BOOST_CHECK(!memo.lookup(registry, data(5), entries[5].size() - 1, id));
+
+    // forgets everything when the known properties or the registry change
+    registry.addKnownProperty("minecraft:test", "foo");
+    BOOST_CHECK(!memo.lookup(registry, data(0), entries[0].size(), id));
+    BOOST_CHECK_EQUAL(memo.size(), 0);
+
+    memo.insert(registry, data(0), entries[0].size(), 42);
+    mc::BlockStateRegistry other_registry;
+    BOOST_CHECK(other_registry.getGeneration() != registry.getGeneration());
+    BOOST_CHECK(!memo.lookup(other_registry, data(0), entries[0].size(), id));
+}
+
+BOOST_AUTO_TEST_CASE(blockstate_testKnownPropertiesHash) {
+    mc::BlockStateRegistry registry, other_registry;
+    BOOST_CHECK_EQUAL(registry.getKnownPropertiesHash(), other_registry.getKnownPropertiesHash());
+
+    // the hash changes with the known properties, also after it was computed once
+    uint64_t hash = registry.getKnownPropertiesHash();
+    registry.addKnownProperty("minecraft:test", "foo");
+    BOOST_CHECK(registry.getKnownPropertiesHash() != hash);
+    hash = registry.getKnownPropertiesHash();
+    registry.addKnownProperty("minecraft:test", "foo");
+    BOOST_CHECK_EQUAL(registry.getKnownPropertiesHash(), hash);
+
+    // registries with the same known properties have the same hash
+    other_registry.addKnownProperty("minecraft:test", "foo");
+    BOOST_CHECK_EQUAL(other_registry.getKnownPropertiesHash(), hash);
+}
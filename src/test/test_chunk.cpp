@@ -0,0 +1,510 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/mc/blockstate.h"
+#include "../mapcraftercore/mc/chunk.h"
+#include "../mapcraftercore/mc/chunkneighborhood.h"
+#include "../mapcraftercore/mc/chunkstore.h"
+#include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/region.h"
+#include "../mapcraftercore/mc/world.h"
+#include "../mapcraftercore/mc/worldcache.h"
+#include "../mapcraftercore/mc/worldentities.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace mc = mapcrafter::mc;
+namespace nbt = mapcrafter::mc::nbt;
+
+BOOST_AUTO_TEST_CASE(chunk_testSection) {
+    // sections with different counts of different blocks
+    for (int different : {1, 2, 3, 4, 5, 16, 17, 256, 257, 4096}) {
+        std::vector<uint16_t> block_ids(4096);
+        for (int i = 0; i < 4096; i++)
+            block_ids[i] = 1000 + (i < different ? i : rand() % different) * 7;
+
+        mc::ChunkSection section;
+        section.setBlockIDs(block_ids.data());
+        for (int i = 0; i < 4096; i++)
+            BOOST_REQUIRE_EQUAL(section.getBlockID(i), block_ids[i]);
+        if (different <= 256)
+            BOOST_CHECK_LT(section.getMemoryUsage(), 4096 * sizeof(uint16_t));
+    }
+
+    // palettes with duplicate block IDs
+    std::vector<uint16_t> indices(4096), palette = {5, 7, 5, 9, 7};
+    for (int i = 0; i < 4096; i++)
+        indices[i] = rand() % palette.size();
+    mc::ChunkSection paletted;
+    paletted.setBlockIDs(indices.data(), palette.data(), palette.size());
+    for (int i = 0; i < 4096; i++)
+        BOOST_REQUIRE_EQUAL(paletted.getBlockID(i), palette[indices[i]]);
+    palette = {3, 3, 3};
+    paletted.setBlockIDs(indices.data(), palette.data(), palette.size());
+    BOOST_CHECK_EQUAL(paletted.getMemoryUsage(), sizeof(mc::ChunkSection));
+    BOOST_CHECK_EQUAL(paletted.getBlockID(1234), 3);
+
+    mc::ChunkSection section;
+    section.setBlockIDs(42);
+    for (int i = 0; i < 4096; i++)
+        BOOST_REQUIRE_EQUAL(section.getBlockID(i), 42);
+
+    // uniform and other light arrays
+    std::vector<uint8_t> light(2048, 0xaa);
+    section.setLight(0, light.data());
+    light[100] = 0x5a;
+    section.setLight(1, light.data());
+    for (int i = 0; i < 4096; i++) {
+        BOOST_REQUIRE_EQUAL(section.getLight(0, i), 0xa);
+        BOOST_REQUIRE_EQUAL(section.getLight(1, i), i == 200 ? 0xa : (i == 201 ? 0x5 : 0xa));
+    }
+
+    // only air and the default light is the same as no section
+    BOOST_CHECK(!section.isEmpty(42));
+    section.setLight(0, (uint8_t)0);
+    section.setLight(1, (uint8_t)15);
+    BOOST_CHECK(section.isEmpty(42));
+    BOOST_CHECK(!section.isEmpty(0));
+    BOOST_CHECK_EQUAL(section.getMemoryUsage(), sizeof(mc::ChunkSection));
+}
+
+namespace {
+
+/**
+ * Returns the NBT data of a 1.18 chunk with a section of stone columns, which are as high
+ * as the y-coordinates in the heights array (index z * 16 + x). Below there is a section
+ * with only air (but block light) and a section with only stone at the bottom.
+ */
+std::string createChunk(const std::string &status, const int *heights,
+                        const int *heightmap_heights, int chunk_x = 0, int chunk_z = 0) {
+    nbt::NBTFile root("");
+    root.addTag("DataVersion", nbt::TagInt(2975));
+    root.addTag("xPos", nbt::TagInt(chunk_x));
+    root.addTag("zPos", nbt::TagInt(chunk_z));
+    root.addTag("yPos", nbt::TagInt(-4));
+    root.addTag("Status", nbt::TagString(status));
+
+    // palette indices of stone (1) and air (0) in section 4, 16 values with 4 bits per long
+    std::vector<int64_t> data(256, 0);
+    for (int i = 0; i < 4096; i++) {
+        int x = i % 16, z = (i / 16) % 16, y = 64 + i / 256;
+        if (y <= heights[z * 16 + x])
+            data[i / 16] |= 1LL << (i % 16 * 4);
+    }
+    nbt::TagList palette(nbt::TagCompound::TAG_TYPE);
+    for (const char *name : {"minecraft:air", "minecraft:stone"}) {
+        nbt::TagCompound *entry = new nbt::TagCompound();
+        entry->addTag("Name", nbt::TagString(name));
+        palette.payload.push_back(nbt::TagPtr(entry));
+    }
+    nbt::TagCompound block_states;
+    block_states.addTag("palette", palette);
+    block_states.addTag("data", nbt::TagLongArray(data));
+    nbt::TagCompound *section = new nbt::TagCompound();
+    section->addTag("Y", nbt::TagByte(4));
+    section->addTag("block_states", block_states);
+    nbt::TagList sections(nbt::TagCompound::TAG_TYPE);
+    sections.payload.push_back(nbt::TagPtr(section));
+
+    for (int y : {1, mc::CHUNK_LOW}) {
+        nbt::TagCompound *entry = new nbt::TagCompound();
+        entry->addTag("Name", nbt::TagString(y == 1 ? "minecraft:air" : "minecraft:stone"));
+        nbt::TagList uniform_palette(nbt::TagCompound::TAG_TYPE);
+        uniform_palette.payload.push_back(nbt::TagPtr(entry));
+        nbt::TagCompound uniform_block_states;
+        uniform_block_states.addTag("palette", uniform_palette);
+        nbt::TagCompound *uniform_section = new nbt::TagCompound();
+        uniform_section->addTag("Y", nbt::TagByte(y));
+        uniform_section->addTag("block_states", uniform_block_states);
+        if (y == 1)
+            uniform_section->addTag("BlockLight",
+                                    nbt::TagByteArray(std::vector<int8_t>(2048, 0x77)));
+        sections.payload.push_back(nbt::TagPtr(uniform_section));
+    }
+    root.addTag("sections", sections);
+
+    // heightmap values are relative to the bottom of the world, 9 bits, 7 values per long
+    if (heightmap_heights != nullptr) {
+        std::vector<int64_t> heightmap(37, 0);
+        for (int i = 0; i < 256; i++)
+            heightmap[i / 7] |= (int64_t)(heightmap_heights[i] + 64 + 1) << (i % 7 * 9);
+        nbt::TagCompound heightmaps;
+        heightmaps.addTag("WORLD_SURFACE", nbt::TagLongArray(heightmap));
+        root.addTag("Heightmaps", heightmaps);
+    }
+
+    std::stringstream stream;
+    root.writeNBT(stream, nbt::Compression::NO_COMPRESSION);
+    return stream.str();
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(chunk_testHeights) {
+    mc::BlockStateRegistry block_registry;
+    uint16_t air_id = block_registry.getBlockID(mc::BlockState("minecraft:air"));
+
+    int heights[256], wrong_heights[256];
+    for (int i = 0; i < 256; i++) {
+        heights[i] = 64 + rand() % 16;
+        wrong_heights[i] = 0;
+    }
+    // a column with only the bottom section
+    heights[17] = mc::CHUNK_LOW * 16 + 15;
+
+    // the heightmap is used for complete chunks, otherwise the heights are computed
+    std::string with_heightmap = createChunk("full", heights, heights);
+    std::string without_heightmap = createChunk("full", heights, nullptr);
+    std::string incomplete = createChunk("features", heights, wrong_heights);
+    for (const std::string &data : {with_heightmap, without_heightmap, incomplete}) {
+        for (int rotation = 0; rotation < 4; rotation++) {
+            mc::Chunk chunk;
+            chunk.setRotation(rotation);
+            BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+                                        nbt::Compression::NO_COMPRESSION));
+            BOOST_CHECK_EQUAL(chunk.getHighestBlock(), 79);
+
+            for (int x = 0; x < 16; x++)
+                for (int z = 0; z < 16; z++) {
+                    int highest = chunk.getHighestBlock(mc::LocalBlockPos(x, z, 0));
+                    if (rotation == 0)
+                        BOOST_REQUIRE_EQUAL(highest, heights[z * 16 + x]);
+                    BOOST_REQUIRE_EQUAL(chunk.getBlockID(mc::LocalBlockPos(x, z, highest + 1)),
+                                        air_id);
+                    if (highest >= mc::CHUNK_LOW * 16)
+                        BOOST_REQUIRE_NE(chunk.getBlockID(mc::LocalBlockPos(x, z, highest)),
+                                         air_id);
+                }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testAirSteps) {
+    mc::BlockStateRegistry block_registry;
+    uint16_t air_id = block_registry.getBlockID(mc::BlockState("minecraft:air"));
+
+    int heights[256];
+    for (int i = 0; i < 256; i++)
+        heights[i] = 64 + rand() % 16;
+    std::string data = createChunk("full", heights, nullptr);
+
+    // isometric, side and top-down rays
+    mc::BlockPos dirs[] = {mc::BlockPos(1, -1, -1), mc::BlockPos(0, -1, -1),
+                           mc::BlockPos(0, 0, -1)};
+    for (int rotation = 0; rotation < 4; rotation++) {
+        mc::Chunk chunk;
+        chunk.setRotation(rotation);
+        BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+                                    nbt::Compression::NO_COMPRESSION));
+
+        // the air section and the missing ones are skipped until the bottom section
+        BOOST_CHECK_EQUAL(chunk.getAirSteps(mc::LocalBlockPos(3, 5, 40), dirs[2]),
+                          40 - (mc::CHUNK_LOW * 16 + 15));
+        BOOST_CHECK_EQUAL(chunk.getAirSteps(mc::LocalBlockPos(3, 5, 60), dirs[0]), 6);
+
+        for (const mc::BlockPos &dir : dirs)
+            for (int x = 0; x < 16; x++)
+                for (int z = 0; z < 16; z++)
+                    for (int y : {319, 100, 79, 70, 40, 0, -40, -60}) {
+                        mc::LocalBlockPos pos(x, z, y);
+                        int steps = chunk.getAirSteps(pos, dir);
+                        int steps_in_chunk = mc::getStepsInChunk(pos, dir);
+                        BOOST_REQUIRE_LE(steps, steps_in_chunk);
+                        for (int i = 0; i < steps; i++) {
+                            mc::LocalBlockPos air(x + dir.x * i, z + dir.z * i, y + dir.y * i);
+                            BOOST_REQUIRE_EQUAL(chunk.getBlockID(air), air_id);
+                        }
+                        // rays straight down stop right at the first block
+                        if (dir.x == 0 && dir.z == 0 && steps < steps_in_chunk)
+                            BOOST_REQUIRE_NE(chunk.getBlockID(mc::LocalBlockPos(x, z, y - steps)),
+                                             air_id);
+                    }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testChunkData) {
+    int heights[256];
+    for (int i = 0; i < 256; i++)
+        heights[i] = 64 + rand() % 16;
+    std::string data = createChunk("full", heights, nullptr);
+
+    mc::BlockStateRegistry block_registry;
+    mc::Chunk chunk;
+    BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+                                nbt::Compression::NO_COMPRESSION));
+    std::stringstream stream;
+    BOOST_REQUIRE(chunk.getChunkData()->write(stream, block_registry));
+
+    // the block IDs of a different registry are different
+    mc::BlockStateRegistry other_registry;
+    other_registry.getBlockID(mc::BlockState("minecraft:dirt"));
+    std::shared_ptr<mc::ChunkData> read = std::make_shared<mc::ChunkData>();
+    BOOST_REQUIRE(read->read(stream, other_registry));
+    BOOST_CHECK_EQUAL(other_registry.getBlockState(read->air_id).getName(), "minecraft:air");
+
+    for (int rotation = 0; rotation < 4; rotation++) {
+        mc::Chunk original, copy;
+        original.setRotation(rotation);
+        original.setChunkData(chunk.getChunkData());
+        copy.setRotation(rotation);
+        copy.setChunkData(read);
+        BOOST_CHECK_EQUAL(copy.getPos(), original.getPos());
+        BOOST_CHECK_EQUAL(copy.getHighestBlock(), original.getHighestBlock());
+        for (int i = 0; i < 16 * 16 * (mc::CHUNK_TOP - mc::CHUNK_LOW) * 16; i += 7) {
+            mc::LocalBlockPos pos(i % 16, i / 16 % 16, mc::CHUNK_LOW * 16 + i / 256);
+            BOOST_REQUIRE_EQUAL(
+                other_registry.getBlockState(copy.getBlockID(pos)).getName(),
+                block_registry.getBlockState(original.getBlockID(pos)).getName());
+            BOOST_REQUIRE_EQUAL(copy.getBlockLight(pos), original.getBlockLight(pos));
+            BOOST_REQUIRE_EQUAL(copy.getSkyLight(pos), original.getSkyLight(pos));
+            BOOST_REQUIRE_EQUAL(copy.getBiomeAt(pos), original.getBiomeAt(pos));
+            BOOST_REQUIRE_EQUAL(copy.getHighestBlock(pos), original.getHighestBlock(pos));
+        }
+    }
+
+    // truncated data is invalid
+    std::string written = stream.str();
+    std::stringstream truncated(written.substr(0, written.size() / 2));
+    mc::ChunkData invalid;
+    BOOST_CHECK(!invalid.read(truncated, other_registry));
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testChunkStore) {
+    int heights[256];
+    for (int i = 0; i < 256; i++)
+        heights[i] = 64 + rand() % 16;
+    std::string data = createChunk("full", heights, nullptr);
+
+    mc::BlockStateRegistry block_registry;
+    mc::Chunk chunk;
+    BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+                                nbt::Compression::NO_COMPRESSION));
+    mc::ChunkPos pos(0, 0);
+
+    fs::path cache_dir = fs::temp_directory_path() / fs::unique_path();
+    {
+        mc::ChunkStore store(block_registry, 1024 * 1024, cache_dir);
+        BOOST_CHECK(!store.get("r.0.0.mca", pos, 42));
+        BOOST_CHECK(store.put("r.0.0.mca", pos, 42, chunk.getChunkData()) ==
+                    chunk.getChunkData());
+        BOOST_CHECK(store.get("r.0.0.mca", pos, 42) == chunk.getChunkData());
+        BOOST_CHECK_GT(store.getMemoryUsage(), 0);
+
+        // changed chunks and chunks decoded with other known properties are outdated
+        BOOST_CHECK(!store.get("r.0.0.mca", pos, 43));
+        block_registry.addKnownProperty("minecraft:stone", "foo");
+        BOOST_CHECK(!store.get("r.0.0.mca", pos, 42));
+        BOOST_CHECK_EQUAL(store.getStats().hits, 1u);
+        BOOST_CHECK_EQUAL(store.getStats().misses, 3u);
+    }
+
+    // the next run reads the chunk from the cache directory
+    mc::BlockStateRegistry other_registry;
+    other_registry.addKnownProperty("minecraft:stone", "foo");
+    mc::ChunkStore store(other_registry, 1024 * 1024, cache_dir);
+    BOOST_CHECK(!store.get("r.0.0.mca", pos, 42));
+    BOOST_CHECK(!store.get("r.1.0.mca", pos, 42));
+    BOOST_REQUIRE(chunk.readNBT(other_registry, data.data(), data.size(),
+                                nbt::Compression::NO_COMPRESSION));
+    store.put("r.0.0.mca", pos, 42, chunk.getChunkData());
+
+    mc::BlockStateRegistry next_registry;
+    next_registry.addKnownProperty("minecraft:stone", "foo");
+    mc::ChunkStore next_store(next_registry, 1024 * 1024, cache_dir);
+    std::shared_ptr<const mc::ChunkData> cached = next_store.get("r.0.0.mca", pos, 42);
+    BOOST_REQUIRE(cached);
+    BOOST_CHECK_EQUAL(cached->sections.size(), chunk.getChunkData()->sections.size());
+    BOOST_CHECK(!next_store.get("r.0.0.mca", pos, 41));
+    fs::remove_all(cache_dir);
+}
+
+namespace {
+
+void checkBlock(const mc::Block &block, const mc::Block &expected) {
+    BOOST_CHECK(block.pos == expected.pos);
+    BOOST_CHECK_EQUAL(block.fields_set, expected.fields_set);
+    BOOST_CHECK_EQUAL(block.id, expected.id);
+    BOOST_CHECK_EQUAL(block.biome, expected.biome);
+    BOOST_CHECK_EQUAL(block.block_light, expected.block_light);
+    BOOST_CHECK_EQUAL(block.sky_light, expected.sky_light);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(chunk_testNeighborhood) {
+    // a world with some chunks with random heights, and some chunks missing
+    fs::path world_dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(world_dir / "region");
+    std::mt19937 random(42);
+    mc::RegionFile region((world_dir / "region" / "r.0.0.mca").string());
+    std::vector<mc::ChunkPos> chunks;
+    for (int x = 0; x < 4; x++) {
+        for (int z = 0; z < 4; z++) {
+            if ((x + z) % 3 == 0)
+                continue;
+            int heights[256];
+            for (int i = 0; i < 256; i++)
+                heights[i] = 64 + int(random() % 16);
+            std::string data = createChunk("full", heights, nullptr, x, z);
+            region.setChunkData(mc::ChunkPos(x, z), std::vector<uint8_t>(data.begin(), data.end()),
+                                mc::RegionFile::COMPRESSION_NONE);
+            chunks.push_back(mc::ChunkPos(x, z));
+        }
+    }
+    BOOST_REQUIRE(region.write());
+
+    // the chunk neighborhood must return the same blocks as the world cache, in every
+    // rotation, at the borders of sections and chunks and next to not existing chunks
+    for (int rotation = 0; rotation < 4; rotation++) {
+        mc::BlockStateRegistry block_registry;
+        mc::World world(world_dir.string());
+        world.setRotation(rotation);
+        BOOST_REQUIRE(world.load());
+
+        mc::WorldCache world_cache(block_registry, world);
+        mc::ChunkNeighborhood neighborhood(&world_cache);
+
+        int existing = 0;
+        int height = (mc::CHUNK_TOP - mc::CHUNK_LOW) * 16;
+        for (int i = 0; i < 3000; i++) {
+            mc::ChunkPos chunk = chunks[random() % chunks.size()];
+            chunk.rotate(rotation);
+            // mostly around the blocks of the chunks, sometimes anywhere
+            int y = i % 4 == 0 ? mc::CHUNK_LOW * 16 - 1 + int(random() % (height + 2))
+                               : 60 + int(random() % 24);
+            mc::BlockPos pos(chunk.x * 16 + int(random() % 18) - 1,
+                             chunk.z * 16 + int(random() % 18) - 1, y);
+            int get = mc::GET_ID | mc::GET_LIGHT;
+            if (pos.y + 1 < mc::CHUNK_TOP * 16)
+                get |= mc::GET_BIOME;
+
+            mc::Block block = neighborhood.getBlock(pos, get);
+            checkBlock(block, world_cache.getBlock(pos, nullptr, get));
+            if (block.fields_set != 0)
+                existing++;
+            if (pos.y < mc::CHUNK_LOW * 16)
+                continue;
+
+            mc::Block neighbors6[6];
+            neighborhood.getNeighbors6(pos, neighbors6, get);
+            const mc::BlockPos dirs[6] = {mc::DIR_NORTH, mc::DIR_SOUTH, mc::DIR_EAST,
+                                          mc::DIR_WEST,  mc::DIR_TOP,   mc::DIR_BOTTOM};
+            for (int j = 0; j < 6; j++)
+                checkBlock(neighbors6[j], world_cache.getBlock(pos + dirs[j], nullptr, get));
+
+            mc::Block neighbors26[27];
+            neighborhood.getNeighbors26(pos, neighbors26, get);
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dz = -1; dz <= 1; dz++)
+                    for (int dx = -1; dx <= 1; dx++)
+                        checkBlock(neighbors26[((dy + 1) * 3 + dz + 1) * 3 + dx + 1],
+                                   world_cache.getBlock(pos + mc::BlockPos(dx, dz, dy), nullptr,
+                                                        get));
+        }
+        BOOST_CHECK_GT(existing, 1000);
+    }
+    fs::remove_all(world_dir);
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testContentHash) {
+    int heights[256];
+    for (int i = 0; i < 256; i++)
+        heights[i] = 64 + rand() % 16;
+    std::string data = createChunk("full", heights, nullptr);
+
+    // tags which are not rendered don't change the hash
+    nbt::NBTFile nbt;
+    nbt.readNBT(data.data(), data.size(), nbt::Compression::NO_COMPRESSION);
+    nbt.addTag("InhabitedTime", nbt::TagLong(123456));
+    nbt.addTag("block_entities", nbt::TagList(nbt::TagCompound::TAG_TYPE));
+    std::stringstream stream;
+    nbt.writeNBT(stream, nbt::Compression::NO_COMPRESSION);
+    std::string with_entities = stream.str();
+
+    heights[42]++;
+    std::string changed = createChunk("full", heights, nullptr);
+
+    uint64_t hash, hash_with_entities, hash_changed;
+    BOOST_REQUIRE(mc::Chunk::getContentHash(data.data(), data.size(),
+                                            nbt::Compression::NO_COMPRESSION, hash));
+    BOOST_REQUIRE(mc::Chunk::getContentHash(with_entities.data(), with_entities.size(),
+                                            nbt::Compression::NO_COMPRESSION,
+                                            hash_with_entities));
+    BOOST_REQUIRE(mc::Chunk::getContentHash(changed.data(), changed.size(),
+                                            nbt::Compression::NO_COMPRESSION, hash_changed));
+    BOOST_CHECK_NE(with_entities.size(), data.size());
+    BOOST_CHECK_EQUAL(hash_with_entities, hash);
+    BOOST_CHECK_NE(hash_changed, hash);
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testSigns) {
+    mc::BlockStateRegistry block_registry;
+    int heights[256];
+    for (int i = 0; i < 256; i++)
+        heights[i] = 64;
+    std::string data = createChunk("full", heights, nullptr);
+
+    // a sign and another block entity
+    nbt::NBTFile nbt;
+    nbt.readNBT(data.data(), data.size(), nbt::Compression::NO_COMPRESSION);
+    nbt::TagList block_entities(nbt::TagCompound::TAG_TYPE);
+    nbt::TagCompound sign;
+    sign.addTag("id", nbt::TagString("minecraft:sign"));
+    sign.addTag("x", nbt::TagInt(3));
+    sign.addTag("y", nbt::TagInt(65));
+    sign.addTag("z", nbt::TagInt(5));
+    sign.addTag("GlowingText", nbt::TagByte(0));
+    sign.addTag("Text1", nbt::TagString("{\"text\":\"[mark]\"}"));
+    sign.addTag("Text2", nbt::TagString("{\"text\":\"home\"}"));
+    sign.addTag("Text3", nbt::TagString("{\"text\":\"\"}"));
+    sign.addTag("Text4", nbt::TagString("{\"text\":\"\"}"));
+    block_entities.payload.push_back(nbt::TagPtr(sign.clone()));
+    nbt::TagCompound chest;
+    chest.addTag("id", nbt::TagString("minecraft:chest"));
+    chest.addTag("x", nbt::TagInt(1));
+    chest.addTag("y", nbt::TagInt(65));
+    chest.addTag("z", nbt::TagInt(1));
+    chest.addTag("Items", nbt::TagList(nbt::TagCompound::TAG_TYPE));
+    block_entities.payload.push_back(nbt::TagPtr(chest.clone()));
+    nbt.addTag("block_entities", block_entities);
+    std::stringstream stream;
+    nbt.writeNBT(stream, nbt::Compression::NO_COMPRESSION);
+    data = stream.str();
+
+    // the signs are read only if requested, the chunk is read the same way
+    mc::Chunk chunk, chunk_with_signs;
+    std::vector<mc::RawSign> signs;
+    BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+                                nbt::Compression::NO_COMPRESSION));
+    BOOST_REQUIRE(chunk_with_signs.readNBT(block_registry, data.data(), data.size(),
+                                           nbt::Compression::NO_COMPRESSION, &signs));
+    BOOST_CHECK_EQUAL(chunk.getHighestBlock(mc::LocalBlockPos(7, 7, 0)),
+                      chunk_with_signs.getHighestBlock(mc::LocalBlockPos(7, 7, 0)));
+
+    BOOST_REQUIRE_EQUAL(signs.size(), 1);
+    BOOST_CHECK_EQUAL(signs[0].pos, mc::BlockPos(3, 5, 65));
+    mc::SignEntity entity(signs[0].pos, signs[0].lines);
+    BOOST_CHECK_EQUAL(entity.getText(), "[mark] home");
+}
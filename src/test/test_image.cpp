@@ -17,6 +17,7 @@
  * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../mapcraftercore/renderer/blockimages.h"
 #include "../mapcraftercore/renderer/image.h"
 
 #include <boost/test/unit_test.hpp>
@@ -50,3 +51,39 @@ BOOST_AUTO_TEST_CASE(image_testIO) {
         }
     }
 }
+
+BOOST_AUTO_TEST_CASE(image_testFaceSpans) {
+    const uint8_t faces[] = {renderer::FACE_LEFT_INDEX, renderer::FACE_RIGHT_INDEX,
+                             renderer::FACE_UP_INDEX, 0};
+    renderer::RGBAImage uv(24, 25);
+    for (size_t i = 0; i < uv.data.size(); i++)
+        uv.data[i] = renderer::rgba(rand() % 256, rand() % 256, faces[rand() % 4], 255);
+
+    // every pixel of a face is in exactly one span of the face
+    std::array<renderer::PixelSpans, 3> face_spans = renderer::blockImageGetFaceSpans(uv);
+    std::vector<int> face_of(uv.data.size(), 3);
+    for (int i = 0; i < 3; i++) {
+        for (const auto &span : face_spans[i]) {
+            BOOST_CHECK_LT(span.first, span.second);
+            for (uint32_t j = span.first; j < span.second; j++) {
+                BOOST_CHECK_EQUAL(face_of[j], 3);
+                face_of[j] = i;
+            }
+        }
+    }
+    for (size_t i = 0; i < uv.data.size(); i++)
+        BOOST_CHECK_EQUAL(faces[face_of[i]], renderer::rgba_blue(uv.data[i]));
+
+    // the cached shadow edge factors give the same result as shading the image directly
+    renderer::RGBAImage block(24, 25), expected;
+    for (size_t i = 0; i < block.data.size(); i++)
+        block.data[i] = renderer::rgba(rand() % 256, rand() % 256, rand() % 256, 255);
+    expected = block;
+    renderer::blockImageShadowEdges(expected, uv, 2, 0, 4, 1, 6);
+    std::vector<uint8_t> factors;
+    renderer::blockImageShadowEdgeFactors(uv, 2, 0, 4, 1, 6, factors);
+    BOOST_REQUIRE_EQUAL(factors.size(), block.data.size());
+    for (size_t i = 0; i < block.data.size(); i++)
+        block.data[i] = renderer::rgba_multiply_scalar(block.data[i], factors[i]);
+    BOOST_CHECK(block.data == expected.data);
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/renderer/image/kernels.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+namespace renderer = mapcrafter::renderer;
+namespace util = mapcrafter::util;
+
+typedef std::vector<renderer::RGBAPixel> Pixels;
+
+namespace {
+
+std::vector<util::InstructionSet> getInstructionSets() {
+    std::vector<util::InstructionSet> sets;
+    for (auto set : {util::InstructionSet::SSE41, util::InstructionSet::AVX2})
+        if (util::isInstructionSetSupported(set))
+            sets.push_back(set);
+    return sets;
+}
+
+renderer::RGBAPixel randomPixel(uint8_t alpha) {
+    return renderer::rgba(rand() % 256, rand() % 256, rand() % 256, alpha);
+}
+
+// runs a kernel on a copy of the pixels with the scalar and each SIMD implementation
+// and checks that the results are the same
+void checkKernel(const Pixels &pixels,
+                 const std::function<void(const renderer::ImageKernels &, Pixels &)> &run) {
+    Pixels expected = pixels;
+    run(renderer::getImageKernels(util::InstructionSet::SCALAR), expected);
+    for (util::InstructionSet set : getInstructionSets()) {
+        BOOST_TEST_CONTEXT(util::getInstructionSetName(set)) {
+            Pixels result = pixels;
+            run(renderer::getImageKernels(set), result);
+            for (size_t i = 0; i < pixels.size(); i++)
+                BOOST_REQUIRE_EQUAL(result[i], expected[i]);
+        }
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(imagekernels_testBlend) {
+    // every combination of source and destination alpha, with a few colors each
+    // (an odd count of pixels so the scalar rest of the SIMD versions is used too)
+    Pixels dest, source;
+    for (int sa = 0; sa < 256; sa++) {
+        for (int da = 0; da < 256; da++) {
+            for (int i = 0; i < 4; i++) {
+                dest.push_back(randomPixel(da));
+                source.push_back(randomPixel(sa));
+            }
+            dest.push_back(renderer::rgba(255, 255, 255, da));
+            source.push_back(renderer::rgba(0, 0, 0, sa));
+        }
+    }
+    dest.push_back(randomPixel(128));
+    source.push_back(randomPixel(128));
+
+    checkKernel(dest, [&source](const renderer::ImageKernels &kernels, Pixels &out) {
+        kernels.blend(out.data(), source.data(), out.size());
+    });
+    checkKernel(dest, [&source](const renderer::ImageKernels &kernels, Pixels &out) {
+        kernels.alphaCopy(out.data(), source.data(), out.size());
+    });
+    renderer::RGBAPixel color = randomPixel(255);
+    checkKernel(dest, [&source, color](const renderer::ImageKernels &kernels, Pixels &out) {
+        kernels.tintMask(out.data(), source.data(), out.size(), color);
+    });
+
+    // blend() is still the reference for single pixels
+    Pixels blended = dest;
+    renderer::getImageKernels().blend(blended.data(), source.data(), blended.size());
+    for (size_t i = 0; i < dest.size(); i++) {
+        renderer::blend(dest[i], source[i]);
+        BOOST_REQUIRE_EQUAL(blended[i], dest[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(imagekernels_testMultiplyFaces) {
+    const uint8_t faces[3] = {42, 127, 85};
+    // every uv coordinate on every face (and a face that isn't one of the three)
+    Pixels pixels, uv;
+    for (int face : {42, 85, 127, 200}) {
+        for (int u = 0; u < 256; u++) {
+            for (int v = 0; v < 256; v++) {
+                pixels.push_back(randomPixel(rand() % 256));
+                uv.push_back(renderer::rgba(u, v, face, rand() % 4 == 0 ? 0 : 255));
+            }
+        }
+    }
+    pixels.push_back(randomPixel(255));
+    uv.push_back(renderer::rgba(1, 2, 42, 255));
+
+    // factors from 0 to 255 and some out of range ones
+    for (uint32_t max : {256, 1024}) {
+        uint32_t factors[3][4];
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 4; j++)
+                factors[i][j] = rand() % max;
+        checkKernel(pixels, [&](const renderer::ImageKernels &kernels, Pixels &out) {
+            kernels.multiplyFaces(out.data(), uv.data(), out.size(), faces, factors);
+        });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(imagekernels_testTint) {
+    // every channel value, with transparent pixels in between
+    Pixels pixels;
+    for (int c = 0; c < 256; c++) {
+        pixels.push_back(renderer::rgba(c, 255 - c, c, rand() % 256));
+        pixels.push_back(renderer::rgba(c, c, 255 - c, 0));
+    }
+    pixels.push_back(randomPixel(255));
+
+    for (int c = 0; c < 256; c++) {
+        renderer::RGBAPixel color = renderer::rgba(c, (c + 85) % 256, 255 - c, rand() % 256);
+        checkKernel(pixels, [color](const renderer::ImageKernels &kernels, Pixels &out) {
+            kernels.tint(out.data(), out.size(), color);
+        });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(imagekernels_testAddClamp) {
+    Pixels pixels, uv;
+    for (int c = 0; c < 256; c++) {
+        pixels.push_back(renderer::rgba(c, 255 - c, c, rand() % 256));
+        pixels.push_back(renderer::rgba(c, c, 255 - c, 0));
+        uv.push_back(renderer::rgba(0, 0, rand() % 2 ? 42 : 85, 255));
+        uv.push_back(renderer::rgba(0, 0, rand() % 2 ? 42 : 85, 255));
+    }
+    pixels.push_back(randomPixel(255));
+    uv.push_back(renderer::rgba(0, 0, 42, 255));
+
+    for (int value = -256; value <= 256; value++) {
+        checkKernel(pixels, [value](const renderer::ImageKernels &kernels, Pixels &out) {
+            kernels.addClamp(out.data(), out.size(), value, -value, value / 2);
+        });
+        checkKernel(pixels, [&uv, value](const renderer::ImageKernels &kernels, Pixels &out) {
+            kernels.addClampFace(out.data(), uv.data(), out.size(), 42, value, -value,
+                                 value / 2);
+        });
+    }
+}
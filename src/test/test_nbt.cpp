@@ -17,11 +17,15 @@
  * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../mapcraftercore/mc/compression.h"
 #include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/nbtreader.h"
 
 #include <boost/test/unit_test.hpp>
 #include <map>
+#include <memory>
 #include <sstream>
+#include <string>
 #include <vector>
 
 namespace nbt = mapcrafter::mc::nbt;
@@ -105,3 +109,164 @@ BOOST_AUTO_TEST_CASE(nbt_testIO) {
         BOOST_CHECK(intarray_data == in.findTag<nbt::TagIntArray>("intarray").payload);
     }
 }
+
+BOOST_AUTO_TEST_CASE(nbt_testReader) {
+    std::vector<int64_t> longarray_data = {1, -1, 1LL << 40, -(1LL << 50)};
+    std::vector<std::string> list_data = {"skip", "these", "strings"};
+
+    nbt::NBTFile out("TestNBTFile");
+    nbt::TagCompound nested;
+    nested.addTag("string", nbt::TagString("not needed"));
+    nested.addTag("nested", nbt::TagCompound());
+    nbt::TagList list(nbt::TagString::TAG_TYPE);
+    for (size_t i = 0; i < list_data.size(); i++)
+        list.payload.push_back(nbt::TagPtr(new nbt::TagString(list_data[i])));
+    nested.addTag("list", list);
+    out.addTag("a_nested", nested);
+    out.addTag("b_int", nbt::TagInt(-23));
+    out.addTag("c_list", list);
+    out.addTag("d_longarray", nbt::TagLongArray(longarray_data));
+    out.addTag("e_string", nbt::TagString("foobar"));
+
+    std::stringstream stream;
+    out.writeNBT(stream, nbt::Compression::ZLIB);
+    std::string compressed = stream.str();
+
+    nbt::ByteBuffer buffer;
+    nbt::decompress(compressed.data(), compressed.size(), nbt::Compression::ZLIB, buffer);
+    nbt::NBTReader reader(buffer.data(), buffer.size());
+    BOOST_CHECK_EQUAL(reader.readRoot(), "TestNBTFile");
+
+    // tags of a compound are written ordered by name
+    int8_t type;
+    std::string_view name;
+    BOOST_REQUIRE(reader.readTagHeader(type, name));
+    BOOST_CHECK_EQUAL(name, "a_nested");
+    BOOST_CHECK(type == nbt::TagCompound::TAG_TYPE);
+    reader.skip(type);
+
+    BOOST_REQUIRE(reader.readTagHeader(type, name));
+    BOOST_CHECK_EQUAL(name, "b_int");
+    BOOST_CHECK_EQUAL(reader.readInt(), -23);
+
+    BOOST_REQUIRE(reader.readTagHeader(type, name));
+    BOOST_CHECK_EQUAL(name, "c_list");
+    nbt::ListView list_view = reader.readList();
+    BOOST_CHECK(list_view.tag_type == nbt::TagString::TAG_TYPE);
+    BOOST_CHECK_EQUAL(list_view.size, list_data.size());
+    size_t offset = reader.tell();
+
+    BOOST_REQUIRE(reader.readTagHeader(type, name));
+    BOOST_CHECK_EQUAL(name, "d_longarray");
+    nbt::ArrayView<int64_t> longarray = reader.readLongArray();
+    BOOST_REQUIRE_EQUAL(longarray.size, longarray_data.size());
+    for (size_t i = 0; i < longarray_data.size(); i++)
+        BOOST_CHECK_EQUAL(longarray[i], longarray_data[i]);
+
+    BOOST_REQUIRE(reader.readTagHeader(type, name));
+    BOOST_CHECK_EQUAL(name, "e_string");
+    BOOST_CHECK_EQUAL(reader.readString(), "foobar");
+    BOOST_CHECK(!reader.readTagHeader(type, name));
+
+    // go back to the elements of the skipped list
+    reader.seek(list_view.offset);
+    for (size_t i = 0; i < list_data.size(); i++)
+        BOOST_CHECK_EQUAL(reader.readString(), list_data[i]);
+    BOOST_CHECK_EQUAL(reader.tell(), offset);
+
+    // reading beyond the end of the data is an error
+    nbt::NBTReader truncated(buffer.data(), buffer.size() / 2);
+    truncated.readRoot();
+    BOOST_CHECK_THROW(truncated.skip(nbt::TagCompound::TAG_TYPE), nbt::NBTError);
+}
+
+BOOST_AUTO_TEST_CASE(nbt_testDecompressors) {
+    nbt::NBTFile out("TestNBTFile");
+    std::vector<int32_t> intarray_data(100000);
+    for (size_t i = 0; i < intarray_data.size(); i++)
+        intarray_data[i] = i % 1000;
+    out.addTag("intarray", nbt::TagIntArray(intarray_data));
+    out.addTag("string", nbt::TagString("foobar"));
+
+    std::stringstream uncompressed_stream, gzip_stream, zlib_stream;
+    out.writeNBT(uncompressed_stream, nbt::Compression::NO_COMPRESSION);
+    out.writeNBT(gzip_stream, nbt::Compression::GZIP);
+    out.writeNBT(zlib_stream, nbt::Compression::ZLIB);
+    std::string uncompressed = uncompressed_stream.str();
+    std::string gzip = gzip_stream.str();
+    std::string zlib = zlib_stream.str();
+
+    std::vector<std::string> names = nbt::getDecompressors();
+    BOOST_REQUIRE(!names.empty());
+    BOOST_CHECK(nbt::createDecompressor("unknown") == nullptr);
+    for (auto it = names.begin(); it != names.end(); ++it) {
+        BOOST_TEST_MESSAGE("Testing decompressor " + *it + ".");
+        std::unique_ptr<nbt::Decompressor> decompressor = nbt::createDecompressor(*it);
+        BOOST_REQUIRE(decompressor);
+        BOOST_CHECK_EQUAL(decompressor->getName(), *it);
+
+        // the buffer is reused, make sure it's resized correctly every time
+        nbt::ByteBuffer buffer;
+        for (int i = 0; i < 2; i++) {
+            decompressor->decompress(gzip.data(), gzip.size(), nbt::Compression::GZIP, buffer);
+            BOOST_CHECK(std::string(buffer.begin(), buffer.end()) == uncompressed);
+            decompressor->decompress(zlib.data(), zlib.size(), nbt::Compression::ZLIB, buffer);
+            BOOST_CHECK(std::string(buffer.begin(), buffer.end()) == uncompressed);
+            decompressor->decompress(uncompressed.data(), uncompressed.size(),
+                                     nbt::Compression::NO_COMPRESSION, buffer);
+            BOOST_CHECK(std::string(buffer.begin(), buffer.end()) == uncompressed);
+        }
+
+        std::string garbage(1000, 'x');
+        BOOST_CHECK_THROW(decompressor->decompress(garbage.data(), garbage.size(),
+                                                   nbt::Compression::ZLIB, buffer),
+                          nbt::NBTError);
+        BOOST_CHECK_THROW(
+            decompressor->decompress(zlib.data(), zlib.size() / 2, nbt::Compression::ZLIB, buffer),
+            nbt::NBTError);
+    }
+}
+
+namespace {
+
+void appendLZ4Block(std::string &data, uint8_t method, const std::string &block,
+                    uint32_t size) {
+    data += "LZ4Block";
+    data += char(method);
+    uint32_t header[3] = {uint32_t(block.size()), size, 0};
+    for (size_t i = 0; i < 3; i++)
+        for (size_t j = 0; j < 4; j++)
+            data += char((header[i] >> (8 * j)) & 0xff);
+    data += block;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(nbt_testLZ4) {
+    // "abc" as literals, a match of 12 bytes at offset 3 (overlapping the bytes it
+    // produces), "defgh" as literals at the end
+    std::string block = {0x38, 'a', 'b', 'c', 0x03, 0x00, 0x50, 'd', 'e', 'f', 'g', 'h'};
+    std::string data;
+    appendLZ4Block(data, 0x20, block, 20);
+    appendLZ4Block(data, 0x10, "xyz", 3);
+    appendLZ4Block(data, 0x10, "", 0);
+
+    nbt::ByteBuffer buffer;
+    nbt::decompress(data.data(), data.size(), nbt::Compression::LZ4, buffer);
+    BOOST_CHECK_EQUAL(std::string(buffer.begin(), buffer.end()), "abcabcabcabcabcdefghxyz");
+
+    // match offset points before the start of the data
+    std::string invalid_block = {0x38, 'a', 'b', 'c', 0x04, 0x00, 0x50, 'd', 'e', 'f', 'g', 'h'};
+    std::string invalid;
+    appendLZ4Block(invalid, 0x20, invalid_block, 20);
+    BOOST_CHECK_THROW(
+        nbt::decompress(invalid.data(), invalid.size(), nbt::Compression::LZ4, buffer),
+        nbt::NBTError);
+
+    // decompressed size doesn't match
+    invalid.clear();
+    appendLZ4Block(invalid, 0x20, block, 21);
+    BOOST_CHECK_THROW(
+        nbt::decompress(invalid.data(), invalid.size(), nbt::Compression::LZ4, buffer),
+        nbt::NBTError);
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/mc/packedarray.h"
+
+#include <array>
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <vector>
+
+namespace mc = mapcrafter::mc;
+namespace util = mapcrafter::util;
+
+namespace {
+
+// the unpacking code mapcrafter had before the unpack functions, as reference
+
+void readPackedShorts(const std::vector<int64_t> &data, std::array<uint16_t, 4096> &palette) {
+    const uint8_t *b = reinterpret_cast<const uint8_t *>(&data.front());
+    int bits_per_entry = data.size() * 64 / (16 * 16 * 16);
+
+    unsigned int i = 0, j = 0;
+    while (i < data.size() * sizeof(int64_t)) {
+        if (bits_per_entry == 4) {
+            for (int k = 0; k < 4; k++) {
+                palette[j++] = b[i + k] & 0x0f;
+                palette[j++] = (b[i + k] & 0xf0) >> 4;
+            }
+            i += 4;
+        }
+        if (bits_per_entry == 5) {
+            palette[j++] = b[i] & 0x1f;
+            palette[j++] = ((b[i + 1] & 0x03) << 3) | ((b[i] & 0xe0) >> 5);
+            palette[j++] = (b[i + 1] & 0x7c) >> 2;
+            palette[j++] = ((b[i + 2] & 0x0f) << 1) | ((b[i + 1] & 0x80) >> 7);
+            palette[j++] = ((b[i + 3] & 0x01) << 4) | ((b[i + 2] & 0xf0) >> 4);
+            palette[j++] = (b[i + 3] & 0x3e) >> 1;
+            palette[j++] = ((b[i + 4] & 0x07) << 2) | ((b[i + 3] & 0xc0) >> 6);
+            palette[j++] = (b[i + 4] & 0xf8) >> 3;
+            i += 5;
+        }
+        if (bits_per_entry == 6) {
+            palette[j++] = b[i] & 0x3f;
+            palette[j++] = ((b[i + 1] & 0x0f) << 2) | ((b[i] & 0xc0) >> 6);
+            palette[j++] = ((b[i + 2] & 0x03) << 4) | ((b[i + 1] & 0xf0) >> 4);
+            palette[j++] = (b[i + 2] & 0xfc) >> 2;
+            i += 3;
+        }
+        if (bits_per_entry == 7) {
+            palette[j++] = b[i] & 0x7f;
+            palette[j++] = ((b[i + 1] & 0x3f) << 1) | ((b[i] & 0x80) >> 7);
+            palette[j++] = ((b[i + 2] & 0x1f) << 2) | ((b[i + 1] & 0xc0) >> 6);
+            palette[j++] = ((b[i + 3] & 0x0f) << 3) | ((b[i + 2] & 0xe0) >> 5);
+            palette[j++] = ((b[i + 4] & 0x07) << 4) | ((b[i + 3] & 0xf0) >> 4);
+            palette[j++] = ((b[i + 5] & 0x03) << 5) | ((b[i + 4] & 0xf8) >> 3);
+            palette[j++] = ((b[i + 6] & 0x01) << 6) | ((b[i + 5] & 0xfc) >> 2);
+            palette[j++] = (b[i + 6] & 0xfe) >> 1;
+            i += 7;
+        }
+        if (bits_per_entry == 8) {
+            palette[j++] = b[i];
+            i += 1;
+        }
+    }
+}
+
+template <std::size_t PALETTE_SIZE>
+void readPackedShorts_v116(const std::vector<int64_t> &data,
+                           std::array<uint16_t, PALETTE_SIZE> &palette) {
+    uint32_t shorts_per_long = (PALETTE_SIZE + data.size() - 1) / data.size();
+    uint32_t bits_per_value = 64 / shorts_per_long;
+    palette.fill(0);
+    uint16_t mask = (1 << bits_per_value) - 1;
+
+    for (uint32_t i = 0; i < shorts_per_long; i++) {
+        uint32_t j = 0;
+        for (uint32_t k = i; k < PALETTE_SIZE; k += shorts_per_long) {
+            palette[k] = (uint16_t)(data[j] >> (bits_per_value * i)) & mask;
+            j++;
+        }
+    }
+}
+
+/**
+ * Packs values like Minecraft does.
+ */
+std::vector<int64_t> pack(mc::PackedFormat format, int bits,
+                          const std::vector<uint16_t> &values) {
+    std::vector<int64_t> longs(mc::getPackedLongs(format, bits, values.size()), 0);
+    int per_long = 64 / bits;
+    for (size_t i = 0; i < values.size(); i++) {
+        uint64_t value = values[i];
+        if (format == mc::PackedFormat::PADDED) {
+            longs[i / per_long] |= value << (bits * (i % per_long));
+        } else {
+            size_t bit = i * bits;
+            longs[bit / 64] |= value << (bit % 64);
+            if (bit % 64 + bits > 64)
+                longs[bit / 64 + 1] |= value >> (64 - bit % 64);
+        }
+    }
+    return longs;
+}
+
+std::vector<uint8_t> toBigEndian(const std::vector<int64_t> &longs) {
+    std::vector<uint8_t> bytes;
+    for (int64_t value : longs)
+        for (int i = 7; i >= 0; i--)
+            bytes.push_back((uint64_t)value >> (8 * i));
+    return bytes;
+}
+
+std::vector<uint16_t> randomValues(size_t count, int bits) {
+    std::vector<uint16_t> values(count);
+    for (size_t i = 0; i < count; i++)
+        values[i] = rand() & ((1 << bits) - 1);
+    return values;
+}
+
+std::vector<util::InstructionSet> getInstructionSets() {
+    std::vector<util::InstructionSet> sets;
+    for (auto set : {util::InstructionSet::SCALAR, util::InstructionSet::SSE41,
+                     util::InstructionSet::AVX2})
+        if (util::isInstructionSetSupported(set))
+            sets.push_back(set);
+    return sets;
+}
+
+void testUnpack(mc::PackedFormat format, int bits, size_t count) {
+    std::vector<uint16_t> indices = randomValues(count, bits);
+    std::vector<uint16_t> lookup = randomValues(1 << bits, 16);
+    std::vector<uint8_t> data = toBigEndian(pack(format, bits, indices));
+
+    uint16_t max_index = 0;
+    for (uint16_t index : indices)
+        max_index = std::max(max_index, index);
+
+    for (util::InstructionSet set : getInstructionSets()) {
+        BOOST_TEST_CONTEXT("bits " << bits << ", count " << count << ", "
+                                   << util::getInstructionSetName(set)) {
+            mc::UnpackFunction unpack = mc::getUnpackFunction(format, bits, count, set);
+            BOOST_REQUIRE(unpack != nullptr);
+
+            std::vector<uint16_t> out(count);
+            BOOST_CHECK_EQUAL(unpack(data.data(), lookup.data(), out.data()), max_index);
+            for (size_t i = 0; i < count; i++)
+                BOOST_REQUIRE_EQUAL(out[i], lookup[indices[i]]);
+
+            unpack(data.data(), mc::getIdentityLookup(), out.data());
+            BOOST_CHECK(out == indices);
+        }
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(packedarray_testUnpack) {
+    for (int bits = 1; bits <= 16; bits++) {
+        testUnpack(mc::PackedFormat::PADDED, bits, 4096);
+        testUnpack(mc::PackedFormat::PADDED, bits, 64);
+        testUnpack(mc::PackedFormat::SPANNING, bits, 4096);
+        testUnpack(mc::PackedFormat::SPANNING, bits, 64);
+    }
+
+    BOOST_CHECK(mc::getUnpackFunction(mc::PackedFormat::PADDED, 0, 4096) == nullptr);
+    BOOST_CHECK(mc::getUnpackFunction(mc::PackedFormat::PADDED, 17, 4096) == nullptr);
+    BOOST_CHECK(mc::getUnpackFunction(mc::PackedFormat::PADDED, 4, 100) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(packedarray_testMaxIndex) {
+    // the SIMD versions determine the maximum differently, make sure every position counts
+    std::vector<uint16_t> indices(4096, 0);
+    for (size_t i = 0; i < 4096; i += 509) {
+        indices[i] = 5 + i % 11;
+        std::vector<uint8_t> data = toBigEndian(pack(mc::PackedFormat::PADDED, 4, indices));
+        for (util::InstructionSet set : getInstructionSets()) {
+            std::vector<uint16_t> out(4096);
+            auto unpack = mc::getUnpackFunction(mc::PackedFormat::PADDED, 4, 4096, set);
+            BOOST_CHECK_EQUAL(unpack(data.data(), mc::getIdentityLookup(), out.data()),
+                              indices[i]);
+        }
+        indices[i] = 0;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(packedarray_testReference) {
+    // compare with the old implementations for the bit widths they support
+    for (int bits = 1; bits <= 16; bits++) {
+        // the old implementation guesses the bit width from the count of longs, which
+        // doesn't work for 11 and 13-15 bits
+        if (bits == 11 || (bits >= 13 && bits <= 15))
+            continue;
+
+        std::vector<uint16_t> indices = randomValues(4096, bits);
+        std::vector<int64_t> longs = pack(mc::PackedFormat::PADDED, bits, indices);
+        std::array<uint16_t, 4096> expected;
+        readPackedShorts_v116(longs, expected);
+
+        std::vector<uint8_t> data = toBigEndian(longs);
+        std::array<uint16_t, 4096> out;
+        mc::getUnpackFunction(mc::PackedFormat::PADDED, bits, 4096)(
+            data.data(), mc::getIdentityLookup(), out.data());
+        BOOST_CHECK_MESSAGE(out == expected, "padded with " << bits << " bits");
+    }
+
+    for (int bits = 1; bits <= 6; bits++) {
+        // same problem with 3 and 5 bits for biomes
+        if (bits == 3 || bits == 5)
+            continue;
+
+        std::vector<uint16_t> indices = randomValues(64, bits);
+        std::vector<int64_t> longs = pack(mc::PackedFormat::PADDED, bits, indices);
+        std::array<uint16_t, 64> expected;
+        readPackedShorts_v116(longs, expected);
+
+        std::vector<uint8_t> data = toBigEndian(longs);
+        std::array<uint16_t, 64> out;
+        mc::getUnpackFunction(mc::PackedFormat::PADDED, bits, 64)(
+            data.data(), mc::getIdentityLookup(), out.data());
+        BOOST_CHECK_MESSAGE(out == expected, "biomes with " << bits << " bits");
+    }
+
+    // the old implementation of the spanning format reads the longs byte by byte in
+    // machine order and handled only up to 8 bits correctly
+    int64_t one = 1;
+    if (*reinterpret_cast<uint8_t *>(&one) != 1)
+        return;
+    for (int bits = 4; bits <= 8; bits++) {
+        std::vector<uint16_t> indices = randomValues(4096, bits);
+        std::vector<int64_t> longs = pack(mc::PackedFormat::SPANNING, bits, indices);
+        std::array<uint16_t, 4096> expected;
+        readPackedShorts(longs, expected);
+
+        std::vector<uint8_t> data = toBigEndian(longs);
+        std::array<uint16_t, 4096> out;
+        mc::getUnpackFunction(mc::PackedFormat::SPANNING, bits, 4096)(
+            data.data(), mc::getIdentityLookup(), out.data());
+        BOOST_CHECK_MESSAGE(out == expected, "spanning with " << bits << " bits");
+    }
+}
@@ -22,11 +22,15 @@
 #include "../mapcraftercore/mc/region.h"
 #include "../mapcraftercore/util.h"
 
+#include <algorithm>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <string>
 
+namespace fs = boost::filesystem;
 namespace mc = mapcrafter::mc;
 
 BOOST_AUTO_TEST_CASE(region_testReadWrite) {
@@ -48,8 +52,74 @@ BOOST_AUTO_TEST_CASE(region_testReadWrite) {
     for (; it1 != chunks1.end() && it2 != chunks2.end(); ++it1, ++it2) {
         BOOST_CHECK_EQUAL(*it1, *it2);
 
+        mc::ChunkDataView data1 = in1.getChunkData(*it1);
+        mc::ChunkDataView data2 = in2.getChunkData(*it2);
+        BOOST_CHECK(!data1.empty());
+        BOOST_CHECK_EQUAL(data1.size, data2.size);
+        BOOST_CHECK_EQUAL(data1.compression, data2.compression);
+        BOOST_CHECK(std::equal(data1.data, data1.data + data1.size, data2.data));
+
         mc::Chunk chunk1, chunk2;
         BOOST_CHECK(in1.loadChunk(*it1, block_registry, chunk1));
         BOOST_CHECK(in2.loadChunk(*it2, block_registry, chunk2));
     }
 }
+
+BOOST_AUTO_TEST_CASE(region_testExternalChunks) {
+    mc::BlockStateRegistry block_registry;
+
+    mc::RegionFile in("data/region/r.-1.0.mca");
+    BOOST_REQUIRE(in.read());
+    mc::ChunkPos pos = *in.getContainingChunks().begin();
+    mc::ChunkDataView data = in.getChunkData(pos);
+    BOOST_REQUIRE(!data.empty());
+
+    // a region file with only this chunk, which is stored in an external file
+    fs::path dir = "data/external";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string region(8192 + 4096, '\0');
+    size_t index = pos.getLocalZ() * 32 + pos.getLocalX();
+    region[4 * index + 2] = 2; // offset in sectors
+    region[4 * index + 3] = 1; // sector count
+    region[8192 + 3] = 1;      // data size
+    region[8192 + 4] = mc::RegionFile::COMPRESSION_EXTERNAL | data.compression;
+    std::ofstream((dir / "r.-1.0.mca").string(), std::ios::binary) << region;
+
+    mc::RegionFile external((dir / "r.-1.0.mca").string());
+    BOOST_REQUIRE(external.read());
+    BOOST_CHECK_EQUAL(external.getContainingChunksCount(), 1);
+    // the external file doesn't exist yet
+    BOOST_CHECK(external.getChunkData(pos).empty());
+
+    std::string filename = "c." + mapcrafter::util::str(pos.x) + "." +
+                           mapcrafter::util::str(pos.z) + ".mcc";
+    std::ofstream((dir / filename).string(), std::ios::binary)
+        .write(reinterpret_cast<const char *>(data.data), data.size);
+
+    mc::ChunkDataView external_data = external.getChunkData(pos);
+    BOOST_CHECK_EQUAL(external_data.size, data.size);
+    BOOST_CHECK_EQUAL(external_data.compression, data.compression);
+    BOOST_CHECK(std::equal(data.data, data.data + data.size, external_data.data));
+
+    mc::Chunk chunk1, chunk2;
+    BOOST_CHECK_EQUAL(in.loadChunk(pos, block_registry, chunk1),
+                      external.loadChunk(pos, block_registry, chunk2));
+    fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(region_testCompressionTypes) {
+    mc::ChunkDataView data;
+    mc::nbt::Compression compression;
+    data.compression = mc::RegionFile::COMPRESSION_GZIP;
+    BOOST_CHECK(data.getCompression(compression) && compression == mc::nbt::Compression::GZIP);
+    data.compression = mc::RegionFile::COMPRESSION_ZLIB;
+    BOOST_CHECK(data.getCompression(compression) && compression == mc::nbt::Compression::ZLIB);
+    data.compression = mc::RegionFile::COMPRESSION_NONE;
+    BOOST_CHECK(data.getCompression(compression) &&
+                compression == mc::nbt::Compression::NO_COMPRESSION);
+    data.compression = mc::RegionFile::COMPRESSION_LZ4;
+    BOOST_CHECK(data.getCompression(compression) && compression == mc::nbt::Compression::LZ4);
+    data.compression = 127;
+    BOOST_CHECK(!data.getCompression(compression));
+}
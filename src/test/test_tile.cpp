@@ -17,11 +17,28 @@
  * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/region.h"
+#include "../mapcraftercore/mc/world.h"
+#include "../mapcraftercore/renderer/blockimages.h"
+#include "../mapcraftercore/renderer/renderviews/topdown/tileset.h"
+#include "../mapcraftercore/renderer/tilerenderer.h"
 #include "../mapcraftercore/renderer/tileset.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
 #include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
 
+namespace fs = boost::filesystem;
+namespace mc = mapcrafter::mc;
+namespace nbt = mapcrafter::mc::nbt;
 namespace renderer = mapcrafter::renderer;
 
 #define PATH(a, b, c, d) ((((renderer::TilePath() + a) + b) + c) + d)
@@ -51,3 +68,288 @@ BOOST_AUTO_TEST_CASE(test_tilepos) {
     }
     BOOST_CHECK_EQUAL(paths.size(), 256);
 }
+
+BOOST_AUTO_TEST_CASE(test_tilesetIndex) {
+    mc::World world("data");
+    BOOST_REQUIRE(world.load());
+
+    renderer::TopdownTileSet tile_set(1);
+    tile_set.scan(world);
+    BOOST_CHECK_GT(tile_set.getRequiredRenderTilesCount(), 0);
+    fs::path index_file = fs::temp_directory_path() / fs::unique_path();
+    BOOST_REQUIRE(tile_set.writeIndex(index_file, 42));
+    BOOST_CHECK(!fs::exists(index_file.string() + ".tmp"));
+
+    // the tiles of the unchanged region are read from the index
+    renderer::TopdownTileSet indexed(1);
+    BOOST_CHECK(!indexed.readIndex(index_file, 43));
+    BOOST_CHECK(indexed.readIndex(index_file, 42));
+    indexed.scan(world);
+    BOOST_CHECK(indexed.getRequiredRenderTiles() == tile_set.getRequiredRenderTiles());
+    BOOST_CHECK_EQUAL(indexed.getDepth(), tile_set.getDepth());
+    fs::remove(index_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_tilesetRescan) {
+    fs::path world_dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(world_dir / "region");
+    auto writeRegion = [&](int region_x, uint32_t timestamp) {
+        fs::path region_file =
+            world_dir / "region" / ("r." + std::to_string(region_x) + ".0.mca");
+        mc::RegionFile region(region_file.string());
+        for (int i = 0; i < 4; i++) {
+            mc::ChunkPos chunk(region_x * 32 + i * 3, i * 5);
+            region.setChunkData(chunk, std::vector<uint8_t>(100, 0),
+                                mc::RegionFile::COMPRESSION_NONE);
+            region.setChunkTimestamp(chunk, timestamp);
+        }
+        BOOST_REQUIRE(region.write());
+    };
+    writeRegion(0, 1000);
+    writeRegion(1, 1000);
+
+    // a tile set which is scanned again (like in watch mode) after a region was removed
+    // and the other one was changed must have the same tiles as a new one
+    renderer::TilePos tile_offset(2, 3);
+    mc::World world(world_dir.string());
+    BOOST_REQUIRE(world.load());
+    renderer::TopdownTileSet tile_set(1);
+    tile_set.scan(world, false, tile_offset);
+
+    fs::remove(world_dir / "region" / "r.1.0.mca");
+    writeRegion(0, 500);
+    mc::World changed_world(world_dir.string());
+    BOOST_REQUIRE(changed_world.load());
+    tile_set.scan(changed_world, false, tile_offset);
+    renderer::TopdownTileSet new_tile_set(1);
+    new_tile_set.scan(changed_world, false, tile_offset);
+
+    tile_set.resetRequired();
+    new_tile_set.resetRequired();
+    BOOST_CHECK_GT(new_tile_set.getRequiredRenderTilesCount(), 0);
+    BOOST_CHECK(tile_set.getRequiredRenderTiles() == new_tile_set.getRequiredRenderTiles());
+    tile_set.scanRequiredByTimestamp(800);
+    new_tile_set.scanRequiredByTimestamp(800);
+    BOOST_CHECK_EQUAL(new_tile_set.getRequiredRenderTilesCount(), 0);
+    BOOST_CHECK(tile_set.getRequiredRenderTiles() == new_tile_set.getRequiredRenderTiles());
+    fs::remove_all(world_dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_tilesetIndexUnreadableRegion) {
+    fs::path world_dir = fs::temp_directory_path() / fs::unique_path();
+    fs::path region_file = world_dir / "region" / "r.0.0.mca";
+    fs::create_directories(region_file.parent_path());
+    mc::RegionFile region(region_file.string());
+    region.setChunkData(mc::ChunkPos(0, 0), std::vector<uint8_t>(100, 0),
+                        mc::RegionFile::COMPRESSION_NONE);
+    BOOST_REQUIRE(region.write());
+    std::time_t mtime = fs::last_write_time(region_file) - 100;
+
+    // a region which can't be read temporarily (here: the offset of its chunk is out of
+    // the file), but has the same size and modification time as the readable one
+    auto setChunkOffset = [&](uint8_t offset) {
+        std::fstream file(region_file.string(), std::ios::in | std::ios::out | std::ios::binary);
+        uint8_t location[4];
+        file.read(reinterpret_cast<char *>(location), 4);
+        location[0] = offset;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *>(location), 4);
+        file.close();
+        fs::last_write_time(region_file, mtime);
+    };
+    setChunkOffset(0x7f);
+
+    mc::World world(world_dir.string());
+    BOOST_REQUIRE(world.load());
+    renderer::TopdownTileSet tile_set(1);
+    tile_set.scan(world);
+    BOOST_CHECK_EQUAL(tile_set.getRequiredRenderTilesCount(), 0);
+    fs::path index_file = world_dir / "index.dat";
+    BOOST_REQUIRE(tile_set.writeIndex(index_file, 42));
+
+    // the region is read again, its failed read is not remembered in the index
+    setChunkOffset(0);
+    renderer::TopdownTileSet indexed(1);
+    BOOST_CHECK(indexed.readIndex(index_file, 42));
+    indexed.scan(world);
+    BOOST_CHECK_GT(indexed.getRequiredRenderTilesCount(), 0);
+    fs::remove_all(world_dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_chunkHashesUnmodifiedRegion) {
+    fs::path world_dir = fs::temp_directory_path() / fs::unique_path();
+    fs::path region_file = world_dir / "region" / "r.0.0.mca";
+    fs::create_directories(region_file.parent_path());
+    std::time_t now = std::time(nullptr);
+    mc::RegionFile region(region_file.string());
+    for (int x = 0; x < 2; x++) {
+        nbt::NBTFile root("");
+        root.addTag("DataVersion", nbt::TagInt(2975));
+        root.addTag("xPos", nbt::TagInt(x));
+        root.addTag("zPos", nbt::TagInt(0));
+        std::stringstream stream;
+        root.writeNBT(stream, nbt::Compression::NO_COMPRESSION);
+        std::string data = stream.str();
+        region.setChunkData(mc::ChunkPos(x, 0), std::vector<uint8_t>(data.begin(), data.end()),
+                            mc::RegionFile::COMPRESSION_NONE);
+        region.setChunkTimestamp(mc::ChunkPos(x, 0), now - 100);
+    }
+    BOOST_REQUIRE(region.write());
+    fs::last_write_time(region_file, now - 100);
+
+    mc::World world(world_dir.string());
+    BOOST_REQUIRE(world.load());
+    renderer::TopdownTileSet tile_set(1);
+    tile_set.scan(world);
+    renderer::ChunkHashIndex index;
+    renderer::ChunkHashCache cache;
+    tile_set.scanRequiredByChunkHashes(world, 0, index, cache);
+    BOOST_CHECK_EQUAL(index.getHashes().size(), 2u);
+    std::map<mc::ChunkPos, uint64_t> hashes = index.getHashes();
+
+    // make the region unreadable without changing its modification time, it is not
+    // opened because it wasn't modified since the last rendering
+    {
+        std::fstream file(region_file.string(), std::ios::in | std::ios::out | std::ios::binary);
+        file.put(0x7f);
+    }
+    fs::last_write_time(region_file, now - 100);
+    renderer::ChunkHashCache other_cache;
+    tile_set.scanRequiredByChunkHashes(world, now, index, other_cache);
+    BOOST_CHECK_EQUAL(tile_set.getRequiredRenderTilesCount(), 0);
+    BOOST_CHECK(index.getHashes() == hashes);
+
+    // a modified region is opened again
+    fs::last_write_time(region_file, now + 100);
+    tile_set.scanRequiredByChunkHashes(world, now, index, other_cache);
+    BOOST_CHECK_GT(tile_set.getRequiredRenderTilesCount(), 0);
+    BOOST_CHECK(index.getHashes().empty());
+    fs::remove_all(world_dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_chunkHashIndex) {
+    std::map<mc::ChunkPos, uint64_t> hashes;
+    for (int i = 0; i < 100; i++)
+        hashes[mc::ChunkPos(i % 10 - 5, i / 10)] = i * 12345;
+    renderer::ChunkHashIndex index;
+    index.setHashes(hashes);
+    fs::path index_file = fs::temp_directory_path() / fs::unique_path();
+    BOOST_REQUIRE(index.write(index_file));
+    BOOST_CHECK(!fs::exists(index_file.string() + ".tmp"));
+
+    renderer::ChunkHashIndex read;
+    BOOST_REQUIRE(read.read(index_file));
+    BOOST_CHECK(read.getHashes() == hashes);
+
+    // a truncated file is ignored
+    fs::resize_file(index_file, fs::file_size(index_file) - 1);
+    BOOST_CHECK(!read.read(index_file));
+    BOOST_CHECK(read.getHashes().empty());
+
+    // and so is a file with a bogus count of chunks
+    BOOST_REQUIRE(index.write(index_file));
+    {
+        std::fstream file(index_file.string(), std::ios::in | std::ios::out | std::ios::binary);
+        uint32_t count = 0xffffffff;
+        file.seekp(8);
+        file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    }
+    BOOST_CHECK(!read.read(index_file));
+    fs::remove(index_file);
+
+    // hashes in the cache are valid only for the same timestamp
+    renderer::ChunkHashCache cache;
+    uint64_t hash;
+    cache.set(mc::ChunkPos(1, 2), 100, 42);
+    BOOST_CHECK(cache.get(mc::ChunkPos(1, 2), 100, hash));
+    BOOST_CHECK_EQUAL(hash, 42u);
+    BOOST_CHECK(!cache.get(mc::ChunkPos(1, 2), 101, hash));
+    BOOST_CHECK(!cache.get(mc::ChunkPos(2, 1), 100, hash));
+}
+
+BOOST_AUTO_TEST_CASE(test_tileImagesOrder) {
+    // the tile images must be composited exactly like when drawing all of them back to
+    // front from a std::set of TileImage (ordered by position and z-index, duplicates
+    // drawn once), even though hidden ones are skipped
+    const uint8_t alphas[] = {0, 128, 255, 255};
+    auto draw = [](const renderer::TileImage &tile_image, renderer::RGBAImage &image) {
+        // something that modifies the colors like the render modes do
+        image = tile_image.block_image->image;
+        for (size_t i = 0; i < image.data.size(); i++) {
+            image.data[i] ^= tile_image.id & 0xff;
+        }
+    };
+
+    renderer::TileImages tile_images;
+    for (int run = 0; run < 3; run++) {
+        std::vector<renderer::BlockImage> block_images(500);
+        std::set<renderer::TileImage> expected_order;
+        tile_images.clear();
+
+        // the last run uses coordinates that are too far apart to be radix sorted
+        int spread = run == 2 ? (1 << 30) : 8;
+        for (int i = 0; i < 500; i++) {
+            mc::BlockPos pos(rand() % spread - spread / 2, rand() % spread - spread / 2,
+                             rand() % 16 - 8);
+            if (run == 2 && i % 2 == 0) {
+                pos = mc::BlockPos(-spread, spread, 300);
+            }
+
+            renderer::BlockImage &block_image = block_images[i];
+            block_image.image.setSize(2, 2);
+            for (int j = 0; j < 4; j++) {
+                block_image.image.data[j] = renderer::rgba(rand() % 256, rand() % 256,
+                                                           rand() % 256, alphas[rand() % 4]);
+            }
+
+            renderer::TileImage tile_image;
+            tile_image.x = rand() % 5 - 1;
+            tile_image.y = rand() % 5 - 1;
+            tile_image.pos = pos;
+            tile_image.z_index = rand() % 2;
+            tile_image.id = i;
+            tile_image.block_image = &block_image;
+            expected_order.insert(tile_image);
+            tile_images.add(tile_image.x, tile_image.y, pos, tile_image.z_index, i, block_image);
+        }
+        BOOST_CHECK_EQUAL(tile_images.size(), 500u);
+
+        renderer::RGBAImage expected(4, 4), tile(4, 4);
+        for (auto it = expected_order.begin(); it != expected_order.end(); ++it) {
+            renderer::RGBAImage image;
+            draw(*it, image);
+            expected.alphaBlit(image, it->x, it->y);
+        }
+        tile_images.composite(tile, draw);
+        BOOST_CHECK(tile.data == expected.data);
+        BOOST_CHECK_GT(tile_images.getSkippedCount(), 500u - expected_order.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_spriteCache) {
+    renderer::SpriteCache cache(2);
+    renderer::RGBAImage *sprite, *first, *second;
+
+    // the sprites are identified by all parts of the key
+    BOOST_CHECK(!cache.get(1, 0, 0xff00ff00, 0, first));
+    BOOST_CHECK(!cache.get(1, 1, 0xff00ff00, 0, second));
+    BOOST_CHECK(first != second);
+    BOOST_CHECK(cache.get(1, 0, 0xff00ff00, 0, sprite));
+    BOOST_CHECK_EQUAL(sprite, first);
+    BOOST_CHECK_EQUAL(cache.size(), 2u);
+
+    // the least recently used sprite is evicted, its entry is reused
+    BOOST_CHECK(!cache.get(1, 0, 0xff00ff00, 0xffff0000, sprite));
+    BOOST_CHECK_EQUAL(sprite, second);
+    BOOST_CHECK_EQUAL(cache.size(), 2u);
+    BOOST_CHECK(cache.get(1, 0, 0xff00ff00, 0, sprite));
+    BOOST_CHECK(!cache.get(1, 1, 0xff00ff00, 0, sprite));
+
+    renderer::SpriteCacheStats stats;
+    cache.addStats(stats);
+    BOOST_CHECK_EQUAL(stats.hits, 2u);
+    BOOST_CHECK_EQUAL(stats.misses, 4u);
+    BOOST_CHECK_EQUAL(stats.evictions, 2u);
+    cache.addStats(stats);
+    BOOST_CHECK_EQUAL(stats.hits, 2u);
+}
@@ -19,8 +19,16 @@
 
 #include "../mapcraftercore/util.h"
 
+#include <atomic>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
 
+namespace fs = boost::filesystem;
 namespace util = mapcrafter::util;
 
 BOOST_AUTO_TEST_CASE(util_testMath) {
@@ -46,3 +54,53 @@ BOOST_AUTO_TEST_CASE(util_testMath) {
     BOOST_CHECK_EQUAL(util::binary<101000101>::value, 325);
     BOOST_CHECK_EQUAL(util::binary<11011101>::value, 221);
 }
+
+BOOST_AUTO_TEST_CASE(util_testDirectoryWatcher) {
+    fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    util::DirectoryWatcher watcher;
+    BOOST_REQUIRE(watcher.addDirectory(dir));
+
+    // a file which is written in several steps like a region file, the quiet period
+    // starts only after the last write
+    std::atomic<bool> writing(true);
+    std::thread writer([&]() {
+        for (int i = 0; i < 8; i++) {
+            std::ofstream out((dir / "r.0.0.mca").string(), std::ios::app);
+            out << "data";
+            out.close();
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        }
+        writing = false;
+    });
+
+    std::set<fs::path> changed;
+    BOOST_CHECK(watcher.waitForChanges(changed, 1));
+    BOOST_CHECK(!writing);
+    BOOST_CHECK_EQUAL(changed.size(), 1u);
+    BOOST_CHECK(changed.count(dir / "r.0.0.mca"));
+    writer.join();
+    fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(util_testMappedFileReadIntoMemory) {
+    fs::path file = fs::temp_directory_path() / fs::unique_path();
+    std::ofstream out(file.string(), std::ios::binary);
+    out << "region data";
+    out.close();
+
+    util::MappedFile read;
+    BOOST_REQUIRE(read.open(file.string(), false));
+    BOOST_REQUIRE_EQUAL(read.getSize(), 11u);
+    BOOST_CHECK(std::string(read.getData(), read.getData() + read.getSize()) == "region data");
+
+    // the file is written in place like the game does it, the data read into memory
+    // stays the same (a mapped file would change)
+    std::fstream rewrite(file.string(), std::ios::in | std::ios::out | std::ios::binary);
+    rewrite << "chunk";
+    rewrite.close();
+    BOOST_CHECK(std::string(read.getData(), read.getData() + read.getSize()) == "region data");
+
+    read.close();
+    fs::remove(file);
+}
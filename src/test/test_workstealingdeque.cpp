@@ -0,0 +1,101 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/thread/impl/workstealingdeque.h"
+
+#include <atomic>
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+
+namespace thread = mapcrafter::thread;
+
+BOOST_AUTO_TEST_CASE(workstealingdeque_test) {
+    thread::WorkStealingDeque<int> deque(3);
+    int item;
+
+    // capacity is rounded up to the next power of two
+    BOOST_CHECK(!deque.pop(item));
+    BOOST_CHECK(!deque.steal(item));
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK(deque.push(i));
+    BOOST_CHECK(!deque.push(4));
+    BOOST_CHECK_EQUAL(deque.size(), 4);
+
+    // owner takes from the bottom, thieves from the top
+    BOOST_CHECK(deque.pop(item));
+    BOOST_CHECK_EQUAL(item, 3);
+    BOOST_CHECK(deque.steal(item));
+    BOOST_CHECK_EQUAL(item, 0);
+    BOOST_CHECK(deque.pop(item));
+    BOOST_CHECK_EQUAL(item, 2);
+    BOOST_CHECK(deque.steal(item));
+    BOOST_CHECK_EQUAL(item, 1);
+    BOOST_CHECK(!deque.pop(item));
+    BOOST_CHECK(!deque.steal(item));
+    BOOST_CHECK_EQUAL(deque.size(), 0);
+
+    // wrapping around the ring buffer
+    for (int i = 0; i < 10; i++) {
+        BOOST_CHECK(deque.push(i));
+        BOOST_CHECK(deque.push(i + 100));
+        BOOST_CHECK(deque.steal(item));
+        BOOST_CHECK_EQUAL(item, i);
+        BOOST_CHECK(deque.pop(item));
+        BOOST_CHECK_EQUAL(item, i + 100);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(workstealingdeque_test_concurrent) {
+    const int items = 100000;
+    thread::WorkStealingDeque<int> deque(items);
+
+    // every item must be taken exactly once, either by the owner or by a thief
+    std::vector<std::atomic<int>> taken(items);
+    for (int i = 0; i < items; i++)
+        taken[i] = 0;
+    std::atomic<bool> done(false);
+
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < 4; i++)
+        thieves.push_back(std::thread([&]() {
+            int item;
+            while (!done)
+                if (deque.steal(item))
+                    taken[item]++;
+        }));
+
+    int item;
+    for (int i = 0; i < items; i++) {
+        deque.push(i);
+        if (i % 3 == 0 && deque.pop(item))
+            taken[item]++;
+    }
+    while (deque.pop(item))
+        taken[item]++;
+    done = true;
+    for (size_t i = 0; i < thieves.size(); i++)
+        thieves[i].join();
+
+    int wrong = 0;
+    for (int i = 0; i < items; i++)
+        if (taken[i] != 1)
+            wrong++;
+    BOOST_CHECK_EQUAL(wrong, 0);
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/region.h"
+#include "../mapcraftercore/mc/world.h"
+#include "../mapcraftercore/mc/worldentities.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace mc = mapcrafter::mc;
+namespace nbt = mapcrafter::mc::nbt;
+
+namespace {
+
+/**
+ * Writes a region file with one chunk with a sign with the specified text, the chunk
+ * and the region file get the specified modification time.
+ */
+void writeRegion(const fs::path &world_dir, const mc::RegionPos &pos, const std::string &text,
+                 std::time_t mtime) {
+    mc::ChunkPos chunk(pos.x * 32, pos.z * 32);
+    nbt::NBTFile root("");
+    root.addTag("xPos", nbt::TagInt(chunk.x));
+    root.addTag("zPos", nbt::TagInt(chunk.z));
+    nbt::TagCompound sign;
+    sign.addTag("id", nbt::TagString("minecraft:sign"));
+    sign.addTag("x", nbt::TagInt(chunk.x * 16 + 1));
+    sign.addTag("y", nbt::TagInt(65));
+    sign.addTag("z", nbt::TagInt(chunk.z * 16 + 1));
+    sign.addTag("Text1", nbt::TagString(text));
+    for (const char *line : {"Text2", "Text3", "Text4"})
+        sign.addTag(line, nbt::TagString(""));
+    nbt::TagList block_entities(nbt::TagCompound::TAG_TYPE);
+    block_entities.payload.push_back(nbt::TagPtr(sign.clone()));
+    root.addTag("block_entities", block_entities);
+    std::stringstream stream;
+    root.writeNBT(stream, nbt::Compression::NO_COMPRESSION);
+    std::string data = stream.str();
+
+    fs::path region_file = world_dir / "region" / ("r." + std::to_string(pos.x) + "." +
+                                                   std::to_string(pos.z) + ".mca");
+    mc::RegionFile region(region_file.string());
+    region.setChunkData(chunk, std::vector<uint8_t>(data.begin(), data.end()),
+                        mc::RegionFile::COMPRESSION_NONE);
+    region.setChunkTimestamp(chunk, mtime);
+    BOOST_REQUIRE(region.write());
+    fs::last_write_time(region_file, mtime);
+}
+
+/**
+ * Updates the entities cache of a world like a new run of the renderer and returns the
+ * texts of the signs.
+ */
+std::multiset<std::string> updateCache(const fs::path &world_dir) {
+    mc::World world(world_dir.string());
+    BOOST_REQUIRE(world.load());
+    mc::WorldEntitiesCache cache(world);
+    cache.update();
+    std::vector<mc::SignEntity> signs = cache.getSigns();
+    std::multiset<std::string> texts;
+    for (auto sign_it = signs.begin(); sign_it != signs.end(); ++sign_it)
+        texts.insert(sign_it->getText());
+    return texts;
+}
+
+std::string readFile(const fs::path &file) {
+    std::ifstream in(file.string(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+/**
+ * Creates a world with two regions with a sign each, both older than now, and its
+ * entities cache file.
+ */
+fs::path createWorld(std::time_t now) {
+    fs::path world_dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(world_dir / "region");
+    writeRegion(world_dir, mc::RegionPos(0, 0), "first", now - 100);
+    writeRegion(world_dir, mc::RegionPos(1, 0), "second", now - 100);
+    BOOST_CHECK(updateCache(world_dir) == (std::multiset<std::string>{"first", "second"}));
+    return world_dir;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(worldentities_testAppendRegion) {
+    std::time_t now = std::time(nullptr);
+    fs::path world_dir = createWorld(now);
+    fs::path cache_file = world_dir / "region" / "entities.cache";
+    std::string content = readFile(cache_file);
+
+    // only the new region is appended
+    writeRegion(world_dir, mc::RegionPos(0, 1), "third", now - 100);
+    BOOST_CHECK(updateCache(world_dir) ==
+                (std::multiset<std::string>{"first", "second", "third"}));
+    std::string appended = readFile(cache_file);
+    BOOST_CHECK_GT(appended.size(), content.size());
+    BOOST_CHECK(appended.compare(0, content.size(), content) == 0);
+
+    // nothing changed, nothing is written
+    BOOST_CHECK(updateCache(world_dir) ==
+                (std::multiset<std::string>{"first", "second", "third"}));
+    BOOST_CHECK(readFile(cache_file) == appended);
+    fs::remove_all(world_dir);
+}
+
+BOOST_AUTO_TEST_CASE(worldentities_testReplaceRegion) {
+    std::time_t now = std::time(nullptr);
+    fs::path world_dir = createWorld(now);
+    fs::path cache_file = world_dir / "region" / "entities.cache";
+    std::string content = readFile(cache_file);
+
+    // the changed region is appended again and replaces the one before
+    writeRegion(world_dir, mc::RegionPos(0, 0), "changed", now + 100);
+    BOOST_CHECK(updateCache(world_dir) == (std::multiset<std::string>{"changed", "second"}));
+    std::string appended = readFile(cache_file);
+    BOOST_CHECK_GT(appended.size(), content.size());
+    BOOST_CHECK(appended.compare(0, content.size(), content) == 0);
+    fs::remove_all(world_dir);
+}
+
+BOOST_AUTO_TEST_CASE(worldentities_testTruncatedRecord) {
+    std::time_t now = std::time(nullptr);
+    fs::path world_dir = createWorld(now);
+    fs::path cache_file = world_dir / "region" / "entities.cache";
+    writeRegion(world_dir, mc::RegionPos(0, 0), "changed", now + 100);
+    BOOST_CHECK(updateCache(world_dir) == (std::multiset<std::string>{"changed", "second"}));
+
+    // the regions before the truncated record are kept, the region of the record is
+    // scanned again and the file is rewritten with only the current regions
+    uintmax_t truncated_size = fs::file_size(cache_file) - 3;
+    fs::resize_file(cache_file, truncated_size);
+    BOOST_CHECK(updateCache(world_dir) == (std::multiset<std::string>{"changed", "second"}));
+    BOOST_CHECK_LT(fs::file_size(cache_file), truncated_size);
+    BOOST_CHECK(updateCache(world_dir) == (std::multiset<std::string>{"changed", "second"}));
+    fs::remove_all(world_dir);
+}
+
+BOOST_AUTO_TEST_CASE(worldentities_testRemovedRegion) {
+    std::time_t now = std::time(nullptr);
+    fs::path world_dir = createWorld(now);
+    fs::path cache_file = world_dir / "region" / "entities.cache";
+    uintmax_t size = fs::file_size(cache_file);
+
+    // the file is rewritten without the removed region
+    fs::remove(world_dir / "region" / "r.1.0.mca");
+    BOOST_CHECK(updateCache(world_dir) == (std::multiset<std::string>{"first"}));
+    BOOST_CHECK_LT(fs::file_size(cache_file), size);
+    BOOST_CHECK(updateCache(world_dir) == (std::multiset<std::string>{"first"}));
+    fs::remove_all(world_dir);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/renderer/image/kernels.h"
+#include "../mapcraftercore/util/cpu.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace renderer = mapcrafter::renderer;
+namespace util = mapcrafter::util;
+
+namespace {
+
+typedef std::vector<renderer::RGBAPixel> Pixels;
+
+// random pixels, about a quarter of them transparent and a quarter of them opaque
+Pixels createPixels(size_t count) {
+    const uint8_t alphas[] = {0, 255, 64, 200};
+    Pixels pixels(count);
+    for (auto &pixel : pixels)
+        pixel = renderer::rgba(rand() % 256, rand() % 256, rand() % 256, alphas[rand() % 4]);
+    return pixels;
+}
+
+typedef std::function<void(const renderer::ImageKernels &kernels, renderer::RGBAPixel *pixels,
+                           size_t offset, size_t n)>
+    Kernel;
+
+// runs the kernel on rows of a block image width (like block images and blits onto tiles)
+void bench(int iterations, const Pixels &pixels, const renderer::ImageKernels &kernels,
+           const Kernel &kernel) {
+    const size_t row = 24;
+    Pixels work = pixels;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        for (size_t j = 0; j + row <= work.size(); j += row)
+            kernel(kernels, &work[j], j, row);
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+    std::cout << std::setw(12) << std::fixed << std::setprecision(0)
+              << iterations * (double)pixels.size() / took.count() / 1e6;
+}
+
+} // namespace
+
+/**
+ * Compares the different implementations of the image kernels, in megapixels per second.
+ */
+int main(int argc, char **argv) {
+    int iterations = 2000;
+    if (argc > 1)
+        iterations = std::max(std::atoi(argv[1]), 1);
+
+    std::vector<util::InstructionSet> sets;
+    for (auto set : {util::InstructionSet::SCALAR, util::InstructionSet::SSE41,
+                     util::InstructionSet::AVX2})
+        if (util::isInstructionSetSupported(set))
+            sets.push_back(set);
+
+    const size_t count = 24 * 24 * 16;
+    Pixels pixels = createPixels(count), source = createPixels(count);
+    Pixels uv(count);
+    const uint8_t faces[3] = {42, 127, 85};
+    const uint32_t factors[3][4] = {{255, 200, 100, 50}, {10, 20, 30, 40}, {255, 255, 0, 0}};
+    for (auto &pixel : uv)
+        pixel = renderer::rgba(rand() % 256, rand() % 256, faces[rand() % 3], 255);
+    renderer::RGBAPixel color = renderer::rgba(100, 200, 50, 128);
+
+    std::cout << iterations << " x " << count << " pixels per test, in megapixels/s"
+              << std::endl;
+    std::cout << std::setw(16) << "kernel";
+    for (auto set : sets)
+        std::cout << std::setw(12) << util::getInstructionSetName(set);
+    std::cout << std::endl;
+
+    std::vector<std::pair<std::string, Kernel>> kernels = {
+        {"blend",
+         [&](const renderer::ImageKernels &k, renderer::RGBAPixel *p, size_t o, size_t n) {
+             k.blend(p, &source[o], n);
+         }},
+        {"alphaCopy",
+         [&](const renderer::ImageKernels &k, renderer::RGBAPixel *p, size_t o, size_t n) {
+             k.alphaCopy(p, &source[o], n);
+         }},
+        {"multiplyFaces",
+         [&](const renderer::ImageKernels &k, renderer::RGBAPixel *p, size_t o, size_t n) {
+             k.multiplyFaces(p, &uv[o], n, faces, factors);
+         }},
+        {"tint",
+         [&](const renderer::ImageKernels &k, renderer::RGBAPixel *p, size_t o, size_t n) {
+             k.tint(p, n, color);
+         }},
+        {"tintMask",
+         [&](const renderer::ImageKernels &k, renderer::RGBAPixel *p, size_t o, size_t n) {
+             k.tintMask(p, &source[o], n, color);
+         }},
+        {"addClamp",
+         [&](const renderer::ImageKernels &k, renderer::RGBAPixel *p, size_t o, size_t n) {
+             k.addClamp(p, n, 20, -20, 5);
+         }},
+        {"addClampFace",
+         [&](const renderer::ImageKernels &k, renderer::RGBAPixel *p, size_t o, size_t n) {
+             k.addClampFace(p, &uv[o], n, 85, 20, -20, 5);
+         }},
+    };
+
+    for (const auto &kernel : kernels) {
+        std::cout << std::setw(16) << kernel.first;
+        for (auto set : sets)
+            bench(iterations, pixels, renderer::getImageKernels(set), kernel.second);
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
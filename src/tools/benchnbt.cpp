@@ -0,0 +1,179 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/mc/blockstate.h"
+#include "../mapcraftercore/mc/chunk.h"
+#include "../mapcraftercore/mc/compression.h"
+#include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/nbtreader.h"
+#include "../mapcraftercore/mc/region.h"
+
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace mc = mapcrafter::mc;
+namespace nbt = mapcrafter::mc::nbt;
+
+namespace {
+
+struct ChunkData {
+    const char *data;
+    size_t size;
+    nbt::Compression compression;
+};
+
+// the size of the decompressed data of all chunks, to calculate the throughput
+size_t decompressed_size = 0;
+
+void bench(const std::string &name, const std::vector<ChunkData> &chunks, int iterations,
+           const std::function<void(const ChunkData &)> &load) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        for (auto it = chunks.begin(); it != chunks.end(); ++it)
+            load(*it);
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+    double count = chunks.size() * iterations;
+    double megabytes = double(decompressed_size) * iterations / (1024 * 1024);
+    std::cout << std::setw(28) << std::left << name << std::right << std::setw(10) << std::fixed
+              << std::setprecision(2) << took.count() << std::setw(12)
+              << took.count() / count * 1000000 << std::setw(12) << count / took.count()
+              << std::setw(12) << megabytes / took.count() << std::endl;
+}
+
+// how the chunk data was decompressed before there were the one-shot decompressors
+void decompressBoost(const ChunkData &chunk) {
+    boost::iostreams::filtering_streambuf<boost::iostreams::input> in;
+    if (chunk.compression == nbt::Compression::GZIP)
+        in.push(boost::iostreams::gzip_decompressor());
+    else
+        in.push(boost::iostreams::zlib_decompressor());
+    in.push(boost::iostreams::array_source(chunk.data, chunk.size));
+    std::stringstream decompressed;
+    boost::iostreams::copy(in, decompressed);
+}
+
+} // namespace
+
+/**
+ * Compares the available decompressors and loading the chunks of a region file through
+ * the NBT tag tree with loading them through the streaming reader Chunk::readNBT uses.
+ *
+ * The throughput (MB/s) is the size of the decompressed chunk data per second.
+ */
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: ./benchnbt [region file] [iterations]" << std::endl;
+        return 1;
+    }
+    int iterations = 10;
+    if (argc > 2)
+        iterations = std::max(std::atoi(argv[2]), 1);
+
+    mc::RegionFile region(argv[1]);
+    if (!region.read()) {
+        std::cerr << "Unable to read region file '" << argv[1] << "'!" << std::endl;
+        return 1;
+    }
+
+    std::vector<ChunkData> chunks;
+    const mc::RegionFile::ChunkMap &positions = region.getContainingChunks();
+    for (auto it = positions.begin(); it != positions.end(); ++it) {
+        mc::ChunkDataView view = region.getChunkData(*it);
+        ChunkData chunk;
+        if (view.empty() || !view.getCompression(chunk.compression))
+            continue;
+        chunk.data = reinterpret_cast<const char *>(view.data);
+        chunk.size = view.size;
+        chunks.push_back(chunk);
+    }
+
+    nbt::ByteBuffer buffer;
+    size_t compressed_size = 0;
+    for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+        nbt::decompress(it->data, it->size, it->compression, buffer);
+        compressed_size += it->size;
+        decompressed_size += buffer.size();
+    }
+    std::cout << chunks.size() << " chunks (" << compressed_size / 1024 << " KiB compressed, "
+              << decompressed_size / 1024 << " KiB decompressed), " << iterations
+              << " iterations" << std::endl;
+
+    std::cout << std::setw(28) << std::left << "" << std::right << std::setw(10) << "seconds"
+              << std::setw(12) << "us/chunk" << std::setw(12) << "chunks/s" << std::setw(12)
+              << "MB/s" << std::endl;
+
+    // boost iostreams can decompress only gzip/zlib data
+    bool deflate_only = true;
+    for (auto it = chunks.begin(); it != chunks.end(); ++it)
+        if (it->compression != nbt::Compression::GZIP && it->compression != nbt::Compression::ZLIB)
+            deflate_only = false;
+    if (deflate_only)
+        bench("decompress (boost)", chunks, iterations, decompressBoost);
+    std::vector<std::string> decompressors = nbt::getDecompressors();
+    for (auto it = decompressors.begin(); it != decompressors.end(); ++it) {
+        std::unique_ptr<nbt::Decompressor> decompressor = nbt::createDecompressor(*it);
+        bench("decompress (" + *it + ")", chunks, iterations,
+              [&decompressor, &buffer](const ChunkData &chunk) {
+                  decompressor->decompress(chunk.data, chunk.size, chunk.compression, buffer);
+              });
+    }
+
+    bench("tag tree (NBTFile)", chunks, iterations, [](const ChunkData &chunk) {
+        nbt::NBTFile nbt;
+        nbt.readNBT(chunk.data, chunk.size, chunk.compression);
+    });
+
+    bench("reader, skip all", chunks, iterations, [&buffer](const ChunkData &chunk) {
+        nbt::decompress(chunk.data, chunk.size, chunk.compression, buffer);
+        nbt::NBTReader reader(buffer.data(), buffer.size());
+        reader.readRoot();
+        reader.skip(nbt::TagCompound::TAG_TYPE);
+    });
+
+    // this includes resolving the palettes and unpacking the block states
+    mc::BlockStateRegistry block_registry;
+    bench("Chunk::readNBT", chunks, iterations, [&block_registry](const ChunkData &chunk) {
+        mc::Chunk c;
+        c.readNBT(block_registry, chunk.data, chunk.size, chunk.compression);
+    });
+
+    size_t memory_usage = 0;
+    for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+        mc::Chunk c;
+        c.readNBT(block_registry, it->data, it->size, it->compression);
+        memory_usage += c.getMemoryUsage();
+    }
+    std::cout << "Loaded chunks use " << memory_usage / chunks.size() / 1024
+              << " KiB memory on average" << std::endl;
+
+    return 0;
+}
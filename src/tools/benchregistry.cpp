@@ -0,0 +1,121 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/mc/blockstate.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mc = mapcrafter::mc;
+
+namespace {
+
+// how the block state registry looked up block IDs before, with a global lock
+class LockedRegistry {
+  public:
+    uint16_t getBlockID(const mc::BlockState &block) {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto it = block_lookup.find(block.getName());
+        if (it != block_lookup.end()) {
+            auto it2 = it->second.find(block.getVariantDescription());
+            if (it2 != it->second.end())
+                return it2->second;
+        }
+        uint16_t id = block_states.size();
+        block_lookup[block.getName()][block.getVariantDescription()] = id;
+        block_states.push_back(block);
+        return id;
+    }
+
+  private:
+    std::mutex mutex;
+    std::map<std::string, std::map<std::string, uint16_t>> block_lookup;
+    std::vector<mc::BlockState> block_states;
+};
+
+void bench(const std::string &name, int threads, int lookups,
+           const std::function<void(int)> &lookup) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&lookup, lookups, t]() {
+            for (int i = 0; i < lookups; i++)
+                lookup(t * 7919 + i);
+        });
+    for (auto &worker : workers)
+        worker.join();
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+    std::cout << std::setw(14) << std::fixed << std::setprecision(0)
+              << threads * lookups / took.count();
+}
+
+} // namespace
+
+/**
+ * Looks up known block states from many threads at the same time with the block state
+ * registry and with the previous registry with a global lock, in lookups per second
+ * (of all threads together).
+ */
+int main(int argc, char **argv) {
+    int max_threads = 32;
+    int lookups = 200000;
+    if (argc > 1)
+        max_threads = std::max(std::atoi(argv[1]), 1);
+    if (argc > 2)
+        lookups = std::max(std::atoi(argv[2]), 1);
+
+    // about as many block states as a render with the default block images has
+    std::vector<mc::BlockState> blocks;
+    for (int i = 0; i < 20000; i++) {
+        mc::BlockState block("minecraft:test_block_" + std::to_string(i % 800));
+        block.setProperty("facing", std::to_string(i / 800 % 5));
+        block.setProperty("waterlogged", (i / 4000) % 2 ? "true" : "false");
+        blocks.push_back(block);
+    }
+
+    mc::BlockStateRegistry registry;
+    LockedRegistry locked_registry;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        registry.getBlockID(blocks[i]);
+        locked_registry.getBlockID(blocks[i]);
+    }
+
+    std::cout << lookups << " lookups per thread, in lookups/s" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "locked" << std::setw(14)
+              << "lock-free" << std::endl;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        std::cout << std::setw(8) << threads;
+        bench("locked", threads, lookups, [&](int i) {
+            locked_registry.getBlockID(blocks[i % blocks.size()]);
+        });
+        bench("lock-free", threads, lookups, [&](int i) {
+            registry.getBlockState(registry.getBlockID(blocks[i % blocks.size()]));
+        });
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/config/mapcrafterconfig.h"
+#include "../mapcraftercore/renderer/manager.h"
+#include "../mapcraftercore/util.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace config = mapcrafter::config;
+namespace renderer = mapcrafter::renderer;
+namespace util = mapcrafter::util;
+
+/**
+ * Force-renders one map/rotation with 1..N threads and reports the render throughput
+ * (render tiles per second) of every thread count. All thread counts (one thread as well)
+ * use the work-stealing dispatcher.
+ *
+ * Attention: This renders into the output directory of the configuration file!
+ */
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: ./benchthreads [configfile] [map] [max threads] [rotation]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string map = argv[2];
+    int max_threads = std::thread::hardware_concurrency();
+    if (argc > 3)
+        max_threads = std::atoi(argv[3]);
+    max_threads = std::max(max_threads, 1);
+
+    config::MapcrafterConfig parser;
+    config::ValidationMap validation = parser.parseFile(argv[1]);
+    if (validation.isCritical()) {
+        validation.log();
+        return 1;
+    }
+    if (!parser.hasMap(map)) {
+        std::cerr << "Unknown map '" << map << "'!" << std::endl;
+        return 1;
+    }
+
+    std::set<int> rotations = parser.getMap(map).getRotations();
+    int rotation = *rotations.begin();
+    if (argc > 4)
+        rotation = std::atoi(argv[4]);
+    if (!rotations.count(rotation)) {
+        std::cerr << "Map '" << map << "' has no rotation " << rotation << "!" << std::endl;
+        return 1;
+    }
+
+    renderer::RenderBehaviors behaviors(renderer::RenderBehavior::SKIP);
+    behaviors.setRenderBehavior(map, rotation, renderer::RenderBehavior::FORCE);
+
+    renderer::RenderManager manager(parser);
+    manager.setRenderBehaviors(behaviors);
+    manager.setWorkStealingSingleThread(true);
+    if (!manager.initialize() || !manager.scanWorlds())
+        return 1;
+
+    double single_thread = 0;
+    std::cout << std::setw(8) << "threads" << std::setw(10) << "tiles" << std::setw(12)
+              << "seconds" << std::setw(12) << "tiles/s" << std::setw(10) << "speedup"
+              << std::endl;
+    for (int threads = 1; threads <= max_threads; threads++) {
+        util::DummyProgressHandler progress;
+        auto start = std::chrono::steady_clock::now();
+        manager.renderMap(map, rotation, threads, &progress);
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+        double tiles_per_second = progress.getValue() / took.count();
+        if (threads == 1)
+            single_thread = tiles_per_second;
+        std::cout << std::setw(8) << threads << std::setw(10) << progress.getValue()
+                  << std::setw(12) << std::fixed << std::setprecision(2) << took.count()
+                  << std::setw(12) << tiles_per_second << std::setw(10)
+                  << (single_thread > 0 ? tiles_per_second / single_thread : 0) << std::endl;
+    }
+
+    return 0;
+}
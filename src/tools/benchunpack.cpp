@@ -0,0 +1,138 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/mc/packedarray.h"
+#include "../mapcraftercore/util/cpu.h"
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace mc = mapcrafter::mc;
+namespace util = mapcrafter::util;
+
+namespace {
+
+struct Section {
+    std::vector<uint8_t> data;
+    std::vector<uint16_t> lookup;
+};
+
+// creates a section with random palette indices in the 1.16+ format
+Section createSection(int bits) {
+    int per_long = 64 / bits;
+    std::vector<uint64_t> longs(mc::getPackedLongs(mc::PackedFormat::PADDED, bits, 4096), 0);
+    for (size_t i = 0; i < 4096; i++) {
+        uint64_t index = rand() & ((1 << bits) - 1);
+        longs[i / per_long] |= index << (bits * (i % per_long));
+    }
+
+    Section section;
+    for (uint64_t value : longs)
+        for (int i = 7; i >= 0; i--)
+            section.data.push_back(value >> (8 * i));
+    for (int i = 0; i < (1 << bits); i++)
+        section.lookup.push_back(rand() & 0xffff);
+    return section;
+}
+
+// how the block states were unpacked before: big-endian longs to a vector, unpacking with
+// the bit width known only at runtime, then translating with a bounds check per block
+bool unpackOld(const Section &section, std::array<uint16_t, 4096> &block_ids) {
+    std::vector<int64_t> data(section.data.size() / 8);
+    for (size_t i = 0; i < data.size(); i++) {
+        uint64_t value = 0;
+        for (int j = 0; j < 8; j++)
+            value = value << 8 | section.data[i * 8 + j];
+        data[i] = value;
+    }
+
+    uint32_t shorts_per_long = (4096 + data.size() - 1) / data.size();
+    uint32_t bits_per_value = 64 / shorts_per_long;
+    block_ids.fill(0);
+    uint16_t mask = (1 << bits_per_value) - 1;
+    for (uint32_t i = 0; i < shorts_per_long; i++) {
+        uint32_t j = 0;
+        for (uint32_t k = i; k < 4096; k += shorts_per_long) {
+            block_ids[k] = (uint16_t)(data[j] >> (bits_per_value * i)) & mask;
+            j++;
+        }
+    }
+
+    for (size_t i = 0; i < 4096; i++) {
+        if (block_ids[i] >= section.lookup.size())
+            return false;
+        block_ids[i] = section.lookup[block_ids[i]];
+    }
+    return true;
+}
+
+void bench(const std::string &name, int iterations, const std::function<void()> &unpack) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        unpack();
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+    std::cout << std::setw(12) << std::fixed << std::setprecision(0)
+              << iterations / took.count();
+}
+
+} // namespace
+
+/**
+ * Compares unpacking and translating the block states of sections with the different
+ * implementations, in sections per second.
+ */
+int main(int argc, char **argv) {
+    int iterations = 20000;
+    if (argc > 1)
+        iterations = std::max(std::atoi(argv[1]), 1);
+
+    std::vector<util::InstructionSet> sets;
+    for (auto set : {util::InstructionSet::SCALAR, util::InstructionSet::SSE41,
+                     util::InstructionSet::AVX2})
+        if (util::isInstructionSetSupported(set))
+            sets.push_back(set);
+
+    std::cout << iterations << " sections per test, in sections/s" << std::endl;
+    std::cout << std::setw(6) << "bits" << std::setw(12) << "old";
+    for (auto set : sets)
+        std::cout << std::setw(12) << util::getInstructionSetName(set);
+    std::cout << std::endl;
+
+    std::array<uint16_t, 4096> block_ids;
+    for (int bits = 4; bits <= 12; bits++) {
+        Section section = createSection(bits);
+        std::cout << std::setw(6) << bits;
+        bench("old", iterations, [&]() { unpackOld(section, block_ids); });
+        for (auto set : sets) {
+            mc::UnpackFunction unpack =
+                mc::getUnpackFunction(mc::PackedFormat::PADDED, bits, 4096, set);
+            bench(util::getInstructionSetName(set), iterations, [&]() {
+                unpack(section.data.data(), section.lookup.data(), block_ids.data());
+            });
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}